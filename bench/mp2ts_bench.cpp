@@ -0,0 +1,644 @@
+/*
+    Microbenchmarks for the parse and payload hot paths.
+
+    Usage: mp2ts_bench [--min-time <seconds>] [--io <stdio|pread|mmap|async>] [--verify] input.xml
+
+    Every benchmark runs on the corpus described by input.xml (and the transport
+    stream it names) until --min-time has passed, then prints one JSON object per line:
+
+    {"benchmark":"FindData","iterations":12,"ops":1234,"ns_per_op":5.1,"bytes_per_sec":3.6e10,"allocs_per_op":0}
+
+    allocs_per_op counts operator new, allocations made inside FFmpeg are not seen.
+
+    Before anything is timed the fast paths are checked against a reference: the
+    TS index and its presentation order against the XML, and FindStartCode()
+    against a byte at a time scan.  Nothing is timed if one differs, --verify
+    stops after the checks.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "mp2ts_xml.h"
+#include "mp2ts_gzip.h"
+#include "mp2ts_input.h"
+#include "mp2ts_demux.h"
+#include "mp2ts_frame.h"
+#include "mp2ts_mpeg2.h"
+#include "mp2ts_bitstream.h"
+#include "mp2ts_reorder.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavutil/frame.h>
+    #include <libavutil/imgutils.h>
+}
+
+// Random buffers FindStartCode() is checked on, up to VERIFY_BUFFER_MAX bytes each
+#define VERIFY_BUFFERS      2000
+#define VERIFY_BUFFER_MAX   300
+
+static std::atomic<uint64_t> g_allocations(0);
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+
+    if(void *p = malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+struct BenchOptions
+{
+    const char      *xmlFileName;
+    double          minSeconds;
+    eInputBackend   inputBackend;
+    bool            bVerifyOnly;
+
+    BenchOptions()
+        : xmlFileName(NULL)
+        , minSeconds(1.0)
+        , inputBackend(eInputMmap)
+        , bVerifyOnly(false)
+    {
+    }
+};
+
+static BenchOptions g_options;
+
+// Keeps the compiler from throwing away results nobody reads
+static volatile uint64_t g_sink = 0;
+
+/*
+    Calls op until minSeconds have passed.  Each call adds the operations
+    and bytes it processed, the totals are reported per operation.
+*/
+template<typename Op>
+static void RunBench(const char *name, Op op)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    uint64_t iterations = 0;
+    uint64_t ops = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = g_allocations.load();
+
+    Clock::time_point start = Clock::now();
+    double seconds = 0.0;
+
+    do
+    {
+        op(ops, bytes);
+        iterations++;
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    } while(seconds < g_options.minSeconds);
+
+    allocations = g_allocations.load() - allocations;
+
+    double perOp = ops ? 1.0 / (double) ops : 0.0;
+
+    printf("{\"benchmark\":\"%s\",\"iterations\":%llu,\"ops\":%llu,\"ns_per_op\":%.3f,\"bytes_per_sec\":%.6g,\"allocs_per_op\":%.3f}\n",
+           name, (unsigned long long) iterations, (unsigned long long) ops,
+           seconds * 1e9 * perOp, seconds > 0.0 ? (double) bytes / seconds : 0.0,
+           (double) allocations * perOp);
+    fflush(stdout);
+}
+
+static void ParseDocument(MpegTS_XML &mpts, tinyxml2::XMLElement *root)
+{
+    mpts.ParsePMT(root);
+    mpts.ParseMpegTSDescriptor(root);
+    mpts.ParsePacketList(root);
+}
+
+static void BenchParsePacketList(tinyxml2::XMLDocument &doc, tinyxml2::XMLElement *root, bool bTerse)
+{
+    // The XML the tree was parsed from, as bytes of input per pass
+    tinyxml2::XMLPrinter printer;
+    doc.Print(&printer);
+    uint64_t xmlBytes = (uint64_t) printer.CStrSize();
+
+    RunBench(bTerse ? "ParsePacketListTerse" : "ParsePacketList", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        MpegTS_XML mpts;
+        ParseDocument(mpts, root);
+
+        ops += mpts.m_videoAccessUnitsDecode.size() + mpts.m_audioAccessUnits.size();
+        bytes += xmlBytes;
+    });
+}
+
+// Time to interactive of a lazy open: header, raw frame scan and the first GOP
+static void BenchOpenLazy()
+{
+    RunBench("OpenLazy", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        MpegTS_XML mpts;
+
+        if(mpts.OpenLazy(g_options.xmlFileName))
+            ops += mpts.m_videoAccessUnitsDecode.size() + mpts.m_audioAccessUnits.size();
+    });
+}
+
+// The index built straight from the TS the XML describes, as ParsePacketList builds it from the XML
+static void BenchOpenTransportStream(InputSource *pInput, const std::string &fileName)
+{
+    RunBench("OpenTransportStream", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        MpegTS_XML mpts;
+
+        if(mpts.OpenTransportStream(fileName.c_str(), pInput))
+            ops += mpts.m_videoAccessUnitsDecode.size() + mpts.m_audioAccessUnits.size();
+
+        bytes += pInput->Size();
+    });
+}
+
+// Up to maxBytes of whole packets from the start of the stream
+static bool ReadPackets(InputSource *pInput, unsigned int packetSize, uint64_t maxBytes, std::vector<uint8_t> &packets)
+{
+    uint64_t size = pInput->Size() < maxBytes ? pInput->Size() : maxBytes;
+    size -= size % packetSize;
+
+    // FindData can look a few bytes past the end of the last packet
+    packets.resize((size_t) size + INPUT_FETCH_PADDING);
+    memset(packets.data() + size, 0, INPUT_FETCH_PADDING);
+
+    return pInput->ReadAt(0, packets.data(), (size_t) size);
+}
+
+static void BenchFindData(InputSource *pInput, unsigned int packetSize)
+{
+    std::vector<uint8_t> packets;
+
+    if(!ReadPackets(pInput, packetSize, 64 * 1024 * 1024, packets))
+    {
+        fprintf(stderr, "Error: Could not read packets from %s\n", pInput->Name());
+        return;
+    }
+
+    size_t numPackets = (packets.size() - INPUT_FETCH_PADDING) / packetSize;
+
+    RunBench("FindData", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        uint64_t sum = 0;
+
+        for(size_t i = 0; i < numPackets; i++)
+            sum += FindData(packets.data() + i * packetSize, packetSize);
+
+        g_sink += sum;
+        ops += numPackets;
+        bytes += numPackets * packetSize;
+    });
+}
+
+static void BenchReadAccessUnitPayload(MpegTS_XML &mpts, InputSource *pInput)
+{
+    unsigned int packetSize = mpts.m_mpegTSDescriptor.packetSize;
+    std::vector<AccessUnitElement> elements;
+    std::vector<uint8_t> payload;
+
+    RunBench("ReadAccessUnitPayload", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        for(uint32_t i = 0; i < mpts.m_videoAccessUnitsDecode.size(); i++)
+        {
+            mpts.m_videoAccessUnitsDecode.GetElements(i, elements);
+            payload.resize((size_t) MaxPayloadSize(elements, packetSize));
+
+            bytes += ReadAccessUnitPayload(pInput, elements, packetSize, payload.data());
+            ops++;
+        }
+    });
+}
+
+// MPEG-1/2 headers of up to 64 MB of video AUs, assembled once up front
+static void BenchParseMPEG2Headers(MpegTS_XML &mpts, InputSource *pInput)
+{
+    unsigned int packetSize = mpts.m_mpegTSDescriptor.packetSize;
+    std::vector<AccessUnitElement> elements;
+    std::vector<uint8_t> payloads;
+    std::vector<size_t> ends;
+
+    for(uint32_t i = 0; i < mpts.m_videoAccessUnitsDecode.size() && payloads.size() < 64 * 1024 * 1024; i++)
+    {
+        mpts.m_videoAccessUnitsDecode.GetElements(i, elements);
+
+        size_t start = payloads.size();
+        payloads.resize(start + (size_t) MaxPayloadSize(elements, packetSize));
+        payloads.resize(start + ReadAccessUnitPayload(pInput, elements, packetSize, payloads.data() + start));
+        ends.push_back(payloads.size());
+    }
+
+    MPEG2HeaderParser parser;
+    MPEG2Picture picture;
+
+    if(ends.empty() || !parser.Parse(payloads.data(), ends[0], picture))
+    {
+        fprintf(stderr, "Skipping ParseMPEG2Headers, the video is not MPEG-1/2\n");
+        return;
+    }
+
+    RunBench("ParseMPEG2Headers", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        size_t start = 0;
+
+        for(size_t i = 0; i < ends.size(); i++)
+        {
+            parser.Parse(payloads.data() + start, ends[i] - start, picture);
+            g_sink += picture.slices;
+            start = ends[i];
+        }
+
+        ops += ends.size();
+        bytes += payloads.size();
+    });
+}
+
+static void BenchPresentationUnits(MpegTS_XML &mpts)
+{
+    unsigned int numFrames = (unsigned int) mpts.m_videoAccessUnitsDecode.size();
+
+    // Seek targets spread over the file, fixed so runs compare
+    std::vector<unsigned int> startFrames(1024);
+    std::mt19937 rng(1);
+
+    for(auto &f : startFrames)
+        f = std::uniform_int_distribution<unsigned int>(0, numFrames - 1)(rng);
+
+    RunBench("BuildPresentationUnits", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        for(auto f : startFrames)
+            g_sink += mpts.BuildPresentationUnits(f);
+
+        ops += startFrames.size();
+    });
+
+    // Playback from the start: one update per displayed frame
+    RunBench("UpdatePresentationUnits", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        unsigned int frame = mpts.BuildPresentationUnits(0);
+
+        while(mpts.UpdatePresentationUnits(++frame))
+            ops++;
+
+        ops++;
+    });
+}
+
+static void BenchVideoKeyFrameFromBytePos(MpegTS_XML &mpts)
+{
+    uint64_t lastBytePos = mpts.VideoFirstByteLocation(mpts.m_videoAccessUnitsDecode.back());
+
+    std::vector<uint64_t> positions(4096);
+    std::mt19937_64 rng(1);
+
+    for(auto &p : positions)
+        p = std::uniform_int_distribution<uint64_t>(0, lastBytePos)(rng);
+
+    RunBench("VideoKeyFrameFromBytePos", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        for(auto p : positions)
+        {
+            uint64_t bytePos = p;
+            g_sink += mpts.VideoKeyFrameFromBytePos(bytePos);
+        }
+
+        ops += positions.size();
+    });
+}
+
+// The WriteFrame conversion on a flipped 4:2:0 picture the size of a broadcast HD frame
+static void BenchConvertFrameToRGBA(int width, int height)
+{
+    AVFrame *pFrame = av_frame_alloc();
+
+    if(!pFrame)
+        return;
+
+    pFrame->width = width;
+    pFrame->height = height;
+    pFrame->format = AV_PIX_FMT_YUV420P;
+
+    if(av_frame_get_buffer(pFrame, 32) < 0)
+    {
+        av_frame_free(&pFrame);
+        return;
+    }
+
+    for(int plane = 0; plane < 3; plane++)
+    {
+        int rows = plane ? height / 2 : height;
+        memset(pFrame->data[plane], 0x80 + plane * 16, pFrame->linesize[plane] * rows);
+    }
+
+    FlipAvFrame(pFrame);
+
+    uint8_t *dst_data[4] = { NULL };
+    int dst_linesize[4] = { 0 };
+
+    RunBench("ConvertFrameToRGBA", [&](uint64_t &ops, uint64_t &bytes)
+    {
+        if(ConvertFrameToRGBA(pFrame, width, height, dst_data, dst_linesize))
+        {
+            ops++;
+            bytes += (uint64_t) width * height * 4;
+        }
+    });
+
+    av_freep(&dst_data[0]);
+
+    // The planes are released through the refcounted buf[], the flipped data pointers don't matter
+    av_frame_free(&pFrame);
+}
+
+// What FindStartCode() has to find, however many positions it tests at once
+static const uint8_t *FindStartCodeReference(const uint8_t *p, const uint8_t *pEnd)
+{
+    for(; pEnd - p >= 3; p++)
+    {
+        if(0 == p[0] && 0 == p[1] && 1 == p[2])
+            return p;
+    }
+
+    return pEnd;
+}
+
+// Every start code from every start offset of random buffers, to a random end.  The bytes are
+// mostly 00 and 01, so prefixes, runs of zeros and prefixes cut off by the end fall on every
+// lane of a vector and across the boundaries between vectors.
+static bool VerifyFindStartCode()
+{
+    std::mt19937 random(1);
+
+    for(unsigned int n = 0; n < VERIFY_BUFFERS; n++)
+    {
+        // Exactly its size, so a read past the end is seen by the address sanitizer and page heap
+        std::vector<uint8_t> buffer(random() % VERIFY_BUFFER_MAX);
+
+        for(size_t i = 0; i < buffer.size(); i++)
+        {
+            uint32_t r = random() % 8;
+            buffer[i] = (uint8_t) (r < 4 ? 0 : (r < 6 ? 1 : random()));
+        }
+
+        const uint8_t *pBuffer = buffer.data();
+
+        for(size_t begin = 0; begin <= buffer.size(); begin++)
+        {
+            const uint8_t *pEnd = pBuffer + begin + random() % (buffer.size() - begin + 1);
+
+            for(const uint8_t *p = pBuffer + begin; p <= pEnd; )
+            {
+                const uint8_t *pFound = FindStartCode(p, pEnd);
+                const uint8_t *pExpected = FindStartCodeReference(p, pEnd);
+
+                if(pFound != pExpected)
+                {
+                    fprintf(stderr, "Error: FindStartCode from %zu to %zu of random buffer %u found %zu, a byte at a time scan %zu\n",
+                            (size_t) (p - pBuffer), (size_t) (pEnd - pBuffer), n, (size_t) (pFound - pBuffer), (size_t) (pExpected - pBuffer));
+                    return false;
+                }
+
+                if(pFound == pEnd)
+                    break;
+
+                p = pFound + 1;
+            }
+        }
+    }
+
+    return true;
+}
+
+// The video AUs OpenTransportStream() indexes from the TS must have the frame types, random
+// access points and PTS of the XML, and their presentation order must be the XML's PTS order.
+// The corpus PTS do not wrap, so a stable sort by PTS is that order.
+static bool VerifyTransportStreamIndex(const MpegTS_XML &xml, InputSource *pInput)
+{
+    MpegTS_XML ts;
+
+    if(!ts.OpenTransportStream(xml.m_mpegTSDescriptor.fileName.c_str(), pInput))
+    {
+        fprintf(stderr, "Error: Could not index %s\n", xml.m_mpegTSDescriptor.fileName.c_str());
+        return false;
+    }
+
+    const AccessUnitIndex &expected = xml.m_videoAccessUnitsDecode;
+    const AccessUnitIndex &indexed = ts.m_videoAccessUnitsDecode;
+
+    if(expected.size() != indexed.size())
+    {
+        fprintf(stderr, "Error: %u video AUs indexed from the TS, the XML has %u\n", indexed.size(), expected.size());
+        return false;
+    }
+
+    PresentationOrder order;
+
+    for(uint32_t i = 0; i < expected.size(); i++)
+    {
+        if(expected.FrameType(i) != indexed.FrameType(i) || expected.RandomAccess(i) != indexed.RandomAccess(i) || expected.PTS(i) != indexed.PTS(i))
+        {
+            fprintf(stderr, "Error: Video AU %u is %c, random access %d, PTS %llu in the XML but %c, %d, %llu indexed from the TS\n", i,
+                    expected.FrameType(i) ? expected.FrameType(i) : '?', (int) expected.RandomAccess(i), (unsigned long long) expected.PTS(i),
+                    indexed.FrameType(i) ? indexed.FrameType(i) : '?', (int) indexed.RandomAccess(i), (unsigned long long) indexed.PTS(i));
+            return false;
+        }
+
+        order.Add(i, indexed.PTS(i));
+    }
+
+    order.Finish();
+
+    std::vector<uint32_t> byPTS(expected.size());
+    std::iota(byPTS.begin(), byPTS.end(), 0);
+    std::stable_sort(byPTS.begin(), byPTS.end(), [&expected](uint32_t a, uint32_t b) { return expected.PTS(a) < expected.PTS(b); });
+
+    if(order.size() != byPTS.size())
+    {
+        fprintf(stderr, "Error: %u video AUs in presentation order, %zu in the XML\n", order.size(), byPTS.size());
+        return false;
+    }
+
+    for(uint32_t i = 0; i < order.size(); i++)
+    {
+        if(order.DecodeIndex(i) != byPTS[i])
+        {
+            fprintf(stderr, "Error: Video AU %u is shown at %u, by the PTS of the XML it is AU %u\n", order.DecodeIndex(i), i, byPTS[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void PrintUsage(const char *appName)
+{
+    fprintf(stderr, "Usage: %s [options] input.xml\n", appName);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --min-time <seconds>           Minimum run time of each benchmark (default: 1)\n");
+    fprintf(stderr, "  --io <stdio|pread|mmap|async>  How the transport stream is read (default: mmap)\n");
+    fprintf(stderr, "  --verify                       Only check the fast paths against their references\n");
+}
+
+static bool ParseCommandLine(int argc, char* argv[])
+{
+    for(int i = 1; i < argc; i++)
+    {
+        if(0 == strcmp(argv[i], "--min-time") && i + 1 < argc)
+        {
+            g_options.minSeconds = atof(argv[++i]);
+        }
+        else if(0 == strcmp(argv[i], "--io") && i + 1 < argc)
+        {
+            if(!InputBackendFromName(argv[++i], g_options.inputBackend))
+            {
+                fprintf(stderr, "Error: Unknown I/O backend: %s\n", argv[i]);
+                return false;
+            }
+        }
+        else if(0 == strcmp(argv[i], "--verify"))
+        {
+            g_options.bVerifyOnly = true;
+        }
+        else if('-' == argv[i][0] && '-' == argv[i][1])
+        {
+            fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
+            return false;
+        }
+        else
+        {
+            g_options.xmlFileName = argv[i];
+        }
+    }
+
+    return NULL != g_options.xmlFileName;
+}
+
+int main(int argc, char* argv[])
+{
+    if(!ParseCommandLine(argc, argv))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    tinyxml2::XMLDocument doc;
+
+    if(tinyxml2::XML_SUCCESS != LoadXMLFile(doc, g_options.xmlFileName))
+    {
+        fprintf(stderr, "Error: TinyXml2 could not open file: %s\n", g_options.xmlFileName);
+        return 1;
+    }
+
+    tinyxml2::XMLElement* root = doc.FirstChildElement("file");
+
+    if(nullptr == root)
+    {
+        fprintf(stderr, "Error: %s does not contain a <file> element at the start!\n", g_options.xmlFileName);
+        return 1;
+    }
+
+    MpegTS_XML mpts;
+    ParseDocument(mpts, root);
+
+    if(mpts.m_videoAccessUnitsDecode.empty())
+    {
+        fprintf(stderr, "Error: %s has no video access units\n", g_options.xmlFileName);
+        return 1;
+    }
+
+    InputSource *pInput = CreateInputSource(g_options.inputBackend);
+
+    if(!pInput || !pInput->Open(mpts.m_mpegTSDescriptor.fileName))
+    {
+        fprintf(stderr, "Error: Could not open %s with the %s I/O backend\n", mpts.m_mpegTSDescriptor.fileName.c_str(), InputBackendName(g_options.inputBackend));
+        return 1;
+    }
+
+    bool bVerified = VerifyFindStartCode() && VerifyTransportStreamIndex(mpts, pInput);
+
+    if(!bVerified || g_options.bVerifyOnly)
+    {
+        if(bVerified)
+            printf("Verified FindStartCode and the TS index of %s\n", mpts.m_mpegTSDescriptor.fileName.c_str());
+
+        delete pInput;
+        return bVerified ? 0 : 1;
+    }
+
+    BenchParsePacketList(doc, root, mpts.m_mpegTSDescriptor.terse);
+
+    if(mpts.m_mpegTSDescriptor.terse)
+        BenchOpenLazy();
+
+    BenchOpenTransportStream(pInput, mpts.m_mpegTSDescriptor.fileName);
+    BenchFindData(pInput, mpts.m_mpegTSDescriptor.packetSize);
+    BenchReadAccessUnitPayload(mpts, pInput);
+    BenchParseMPEG2Headers(mpts, pInput);
+    BenchPresentationUnits(mpts);
+    BenchVideoKeyFrameFromBytePos(mpts);
+    BenchConvertFrameToRGBA(1920, 1080);
+
+    delete pInput;
+
+    return 0;
+}
@@ -0,0 +1,769 @@
+/*
+    Writes a deterministic MPEG-2 transport stream made from synthetic
+    pictures and a test tone, plus the terse and/or verbose XML mpts_parser
+    would have written for it, so the analyzer and mp2ts_bench can be run
+    on any length of content without real captures.
+
+    Usage: mp2ts_corpus [options] output
+
+    Writes output.ts, output.xml (terse) and output.verbose.xml.
+    The same options always produce byte identical files.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "mp2ts_ts_writer.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/channel_layout.h>
+    #include <libavutil/mathematics.h>
+    #include <libavutil/opt.h>
+}
+
+// PES timestamps start here, B frames make the first DTS earlier than the first PTS
+#define TIMESTAMP_OFFSET    90000
+
+// An AU is sent no earlier than this before its DTS (90 kHz).  The PCR trails the DTS by
+// at most this much plus the time the AU takes at the mux rate, the T-STD allows 1 s.
+#define MUX_MAX_DELAY       45000
+
+// PAT and PMT at least this often (27 MHz), as well as ahead of every I frame.  TR 101 290 allows 500 ms.
+#define PSI_INTERVAL        (100 * 27000)
+
+#define AUDIO_SAMPLE_RATE   48000
+
+enum eXmlOutput
+{
+    eXmlTerse   = 1,
+    eXmlVerbose = 2,
+    eXmlBoth    = 3
+};
+
+struct CorpusOptions
+{
+    const char      *outName;
+    int             width;
+    int             height;
+    int             fpsNum;
+    int             fpsDen;
+    int             gopSize;
+    int             bFrames;
+    int64_t         bitRate;
+    int64_t         muxRate;        // 0 to work it out from bitRate
+    bool            bClosedGop;
+    double          duration;
+    unsigned int    packetSize;
+    uint16_t        pmtPID;
+    uint16_t        videoPID;
+    uint16_t        audioPID;       // 0 for no audio
+    unsigned int    nullEvery;
+    int             xml;
+
+    CorpusOptions()
+        : outName(NULL)
+        , width(720)
+        , height(480)
+        , fpsNum(30000)
+        , fpsDen(1001)
+        , gopSize(15)
+        , bFrames(2)
+        , bitRate(4000000)
+        , muxRate(0)
+        , bClosedGop(false)
+        , duration(10.0)
+        , packetSize(188)
+        , pmtPID(0x1000)
+        , videoPID(0x100)
+        , audioPID(0x101)
+        , nullEvery(0)
+        , xml(eXmlBoth)
+    {
+    }
+};
+
+static CorpusOptions g_options;
+
+// An encoded AU waiting to be multiplexed
+struct PendingAU
+{
+    std::vector<uint8_t>    data;
+    uint64_t                pts;    // 90 kHz, offset applied
+    uint64_t                dts;
+    bool                    bVideo;
+    char                    frameType;
+    int                     closedGop;
+};
+
+struct Corpus
+{
+    AVCodecContext          *pVideoContext;
+    AVCodecContext          *pAudioContext;
+    AVFrame                 *pVideoFrame;
+    AVFrame                 *pAudioFrame;
+    AVPacket                *pPacket;
+    TSWriter                writer;
+    FILE                    *fpTerse;
+    FILE                    *fpVerbose;
+    long                    terseSizeOffset;
+    long                    verboseSizeOffset;
+    std::deque<PendingAU>   video;
+    std::deque<PendingAU>   audio;
+    std::vector<PacketRun>  runs;
+    unsigned int            videoFramesWritten;
+    unsigned int            audioFramesWritten;
+    int64_t                 audioSamples;
+    uint64_t                lastPSI;            // Mux time of the last PAT and PMT
+    unsigned int            lateFrames;         // AUs that did not arrive by their DTS
+
+    Corpus()
+        : pVideoContext(NULL)
+        , pAudioContext(NULL)
+        , pVideoFrame(NULL)
+        , pAudioFrame(NULL)
+        , pPacket(NULL)
+        , fpTerse(NULL)
+        , fpVerbose(NULL)
+        , terseSizeOffset(0)
+        , verboseSizeOffset(0)
+        , videoFramesWritten(0)
+        , audioFramesWritten(0)
+        , audioSamples(0)
+        , lastPSI(0)
+        , lateFrames(0)
+    {
+    }
+};
+
+// Picture type and closed_gop from the MPEG-2 headers in an AU
+static void ScanPictureHeaders(const uint8_t *p, size_t size, char &frameType, int &closedGop)
+{
+    frameType = '?';
+    closedGop = 0;
+
+    for(size_t i = 0; i + 8 <= size; i++)
+    {
+        if(p[i] != 0 || p[i + 1] != 0 || p[i + 2] != 1)
+            continue;
+
+        if(0xB8 == p[i + 3])
+        {
+            // group_of_pictures_header: 25 bit time_code, then closed_gop
+            closedGop = (p[i + 7] >> 6) & 1;
+        }
+        else if(0x00 == p[i + 3])
+        {
+            // picture_header: 10 bit temporal_reference, then picture_coding_type
+            switch((p[i + 5] >> 3) & 0x07)
+            {
+                case 1: frameType = 'I'; break;
+                case 2: frameType = 'P'; break;
+                case 3: frameType = 'B'; break;
+            }
+
+            return;
+        }
+    }
+}
+
+// Moving gradients and a box that crosses the picture once a second
+static void FillVideoFrame(AVFrame *pFrame, int64_t frameNumber)
+{
+    int width = pFrame->width;
+    int height = pFrame->height;
+    int boxSize = height / 4;
+    int boxX = (int) ((frameNumber * 8) % (width - boxSize));
+    int boxY = (height - boxSize) / 2;
+
+    for(int y = 0; y < height; y++)
+    {
+        uint8_t *pRow = pFrame->data[0] + y * pFrame->linesize[0];
+
+        for(int x = 0; x < width; x++)
+        {
+            bool bBox = x >= boxX && x < boxX + boxSize && y >= boxY && y < boxY + boxSize;
+            pRow[x] = bBox ? 235 : (uint8_t) (x + y + frameNumber * 3);
+        }
+    }
+
+    for(int y = 0; y < height / 2; y++)
+    {
+        uint8_t *pU = pFrame->data[1] + y * pFrame->linesize[1];
+        uint8_t *pV = pFrame->data[2] + y * pFrame->linesize[2];
+
+        for(int x = 0; x < width / 2; x++)
+        {
+            pU[x] = (uint8_t) (128 + y + frameNumber * 2);
+            pV[x] = (uint8_t) (64 + x + frameNumber * 5);
+        }
+    }
+}
+
+// A 1 kHz tone, 16 bit stereo
+static void FillAudioFrame(AVFrame *pFrame, int64_t firstSample)
+{
+    int16_t *pSamples = (int16_t *) pFrame->data[0];
+
+    for(int i = 0; i < pFrame->nb_samples; i++)
+    {
+        // Integer triangle wave, no libm so every platform writes the same bytes
+        int phase = (int) ((firstSample + i) % 48);
+        int value = phase < 24 ? phase * 1000 - 12000 : (48 - phase) * 1000 - 12000;
+
+        pSamples[2 * i] = (int16_t) value;
+        pSamples[2 * i + 1] = (int16_t) value;
+    }
+}
+
+static bool OpenVideoEncoder(Corpus &corpus)
+{
+    AVCodec *pCodec = avcodec_find_encoder(AV_CODEC_ID_MPEG2VIDEO);
+
+    if(!pCodec)
+    {
+        fprintf(stderr, "Error: libavcodec has no MPEG-2 video encoder\n");
+        return false;
+    }
+
+    AVCodecContext *pContext = avcodec_alloc_context3(pCodec);
+
+    if(!pContext)
+        return false;
+
+    pContext->width = g_options.width;
+    pContext->height = g_options.height;
+    pContext->pix_fmt = AV_PIX_FMT_YUV420P;
+    pContext->time_base = av_make_q(g_options.fpsDen, g_options.fpsNum);
+    pContext->framerate = av_make_q(g_options.fpsNum, g_options.fpsDen);
+    pContext->gop_size = g_options.gopSize;
+    pContext->max_b_frames = g_options.bFrames;
+    pContext->bit_rate = g_options.bitRate;
+    pContext->rc_max_rate = g_options.bitRate;
+    pContext->rc_buffer_size = (int) (g_options.bitRate / 2);
+    pContext->thread_count = 1;
+    pContext->flags |= AV_CODEC_FLAG_BITEXACT;
+
+    if(g_options.bClosedGop)
+        pContext->flags |= AV_CODEC_FLAG_CLOSED_GOP;
+
+    if(avcodec_open2(pContext, pCodec, NULL) < 0)
+    {
+        fprintf(stderr, "Error: Could not open the MPEG-2 video encoder\n");
+        avcodec_free_context(&pContext);
+        return false;
+    }
+
+    corpus.pVideoContext = pContext;
+
+    corpus.pVideoFrame = av_frame_alloc();
+
+    if(!corpus.pVideoFrame)
+        return false;
+
+    corpus.pVideoFrame->format = pContext->pix_fmt;
+    corpus.pVideoFrame->width = pContext->width;
+    corpus.pVideoFrame->height = pContext->height;
+
+    return av_frame_get_buffer(corpus.pVideoFrame, 32) >= 0;
+}
+
+static bool OpenAudioEncoder(Corpus &corpus)
+{
+    AVCodec *pCodec = avcodec_find_encoder(AV_CODEC_ID_MP2);
+
+    if(!pCodec)
+    {
+        fprintf(stderr, "Error: libavcodec has no MPEG audio layer 2 encoder\n");
+        return false;
+    }
+
+    AVCodecContext *pContext = avcodec_alloc_context3(pCodec);
+
+    if(!pContext)
+        return false;
+
+    pContext->sample_fmt = AV_SAMPLE_FMT_S16;
+    pContext->sample_rate = AUDIO_SAMPLE_RATE;
+    pContext->channel_layout = AV_CH_LAYOUT_STEREO;
+    pContext->channels = 2;
+    pContext->bit_rate = 192000;
+    pContext->time_base = av_make_q(1, AUDIO_SAMPLE_RATE);
+    pContext->flags |= AV_CODEC_FLAG_BITEXACT;
+
+    if(avcodec_open2(pContext, pCodec, NULL) < 0)
+    {
+        fprintf(stderr, "Error: Could not open the MPEG audio encoder\n");
+        avcodec_free_context(&pContext);
+        return false;
+    }
+
+    corpus.pAudioContext = pContext;
+
+    corpus.pAudioFrame = av_frame_alloc();
+
+    if(!corpus.pAudioFrame)
+        return false;
+
+    corpus.pAudioFrame->format = pContext->sample_fmt;
+    corpus.pAudioFrame->channel_layout = pContext->channel_layout;
+    corpus.pAudioFrame->channels = pContext->channels;
+    corpus.pAudioFrame->nb_samples = pContext->frame_size;
+
+    return av_frame_get_buffer(corpus.pAudioFrame, 0) >= 0;
+}
+
+// Moves every packet the encoder has ready into the mux queue
+static bool DrainEncoder(Corpus &corpus, AVCodecContext *pContext, bool bVideo)
+{
+    while(1)
+    {
+        int ret = avcodec_receive_packet(pContext, corpus.pPacket);
+
+        if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+            return true;
+
+        if(ret < 0)
+        {
+            fprintf(stderr, "Error: Encoding failed\n");
+            return false;
+        }
+
+        PendingAU au;
+        AVRational ts90k = av_make_q(1, 90000);
+
+        au.data.assign(corpus.pPacket->data, corpus.pPacket->data + corpus.pPacket->size);
+        au.pts = (uint64_t) (av_rescale_q(corpus.pPacket->pts, pContext->time_base, ts90k) + TIMESTAMP_OFFSET);
+        au.dts = (uint64_t) (av_rescale_q(corpus.pPacket->dts, pContext->time_base, ts90k) + TIMESTAMP_OFFSET);
+        au.bVideo = bVideo;
+        au.frameType = 0;
+        au.closedGop = 0;
+
+        if(bVideo)
+            ScanPictureHeaders(au.data.data(), au.data.size(), au.frameType, au.closedGop);
+
+        (bVideo ? corpus.video : corpus.audio).push_back(au);
+
+        av_packet_unref(corpus.pPacket);
+    }
+}
+
+static void WriteTimestamp(FILE *fp, const char *name, uint64_t ts)
+{
+    fprintf(fp, "        <%s>%llu (%f)</%s>\n", name, (unsigned long long) ts, (double) ts / 90000.0, name);
+}
+
+// One terse <frame> element
+static void WriteXmlFrame(Corpus &corpus, const PendingAU &au, uint16_t pid, unsigned int frameNumber)
+{
+    FILE *fp = corpus.fpTerse;
+
+    fprintf(fp, "    <frame number=\"%u\" pid=\"0x%x\">\n", frameNumber, pid);
+
+    if(au.dts != au.pts)
+        WriteTimestamp(fp, "DTS", au.dts);
+
+    WriteTimestamp(fp, "PTS", au.pts);
+
+    if(au.bVideo)
+    {
+        fprintf(fp, "        <type>%c</type>\n", au.frameType);
+
+        if('I' == au.frameType)
+            fprintf(fp, "        <closed_gop>%d</closed_gop>\n", au.closedGop);
+    }
+
+    fprintf(fp, "        <slices>\n");
+
+    for(auto &run : corpus.runs)
+        fprintf(fp, "            <slice byte=\"%llu\" packets=\"%llu\"/>\n",
+                (unsigned long long) run.startByteLocation, (unsigned long long) run.numPackets);
+
+    fprintf(fp, "        </slices>\n");
+    fprintf(fp, "    </frame>\n");
+}
+
+static bool WritePSI(Corpus &corpus)
+{
+    corpus.lastPSI = corpus.writer.Clock();
+
+    return corpus.writer.WritePSI();
+}
+
+static bool WriteAU(Corpus &corpus, const PendingAU &au)
+{
+    // Padding holds the AU back until MUX_MAX_DELAY before its DTS
+    if(au.dts > MUX_MAX_DELAY && !corpus.writer.PadUntil((au.dts - MUX_MAX_DELAY) * 300))
+        return false;
+
+    // Tables go out ahead of every I frame so a decoder can start there
+    if((('I' == au.frameType && au.bVideo) || corpus.writer.Clock() - corpus.lastPSI >= PSI_INTERVAL) && !WritePSI(corpus))
+        return false;
+
+    if(au.bVideo)
+    {
+        if(!corpus.writer.WritePES(g_options.videoPID, 0xE0, au.data.data(), au.data.size(), au.pts, au.dts, corpus.runs))
+            return false;
+
+        if(corpus.fpTerse)
+            WriteXmlFrame(corpus, au, g_options.videoPID, corpus.videoFramesWritten);
+
+        corpus.videoFramesWritten++;
+    }
+    else
+    {
+        if(!corpus.writer.WritePES(g_options.audioPID, 0xC0, au.data.data(), au.data.size(), au.pts, au.pts, corpus.runs))
+            return false;
+
+        if(corpus.fpTerse)
+            WriteXmlFrame(corpus, au, g_options.audioPID, corpus.audioFramesWritten);
+
+        corpus.audioFramesWritten++;
+    }
+
+    if(corpus.writer.Clock() > au.dts * 300)
+        corpus.lateFrames++;
+
+    return true;
+}
+
+// Writes queued AUs in DTS order.  Until bFlush, one queue waits while the other is empty.
+static bool Multiplex(Corpus &corpus, bool bFlush)
+{
+    bool bAudio = 0 != g_options.audioPID;
+
+    while(corpus.video.size() || corpus.audio.size())
+    {
+        if(!bFlush && (corpus.video.empty() || (bAudio && corpus.audio.empty())))
+            break;
+
+        bool bTakeVideo = corpus.audio.empty() ||
+                          (corpus.video.size() && corpus.video.front().dts <= corpus.audio.front().dts);
+
+        std::deque<PendingAU> &queue = bTakeVideo ? corpus.video : corpus.audio;
+
+        if(!WriteAU(corpus, queue.front()))
+            return false;
+
+        queue.pop_front();
+    }
+
+    return true;
+}
+
+static FILE *OpenXml(const std::string &fileName, const std::string &tsName, bool bTerse, long &sizeOffset)
+{
+    FILE *fp = fopen(fileName.c_str(), "wb");
+
+    if(!fp)
+        return NULL;
+
+    fprintf(fp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(fp, "<file>\n");
+    fprintf(fp, "    <name>%s</name>\n", tsName.c_str());
+    fprintf(fp, "    <file_size>");
+
+    // Patched once the stream is complete, leading zeros keep the width fixed
+    sizeOffset = ftell(fp);
+    fprintf(fp, "%020llu</file_size>\n", 0ULL);
+
+    fprintf(fp, "    <packet_size>%u</packet_size>\n", g_options.packetSize);
+    fprintf(fp, "    <terse>%d</terse>\n", bTerse ? 1 : 0);
+
+    return fp;
+}
+
+static void CloseXml(FILE *fp, long sizeOffset, uint64_t fileSize)
+{
+    if(!fp)
+        return;
+
+    fprintf(fp, "</file>\n");
+    fseek(fp, sizeOffset, SEEK_SET);
+    fprintf(fp, "%020llu", (unsigned long long) fileSize);
+    fclose(fp);
+}
+
+static bool GenerateCorpus(Corpus &corpus)
+{
+    std::string baseName = g_options.outName;
+    std::string tsName = baseName + ".ts";
+
+    if(g_options.xml & eXmlTerse)
+    {
+        corpus.fpTerse = OpenXml(baseName + ".xml", tsName, true, corpus.terseSizeOffset);
+
+        if(!corpus.fpTerse)
+            return false;
+    }
+
+    if(g_options.xml & eXmlVerbose)
+    {
+        corpus.fpVerbose = OpenXml(baseName + ".verbose.xml", tsName, false, corpus.verboseSizeOffset);
+
+        if(!corpus.fpVerbose)
+            return false;
+    }
+
+    if(!corpus.writer.Open(tsName, g_options.packetSize, corpus.fpTerse, corpus.fpVerbose))
+    {
+        fprintf(stderr, "Error: Could not create %s\n", tsName.c_str());
+        return false;
+    }
+
+    std::vector<TSStreamInfo> streams;
+    streams.push_back({ 0x02, g_options.videoPID, "MPEG-2 Video" });
+
+    if(g_options.audioPID)
+        streams.push_back({ 0x03, g_options.audioPID, "MPEG-1 Audio" });
+
+    corpus.writer.SetProgram(g_options.pmtPID, g_options.videoPID, streams);
+    corpus.writer.SetNullPacketInterval(g_options.nullEvery);
+
+    // Room for the video peaks, the audio and the tables, PCRs and PES headers.  The clock
+    // starts at 0, TIMESTAMP_OFFSET ahead of the first PTS.
+    int64_t muxRate = g_options.muxRate ? g_options.muxRate : g_options.bitRate * 5 / 4 + 400000;
+
+    corpus.writer.SetMuxRate((uint64_t) muxRate, 0);
+
+    // The stream starts with the tables, whichever AU comes first
+    if(!WritePSI(corpus))
+        return false;
+
+    corpus.pPacket = av_packet_alloc();
+
+    if(!corpus.pPacket || !OpenVideoEncoder(corpus))
+        return false;
+
+    if(g_options.audioPID && !OpenAudioEncoder(corpus))
+        return false;
+
+    int64_t numFrames = (int64_t) (g_options.duration * g_options.fpsNum / g_options.fpsDen + 0.5);
+
+    for(int64_t frame = 0; frame <= numFrames; frame++)
+    {
+        bool bFlush = frame == numFrames;
+
+        if(!bFlush)
+        {
+            if(av_frame_make_writable(corpus.pVideoFrame) < 0)
+                return false;
+
+            FillVideoFrame(corpus.pVideoFrame, frame);
+            corpus.pVideoFrame->pts = frame;
+        }
+
+        if(avcodec_send_frame(corpus.pVideoContext, bFlush ? NULL : corpus.pVideoFrame) < 0 ||
+           !DrainEncoder(corpus, corpus.pVideoContext, true))
+            return false;
+
+        // Audio up to the end of this video frame
+        if(corpus.pAudioContext)
+        {
+            int64_t audioEnd = av_rescale(frame + 1, (int64_t) AUDIO_SAMPLE_RATE * g_options.fpsDen, g_options.fpsNum);
+
+            while(!bFlush && corpus.audioSamples < audioEnd)
+            {
+                if(av_frame_make_writable(corpus.pAudioFrame) < 0)
+                    return false;
+
+                FillAudioFrame(corpus.pAudioFrame, corpus.audioSamples);
+                corpus.pAudioFrame->pts = corpus.audioSamples;
+                corpus.audioSamples += corpus.pAudioFrame->nb_samples;
+
+                if(avcodec_send_frame(corpus.pAudioContext, corpus.pAudioFrame) < 0 ||
+                   !DrainEncoder(corpus, corpus.pAudioContext, false))
+                    return false;
+            }
+
+            if(bFlush && (avcodec_send_frame(corpus.pAudioContext, NULL) < 0 ||
+                          !DrainEncoder(corpus, corpus.pAudioContext, false)))
+                return false;
+        }
+
+        if(!Multiplex(corpus, bFlush))
+            return false;
+    }
+
+    uint64_t fileSize = corpus.writer.Position();
+
+    corpus.writer.Close();
+    CloseXml(corpus.fpTerse, corpus.terseSizeOffset, fileSize);
+    CloseXml(corpus.fpVerbose, corpus.verboseSizeOffset, fileSize);
+    corpus.fpTerse = corpus.fpVerbose = NULL;
+
+    printf("%s: %u video frames, %u audio frames, %llu packets, %llu bytes, mux rate %lld bits/s\n", tsName.c_str(),
+           corpus.videoFramesWritten, corpus.audioFramesWritten,
+           (unsigned long long) corpus.writer.PacketsWritten(), (unsigned long long) fileSize, (long long) muxRate);
+
+    if(corpus.lateFrames)
+        fprintf(stderr, "Warning: %u AUs were sent after their DTS, raise --mux-rate\n", corpus.lateFrames);
+
+    return true;
+}
+
+static void FreeCorpus(Corpus &corpus)
+{
+    avcodec_free_context(&corpus.pVideoContext);
+    avcodec_free_context(&corpus.pAudioContext);
+    av_frame_free(&corpus.pVideoFrame);
+    av_frame_free(&corpus.pAudioFrame);
+    av_packet_free(&corpus.pPacket);
+
+    if(corpus.fpTerse)
+        fclose(corpus.fpTerse);
+
+    if(corpus.fpVerbose)
+        fclose(corpus.fpVerbose);
+}
+
+// Accepts 4000000, 4000k or 4M
+static int64_t ParseBitRate(const char *text)
+{
+    char *pEnd = NULL;
+    double value = strtod(text, &pEnd);
+
+    if(pEnd && ('k' == *pEnd || 'K' == *pEnd))
+        value *= 1000.0;
+    else if(pEnd && ('m' == *pEnd || 'M' == *pEnd))
+        value *= 1000000.0;
+
+    return (int64_t) value;
+}
+
+static void PrintUsage(const char *appName)
+{
+    fprintf(stderr, "Usage: %s [options] output\n", appName);
+    fprintf(stderr, "  Writes output.ts, output.xml (terse) and output.verbose.xml\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --size <width>x<height>        Picture size (default: 720x480)\n");
+    fprintf(stderr, "  --fps <num>[/<den>]            Frame rate (default: 30000/1001)\n");
+    fprintf(stderr, "  --gop <frames>                 GOP length (default: 15)\n");
+    fprintf(stderr, "  --bframes <n>                  B frames between reference frames (default: 2)\n");
+    fprintf(stderr, "  --closed-gop                   Encode closed GOPs\n");
+    fprintf(stderr, "  --bitrate <bits/s>             Video bit rate, k and M suffixes allowed (default: 4M)\n");
+    fprintf(stderr, "  --mux-rate <bits/s>            Constant TS rate (default: 5/4 of the video bit rate plus 400k)\n");
+    fprintf(stderr, "  --duration <seconds>           Length of the stream (default: 10)\n");
+    fprintf(stderr, "  --packet-size <188|192>        Transport packet size (default: 188)\n");
+    fprintf(stderr, "  --pmt-pid <pid>                (default: 0x1000)\n");
+    fprintf(stderr, "  --video-pid <pid>              (default: 0x100)\n");
+    fprintf(stderr, "  --audio-pid <pid>              0 for no audio (default: 0x101)\n");
+    fprintf(stderr, "  --null-every <n>               Insert a null packet after every n packets (default: 0, none)\n");
+    fprintf(stderr, "  --xml <terse|verbose|both>     Which XML files to write (default: both)\n");
+}
+
+static bool ParseCommandLine(int argc, char* argv[])
+{
+    for(int i = 1; i < argc; i++)
+    {
+        bool bHasValue = i + 1 < argc;
+
+        if(0 == strcmp(argv[i], "--size") && bHasValue)
+        {
+            if(2 != sscanf(argv[++i], "%dx%d", &g_options.width, &g_options.height))
+                return false;
+        }
+        else if(0 == strcmp(argv[i], "--fps") && bHasValue)
+        {
+            g_options.fpsDen = 1;
+
+            if(sscanf(argv[++i], "%d/%d", &g_options.fpsNum, &g_options.fpsDen) < 1)
+                return false;
+        }
+        else if(0 == strcmp(argv[i], "--gop") && bHasValue)
+            g_options.gopSize = atoi(argv[++i]);
+        else if(0 == strcmp(argv[i], "--bframes") && bHasValue)
+            g_options.bFrames = atoi(argv[++i]);
+        else if(0 == strcmp(argv[i], "--closed-gop"))
+            g_options.bClosedGop = true;
+        else if(0 == strcmp(argv[i], "--bitrate") && bHasValue)
+            g_options.bitRate = ParseBitRate(argv[++i]);
+        else if(0 == strcmp(argv[i], "--mux-rate") && bHasValue)
+            g_options.muxRate = ParseBitRate(argv[++i]);
+        else if(0 == strcmp(argv[i], "--duration") && bHasValue)
+            g_options.duration = atof(argv[++i]);
+        else if(0 == strcmp(argv[i], "--packet-size") && bHasValue)
+            g_options.packetSize = (unsigned int) atoi(argv[++i]);
+        else if(0 == strcmp(argv[i], "--pmt-pid") && bHasValue)
+            g_options.pmtPID = (uint16_t) strtol(argv[++i], NULL, 0);
+        else if(0 == strcmp(argv[i], "--video-pid") && bHasValue)
+            g_options.videoPID = (uint16_t) strtol(argv[++i], NULL, 0);
+        else if(0 == strcmp(argv[i], "--audio-pid") && bHasValue)
+            g_options.audioPID = (uint16_t) strtol(argv[++i], NULL, 0);
+        else if(0 == strcmp(argv[i], "--null-every") && bHasValue)
+            g_options.nullEvery = (unsigned int) atoi(argv[++i]);
+        else if(0 == strcmp(argv[i], "--xml") && bHasValue)
+        {
+            i++;
+
+            if(0 == strcmp(argv[i], "terse"))
+                g_options.xml = eXmlTerse;
+            else if(0 == strcmp(argv[i], "verbose"))
+                g_options.xml = eXmlVerbose;
+            else if(0 == strcmp(argv[i], "both"))
+                g_options.xml = eXmlBoth;
+            else
+                return false;
+        }
+        else if('-' == argv[i][0] && '-' == argv[i][1])
+        {
+            fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
+            return false;
+        }
+        else
+        {
+            g_options.outName = argv[i];
+        }
+    }
+
+    if(188 != g_options.packetSize && 192 != g_options.packetSize)
+    {
+        fprintf(stderr, "Error: Packet size must be 188 or 192\n");
+        return false;
+    }
+
+    // PIDs 0-0xF are reserved for tables, 0x1FFF is the null PID
+    uint16_t pids[] = { g_options.pmtPID, g_options.videoPID, g_options.audioPID };
+
+    for(int i = 0; i < 3; i++)
+    {
+        if((i < 2 || pids[i]) && (pids[i] < 0x10 || pids[i] >= TS_NULL_PID))
+        {
+            fprintf(stderr, "Error: PID 0x%x is out of range\n", pids[i]);
+            return false;
+        }
+    }
+
+    if(g_options.videoPID == g_options.pmtPID || g_options.audioPID == g_options.pmtPID || g_options.audioPID == g_options.videoPID)
+    {
+        fprintf(stderr, "Error: Every PID must be different\n");
+        return false;
+    }
+
+    return NULL != g_options.outName && g_options.muxRate >= 0 && g_options.fpsNum > 0 && g_options.fpsDen > 0 &&
+           g_options.width > 0 && g_options.height > 0 && g_options.duration > 0.0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(!ParseCommandLine(argc, argv))
+    {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    Corpus corpus;
+
+    bool bOK = GenerateCorpus(corpus);
+
+    FreeCorpus(corpus);
+
+    return bOK ? 0 : 1;
+}
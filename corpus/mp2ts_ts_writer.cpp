@@ -0,0 +1,434 @@
+#include "mp2ts_ts_writer.h"
+
+#include <cstring>
+
+// 27 MHz ticks one packet takes, times the mux rate in bits per second
+#define TS_PACKET_TICKS     (TS_PACKET_SIZE * 8ull * 27000000)
+
+// Until SetMuxRate()
+#define TS_DEFAULT_MUX_RATE 6000000
+
+uint32_t Crc32Mpeg2(const uint8_t *pData, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(size_t i = 0; i < size; i++)
+    {
+        crc ^= (uint32_t) pData[i] << 24;
+
+        for(int bit = 0; bit < 8; bit++)
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+    }
+
+    return crc;
+}
+
+// 33 bit PES timestamp with its 4 bit prefix and marker bits
+static void PutTimestamp(uint8_t *p, uint8_t prefix, uint64_t ts)
+{
+    p[0] = (uint8_t) ((prefix << 4) | (((ts >> 30) & 0x07) << 1) | 1);
+    p[1] = (uint8_t) (ts >> 22);
+    p[2] = (uint8_t) ((((ts >> 15) & 0x7F) << 1) | 1);
+    p[3] = (uint8_t) (ts >> 7);
+    p[4] = (uint8_t) (((ts & 0x7F) << 1) | 1);
+}
+
+static void PutPCR(uint8_t *p, uint64_t base, uint16_t extension)
+{
+    p[0] = (uint8_t) (base >> 25);
+    p[1] = (uint8_t) (base >> 17);
+    p[2] = (uint8_t) (base >> 9);
+    p[3] = (uint8_t) (base >> 1);
+    p[4] = (uint8_t) (((base & 1) << 7) | 0x7E | ((extension >> 8) & 1));
+    p[5] = (uint8_t) extension;
+}
+
+TSWriter::TSWriter()
+    : m_fp(NULL)
+    , m_fpTerse(NULL)
+    , m_fpVerbose(NULL)
+    , m_packetSize(TS_PACKET_SIZE)
+    , m_nullEvery(0)
+    , m_sinceNull(0)
+    , m_position(0)
+    , m_packetsWritten(0)
+    , m_muxRate(TS_DEFAULT_MUX_RATE)
+    , m_clock(0)
+    , m_clockRemainder(0)
+    , m_lastPCR(0)
+    , m_bPCRSent(false)
+    , m_bTersePSIWritten(false)
+    , m_pmtPID(0x1000)
+    , m_pcrPID(0x100)
+{
+    memset(m_continuityCounter, 0, sizeof(m_continuityCounter));
+}
+
+TSWriter::~TSWriter()
+{
+    Close();
+}
+
+bool TSWriter::Open(const std::string &fileName, unsigned int packetSize, FILE *fpTerse, FILE *fpVerbose)
+{
+    if(188 != packetSize && 192 != packetSize)
+        return false;
+
+    m_fp = fopen(fileName.c_str(), "wb");
+
+    if(!m_fp)
+        return false;
+
+    m_packetSize = packetSize;
+    m_fpTerse = fpTerse;
+    m_fpVerbose = fpVerbose;
+
+    return true;
+}
+
+void TSWriter::Close()
+{
+    if(m_fp)
+        fclose(m_fp);
+
+    m_fp = NULL;
+}
+
+void TSWriter::SetProgram(uint16_t pmtPID, uint16_t pcrPID, const std::vector<TSStreamInfo> &streams)
+{
+    m_pmtPID = pmtPID;
+    m_pcrPID = pcrPID;
+    m_streams = streams;
+}
+
+void TSWriter::SetMuxRate(uint64_t bitsPerSecond, uint64_t startTime)
+{
+    m_muxRate = bitsPerSecond;
+    m_clock = startTime;
+    m_clockRemainder = 0;
+}
+
+bool TSWriter::PadUntil(uint64_t time)
+{
+    while(m_clock < time)
+    {
+        if(!(PCRDue() ? WritePCRPacket() : WriteNullPacket()))
+            return false;
+    }
+
+    return true;
+}
+
+void TSWriter::WriteXmlPacket(FILE *fp, const uint8_t *pPacket, const char *pXmlBody)
+{
+    uint16_t pid = ((pPacket[1] & 0x1F) << 8) | pPacket[2];
+
+    fprintf(fp, "    <packet byte=\"%llu\">\n", (unsigned long long) m_position);
+    fprintf(fp, "        <number>%llu</number>\n", (unsigned long long) m_packetsWritten);
+    fprintf(fp, "        <sync_byte>0x47</sync_byte>\n");
+    fprintf(fp, "        <transport_error_indicator>0x%x</transport_error_indicator>\n", (pPacket[1] >> 7) & 1);
+    fprintf(fp, "        <payload_unit_start_indicator>0x%x</payload_unit_start_indicator>\n", (pPacket[1] >> 6) & 1);
+    fprintf(fp, "        <transport_priority>0x%x</transport_priority>\n", (pPacket[1] >> 5) & 1);
+    fprintf(fp, "        <pid>0x%x</pid>\n", pid);
+    fprintf(fp, "        <transport_scrambling_control>0x%x</transport_scrambling_control>\n", (pPacket[3] >> 6) & 3);
+    fprintf(fp, "        <adaptation_field_control>0x%x</adaptation_field_control>\n", (pPacket[3] >> 4) & 3);
+    fprintf(fp, "        <continuity_counter>0x%x</continuity_counter>\n", pPacket[3] & 0x0F);
+
+    if(pXmlBody)
+        fputs(pXmlBody, fp);
+
+    fprintf(fp, "    </packet>\n");
+}
+
+// pPacket is 188 bytes, the continuity counter is filled in here
+bool TSWriter::WritePacket(uint8_t *pPacket, const char *pXmlBody)
+{
+    uint16_t pid = ((pPacket[1] & 0x1F) << 8) | pPacket[2];
+
+    // Only packets with a payload advance the counter
+    if(pPacket[3] & 0x10)
+    {
+        pPacket[3] = (pPacket[3] & 0xF0) | m_continuityCounter[pid];
+        m_continuityCounter[pid] = (m_continuityCounter[pid] + 1) & 0x0F;
+    }
+    else
+    {
+        pPacket[3] = (pPacket[3] & 0xF0) | m_continuityCounter[pid];
+    }
+
+    if(192 == m_packetSize)
+    {
+        // copy_permission_indicator and a 30 bit arrival timestamp
+        uint32_t ats = (uint32_t) (m_clock & 0x3FFFFFFF);
+        uint8_t prefix[4] = { (uint8_t) (ats >> 24), (uint8_t) (ats >> 16), (uint8_t) (ats >> 8), (uint8_t) ats };
+
+        if(1 != fwrite(prefix, 4, 1, m_fp))
+            return false;
+    }
+
+    if(1 != fwrite(pPacket, TS_PACKET_SIZE, 1, m_fp))
+        return false;
+
+    if(m_fpVerbose)
+        WriteXmlPacket(m_fpVerbose, pPacket, pXmlBody);
+
+    m_position += m_packetSize;
+    m_packetsWritten++;
+
+    // The next packet leaves one packet time later at the mux rate
+    m_clock += TS_PACKET_TICKS / m_muxRate;
+    m_clockRemainder += TS_PACKET_TICKS % m_muxRate;
+
+    if(m_clockRemainder >= m_muxRate)
+    {
+        m_clock++;
+        m_clockRemainder -= m_muxRate;
+    }
+
+    if(pid != TS_NULL_PID && m_nullEvery && ++m_sinceNull == m_nullEvery)
+    {
+        m_sinceNull = 0;
+        return WriteNullPacket();
+    }
+
+    return true;
+}
+
+bool TSWriter::WriteNullPacket()
+{
+    uint8_t packet[TS_PACKET_SIZE];
+
+    memset(packet, 0xFF, sizeof(packet));
+    packet[0] = 0x47;
+    packet[1] = (TS_NULL_PID >> 8) & 0x1F;
+    packet[2] = TS_NULL_PID & 0xFF;
+    packet[3] = 0x10;
+
+    return WritePacket(packet, NULL);
+}
+
+// Adaptation field only, a PCR of the PCR PID when there is no PES data to carry it
+bool TSWriter::WritePCRPacket()
+{
+    uint8_t packet[TS_PACKET_SIZE];
+
+    memset(packet, 0xFF, sizeof(packet));
+    packet[0] = 0x47;
+    packet[1] = (m_pcrPID >> 8) & 0x1F;
+    packet[2] = m_pcrPID & 0xFF;
+    packet[3] = 0x20;
+    packet[4] = TS_PACKET_SIZE - 5;
+    packet[5] = 0x10;   // PCR_flag
+    PutPCR(packet + 6, m_clock / 300, (uint16_t) (m_clock % 300));
+
+    m_lastPCR = m_clock;
+    m_bPCRSent = true;
+
+    return WritePacket(packet, NULL);
+}
+
+bool TSWriter::WriteSection(uint16_t pid, const std::vector<uint8_t> &section, const char *pXmlBody)
+{
+    uint8_t packet[TS_PACKET_SIZE];
+
+    // Our sections always fit in one packet
+    if(section.size() + 5 > TS_PACKET_SIZE)
+        return false;
+
+    memset(packet, 0xFF, sizeof(packet));
+    packet[0] = 0x47;
+    packet[1] = 0x40 | ((pid >> 8) & 0x1F);
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10;
+    packet[4] = 0;  // pointer_field
+
+    memcpy(packet + 5, section.data(), section.size());
+
+    // The terse XML keeps the first PAT and PMT, ParsePMT needs them
+    if(m_fpTerse && !m_bTersePSIWritten)
+        WriteXmlPacket(m_fpTerse, packet, pXmlBody);
+
+    return WritePacket(packet, pXmlBody);
+}
+
+static void FinishSection(std::vector<uint8_t> &section)
+{
+    // section_length counts everything after it, CRC included
+    size_t sectionLength = section.size() - 3 + 4;
+    section[1] = 0xB0 | (uint8_t) ((sectionLength >> 8) & 0x0F);
+    section[2] = (uint8_t) sectionLength;
+
+    uint32_t crc = Crc32Mpeg2(section.data(), section.size());
+    section.push_back((uint8_t) (crc >> 24));
+    section.push_back((uint8_t) (crc >> 16));
+    section.push_back((uint8_t) (crc >> 8));
+    section.push_back((uint8_t) crc);
+}
+
+bool TSWriter::WritePSI()
+{
+    char xml[4096];
+    int length = 0;
+
+    // Program association table, a single program
+    std::vector<uint8_t> pat = { 0x00, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                 0x00, 0x01, (uint8_t) (0xE0 | (m_pmtPID >> 8)), (uint8_t) m_pmtPID };
+    FinishSection(pat);
+
+    snprintf(xml, sizeof(xml),
+             "        <program_association_table>\n"
+             "            <program>\n"
+             "                <number>1</number>\n"
+             "                <pid>0x%x</pid>\n"
+             "            </program>\n"
+             "        </program_association_table>\n", m_pmtPID);
+
+    if(!WriteSection(0, pat, xml))
+        return false;
+
+    // Program map table
+    std::vector<uint8_t> pmt = { 0x02, 0, 0, 0x00, 0x01, 0xC1, 0x00, 0x00,
+                                 (uint8_t) (0xE0 | (m_pcrPID >> 8)), (uint8_t) m_pcrPID, 0xF0, 0x00 };
+
+    length = snprintf(xml, sizeof(xml), "        <program_map_table>\n            <pcr_pid>0x%x</pcr_pid>\n", m_pcrPID);
+
+    for(auto &stream : m_streams)
+    {
+        pmt.push_back(stream.streamType);
+        pmt.push_back((uint8_t) (0xE0 | (stream.pid >> 8)));
+        pmt.push_back((uint8_t) stream.pid);
+        pmt.push_back(0xF0);
+        pmt.push_back(0x00);
+
+        length += snprintf(xml + length, sizeof(xml) - length,
+                           "            <stream>\n"
+                           "                <type_number>0x%x</type_number>\n"
+                           "                <type_name>%s</type_name>\n"
+                           "                <pid>0x%x</pid>\n"
+                           "            </stream>\n", stream.streamType, stream.typeName, stream.pid);
+    }
+
+    snprintf(xml + length, sizeof(xml) - length, "        </program_map_table>\n");
+
+    FinishSection(pmt);
+
+    if(!WriteSection(m_pmtPID, pmt, xml))
+        return false;
+
+    m_bTersePSIWritten = true;
+
+    return true;
+}
+
+bool TSWriter::WritePES(uint16_t pid, uint8_t streamId, const uint8_t *pData, size_t size,
+                        uint64_t pts, uint64_t dts, std::vector<PacketRun> &runs)
+{
+    uint8_t header[19];
+    size_t headerSize = 9;
+    bool bDTS = dts != pts;
+
+    header[0] = 0x00;
+    header[1] = 0x00;
+    header[2] = 0x01;
+    header[3] = streamId;
+    header[6] = 0x84;                       // '10', data_alignment_indicator
+    header[7] = bDTS ? 0xC0 : 0x80;         // PTS_DTS_flags
+    header[8] = bDTS ? 10 : 5;              // PES_header_data_length
+
+    PutTimestamp(header + 9, bDTS ? 0x3 : 0x2, pts);
+    headerSize += 5;
+
+    if(bDTS)
+    {
+        PutTimestamp(header + 14, 0x1, dts);
+        headerSize += 5;
+    }
+
+    // Video PES may be unbounded
+    size_t pesLength = headerSize - 6 + size;
+    if(pesLength > 0xFFFF)
+        pesLength = 0;
+
+    header[4] = (uint8_t) (pesLength >> 8);
+    header[5] = (uint8_t) pesLength;
+
+    runs.clear();
+
+    size_t total = headerSize + size;
+    size_t written = 0;
+
+    while(written < total)
+    {
+        uint8_t packet[TS_PACKET_SIZE];
+        bool bFirst = 0 == written;
+        bool bPCR = pid == m_pcrPID && (bFirst || PCRDue());
+        size_t adaptationSize = bPCR ? 8 : 0;
+        size_t payloadSize = TS_PACKET_SIZE - 4 - adaptationSize;
+
+        if(payloadSize > total - written)
+        {
+            payloadSize = total - written;
+            adaptationSize = TS_PACKET_SIZE - 4 - payloadSize;
+        }
+
+        packet[0] = 0x47;
+        packet[1] = (bFirst ? 0x40 : 0x00) | ((pid >> 8) & 0x1F);
+        packet[2] = pid & 0xFF;
+        packet[3] = adaptationSize ? 0x30 : 0x10;
+
+        if(adaptationSize)
+        {
+            packet[4] = (uint8_t) (adaptationSize - 1);
+
+            if(adaptationSize > 1)
+            {
+                memset(packet + 5, 0xFF, adaptationSize - 1);
+                packet[5] = 0x00;
+
+                if(bPCR)
+                {
+                    packet[5] = 0x10;   // PCR_flag
+                    PutPCR(packet + 6, m_clock / 300, (uint16_t) (m_clock % 300));
+                    m_lastPCR = m_clock;
+                    m_bPCRSent = true;
+                }
+            }
+        }
+
+        // Payload comes from the PES header first, then the ES data
+        uint8_t *p = packet + 4 + adaptationSize;
+        size_t remaining = payloadSize;
+
+        while(remaining)
+        {
+            size_t n;
+
+            if(written < headerSize)
+            {
+                n = headerSize - written < remaining ? headerSize - written : remaining;
+                memcpy(p, header + written, n);
+            }
+            else
+            {
+                n = remaining;
+                memcpy(p, pData + (written - headerSize), n);
+            }
+
+            p += n;
+            written += n;
+            remaining -= n;
+        }
+
+        uint64_t position = m_position;
+
+        if(!WritePacket(packet, NULL))
+            return false;
+
+        if(runs.size() && runs.back().startByteLocation + runs.back().numPackets * m_packetSize == position)
+            runs.back().numPackets++;
+        else
+            runs.push_back({ position, 1 });
+    }
+
+    return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define TS_PACKET_SIZE      188
+#define TS_NULL_PID         0x1FFF
+
+// 27 MHz ticks between PCRs of the PCR PID at most, TR 101 290 allows 40 ms
+#define TS_PCR_INTERVAL     (30 * 27000)
+
+// Contiguous packets of one PID, an element of an AU in the XML
+struct PacketRun
+{
+    uint64_t startByteLocation;
+    uint64_t numPackets;
+};
+
+struct TSStreamInfo
+{
+    uint8_t     streamType;     // eMPEG2_Video, eMPEG2_Audio...
+    uint16_t    pid;
+    const char  *typeName;
+};
+
+/*
+    Writes a single program transport stream, 188 or 192 byte packets,
+    and the XML mpts_parser would have produced for it.
+
+    The stream is a constant rate mux: packet n leaves at n 188 byte packets
+    of the mux rate after the start time, and its PCR and its arrival
+    timestamp are that time.  Packets of the PCR PID carry a PCR at the
+    start of every PES and whenever TS_PCR_INTERVAL has gone by.  PadUntil()
+    fills the time nothing is due with null packets, or with adaptation
+    field only packets of the PCR PID when a PCR is due.
+
+    fpTerse gets the <packet> elements of the first PAT and PMT, the caller
+    adds one <frame> per AU from the runs WritePES returns.
+    fpVerbose gets a <packet> element for every packet.
+    Either may be NULL.
+*/
+class TSWriter
+{
+public:
+
+    TSWriter();
+    ~TSWriter();
+
+    bool Open(const std::string &fileName, unsigned int packetSize, FILE *fpTerse, FILE *fpVerbose);
+    void Close();
+
+    // Packets of the program are followed by a null packet every nullEvery packets, 0 for none
+    void SetNullPacketInterval(unsigned int nullEvery) { m_nullEvery = nullEvery; }
+
+    void SetProgram(uint16_t pmtPID, uint16_t pcrPID, const std::vector<TSStreamInfo> &streams);
+
+    // Mux rate in bits per second of 188 byte packets, and the 27 MHz time of the first packet
+    void SetMuxRate(uint64_t bitsPerSecond, uint64_t startTime);
+
+    // 27 MHz time the next packet leaves at
+    uint64_t Clock() const { return m_clock; }
+
+    // Writes padding until the next packet leaves at time or later
+    bool PadUntil(uint64_t time);
+
+    // PAT followed by PMT, one packet each
+    bool WritePSI();
+
+    // Packetizes one PES.  dts is only written if it differs from pts.
+    // runs receives where the packets of this PES ended up.
+    bool WritePES(uint16_t pid, uint8_t streamId, const uint8_t *pData, size_t size,
+                  uint64_t pts, uint64_t dts, std::vector<PacketRun> &runs);
+
+    uint64_t Position() const { return m_position; }
+    uint64_t PacketsWritten() const { return m_packetsWritten; }
+
+private:
+    bool WritePacket(uint8_t *pPacket, const char *pXmlBody);
+    bool WriteNullPacket();
+    bool WritePCRPacket();
+    bool PCRDue() const { return !m_bPCRSent || m_clock - m_lastPCR >= TS_PCR_INTERVAL; }
+    bool WriteSection(uint16_t pid, const std::vector<uint8_t> &section, const char *pXmlBody);
+    void WriteXmlPacket(FILE *fp, const uint8_t *pPacket, const char *pXmlBody);
+
+    FILE                        *m_fp;
+    FILE                        *m_fpTerse;
+    FILE                        *m_fpVerbose;
+    unsigned int                m_packetSize;
+    unsigned int                m_nullEvery;
+    unsigned int                m_sinceNull;
+    uint64_t                    m_position;
+    uint64_t                    m_packetsWritten;
+    uint64_t                    m_muxRate;
+    uint64_t                    m_clock;            // 27 MHz time of the next packet
+    uint64_t                    m_clockRemainder;   // Of the ticks per packet, in 1/m_muxRate ticks
+    uint64_t                    m_lastPCR;
+    bool                        m_bPCRSent;
+    bool                        m_bTersePSIWritten;
+    uint16_t                    m_pmtPID;
+    uint16_t                    m_pcrPID;
+    std::vector<TSStreamInfo>   m_streams;
+    uint8_t                     m_continuityCounter[8192];
+};
+
+// CRC-32/MPEG-2 of a PSI section
+uint32_t Crc32Mpeg2(const uint8_t *pData, size_t size);
@@ -1,1858 +1,3089 @@
-/*
-    Original code by Mike Cancilla (https://github.com/mikecancilla)
-    2019
-
-    This software is provided 'as-is', without any express or implied
-    warranty. In no event will the authors be held liable for any
-    damages arising from the use of this software.
-
-    Permission is granted to anyone to use this software for any
-    purpose, including commercial applications, and to alter it and
-    redistribute it freely, subject to the following restrictions:
-
-    1. The origin of this software must not be misrepresented; you must
-    not claim that you wrote the original software. If you use this
-    software in a product, an acknowledgment in the product documentation
-    would be appreciated but is not required.
-
-    2. Altered source versions must be plainly marked as such, and
-    must not be misrepresented as being the original software.
-
-    3. This notice may not be removed or altered from any source
-    distribution.
-*/
-
-/*
-    This program is still under development!
-
-    Known Issues:
-
-    - Only handles the first Video and Audio stream
-    - GUI does not talk to decoder
-    - Needs to feed a decoder
-*/
-
-#define DUMP_OUTPUT_FILE 0
-
-#include <cstdio>
-#include <cstring>
-#include <cstdarg>
-#include <cstdlib>
-
-// OpenGL
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
-
-// GLM
-#include "glm.hpp"
-#include "gtc/matrix_transform.hpp"
-
-// ImGUI
-#include "imgui.h"
-#include "imgui_impl_glfw_gl3.h"
-
-// FFMPEG
-extern "C"
-{
-    #include <libavcodec/avcodec.h>
-    #include <libavformat/avformat.h>
-    #include <libavfilter/buffersink.h>
-    #include <libavfilter/buffersrc.h>
-    #include <libavutil/common.h>
-    #include <libavutil/opt.h>
-    #include <libavutil/pixdesc.h>
-    #include <libavutil/threadmessage.h>
-    #include <libavutil/time.h>
-    #include <libavutil/audio_fifo.h>
-    #include <libswresample/swresample.h>
-    #include <libavutil/frame.h>
-    #include <libswscale/swscale.h>
-    #include <libavutil/imgutils.h>
-}
-
-// My OpenGL Classes
-#include "Renderer.h"
-#include "Texture.h"
-#include "VertexBufferLayout.h"
-#include "TexturePresenter.h"
-
-#include "mp2ts_xml.h"
-
-extern void DoMyXMLTest(char *pXMLFile);
-extern void DoMyXMLTest2();
-extern int DoFFMpegOpenGLTest(const std::string &inFileName);
-
-#define WINDOW_WIDTH 1600
-#define WINDOW_HEIGHT 900
-
-#define KEY_RIGHT_ARROW 262
-#define KEY_LEFT_ARROW 263
-
-#define MIN(x,y) ((x) < (y) ? (x) : (y))
-#define MAX(x,y) ((x) > (y) ? (x) : (y))
-
-enum PlayState
-{
-    eStopped,
-    ePlaying,
-    eSeeking
-};
-
-typedef struct StreamContext {
-    AVCodecContext *dec_ctx;
-//    AVCodecContext *enc_ctx;
-    AVAudioFifo *audio_fifo;
-} StreamContext;
-
-typedef struct FilteringContext {
-    AVFilterContext *buffersink_ctx;
-    AVFilterContext *buffersrc_ctx;
-    AVFilterGraph *filter_graph;
-} FilteringContext;
-
-#if DUMP_OUTPUT_FILE
-static FILE *g_fpTemp = NULL;
-#endif
-
-static FILE *inputFile = NULL;
-
-// Describes the input file
-static AVFormatContext  *g_ifmt_ctx = NULL;
-static StreamContext    *g_stream_ctx = NULL;
-static AVFrame          *g_pFrame = NULL;
-static GLFWwindow       *g_window = NULL;
-static TexturePresenter *g_pTexturePresenter = NULL;
-static FilteringContext *g_filter_ctx = NULL;
-
-static char             g_error[AV_ERROR_MAX_STRING_SIZE] = {0};
-
-static int InitFilter(FilteringContext *fctx,
-                      AVStream *st,
-                      AVCodecContext *dec_ctx,
-                      //AVCodecContext *enc_ctx,
-                      const char *filter_spec);
-static int InitFilters();
-
-template <typename T>
-void IncAndClamp(T &value, T &incBy, T min, T max)
-
-{
-    value += incBy;
-
-    if(value < min)
-    {
-        value = min;
-        incBy *= (T) -1;
-    }
-    else if(value > max)
-    {
-        value = max;
-        incBy *= (T) -1;
-    }
-}
-
-static int OpenInputFile(MpegTS_XML &mpts)
-{
-    int ret;
-    g_ifmt_ctx = NULL;
-    std::string inFileName = mpts.m_mpegTSDescriptor.fileName;
-
-    av_log_set_level(AV_LOG_VERBOSE);
-
-    if ((ret = avformat_open_input(&g_ifmt_ctx, inFileName.c_str(), NULL, NULL)) < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Cannot open input file: %s\n", av_make_error_string(g_error, AV_ERROR_MAX_STRING_SIZE, ret));
-        return ret;
-    }
-
-    if ((ret = avformat_find_stream_info(g_ifmt_ctx, NULL)) < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
-        return ret;
-    }
-
-    g_stream_ctx = (StreamContext *)av_mallocz_array(g_ifmt_ctx->nb_streams, sizeof(*g_stream_ctx));
-    if (!g_stream_ctx)
-        return AVERROR(ENOMEM);
-
-    bool bWantVideoIndex = true;
-    bool bWantAudioIndex = true;
-
-    for(unsigned int streamIndex = 0; streamIndex < g_ifmt_ctx->nb_streams; streamIndex++)
-    {
-        if(g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-        {
-            if(bWantVideoIndex)
-            {
-                mpts.m_videoStreamIndex = streamIndex;
-                bWantVideoIndex = false;
-                continue;
-            }
-        }
-
-        if(g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
-        {
-            if(bWantAudioIndex)
-            {
-                mpts.m_audioStreamIndex = streamIndex;
-                bWantAudioIndex = false;
-                continue;
-            }
-        }
-    }
-
-    if(-1 == mpts.m_videoStreamIndex)
-    {
-        fprintf(stderr, "Error: No video stream found in source file!!\n");
-        return AVERROR_STREAM_NOT_FOUND;
-    }
-        
-    AVStream *stream = g_ifmt_ctx->streams[mpts.m_videoStreamIndex];
-        
-    AVCodec *dec = avcodec_find_decoder(stream->codecpar->codec_id);
-    AVCodecContext *codec_ctx = NULL;
-
-    if (!dec)
-        return AVERROR_DECODER_NOT_FOUND;
-
-    codec_ctx = avcodec_alloc_context3(dec);
-    if (!codec_ctx)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to allocate the decoder context for stream #%u\n", mpts.m_videoStreamIndex);
-        return AVERROR(ENOMEM);
-    }
-
-    ret = avcodec_parameters_to_context(codec_ctx, stream->codecpar);
-    if (ret < 0)
-    {
-        av_log(NULL, AV_LOG_ERROR, "Failed to copy decoder parameters to input decoder context "
-            "for stream #%u\n", mpts.m_videoStreamIndex);
-        return ret;
-    }
-
-    codec_ctx->framerate = av_guess_frame_rate(g_ifmt_ctx, stream, NULL);
-
-    // Open decoder
-    ret = avcodec_open2(codec_ctx, dec, NULL);
-    if (ret < 0) {
-        av_log(NULL, AV_LOG_ERROR, "Failed to open decoder for stream #%u\n", mpts.m_videoStreamIndex);
-        return ret;
-    }
-
-    g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx = codec_ctx;
-
-    av_dump_format(g_ifmt_ctx, 0, inFileName.c_str(), 0);
-
-#if DUMP_OUTPUT_FILE
-    g_fpTemp = fopen("C:\\Temp\\temp.mpg", "wb");
-#endif
-
-    return 0;
-}
-
-static int CloseInputFile(MpegTS_XML &mpts)
-{
-    for(unsigned int i = 0; i < g_ifmt_ctx->nb_streams; i++)
-    {
-        if(&(g_stream_ctx[i]))
-            avcodec_free_context(&g_stream_ctx[i].dec_ctx);
-    }
-
-    avformat_close_input(&g_ifmt_ctx);
-
-#if DUMP_OUTPUT_FILE
-    if(g_fpTemp)
-        fclose(g_fpTemp);
-#endif
-
-    return 0;
-}
-
-static int InitOpenGL(std::string windowTitle)
-{
-    /* Initialize the library */
-    if(!glfwInit())
-        return -1;
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    /* Create a windowed mode window and its OpenGL context */
-    g_window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, windowTitle.c_str(), NULL, NULL);
-    if (!g_window)
-    {
-        fprintf(stderr, "Could not create GL window! Continuing without a GUI!\n");
-        glfwTerminate();
-        return -1;
-    }
-
-    /* Make the window's context current */
-    glfwMakeContextCurrent(g_window);
-
-    glfwSwapInterval(1);
-
-    if(glewInit() != GLEW_OK)
-    {
-        fprintf(stderr, "Glew Initialization Error! Continuing without a GUI!\n");
-        glfwTerminate();
-        return -1;
-    }
-
-    return 0;
-}
-
-static int CloseOpenGL()
-{
-    glfwTerminate();
-    return 0;
-}
-
-static void FlipAvFrame(AVFrame *pFrame)
-{
-    // We need to flip the video image
-    //  See: https://lists.ffmpeg.org/pipermail/ffmpeg-user/2011-May/000976.html
-    pFrame->data[0] += pFrame->linesize[0] * (pFrame->height - 1);
-    pFrame->linesize[0] = -(pFrame->linesize[0]);
-
-    pFrame->data[1] += pFrame->linesize[1] * ((pFrame->height/2) - 1);
-    pFrame->linesize[1] = -(pFrame->linesize[1]);
-
-    pFrame->data[2] += pFrame->linesize[2] * ((pFrame->height/2) - 1);
-    pFrame->linesize[2] = -(pFrame->linesize[2]);
-}
-
-static uint8_t* dst_data[4];
-static int dst_linesize[4];
-
-static bool WriteFrame(AVCodecContext* dec_ctx,
-    AVFrame* frame,
-    int frame_num,
-    TexturePresenter* pTexturePresenter,
-                       bool bNewFrame)
-{
-    enum AVPixelFormat dst_pix_fmt = AV_PIX_FMT_RGBA;
-    struct SwsContext* sws_ctx = NULL;
-
-    if (bNewFrame) {
-        if (dst_data[0])
-            av_freep(&dst_data[0]);
-
-        // create scaling context
-        sws_ctx = sws_getContext(frame->width, frame->height, (enum AVPixelFormat)frame->format,
-            frame->width, frame->height, dst_pix_fmt,
-            SWS_BILINEAR, NULL, NULL, NULL);
-        if (!sws_ctx) {
-            fprintf(stderr,
-                "Impossible to create scale context for the conversion "
-                "fmt:%s s:%dx%d -> fmt:%s s:%dx%d\n",
-                av_get_pix_fmt_name((enum AVPixelFormat)frame->format), frame->width, frame->height,
-                av_get_pix_fmt_name(dst_pix_fmt), frame->width, frame->height);
-            return false;
-        }
-
-        int dst_bufsize = 0;
-
-        // buffer is going to be rawvideo file, no alignment
-        if ((dst_bufsize = av_image_alloc(dst_data, dst_linesize,
-            //frame->width, frame->height, dst_pix_fmt, 1)) < 0)
-            dec_ctx->width, dec_ctx->height, dst_pix_fmt, 1)) < 0) {
-            fprintf(stderr, "Could not allocate destination image\n");
-            return false;
-        }
-
-        /* convert to destination format */
-        sws_scale(sws_ctx,
-            (const uint8_t* const*)frame->data,
-            frame->linesize,
-            0,
-            frame->height,
-            dst_data,
-            dst_linesize);
-
-        // Save the frame to disk, only works with 24 bpp
-        //SaveFrame(dst_data[0], frame->width, frame->height, dst_linesize[0], frame_num);
-        //return true;
-
-        /*
-        // Determine required buffer size and allocate buffer
-        int numBytes = avpicture_get_size(AV_PIX_FMT_RGB24,
-                                          frame->width,
-                                          frame->height);
-
-        uint8_t *buffer = (uint8_t*) malloc(numBytes);
-
-        DeStride(dst_data[0], frame->width, frame->height, dst_linesize[0], buffer);
-        */
-    }
-
-    pTexturePresenter->Render(dst_data[0], dec_ctx->width, dec_ctx->height);
-
-    sws_freeContext(sws_ctx);
-
-    return true;
-}
-
-static size_t inline increment_ptr(uint8_t *&p, size_t bytes)
-{
-    p += bytes;
-    return bytes;
-}
-
-static inline uint16_t read_2_bytes(uint8_t *p)
-{
-    uint16_t ret = *p++;
-    ret <<= 8;
-    ret |= *p++;
-
-    return ret;
-}
-
-static inline uint32_t read_4_bytes(uint8_t *p)
-{
-    uint32_t ret = 0;
-    uint32_t val = *p++;
-    ret = val << 24;
-    val = *p++;
-    ret |= val << 16;
-    val = *p++;
-    ret |= val << 8;
-    ret |= *p;
-
-    return ret;
-}
-
-inline uint8_t process_adaptation_field(uint8_t *&p)
-{
-    uint8_t adaptation_field_length = *p;
-    return adaptation_field_length + 1;
-}
-
-static int FindData(uint8_t *packet, int packetSize)
-{
-    uint8_t* p = packet;
-
-    if (192 == packetSize)
-        increment_ptr(p, 4);
-
-    if (0x47 != *p) {
-        fprintf(stderr, "Error: Packet does not start with 0x47\n");
-        return -1;
-    }
-
-    // Skip the sync byte 0x47
-    increment_ptr(p, 1);
-
-    uint16_t PID = read_2_bytes(p);
-    increment_ptr(p, 2);
-
-    uint8_t transport_error_indicator = (PID & 0x8000) >> 15;
-    uint8_t payload_unit_start_indicator = (PID & 0x4000) >> 14;
-
-    uint8_t transport_priority = (PID & 0x2000) >> 13;
-
-    PID &= 0x1FFF;
-
-    // Move beyond the 32 bit header
-    uint8_t final_byte = *p;
-    increment_ptr(p, 1);
-
-    uint8_t transport_scrambling_control = (final_byte & 0xC0) >> 6;
-    uint8_t adaptation_field_control = (final_byte & 0x30) >> 4;
-    uint8_t continuity_counter = (final_byte & 0x0F) >> 4;
-
-    /*
-        Table 2-5  Adaptation field control values
-            Value  Description
-             00    Reserved for future use by ISO/IEC
-             01    No adaptation_field, payload only
-             10    Adaptation_field only, no payload
-             11    Adaptation_field followed by payload
-    */
-
-    uint8_t adaptation_field_length = 0;
-
-    if (2 == adaptation_field_control) {
-        return packetSize;
-    } else if (3 == adaptation_field_control) {
-        adaptation_field_length = process_adaptation_field(p);
-    }
-
-    increment_ptr(p, adaptation_field_length);
-
-    /*
-    http://dvd.sourceforge.net/dvdinfo/mpeghdrs.html
-
-    TODO: When demuxing to an elementary stream with the -f rawvideo flag,
-    FFMPEG removes start codes outside the range of 0x00-0xB8.
-    I'm just doing what they do.  It makes debugging my output easier.
-    This way I have something to compare against.
-
-    This step is not techinically necessary, a decoder will handle this data
-    if it is in the stream.
-    */
-
-    uint32_t fourBytes = read_4_bytes(p);
-    uint32_t startCodePrefix = (fourBytes & 0xFFFFFF00) >> 8;
-    if (0x000001 == startCodePrefix) {
-        uint8_t startCode = fourBytes & 0xFF;
-
-        // 0xB9-0xFF are stream ids, don't need them
-        while (startCode > 0xB8 && (p + 1 - packet < packetSize)) {
-            startCodePrefix = 0;
-            while (startCodePrefix != 0x000001 && (p + 1 - packet < packetSize)) {
-                increment_ptr(p, 1);
-                fourBytes = read_4_bytes(p);
-                startCodePrefix = (fourBytes & 0xFFFFFF00) >> 8;
-            }
-
-            startCode = fourBytes & 0xFF;
-        }
-    }
-
-    return p - packet;
-}
-
-static unsigned int FrameNumberFromBytePos(uint64_t &bytePos, std::vector<AccessUnit> &accessUnitList)
-{
-    // If searching for beginning of file, just return 0
-    if (0 == bytePos)
-        return 0;
-
-    // Look for bytePos in the list of AUs
-    for (std::vector<AccessUnit>::iterator i = accessUnitList.begin(); i < accessUnitList.end(); i++) {
-        if (i->accessUnitElements[0].startByteLocation >= bytePos) {
-            bytePos = i->accessUnitElements[0].startByteLocation;
-            return i->frameNumber;
-        }
-    }
-
-    // Didn't fine one? Return the frame number of the last AU
-    return accessUnitList.back().frameNumber;
-}
-
-static unsigned int FrameNumberFromBytePosInternal(uint64_t &bytePos, std::vector<AccessUnit> &accessUnitList)
-{
-    // If searching for beginning of file, just return 0
-    if (0 == bytePos)
-        return 0;
-
-    // Look for bytePos in the list of AUs
-    for (std::vector<AccessUnit>::iterator i = accessUnitList.begin(); i < accessUnitList.end(); i++) {
-        if (i->accessUnitElements[0].startByteLocation >= bytePos && i->frameType == "I") {
-            bytePos = i->accessUnitElements[0].startByteLocation;
-            return i->frameNumber;
-        }
-    }
-
-    // Didn't fine one? Return the frame number of the last AU
-    return accessUnitList.back().frameNumber;
-}
-
-uint8_t g_pVideoData[1000000];
-
-static void WriteAllFramesToFile(MpegTS_XML &mpts)
-{
-#if DUMP_OUTPUT_FILE
-    int packetSize = mpts.m_mpegTSDescriptor.packetSize;
-    uint8_t* buffer = (uint8_t*)alloca(packetSize);
-
-    for (unsigned int f = 0; f < mpts.m_videoAccessUnitsDecode.size(); f++) {
-        for (auto aue : mpts.m_videoAccessUnitsDecode[f].accessUnitElements) {
-            // Seek to aue.startByteLocation
-            fseek(inputFile, aue.startByteLocation, SEEK_SET);
-
-            for (unsigned int i = 0; i < aue.numPackets; i++) {
-                fread(buffer, packetSize, 1, inputFile);
-
-                uint8_t count = FindData(buffer, packetSize);
-
-                if (count)
-                    fwrite(buffer + count, packetSize - count, 1, g_fpTemp);
-            }
-        }
-    }
-#endif
-}
-
-static void FlushDecoder(MpegTS_XML &mpts)
-{
-    int ret = avcodec_send_packet(g_stream_ctx[0].dec_ctx, NULL);
-
-    while (ret >= 0) {
-        AVFrame* frame = av_frame_alloc();
-        ret = avcodec_receive_frame(g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx, frame);
-        av_frame_free(&frame);
-    }
-
-    //avformat_flush(g_ifmt_ctx);
-    //avio_flush(g_ifmt_ctx->pb);
-    avcodec_flush_buffers(g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx);
-}
-
-AVFrame* MpegTS_XML::GetNextVideoFrameInternal(MpegTS_XML& mpts, uint64_t &bytePos, int seekFrame)
-{
-    AVFrame* pFrame = NULL;
-    unsigned int packetSize = m_mpegTSDescriptor.packetSize;
-    uint8_t* buffer = (uint8_t*)alloca(packetSize + 4);
-
-    if (-1 != seekFrame)
-        m_decodeFrameNumber = seekFrame;
-
-    while (1) {
-        if (m_decodeFrameNumber > m_videoAccessUnitsDecode.size() - 1)
-            return NULL;
-
-        unsigned int numBytes = 0;
-
-        for (auto aue : m_videoAccessUnitsDecode[m_decodeFrameNumber].accessUnitElements) {
-            // Seek to aue.startByteLocation
-            fseek(inputFile, aue.startByteLocation, SEEK_SET);
-
-            for (unsigned int i = 0; i < aue.numPackets; i++) {
-                fread(buffer, packetSize, 1, inputFile);
-
-                uint8_t count = FindData(buffer, packetSize);
-
-                if (count) {
-                    memcpy(g_pVideoData + numBytes, buffer + count, packetSize - count);
-                    numBytes += packetSize - count;
-                }
-            }
-        }
-
-        AVPacket packet;
-        av_init_packet(&packet);
-
-        if (m_videoAccessUnitsDecode[m_decodeFrameNumber].frameType == "I")
-            packet.flags = AV_PKT_FLAG_KEY;
-
-        //memset(&packet, 0, sizeof(packet));
-
-        packet.buf = av_buffer_alloc(numBytes);
-        memcpy(packet.buf->data, g_pVideoData, numBytes);
-
-        packet.data = packet.buf->data;
-        packet.size = packet.buf->size;
-        packet.dts = m_videoAccessUnitsDecode[m_decodeFrameNumber].dts;
-        packet.pts = m_videoAccessUnitsDecode[m_decodeFrameNumber].pts;
-        packet.pos = m_videoAccessUnitsDecode[m_decodeFrameNumber].accessUnitElements[0].startByteLocation;
-
-        m_decodeFrameNumber++;
-
-        int streamIndex = mpts.m_videoStreamIndex;
-
-        //If the packet is from the video stream
-        if (g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            // Send a packet to the decoder
-            int ret = avcodec_send_packet(g_stream_ctx[streamIndex].dec_ctx, &packet);
-
-            // Unref the packet
-            av_packet_unref(&packet);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Error while sending a packet to the decoder\n");
-                break;
-            }
-
-            pFrame = av_frame_alloc();
-
-            if (!pFrame) {
-                av_log(NULL, AV_LOG_ERROR, "Decode thread could not allocate frame\n");
-                ret = AVERROR(ENOMEM);
-                break;
-            }
-
-            // Get a frame from the decoder
-            ret = avcodec_receive_frame(g_stream_ctx[streamIndex].dec_ctx, pFrame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                av_frame_free(&pFrame);
-                continue;
-            } else if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Error while receiving a frame from the decoder\n");
-                av_frame_free(&pFrame);
-                break;
-            }
-
-            if (ret >= 0)
-                break;
-        }
-    }
-
-    if (pFrame)
-        FlipAvFrame(pFrame);
-
-    return pFrame;
-}
-
-static AVFrame* GetNextVideoFrameFFMPEG()
-{
-    AVPacket packet;
-    AVFrame* pFrame = NULL;
-
-    while(av_read_frame(g_ifmt_ctx, &packet) >= 0)
-    {
-        int streamIndex = packet.stream_index;
-
-        //If the packet is from the video stream
-        if (g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            // Send a packet to the decoder
-            int ret = avcodec_send_packet(g_stream_ctx[streamIndex].dec_ctx, &packet);
-
-            // Unref the packet
-            av_packet_unref(&packet);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Error while sending a packet to the decoder\n");
-                break;
-            }
-
-            pFrame = av_frame_alloc();
-
-            if (!pFrame) {
-                av_log(NULL, AV_LOG_ERROR, "Decode thread could not allocate frame\n");
-                ret = AVERROR(ENOMEM);
-                break;
-            }
-
-            // Get a frame from the decoder
-            ret = avcodec_receive_frame(g_stream_ctx[streamIndex].dec_ctx, pFrame);
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-                av_frame_free(&pFrame);
-                continue;
-            } else if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Error while receiving a frame from the decoder\n");
-                av_frame_free(&pFrame);
-                break;
-            }
-
-            if (ret >= 0)
-                break;
-        }
-    }
-
-    if (pFrame)
-        FlipAvFrame(pFrame);
-
-    return pFrame;
-}
-
-static void DoSeekTest()
-{
-    int videoStreamIndex = -1;
-    float duration = 0;
-
-    for (unsigned int streamIndex = 0; streamIndex < g_ifmt_ctx->nb_streams; streamIndex++)
-        if (g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            AVStream* stream = g_ifmt_ctx->streams[streamIndex];
-            duration = (float)stream->duration;
-            videoStreamIndex = streamIndex;
-            break;
-        }
-
-    ImGui_ImplGlfwGL3_NewFrame();
-
-    ImGui::SetNextWindowContentSize(ImVec2(50.f, 2.f));
-    ImGui::Begin("Seek bar"); // Create a window called "Seek bar" and append into it.
-
-    static int seekValueLast = 0;
-    int seekValue = seekValueLast;
-    ImGui::SliderInt("Seek", &seekValue, 1, 100);
-
-    if (seekValueLast != seekValue) {
-        seekValueLast = seekValue;
-
-        float percent = (float)seekValue / 100.f;
-        uint64_t seekTS = (uint64_t)(duration * percent);
-
-        avformat_flush(g_ifmt_ctx);
-        avio_flush(g_ifmt_ctx->pb);
-        avformat_seek_file(g_ifmt_ctx, videoStreamIndex, seekTS, seekTS, seekTS, 0);
-
-        if (g_pFrame)
-            av_frame_free(&g_pFrame);
-
-        g_pFrame = GetNextVideoFrameFFMPEG();
-    }
-
-    bool bNewFrame = true;
-    if (g_pFrame)
-        WriteFrame(g_stream_ctx[videoStreamIndex].dec_ctx, g_pFrame, 0, g_pTexturePresenter, bNewFrame);
-
-    ImGui::End();
-}
-
-static int64_t BytePosOfLastAU(std::vector<AccessUnit> &accessUnitList)
-{
-    AccessUnit lastAccessUnit = accessUnitList.back();
-    return lastAccessUnit.accessUnitElements[0].startByteLocation;
-}
-
-static bool RunGUI(MpegTS_XML &mpts)
-{
-    static PlayState g_playState = eStopped;
-
-    std::string windowTitle = "Mpeg2-Ts Parser GUI: ";
-    windowTitle += mpts.m_mpegTSDescriptor.fileName;
-    if (0 != InitOpenGL(windowTitle))
-        return false;
-
-    g_pTexturePresenter = new TexturePresenter(g_window, "");
-
-    if (NULL == g_pTexturePresenter) {
-        CloseOpenGL();
-        return false;
-    }
-
-    unsigned int err = GLFW_NO_ERROR;
-
-    ImGui::CreateContext();
-    ImGui_ImplGlfwGL3_Init(g_window, true);
-    ImGui::StyleColorsDark();
-
-    int ret = 0;
-    int frame_num = 0;
-    bool bNeedFrame = false;
-
-    unsigned int frameDisplaying = 0;
-    uint64_t fileBytePos = 0;
-    size_t framesToDecode = 0;
-    size_t framesDecoded = 0;
-
-    float red = 114.f;
-    float redInc = -3.f;
-    float green = 144.f;
-    float greenInc = 5.f;
-    float blue = 154.f;
-    float blueInc = 7.f;
-
-    unsigned int numVideoFrames = mpts.m_videoAccessUnitsDecode.size() - 1;
-    size_t bytePosOfLastAU = BytePosOfLastAU(mpts.m_videoAccessUnitsDecode);
-
-    Renderer renderer;
-
-#if DUMP_OUTPUT_FILE
-    WriteAllFramesToFile(mpts);
-    return true;
-#endif
-
-#define FFMPEG_DEMUX 0
-#if FFMPEG_DEMUX
-    avformat_seek_file(g_ifmt_ctx, mpts.m_videoStreamIndex, 0, 0, 0, AVSEEK_FLAG_BYTE);
-    g_pFrame = GetNextVideoFrameFFMPEG();
-#else
-    g_pFrame = mpts.GetNextVideoFrameInternal(mpts, fileBytePos);
-#endif
-
-    if (!g_pFrame) {
-        fprintf(stderr, "Error: Unable to decode %s\n", mpts.m_mpegTSDescriptor.fileName.c_str());
-        return false;
-    }
-
-    bool bNewFrame = true;
-
-    while (!glfwWindowShouldClose(g_window)) {
-        glClearColor(0.f, 0.f, 0.f, 1.f);
-        renderer.Clear();
-
-#define RUN_TEST 0
-#if RUN_TEST
-        DoSeekTest();
-#else
-
-        ImGui_ImplGlfwGL3_NewFrame();
-
-        ImGui::Begin("Playback Controls");
-
-        static int seekValueLast = 0;
-        int seekValue = seekValueLast;
-        ImGui::SliderInt("##Seek", &seekValue, 0, 100);
-
-        ImGui::SameLine();
-
-        //        ImVec4 color = ImVec4(red/255.0f, green/255.0f, blue/255.0f, 1.f);
-        //        ImGui::ColorButton("ColorButton", *(ImVec4*)&color, 0x00020000, ImVec2(20,20));
-
-        // Keyboard or Play Button
-        if ((ImGui::GetIO().KeysDownDuration[32] > 0.f && ImGui::GetIO().KeysDownDuration[32] < 0.04f) ||
-            ImGui::ArrowButton("Play", ImGuiDir_Right)) {
-            if (eStopped == g_playState) {
-                framesToDecode = numVideoFrames - frameDisplaying;
-                g_playState = ePlaying;
-                bNeedFrame = true;
-            } else {
-                g_playState = eStopped;
-                bNeedFrame = false;
-            }
-        }
-
-        // Right Arrow Key
-        if (ImGui::IsKeyPressed(KEY_RIGHT_ARROW)) {
-            g_playState = eStopped;
-            bNeedFrame = true;
-            framesDecoded = 0;
-            framesToDecode = 1;
-        }
-
-        bool bForceSeek = false;
-
-        // Left Arrow Key
-        if (ImGui::IsKeyPressed(KEY_LEFT_ARROW)) {
-            seekValue--;
-            seekValue = MAX(0, seekValue);
-
-            if (seekValueLast == seekValue &&
-                frameDisplaying != 0)
-                bForceSeek = true;
-        }
-
-        fileBytePos = (uint64_t)((float)bytePosOfLastAU * ((float)seekValue / 100.f));
-
-        static size_t lastFileBytePos = 0;
-
-        if (seekValueLast != seekValue ||
-            bForceSeek) {
-            g_playState = eStopped;
-            seekValueLast = seekValue;
-            lastFileBytePos = fileBytePos;
-
-            //avformat_flush(g_ifmt_ctx);
-            //avio_flush(g_ifmt_ctx->pb);
-
-            /* Timestamp based testing with cars_2_toy_story
-            size_t lastTimestamp = 33495336;
-            size_t timeStampPos = (size_t) ((float) lastTimestamp * ((float) seekValue / 100.f));
-            av_seek_frame(g_ifmt_ctx, mpts.m_videoStreamIndex, timeStampPos, 0);
-            */
-
-            if (g_pFrame)
-                av_frame_free(&g_pFrame);
-
-#if FFMPEG_DEMUX
-            //            frameDisplaying = FrameNumberFromBytePos(fileBytePos, mpts.m_videoAccessUnitsPresentation);
-            frameDisplaying = FrameNumberFromBytePos(fileBytePos, mpts.m_videoAccessUnitsDecode);
-            avformat_seek_file(g_ifmt_ctx, mpts.m_videoStreamIndex, fileBytePos, fileBytePos, fileBytePos, AVSEEK_FLAG_BYTE);
-            g_pFrame = GetNextVideoFrameFFMPEG();
-#else
-            FlushDecoder(mpts);
-            //frameDisplaying = FrameNumberFromBytePosInternal(fileBytePos, mpts.m_videoAccessUnitsPresentation);
-            frameDisplaying = FrameNumberFromBytePosInternal(fileBytePos, mpts.m_videoAccessUnitsDecode);
-            g_pFrame = mpts.GetNextVideoFrameInternal(mpts, fileBytePos, frameDisplaying);
-#endif
-
-            // BuildPresentationUnits can skip initial B frames if Open GOP
-            frameDisplaying = mpts.BuildPresentationUnits(frameDisplaying);
-
-            printf("----------\n");
-
-            /*
-                        while(g_pFrame && AV_PICTURE_TYPE_I != g_pFrame->pict_type)
-                        {
-                            switch(g_pFrame->pict_type)
-                            {
-                                case AV_PICTURE_TYPE_P:
-                                    printf("%d: P Frame\n", frameDisplaying);
-                                break;
-
-                                case AV_PICTURE_TYPE_B:
-                                    printf("%d: B Frame\n", frameDisplaying);
-                                break;
-                            }
-
-                            frameDisplaying++;
-
-                            av_frame_free(&g_pFrame);
-
-            #if FFMPEG_DEMUX
-                            g_pFrame = GetNextVideoFrameFFMPEG();
-            #else
-                            g_pFrame = mpts.GetNextVideoFrameInternal(mpts, fileBytePos);
-            #endif
-                        }
-            */
-
-            bNeedFrame = false;
-            bNewFrame = true;
-        } else {
-            // If still frames to read
-            if (bNeedFrame) {
-                if (g_pFrame)
-                    av_frame_free(&g_pFrame);
-
-#if FFMPEG_DEMUX
-                g_pFrame = GetNextVideoFrameFFMPEG();
-#else
-                g_pFrame = mpts.GetNextVideoFrameInternal(mpts, fileBytePos);
-#endif
-
-                if (g_pFrame) {
-                    framesDecoded++;
-
-                    //IncAndClamp(red, redInc, 0.f, 255.f);
-                    //IncAndClamp(green, greenInc, 0.f, 255.f);
-                    //IncAndClamp(blue, blueInc, 0.f, 255.f);
-
-                    frameDisplaying++;
-
-                    if (framesDecoded == framesToDecode)
-                        bNeedFrame = false;
-
-                    float percent = ((float)frameDisplaying / (float)numVideoFrames) * 100.f;
-                    seekValue = (int)percent;
-                    seekValueLast = seekValue;
-                    bNewFrame = true;
-
-                    if (bNewFrame)
-                        mpts.UpdatePresentationUnits(frameDisplaying);
-                }
-            }
-        }
-
-        if (g_pFrame)
-            WriteFrame(g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx, g_pFrame, 0, g_pTexturePresenter, bNewFrame);
-
-        char frameType = ' ';
-
-        if (g_pFrame) {
-            switch (g_pFrame->pict_type) {
-                case AV_PICTURE_TYPE_I:
-                    frameType = 'I';
-                    break;
-                case AV_PICTURE_TYPE_P:
-                    frameType = 'P';
-                    break;
-                case AV_PICTURE_TYPE_B:
-                    frameType = 'B';
-                    break;
-            }
-        }
-
-        ImGui::Text("Displaying:%d of %d, Type:%c, Offset:%llu", frameDisplaying, numVideoFrames, frameType, (int64_t)fileBytePos);
-
-        ImGui::End(); // Seek
-
-        ImGui::Begin("Frames");
-
-        if (ImGui::CollapsingHeader(mpts.m_videoAccessUnitsPresentation[0].esd.name.c_str())) {
-            unsigned int frame = frameDisplaying;
-            unsigned int high = frame + mpts.m_videoAccessUnitsPresentation.size(); // TODO: Make this GOP size
-            high = MIN(high, numVideoFrames);
-
-            if (mpts.m_videoAccessUnitsPresentation.size()) {
-                for (unsigned int i = frame, j = 0; i < high; i++, j++) {
-                    AccessUnit& au = mpts.m_videoAccessUnitsPresentation[j];
-
-                    size_t numPackets = 0;
-                    for (std::vector<AccessUnitElement>::iterator j = au.accessUnitElements.begin(); j < au.accessUnitElements.end(); j++)
-                        numPackets += j->numPackets;
-
-                    if (ImGui::TreeNode((void*)au.frameNumber, "Frame:%u, Type:%s, PTS:%ld, Packets:%llu, PID:%ld", au.frameNumber, au.frameType.c_str(), au.pts, numPackets, au.esd.pid)) {
-                        if (ImGui::SmallButton("View")) {
-                            if (frame > frameDisplaying) {
-                                framesToDecode = frame - frameDisplaying;
-                                bNeedFrame = true;
-                                framesDecoded = 0;
-                            }
-                        };
-
-                        ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
-
-                        for (std::vector<AccessUnitElement>::iterator j = au.accessUnitElements.begin(); j < au.accessUnitElements.end(); j++) {
-                            if ("I" == au.frameType) {
-                                ImGui::TreeNodeEx((void*)(intptr_t)frame, nodeFlags, "Closed GOP:%d Byte Location:%llu, Num Packets:%llu", au.closed_gop, j->startByteLocation, j->numPackets);
-                            } else {
-                                ImGui::TreeNodeEx((void*)(intptr_t)frame, nodeFlags, "Byte Location:%llu, Num Packets:%llu", j->startByteLocation, j->numPackets);
-                            }
-                        }
-
-                        ImGui::TreePop();
-                    }
-
-                    frame++;
-                }
-            }
-        }
-
-        /*
-            unsigned int frame = frameDisplaying;
-
-            unsigned int high = frame + mpts.m_videoAccessUnitsPresentation.size(); // TODO: Make this GOP size
-
-            high = MIN(high, numVideoFrames);
-
-            if(mpts.m_videoAccessUnitsPresentation.size())
-            {
-                if (ImGui::CollapsingHeader(mpts.m_videoAccessUnitsPresentation[0].esd.name.c_str()))
-                {
-                    for(unsigned int i = frame; i < high; i++)
-                    {
-                        AccessUnit &au = mpts.m_videoAccessUnitsPresentation[i];
-
-                        size_t numPackets = 0;
-                        for (std::vector<AccessUnitElement>::iterator j = au.accessUnitElements.begin(); j < au.accessUnitElements.end(); j++)
-                            numPackets += j->numPackets;
-
-                        if(ImGui::TreeNode((void*) au.frameNumber, "Frame:%u, Type:%s, PTS:%ld, Packets:%llu, PID:%ld", au.frameNumber, au.frameType.c_str(), au.pts, numPackets, au.esd.pid))
-                        {
-                            if (ImGui::SmallButton("View"))
-                            {
-                                if(frame > frameDisplaying)
-                                {
-                                    framesToDecode = frame - frameDisplaying;
-                                    bNeedFrame = true;
-                                    framesDecoded = 0;
-                                }
-                            };
-
-                            ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
-
-                            for (std::vector<AccessUnitElement>::iterator j = au.accessUnitElements.begin(); j < au.accessUnitElements.end(); j++)
-                            {
-                                ImGui::TreeNodeEx((void*)(intptr_t)frame, nodeFlags, "Byte Location:%llu, Num Packets:%llu", j->startByteLocation, j->numPackets);
-                            }
-
-                            ImGui::TreePop();
-                        }
-
-                        frame++;
-                    }
-                }
-            }
-    */
-
-    /*
-            frame = 1;
-            if (ImGui::CollapsingHeader("Audio"))
-            {
-                for(std::vector<AccessUnit>::iterator i = mpts.m_audioAccessUnits.begin(); i < mpts.m_audioAccessUnits.end(); i++)
-                {
-                    size_t numPackets = 0;
-                    for (std::vector<AccessUnitElement>::iterator j = i->accessUnitElements.begin(); j < i->accessUnitElements.end(); j++)
-                        numPackets += j->numPackets;
-
-                    if(ImGui::TreeNode((void*) frame, "Frame:%d, Name:%s, Packets:%d, PID:%ld", frame, i->esd.name.c_str(), numPackets, i->esd.pid))
-                    {
-                        for (std::vector<AccessUnitElement>::iterator j = i->accessUnitElements.begin(); j < i->accessUnitElements.end(); j++)
-                        {
-                            if (ImGui::TreeNode((void*)(intptr_t)frame, "Byte Location:%d, Num Packets:%d", j->startByteLocation, j->numPackets))
-                                ImGui::TreePop();
-                        }
-
-                        ImGui::TreePop();
-                    }
-
-                    frame++;
-                }
-            }
-    */
-
-        ImGui::End(); // Frames
-#endif
-
-        ImGui::Render();
-        ImGui_ImplGlfwGL3_RenderDrawData(ImGui::GetDrawData());
-
-        /* Swap front and back buffers */
-        glfwSwapBuffers(g_window);
-
-        /* Poll for and process events */
-        glfwPollEvents();
-
-        bNewFrame = false;
-    }
-
-    if (g_pFrame)
-        av_frame_free(&g_pFrame);
-
-    if (g_pTexturePresenter)
-        delete g_pTexturePresenter;
-
-    ImGui_ImplGlfwGL3_Shutdown();
-    ImGui::DestroyContext();
-
-    CloseOpenGL();
-
-    return true;
-}
-
-static int InitFilter(FilteringContext* fctx,
-    AVStream* st,
-    AVCodecContext* dec_ctx,
-    //AVCodecContext *enc_ctx,
-                      const char *filter_spec)
-{
-    char args[512];
-    int ret = 0;
-
-    const AVFilter* cur_filter = NULL;
-    AVFilterContext* cur_ctx = NULL;
-    AVFilterContext* prev_ctx = NULL;
-
-    //    AVCodecContext *codec_ctx;
-    //    ret = avcodec_parameters_to_context(codec_ctx, st->codecpar);
-
-    AVFilterGraph* filter_graph = avfilter_graph_alloc();
-    if (!filter_graph) {
-        av_log(NULL, AV_LOG_ERROR, "Can not create filter graph\n");
-        ret = AVERROR(ENOMEM);
-        goto end;
-    }
-
-    fctx->filter_graph = filter_graph;
-
-    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-        // Create Video Source
-        //////////////////////
-        cur_filter = avfilter_get_by_name("buffer");
-
-        if (!cur_filter) {
-            av_log(NULL, AV_LOG_ERROR, "Filter video source not found\n");
-            ret = AVERROR_UNKNOWN;
-            goto end;
-        }
-
-        snprintf(args, sizeof(args),
-            "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
-            st->codecpar->width, st->codecpar->height,
-            st->codecpar->format,
-            st->time_base.num, st->time_base.den,
-            st->codecpar->sample_aspect_ratio.num, st->codecpar->sample_aspect_ratio.den,
-            st->r_frame_rate.num, st->r_frame_rate.den);
-
-        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "src",
-            args, NULL, filter_graph);
-
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot create video source\n");
-            goto end;
-        }
-
-        fctx->buffersrc_ctx = cur_ctx;
-        prev_ctx = cur_ctx;
-
-        // dec_ctx num and den are flipped at this point, store into dst un-flipped
-        AVRational dst;
-        dst.num = dec_ctx->time_base.den;
-        dst.den = dec_ctx->time_base.num;
-
-#define DO_DEINTERLACING 0
-#if DO_DEINTERLACING
-
-        // Perform deinterlacing?
-        /////////////////////////
-        if (IsDeinterlacing(fr_code)) {
-            cur_filter = avfilter_get_by_name("yadif");
-
-            if (!cur_filter) {
-                av_log(NULL, AV_LOG_ERROR, "Filter yadif not found\n");
-                ret = AVERROR_UNKNOWN;
-                goto end;
-            }
-
-            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "yadif",
-                NULL, NULL, filter_graph);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot create yadif filter\n");
-                goto end;
-            }
-
-            ret = avfilter_link(prev_ctx, 0,
-                cur_ctx, 0);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot link yadif filter\n");
-                goto end;
-            }
-
-            prev_ctx = cur_ctx;
-        }
-#endif
-
-#define DO_FRAME_RATE_CONVERSION 0
-#if DO_FRAME_RATE_CONVERSION
-
-        // Perform frame rate conversion?
-        /////////////////////////////////
-        if (st->r_frame_rate.num != dst.num ||
-            st->r_frame_rate.den != dst.den) {
-            /*
-            st->codec->field_order
-
-            enum AVFieldOrder {
-                AV_FIELD_UNKNOWN,
-                AV_FIELD_PROGRESSIVE,
-                AV_FIELD_TT,          //< Top coded_first, top displayed first
-                AV_FIELD_BB,          //< Bottom coded first, bottom displayed first
-                AV_FIELD_TB,          //< Top coded first, bottom displayed first
-                AV_FIELD_BT,          //< Bottom coded first, top displayed first
-            };
-            */
-
-            // All of the following code is based on CSourceAssembly::ConfigureAVISynthFRConverter()
-
-            /*
-            if (m_bSourceIsVFR)
-            {
-                // TODO: For the time being, don't convert VFR between PAL and NTSC.
-                // Currently the VFR->CFR is done in the MC FR Converter.
-                // Converting between NTSC/PAL here would lose sync.
-                m_hr = E_INVALIDARG;
-                SetError(ERR_UnsupportedFrameRate, L"BuildVideoPreprocessingPath", L"VFR unsupported in PAL<->NTSC conversion");
-                goto ConfigureAVISynthFRConverter_Failed;
-            }
-            */
-
-            // TODO: Pull this in from the json.
-            bool bIsTelecine = false;
-            EFrameRateConversionCode fr_code = CalculateFrameRateConversion(st->r_frame_rate, dst, bIsTelecine);
-
-            if (fr_code == kNTSCInverseTelecine_to_PAL ||
-                fr_code == kNTSCInverseTelecine_to_NTSCFilm ||
-                fr_code == kNTSC60pInverseTelecine_to_NTSCFilm ||
-                fr_code == kNTSC60pInverseTelecine_to_PAL) {
-                //double frameRate = 23.976;
-                if (fr_code == EFrameRateConversionCode::kNTSC60pInverseTelecine_to_NTSCFilm ||
-                    fr_code == EFrameRateConversionCode::kNTSC60pInverseTelecine_to_PAL) {
-                    // TODO
-                    //wcscpy_s(script, _countof(script), L"TDecimate(cycleR=3, Cycle=5)");
-
-                    // Insert Decimate
-                    /*
-                    cur_filter = avfilter_get_by_name("decimate");
-
-                    if (!cur_filter)
-                    {
-                        av_log(NULL, AV_LOG_ERROR, "Filter decimate not found\n");
-                        ret = AVERROR_UNKNOWN;
-                        goto end;
-                    }
-
-                    ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "decimate",
-                                                       NULL, NULL, filter_graph);
-
-                    if (ret < 0)
-                    {
-                        av_log(NULL, AV_LOG_ERROR, "Cannot create decimate filter\n");
-                        goto end;
-                    }
-
-                    ret = avfilter_link(prev_ctx, 0, cur_ctx, 0);
-
-                    if (ret < 0)
-                    {
-                        av_log(NULL, AV_LOG_ERROR, "Cannot link decimate filter\n");
-                        goto end;
-                    }
-
-                    prev_ctx = cur_ctx;
-                    */
-                } else {
-                    //wcscpy_s(script, _countof(script), L"TFM()TDecimate()");
-
-                    // Insert FieldMatch
-                    cur_filter = avfilter_get_by_name("fieldmatch");
-
-                    if (!cur_filter) {
-                        av_log(NULL, AV_LOG_ERROR, "Filter fieldmatch not found\n");
-                        ret = AVERROR_UNKNOWN;
-                        goto end;
-                    }
-
-                    ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "fieldmatch",
-                        NULL, NULL, filter_graph);
-
-                    if (ret < 0) {
-                        av_log(NULL, AV_LOG_ERROR, "Cannot create fieldmatch filter\n");
-                        goto end;
-                    }
-
-                    ret = avfilter_link(prev_ctx, 0, cur_ctx, 0);
-
-                    if (ret < 0) {
-                        av_log(NULL, AV_LOG_ERROR, "Cannot link fieldmatch filter\n");
-                        goto end;
-                    }
-
-                    prev_ctx = cur_ctx;
-
-                    // Insert Decimate
-                    cur_filter = avfilter_get_by_name("decimate");
-
-                    if (!cur_filter) {
-                        av_log(NULL, AV_LOG_ERROR, "Filter decimate not found\n");
-                        ret = AVERROR_UNKNOWN;
-                        goto end;
-                    }
-
-                    ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "decimate",
-                        NULL, NULL, filter_graph);
-
-                    if (ret < 0) {
-                        av_log(NULL, AV_LOG_ERROR, "Cannot create decimate filter\n");
-                        goto end;
-                    }
-
-                    ret = avfilter_link(prev_ctx, 0, cur_ctx, 0);
-
-                    if (ret < 0) {
-                        av_log(NULL, AV_LOG_ERROR, "Cannot link decimate filter\n");
-                        goto end;
-                    }
-
-                    prev_ctx = cur_ctx;
-                }
-
-                // Speed up video to 25fps if desired (e.g. NTSC film to PAL conversion)
-                if (fr_code == EFrameRateConversionCode::kNTSCInverseTelecine_to_PAL ||
-                    fr_code == EFrameRateConversionCode::kNTSC60pInverseTelecine_to_PAL) {
-                    //wcscat_s(script, _countof(script), L"AssumeFPS(25, 1, sync_audio=false)");
-                    //frameRate = 25.0;
-                    dst.num = 25;
-                    dst.den = 1;
-                } else {
-                    dst.num = 24000;
-                    dst.den = 1001;
-                }
-
-                // Update output frame rate
-                // TODO: code review -- move otu to BuildFilterGraph everything that changes the output frame 
-                //if (m_pTUM->GetFrameRatePassThru() && m_iTranscodeStage == TranscodeStages::kMainContentStage)
-                //    m_pTUM->SetOutputFrameRate(frameRate);
-            } else if (fr_code == kNTSC60p_to_PAL) {
-                /*
-                // Perform frame rate conversion to 50i
-                wcscpy_s(script, _countof(script), L"ChangeFPS(50.00)\n"); // or blend via ConvertFPS
-
-                                                                           // Re-interlace
-                bool isTFF = m_pTUM->IsInterlacedTopFieldFirst();
-                wcscat_s(script, _countof(script), (isTFF) ? L"AssumeTFF()\n" : L"AssumeBFF()\n");
-                wcscat_s(script, _countof(script), L"SeparateFields()\n");
-                wcscat_s(script, _countof(script), L"SelectEvery(4,0,3)\n");
-                wcscat_s(script, _countof(script), L"Weave()\n");
-
-                wcscat_s(script, _countof(script), L"AssumeFPS(25, 1, sync_audio=false)");
-                */
-            }
-
-            cur_filter = avfilter_get_by_name("fps");
-            if (!cur_filter) {
-                av_log(NULL, AV_LOG_ERROR, "Filter fps not found\n");
-                ret = AVERROR_UNKNOWN;
-                goto end;
-            }
-
-            char fps[32];
-            char num[10];
-            char den[10];
-            snprintf(num, sizeof(num), "%d", dst.num);
-            snprintf(den, sizeof(den), "%d", dst.den);
-            strcpy(fps, num);
-            strcat(fps, "/");
-            strcat(fps, den);
-
-            snprintf(args, sizeof(args), "fps=%s", fps);
-
-            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "fps",
-                args, NULL, filter_graph);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot create fps\n");
-                goto end;
-            }
-
-            ret = avfilter_link(prev_ctx, 0,
-                cur_ctx, 0);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot link fps\n");
-                goto end;
-            }
-
-            prev_ctx = cur_ctx;
-        }
-#endif
-
-#define DO_AVISYNTH 0
-#if DO_AVISYNTH
-
-        // Create avisynth?
-        ///////////////////
-        if (g_options.avisynth) {
-            cur_filter = avfilter_get_by_name("avisynth");
-            if (!cur_filter) {
-                av_log(NULL, AV_LOG_ERROR, "Filter avisynth not found\n");
-                ret = AVERROR_UNKNOWN;
-                goto end;
-            }
-
-            snprintf(args, sizeof(args),
-                "script=%s",
-                g_options.avisynth_script);
-
-            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "avisynth",
-                args, NULL, filter_graph);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot create avisynth\n");
-                goto end;
-            }
-
-            ret = avfilter_link(prev_ctx, 0,
-                cur_ctx, 0);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot link avisynth\n");
-                goto end;
-            }
-
-            prev_ctx = cur_ctx;
-        }
-#endif
-
-#define DO_SCALING 0
-#if DO_SCALING
-
-        // Create Video Scaler?
-        ///////////////////////
-        if (enc_ctx->width != st->codecpar->width || enc_ctx->height != st->codecpar->height) {
-            cur_filter = avfilter_get_by_name("scale");
-            if (!cur_filter) {
-                av_log(NULL, AV_LOG_ERROR, "Filter video_scale not found\n");
-                ret = AVERROR_UNKNOWN;
-                goto end;
-            }
-
-            snprintf(args, sizeof(args),
-                "width=%d:height=%d",
-                enc_ctx->width, enc_ctx->height);
-
-            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "scale",
-                args, NULL, filter_graph);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot create video scaler\n");
-                goto end;
-            }
-
-            ret = avfilter_link(prev_ctx, 0,
-                cur_ctx, 0);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot link video scaler\n");
-                goto end;
-            }
-
-            prev_ctx = cur_ctx;
-        }
-#endif
-
-#define DO_VIDEO_TRIM 0
-#if DO_VIDEO_TRIM
-
-        // Create Video Trim?
-        /////////////////////
-        if (g_options.start_time != -1 || g_options.end_time != -1) {
-            cur_filter = avfilter_get_by_name("trim");
-            if (!cur_filter) {
-                av_log(NULL, AV_LOG_ERROR, "Filter video_trim not found\n");
-                ret = AVERROR_UNKNOWN;
-                goto end;
-            }
-
-            memset(args, 0, sizeof(args));
-
-            if (g_options.start_time != -1) {
-                snprintf(args, sizeof(args),
-                    "start=%d",
-                    g_options.start_time);
-            }
-
-            if (g_options.end_time != -1) {
-                char end[32];
-                snprintf(end, sizeof(end),
-                    (g_options.start_time != -1) ? ":end=%d" : "end=%d",
-                    g_options.end_time);
-                strcat(args, end);
-            }
-
-            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "video_trim",
-                args, NULL, filter_graph);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot create video trim\n");
-                goto end;
-            }
-
-            ret = avfilter_link(prev_ctx, 0,
-                cur_ctx, 0);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot link video trim\n");
-                goto end;
-            }
-
-            prev_ctx = cur_ctx;
-        }
-#endif
-
-        // Create Video Sink
-        ////////////////////
-        cur_filter = avfilter_get_by_name("buffersink");
-        if (!cur_filter) {
-            av_log(NULL, AV_LOG_ERROR, "Filter video sink element not found\n");
-            ret = AVERROR_UNKNOWN;
-            goto end;
-        }
-
-        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "sink",
-            NULL, NULL, filter_graph);
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot create video sink\n");
-            goto end;
-        }
-
-        ret = av_opt_set_bin(cur_ctx, "pix_fmts",
-            (uint8_t*)&dec_ctx->pix_fmt, sizeof(dec_ctx->pix_fmt),
-            //(uint8_t*)&enc_ctx->pix_fmt, sizeof(enc_ctx->pix_fmt),
-            AV_OPT_SEARCH_CHILDREN);
-
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot set output pixel format\n");
-            goto end;
-        }
-
-        ret = avfilter_link(prev_ctx, 0,
-            cur_ctx, 0);
-
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot link video sink\n");
-            goto end;
-        }
-
-        fctx->buffersink_ctx = cur_ctx;
-    } else if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
-        // Create the audio source
-        //////////////////////////
-        cur_filter = avfilter_get_by_name("abuffer");
-        if (!cur_filter) {
-            av_log(NULL, AV_LOG_ERROR, "Filter audio source not found\n");
-            ret = AVERROR_UNKNOWN;
-            goto end;
-        }
-
-        snprintf(args, sizeof(args),
-            "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%llx",
-            st->time_base.num, st->time_base.den, st->codecpar->sample_rate,
-            av_get_sample_fmt_name((AVSampleFormat)st->codecpar->format),
-            st->codecpar->channel_layout);
-
-        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "src",
-            args, NULL, filter_graph);
-
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot create audio source\n");
-            goto end;
-        }
-
-        fctx->buffersrc_ctx = cur_ctx;
-        prev_ctx = cur_ctx;
-
-#define DO_AUDIO_TRIM 0
-#if DO_AUDIO_TRIM
-        // Create audio trim?
-        /////////////////////
-        if (g_options.start_time != -1 || g_options.end_time != -1) {
-            cur_filter = avfilter_get_by_name("atrim");
-            if (!cur_filter) {
-                av_log(NULL, AV_LOG_ERROR, "Filter audio_trim not found\n");
-                ret = AVERROR_UNKNOWN;
-                goto end;
-            }
-
-            memset(args, 0, sizeof(args));
-
-            if (g_options.start_time != -1) {
-                snprintf(args, sizeof(args),
-                    "start=%d",
-                    g_options.start_time);
-            }
-
-            if (g_options.end_time != -1) {
-                char end[32];
-                snprintf(end, sizeof(end),
-                    (g_options.start_time != -1) ? ":end=%d" : "end=%d",
-                    g_options.end_time);
-                strcat(args, end);
-            }
-
-            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "audio_trim",
-                args, NULL, filter_graph);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot create audio trim\n");
-                goto end;
-            }
-
-            ret = avfilter_link(prev_ctx, 0,
-                cur_ctx, 0);
-
-            if (ret < 0) {
-                av_log(NULL, AV_LOG_ERROR, "Cannot link audio trim\n");
-                goto end;
-            }
-
-            prev_ctx = cur_ctx;
-        }
-#endif
-
-        // Create the audio sink
-        ////////////////////////
-        cur_filter = avfilter_get_by_name("abuffersink");
-        if (!cur_filter) {
-            av_log(NULL, AV_LOG_ERROR, "Filter audio sink not found\n");
-            ret = AVERROR_UNKNOWN;
-            goto end;
-        }
-
-        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "sink",
-            NULL, NULL, filter_graph);
-
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot create audio sink\n");
-            goto end;
-        }
-
-        ret = avfilter_link(prev_ctx, 0,
-            cur_ctx, 0);
-
-        if (ret < 0) {
-            av_log(NULL, AV_LOG_ERROR, "Cannot link audio sink\n");
-            goto end;
-        }
-
-        fctx->buffersink_ctx = cur_ctx;
-    } else {
-        ret = AVERROR_UNKNOWN;
-        goto end;
-    }
-
-    if ((ret = avfilter_graph_config(filter_graph, NULL)) < 0)
-        goto end;
-
-end:
-    return ret;
-}
-
-static int InitFilters(void)
-{
-    const char* filter_spec;
-    unsigned int i;
-    int ret;
-
-    g_filter_ctx = (FilteringContext*)av_malloc_array(g_ifmt_ctx->nb_streams, sizeof(*g_filter_ctx));
-
-    if (!g_filter_ctx)
-        return AVERROR(ENOMEM);
-
-#ifdef DEBUG
-    char p_graph[2048] = { 0 };
-#endif
-
-    for (i = 0; i < g_ifmt_ctx->nb_streams; i++) {
-        g_filter_ctx[i].buffersrc_ctx = NULL;
-        g_filter_ctx[i].buffersink_ctx = NULL;
-        g_filter_ctx[i].filter_graph = NULL;
-
-        if (!(g_ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO
-            || g_ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO))
-            continue;
-
-        if (g_ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
-            filter_spec = "null"; /* passthrough (dummy) filter for video */
-        else
-            filter_spec = "anull"; /* passthrough (dummy) filter for audio */
-
-        ret = InitFilter(&g_filter_ctx[i],
-            g_ifmt_ctx->streams[i],
-            //g_stream_ctx[i].enc_ctx,
-            g_stream_ctx[i].dec_ctx,
-            filter_spec);
-
-        if (ret)
-            return ret;
-
-#ifdef DEBUG
-        strcpy(p_graph, avfilter_graph_dump(g_filter_ctx[i].filter_graph, NULL));
-#endif
-    }
-
-    return 0;
-}
-
-// It all starts here
-int main(int argc, char* argv[])
-{
-    //    DoMyXMLTest(argv[1]);
-    //    DoMyXMLTest2();
-    //    return 0;
-
-    /*
-        if(1)
-        {
-            DoFFMpegOpenGLTest("F:\\streams\\mpeg2\\muppets_take_manhattan.mpg");
-            return 0;
-        }
-    */
-
-    if (1 == argc) {
-        fprintf(stderr, "Usage: %s input.xml\n", argv[0]);
-        fprintf(stderr, "  The file input.xml is generated by mpts_parser\n");
-        return 1;
-    }
-
-    printf("%s: Opening and analyzing %s, this can take a while...\n", argv[0], argv[1]);
-
-    // Open the source xml file that describes the MPTS
-    tinyxml2::XMLDocument doc;
-    tinyxml2::XMLError xmlError = doc.LoadFile(argv[1]);
-
-    if (tinyxml2::XML_SUCCESS != xmlError) {
-        fprintf(stderr, "Error: TinyXml2 could not open file: %s\n", argv[1]);
-        return 1;
-    }
-
-    tinyxml2::XMLElement* root = doc.FirstChildElement("file");
-
-    if (nullptr == root) {
-        fprintf(stderr, "Error: %s does not contain a <file> element at the start!\n", argv[1]);
-        return 1;
-    }
-
-    MpegTS_XML mpts;
-
-    mpts.ParsePMT(root);
-
-    // Get simple info about the file
-    mpts.ParseMpegTSDescriptor(root);
-
-    // Build current access units
-    mpts.ParsePacketList(root);
-
-    if (0 != OpenInputFile(mpts))
-        return 1;
-
-    inputFile = fopen(mpts.m_mpegTSDescriptor.fileName.c_str(), "rb");
-
-    if (0 != InitFilters())
-        return 1;
-
-    // Show as GUI
-    if (RunGUI(mpts)) {
-        CloseInputFile(mpts);
-        fclose(inputFile);
-        return 0;
-    }
-
-    return 1;
+/*
+    Original code by Mike Cancilla (https://github.com/mikecancilla)
+    2019
+
+    This software is provided 'as-is', without any express or implied
+    warranty. In no event will the authors be held liable for any
+    damages arising from the use of this software.
+
+    Permission is granted to anyone to use this software for any
+    purpose, including commercial applications, and to alter it and
+    redistribute it freely, subject to the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must
+    not claim that you wrote the original software. If you use this
+    software in a product, an acknowledgment in the product documentation
+    would be appreciated but is not required.
+
+    2. Altered source versions must be plainly marked as such, and
+    must not be misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source
+    distribution.
+*/
+
+/*
+    This program is still under development!
+
+    Known Issues:
+
+    - Only handles the first Video and Audio stream
+    - GUI does not talk to decoder
+    - Needs to feed a decoder
+*/
+
+#define DUMP_OUTPUT_FILE 0
+
+#include <cstdio>
+#include <cstring>
+#include <cstdarg>
+#include <cstdlib>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <new>
+#include <mutex>
+
+// OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// GLM
+#include "glm.hpp"
+#include "gtc/matrix_transform.hpp"
+
+// ImGUI
+#include "imgui.h"
+#include "imgui_impl_glfw_gl3.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libavfilter/buffersink.h>
+    #include <libavfilter/buffersrc.h>
+    #include <libavutil/common.h>
+    #include <libavutil/opt.h>
+    #include <libavutil/pixdesc.h>
+    #include <libavutil/threadmessage.h>
+    #include <libavutil/time.h>
+    #include <libavutil/audio_fifo.h>
+    #include <libswresample/swresample.h>
+    #include <libavutil/frame.h>
+    #include <libswscale/swscale.h>
+    #include <libavutil/imgutils.h>
+    #include <libavutil/adler32.h>
+}
+
+// My OpenGL Classes
+#include "Renderer.h"
+#include "Texture.h"
+#include "VertexBufferLayout.h"
+#include "TexturePresenter.h"
+
+#include "mp2ts_xml.h"
+#include "mp2ts_gzip.h"
+#include "mp2ts_input.h"
+#include "mp2ts_avio.h"
+#include "mp2ts_demux.h"
+#include "mp2ts_frame.h"
+#include "mp2ts_profiler.h"
+#include "mp2ts_metrics.h"
+#include "mp2ts_memory.h"
+#include "mp2ts_budget.h"
+#include "mp2ts_page_cache.h"
+#include "mp2ts_frame_table.h"
+#include "mp2ts_timeline.h"
+#include "mp2ts_conformance.h"
+#include "mp2ts_programs.h"
+
+extern void DoMyXMLTest(char *pXMLFile);
+extern void DoMyXMLTest2();
+extern int DoFFMpegOpenGLTest(const std::string &inFileName);
+
+#define WINDOW_WIDTH 1600
+#define WINDOW_HEIGHT 900
+
+#define KEY_RIGHT_ARROW 262
+#define KEY_LEFT_ARROW 263
+
+// GUI frame time spent copying rows into the Frames table until it has them all
+#define FRAME_TABLE_FILL_MS 4.0
+
+// Frame size timeline above the seek bar
+#define TIMELINE_HEIGHT 60.f
+#define TIMELINE_MIN_FRAMES 8.0
+#define TIMELINE_MARK_HEIGHT 6.f
+#define TIMELINE_PCR_HEIGHT 30.f
+
+#define MIN(x,y) ((x) < (y) ? (x) : (y))
+#define MAX(x,y) ((x) > (y) ? (x) : (y))
+
+enum PlayState
+{
+    eStopped,
+    ePlaying,
+    eSeeking
+};
+
+typedef struct StreamContext {
+    AVCodecContext *dec_ctx;
+//    AVCodecContext *enc_ctx;
+    AVAudioFifo *audio_fifo;
+} StreamContext;
+
+typedef struct FilteringContext {
+    AVFilterContext *buffersink_ctx;
+    AVFilterContext *buffersrc_ctx;
+    AVFilterGraph *filter_graph;
+} FilteringContext;
+
+#if DUMP_OUTPUT_FILE
+static FILE *g_fpTemp = NULL;
+#endif
+
+static InputSource *g_pInput = NULL;
+static PacketSource *g_pPacketSource = NULL;
+static VideoDecoder *g_pDecoder = NULL;
+
+struct AnalyzerOptions
+{
+    const char      *xmlFileName;
+    eInputBackend   inputBackend;
+    eDemuxBackend   demuxBackend;
+    bool            bBenchDemux;
+    bool            bBenchSeek;
+    unsigned int    seeksPerPattern;
+    unsigned int    seed;
+    bool            bProfile;
+    const char      *traceFileName;
+    const char      *metricsTarget;
+    unsigned int    metricsInterval;
+    bool            bMemReport;
+    uint64_t        memLimit;
+    uint64_t        indexCache;
+    bool            bFullLoad;
+    bool            bCheck;
+    const char      *pcrFileName;
+    int             programNumber;
+    bool            bAnalyzePrograms;
+    unsigned int    numWorkers;
+
+    AnalyzerOptions()
+        : xmlFileName(NULL)
+        , inputBackend(eInputPread)
+        , demuxBackend(eDemuxInternal)
+        , bBenchDemux(false)
+        , bBenchSeek(false)
+        , seeksPerPattern(200)
+        , seed(1)
+        , bProfile(false)
+        , traceFileName(NULL)
+        , metricsTarget(NULL)
+        , metricsInterval(10)
+        , bMemReport(false)
+        , memLimit(0)
+        , indexCache(PAGE_CACHE_DEFAULT)
+        , bFullLoad(false)
+        , bCheck(false)
+        , pcrFileName(NULL)
+        , programNumber(-1)
+        , bAnalyzePrograms(false)
+        , numWorkers(0)
+    {
+    }
+};
+
+static AnalyzerOptions g_options;
+
+// Describes the input file
+static AVFormatContext  *g_ifmt_ctx = NULL;
+static AVIOContext      *g_avio_ctx = NULL;
+static StreamContext    *g_stream_ctx = NULL;
+static AVFrame          *g_pFrame = NULL;
+static GLFWwindow       *g_window = NULL;
+static TexturePresenter *g_pTexturePresenter = NULL;
+static FilteringContext *g_filter_ctx = NULL;
+
+static char             g_error[AV_ERROR_MAX_STRING_SIZE] = {0};
+
+// Every allocation is charged to the subsystem of the current MemoryScope.  All forms
+// free through MemoryTaggedFree(), so any delete matches any new.
+static void* TaggedNew(size_t size, size_t alignment = 16)
+{
+    if (void* p = MemoryTaggedAlloc(size, alignment))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size)
+{
+    return TaggedNew(size);
+}
+
+void* operator new[](size_t size)
+{
+    return TaggedNew(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return MemoryTaggedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return MemoryTaggedAlloc(size);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete(void* p) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+    return TaggedNew(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+    return TaggedNew(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return MemoryTaggedAlloc(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return MemoryTaggedAlloc(size, (size_t)alignment);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    MemoryTaggedFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    MemoryTaggedFree(p);
+}
+#endif
+
+static int InitFilter(FilteringContext *fctx,
+                      AVStream *st,
+                      AVCodecContext *dec_ctx,
+                      //AVCodecContext *enc_ctx,
+                      const char *filter_spec);
+static int InitFilters();
+
+template <typename T>
+void IncAndClamp(T &value, T &incBy, T min, T max)
+
+{
+    value += incBy;
+
+    if(value < min)
+    {
+        value = min;
+        incBy *= (T) -1;
+    }
+    else if(value > max)
+    {
+        value = max;
+        incBy *= (T) -1;
+    }
+}
+
+static int OpenInputFile(MpegTS_XML &mpts)
+{
+    int ret;
+    g_ifmt_ctx = NULL;
+    std::string inFileName = mpts.m_mpegTSDescriptor.fileName;
+
+    av_log_set_level(AV_LOG_VERBOSE);
+
+    // FFmpeg reads through our own I/O backend rather than opening the file itself
+    g_ifmt_ctx = avformat_alloc_context();
+    g_avio_ctx = CreateInputAVIOContext(g_pInput);
+
+    if (!g_ifmt_ctx || !g_avio_ctx)
+        return AVERROR(ENOMEM);
+
+    g_ifmt_ctx->pb = g_avio_ctx;
+
+    if ((ret = avformat_open_input(&g_ifmt_ctx, inFileName.c_str(), NULL, NULL)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Cannot open input file: %s\n", av_make_error_string(g_error, AV_ERROR_MAX_STRING_SIZE, ret));
+        return ret;
+    }
+
+    if ((ret = avformat_find_stream_info(g_ifmt_ctx, NULL)) < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Cannot find stream information\n");
+        return ret;
+    }
+
+    g_stream_ctx = (StreamContext *)av_mallocz_array(g_ifmt_ctx->nb_streams, sizeof(*g_stream_ctx));
+    if (!g_stream_ctx)
+        return AVERROR(ENOMEM);
+
+    bool bWantVideoIndex = true;
+    bool bWantAudioIndex = true;
+
+    // The streams of the played program, by PID, which the mpegts demuxer keeps in AVStream::id.
+    // Without a PMT in the XML the first video and audio stream are taken.
+    long videoPID = mpts.VideoPID();
+    long audioPID = mpts.AudioPID();
+
+    for(unsigned int streamIndex = 0; streamIndex < g_ifmt_ctx->nb_streams; streamIndex++)
+    {
+        int pid = g_ifmt_ctx->streams[streamIndex]->id;
+
+        if(g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+        {
+            if(bWantVideoIndex && (-1 == videoPID || pid == videoPID))
+            {
+                mpts.m_videoStreamIndex = streamIndex;
+                bWantVideoIndex = false;
+                continue;
+            }
+        }
+
+        if(g_ifmt_ctx->streams[streamIndex]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+        {
+            if(bWantAudioIndex && (-1 == audioPID || pid == audioPID))
+            {
+                mpts.m_audioStreamIndex = streamIndex;
+                bWantAudioIndex = false;
+                continue;
+            }
+        }
+    }
+
+    if(-1 == mpts.m_videoStreamIndex)
+    {
+        fprintf(stderr, "Error: No video stream found in source file!!\n");
+        return AVERROR_STREAM_NOT_FOUND;
+    }
+        
+    AVStream *stream = g_ifmt_ctx->streams[mpts.m_videoStreamIndex];
+        
+    AVCodec *dec = avcodec_find_decoder(stream->codecpar->codec_id);
+    AVCodecContext *codec_ctx = NULL;
+
+    if (!dec)
+        return AVERROR_DECODER_NOT_FOUND;
+
+    codec_ctx = avcodec_alloc_context3(dec);
+    if (!codec_ctx)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to allocate the decoder context for stream #%u\n", mpts.m_videoStreamIndex);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = avcodec_parameters_to_context(codec_ctx, stream->codecpar);
+    if (ret < 0)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Failed to copy decoder parameters to input decoder context "
+            "for stream #%u\n", mpts.m_videoStreamIndex);
+        return ret;
+    }
+
+    codec_ctx->framerate = av_guess_frame_rate(g_ifmt_ctx, stream, NULL);
+
+    // Open decoder
+    ret = avcodec_open2(codec_ctx, dec, NULL);
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR, "Failed to open decoder for stream #%u\n", mpts.m_videoStreamIndex);
+        return ret;
+    }
+
+    g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx = codec_ctx;
+
+    av_dump_format(g_ifmt_ctx, 0, inFileName.c_str(), 0);
+
+#if DUMP_OUTPUT_FILE
+    g_fpTemp = fopen("C:\\Temp\\temp.mpg", "wb");
+#endif
+
+    return 0;
+}
+
+static int CloseInputFile(MpegTS_XML &mpts)
+{
+    for(unsigned int i = 0; i < g_ifmt_ctx->nb_streams; i++)
+    {
+        if(&(g_stream_ctx[i]))
+            avcodec_free_context(&g_stream_ctx[i].dec_ctx);
+    }
+
+    avformat_close_input(&g_ifmt_ctx);
+    FreeInputAVIOContext(&g_avio_ctx);
+
+#if DUMP_OUTPUT_FILE
+    if(g_fpTemp)
+        fclose(g_fpTemp);
+#endif
+
+    return 0;
+}
+
+static int InitOpenGL(std::string windowTitle)
+{
+    /* Initialize the library */
+    if(!glfwInit())
+        return -1;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+    /* Create a windowed mode window and its OpenGL context */
+    g_window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, windowTitle.c_str(), NULL, NULL);
+    if (!g_window)
+    {
+        fprintf(stderr, "Could not create GL window! Continuing without a GUI!\n");
+        glfwTerminate();
+        return -1;
+    }
+
+    /* Make the window's context current */
+    glfwMakeContextCurrent(g_window);
+
+    glfwSwapInterval(1);
+
+    if(glewInit() != GLEW_OK)
+    {
+        fprintf(stderr, "Glew Initialization Error! Continuing without a GUI!\n");
+        glfwTerminate();
+        return -1;
+    }
+
+    return 0;
+}
+
+static int CloseOpenGL()
+{
+    glfwTerminate();
+    return 0;
+}
+
+static uint8_t* dst_data[4];
+static int dst_linesize[4];
+
+static bool WriteFrame(AVCodecContext* dec_ctx,
+    AVFrame* frame,
+    int frame_num,
+    TexturePresenter* pTexturePresenter,
+                       bool bNewFrame)
+{
+    if (bNewFrame && !ConvertFrameToRGBA(frame, dec_ctx->width, dec_ctx->height, dst_data, dst_linesize))
+        return false;
+
+    PROFILE_SCOPE(eProfileUpload);
+
+    pTexturePresenter->Render(dst_data[0], dec_ctx->width, dec_ctx->height);
+
+    return true;
+}
+
+static void WriteAllFramesToFile(MpegTS_XML &mpts)
+{
+#if DUMP_OUTPUT_FILE
+    int packetSize = mpts.m_mpegTSDescriptor.packetSize;
+    std::vector<AccessUnitElement> elements;
+    std::vector<uint8_t> payload;
+
+    for (unsigned int f = 0; f < mpts.m_videoAccessUnitsDecode.size(); f++) {
+        mpts.GetVideoAccessUnitElements(mpts.m_videoAccessUnitsDecode[f], elements);
+
+        payload.resize(MaxPayloadSize(elements, packetSize));
+
+        size_t numBytes = ReadAccessUnitPayload(g_pInput, elements, packetSize, payload.data());
+
+        if (numBytes)
+            fwrite(payload.data(), numBytes, 1, g_fpTemp);
+    }
+#endif
+}
+
+static AVFrame* GetNextVideoFrame()
+{
+    AVFrame* pFrame = g_pDecoder->DecodeNextFrame(g_pPacketSource);
+
+    if (pFrame)
+        FlipAvFrame(pFrame);
+
+    return pFrame;
+}
+
+// Restarts decoding at the AU with decode order frameNumber, which starts at bytePos
+static AVFrame* SeekToFrame(unsigned int frameNumber, uint64_t bytePos)
+{
+    uint64_t start = MetricsNow();
+
+    g_pDecoder->Flush();
+
+    if (!g_pPacketSource->Seek(frameNumber, bytePos))
+        return NULL;
+
+    AVFrame* pFrame = GetNextVideoFrame();
+
+    if (pFrame)
+        MetricsObserve(eMetricSeek, MetricsNow() - start);
+
+    return pFrame;
+}
+
+static int64_t BytePosOfLastAU(MpegTS_XML &mpts)
+{
+    return mpts.VideoFirstByteLocation(mpts.m_videoAccessUnitsDecode.back());
+}
+
+// Milliseconds per GUI frame for every stage of the pipeline
+static void DrawPerformanceWindow()
+{
+    ImGui::Begin("Performance");
+
+    bool bEnabled = ProfilerEnabled();
+    if (ImGui::Checkbox("Profile", &bEnabled))
+        ProfilerEnable(bEnabled);
+
+    ImGui::SameLine();
+
+    static char traceFileName[256] = "mp2ts_trace.json";
+
+    if (ImGui::Button("Save Chrome Trace"))
+        ProfilerWriteChromeTrace(traceFileName);
+
+    ImGui::SameLine();
+    ImGui::PushItemWidth(-1.f);
+    ImGui::InputText("##TraceFile", traceFileName, sizeof(traceFileName));
+    ImGui::PopItemWidth();
+
+    ImGui::Text("Events:%llu, Dropped:%llu", ProfilerEventCount(), ProfilerDroppedEvents());
+
+    for (int stage = 0; stage <= eProfileNumStages; stage++) {
+        int offset = 0;
+        const float* pHistory = ProfilerHistory((eProfileStage)stage, offset);
+
+        // Most recent frame is the one before offset
+        float last = pHistory[(offset + PROFILER_HISTORY - 1) % PROFILER_HISTORY];
+
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.3f ms", last);
+
+        ImGui::PlotLines(ProfileStageName((eProfileStage)stage), pHistory, PROFILER_HISTORY, offset, overlay, 0.f, FLT_MAX, ImVec2(0.f, 40.f));
+    }
+
+    ImGui::End(); // Performance
+}
+
+// Current and peak bytes per subsystem
+static void DrawMemoryWindow(const MpegTS_XML &mpts)
+{
+    ImGui::Begin("Memory");
+
+    ImGui::Columns(3, "MemoryColumns");
+    ImGui::Text("Subsystem");
+    ImGui::NextColumn();
+    ImGui::Text("Current (KB)");
+    ImGui::NextColumn();
+    ImGui::Text("Peak (KB)");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (int i = 0; i < eMemNumSubsystems; i++) {
+        eMemSubsystem subsystem = (eMemSubsystem)i;
+
+        ImGui::Text("%s", MemorySubsystemName(subsystem));
+        ImGui::NextColumn();
+        ImGui::Text("%llu", MemoryCurrent(subsystem) / 1024);
+        ImGui::NextColumn();
+        ImGui::Text("%llu", MemoryPeak(subsystem) / 1024);
+        ImGui::NextColumn();
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Total");
+    ImGui::NextColumn();
+    ImGui::Text("%llu", MemoryTotal() / 1024);
+    ImGui::NextColumn();
+    ImGui::Text("%llu", MemoryTotalPeak() / 1024);
+    ImGui::NextColumn();
+
+    ImGui::Columns(1);
+
+    if (BudgetLimit())
+        ImGui::Text("Cap:%llu MB, Evictable:%llu KB, Evictions:%llu (%llu KB)", BudgetLimit() >> 20, BudgetEvictableBytes() / 1024, BudgetEvictions(), BudgetEvictedBytes() / 1024);
+    else
+        ImGui::Text("No memory cap, see --mem-limit");
+
+    ImGui::Text("AU index pages: %llu KB resident of %llu MB", PagedStore::CacheResidentBytes() / 1024, PagedStore::CacheLimit() >> 20);
+
+    if (mpts.LazyChunks()) {
+        ImGui::Text("XML chunks parsed: %u of %u", mpts.LazyChunksLoaded(), mpts.LazyChunks());
+
+        if (mpts.LazyChunksFailed())
+            ImGui::Text("XML chunks that failed: %u, their frames are missing", mpts.LazyChunksFailed());
+    }
+
+    ImGui::End(); // Memory
+}
+
+// Every program of the PAT and every stream of its PMT with the AUs indexed for it.
+// The streams the player and timeline use are marked.  Analyze reads the file again
+// on its own threads and adds GOPs, A/V sync and sampled decodes of every program.
+static void DrawStreamsWindow(const MpegTS_XML &mpts, ProgramAnalyzer &analyzer)
+{
+    ImGui::Begin("Streams");
+
+    ImGui::Columns(5, "StreamColumns");
+    ImGui::Text("Program");
+    ImGui::NextColumn();
+    ImGui::Text("PID");
+    ImGui::NextColumn();
+    ImGui::Text("Type");
+    ImGui::NextColumn();
+    ImGui::Text("AUs");
+    ImGui::NextColumn();
+    ImGui::Text("Played");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (size_t p = 0; p < mpts.Programs().size(); p++) {
+        const TransportProgram &program = mpts.Programs()[p];
+
+        ImGui::Text("%u", program.programNumber);
+        ImGui::NextColumn();
+        if (program.pcrPID >= 0)
+            ImGui::Text("PMT 0x%04lX, PCR 0x%04lX", program.pmtPID, program.pcrPID);
+        else
+            ImGui::Text("PMT 0x%04lX, PCR none", program.pmtPID);
+        ImGui::NextColumn();
+        ImGui::NextColumn();
+        ImGui::NextColumn();
+        ImGui::Text("%s", (int)p == mpts.PlayedProgram() ? "*" : "");
+        ImGui::NextColumn();
+
+        for (size_t s : program.streams) {
+            const ElementaryStream &stream = mpts.Streams()[s];
+            bool bPlayed = stream.pAccessUnits == &mpts.m_videoAccessUnitsDecode || stream.pAccessUnits == &mpts.m_audioAccessUnits;
+
+            ImGui::NextColumn();
+            ImGui::Text("0x%04lX", stream.esd.pid);
+            ImGui::NextColumn();
+            ImGui::Text("0x%02X %s", stream.esd.streamType, stream.esd.name.c_str());
+            ImGui::NextColumn();
+            ImGui::Text("%u", stream.pAccessUnits->size());
+            ImGui::NextColumn();
+            ImGui::Text("%s", bPlayed ? "*" : "");
+            ImGui::NextColumn();
+        }
+    }
+
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    if (!analyzer.IsStarted()) {
+        if (ImGui::Button("Analyze")) {
+            // The async backend charges the memory budget, which is not thread safe
+            eInputBackend backend = eInputMmap == g_options.inputBackend ? eInputMmap : eInputPread;
+            analyzer.Start(mpts, backend, g_options.numWorkers);
+        }
+
+        ImGui::SameLine();
+        ImGui::Text("GOPs, A/V sync, bit rate and sampled decodes of every program in one pass");
+
+        ImGui::End(); // Streams
+        return;
+    }
+
+    if (!analyzer.IsDone()) {
+        float fraction = analyzer.BytesTotal() ? (float)((double)analyzer.BytesRead() / (double)analyzer.BytesTotal()) : 0.f;
+        ImGui::ProgressBar(fraction);
+
+        ImGui::End(); // Streams
+        return;
+    }
+
+    ImGui::Text("%zu programs on %u workers in %.2f seconds", analyzer.Programs(), analyzer.Workers(), analyzer.Seconds());
+
+    ImGui::Columns(7, "ProgramColumns");
+    ImGui::Text("Program");
+    ImGui::NextColumn();
+    ImGui::Text("Mbit/s");
+    ImGui::NextColumn();
+    ImGui::Text("Frames I/P/B");
+    ImGui::NextColumn();
+    ImGui::Text("GOP min/mean/max");
+    ImGui::NextColumn();
+    ImGui::Text("A/V ms min/mean/max");
+    ImGui::NextColumn();
+    ImGui::Text("Quantiser");
+    ImGui::NextColumn();
+    ImGui::Text("Decoded, luma");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (size_t i = 0; i < analyzer.Programs(); i++) {
+        const ProgramReport &report = analyzer.Report(i);
+
+        ImGui::Text("%u", report.programNumber);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", report.bitsPerSecond / 1000000.0);
+        ImGui::NextColumn();
+        ImGui::Text("%u/%u/%u", report.framesOfType[0], report.framesOfType[1], report.framesOfType[2]);
+        ImGui::NextColumn();
+
+        if (report.gops)
+            ImGui::Text("%u/%.1f/%u", report.minGOPLength, report.meanGOPLength, report.maxGOPLength);
+
+        ImGui::NextColumn();
+
+        if (report.avSamples)
+            ImGui::Text("%.0f/%.0f/%.0f", report.minAVOffsetMs, report.meanAVOffsetMs, report.maxAVOffsetMs);
+
+        ImGui::NextColumn();
+
+        if (report.meanQuantiserScale > 0.0)
+            ImGui::Text("%.1f", report.meanQuantiserScale);
+
+        ImGui::NextColumn();
+
+        if (report.framesDecoded)
+            ImGui::Text("%u of %u, %dx%d, luma %.0f, darkest %.0f", report.framesDecoded, report.framesDecoded + report.decodeErrors,
+                        report.width, report.height, report.meanLuma, report.minLuma);
+        else if (report.decodeErrors)
+            ImGui::Text("0 of %u", report.decodeErrors);
+
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+
+    ImGui::End(); // Streams
+}
+
+// TS rate of one PCR PID under the frame sizes, over the same frames.  Each column spans the
+// lowest to the highest instantaneous rate of its PCRs, the line is the piecewise constant
+// rate and PCRs past the TR 101 290 accuracy get a red mark.
+static void DrawPCRTrack(const PCRTrack &track, const FrameTable &frameTable, double viewFirst, double framesPerPixel, uint32_t frames, float width)
+{
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("##PCRTrack", ImVec2(width, TIMELINE_PCR_HEIGHT));
+
+    size_t samples = track.Samples();
+
+    if (0 == samples)
+        return;
+
+    bool bHovered = ImGui::IsItemHovered();
+    int mouseX = (int)(ImGui::GetIO().MousePos.x - origin.x);
+
+    float bottom = origin.y + TIMELINE_PCR_HEIGHT;
+    float scale = track.Summary().maxBitsPerSecond > 0.0 ? (TIMELINE_PCR_HEIGHT - 2.f) / (float)track.Summary().maxBitsPerSecond : 0.f;
+
+    ImDrawList *pDrawList = ImGui::GetWindowDrawList();
+    pDrawList->AddRectFilled(origin, ImVec2(origin.x + width, bottom), IM_COL32(20, 20, 20, 255));
+
+    static std::vector<ImVec2> segmentRates;
+    segmentRates.clear();
+
+    for (int x = 0; x < (int)width; x++) {
+        uint32_t first = (uint32_t)(viewFirst + x * framesPerPixel);
+        uint32_t last = MAX(first + 1, (uint32_t)(viewFirst + (x + 1) * framesPerPixel));
+
+        if (first >= frames)
+            break;
+
+        // The PCRs sent with these frames, at least the one that ends the interval they are in
+        uint64_t begin = frameTable.Row(first).firstByteLocation;
+        uint64_t end = last < frames ? frameTable.Row(last).firstByteLocation : UINT64_MAX;
+        size_t sample = track.FirstSampleAt(begin);
+
+        if (sample >= samples)
+            break;
+
+        size_t sampleEnd = MIN(samples, MAX(track.FirstSampleAt(end), sample + 1));
+
+        float lowest = FLT_MAX;
+        float highest = 0.f;
+        bool bInaccurate = false;
+
+        for (size_t i = sample; i < sampleEnd; i++) {
+            float bitsPerSecond = track.BitsPerSecond(i);
+
+            if (bitsPerSecond > 0.f) {
+                lowest = MIN(lowest, bitsPerSecond);
+                highest = MAX(highest, bitsPerSecond);
+            }
+
+            if (fabsf(track.AccuracyNs(i)) > PCR_ACCURACY_NS)
+                bInaccurate = true;
+        }
+
+        float px = origin.x + x + 0.5f;
+
+        if (highest > 0.f)
+            pDrawList->AddLine(ImVec2(px, bottom - lowest * scale), ImVec2(px, bottom - highest * scale - 1.f), IM_COL32(80, 150, 90, 255));
+
+        if (bInaccurate)
+            pDrawList->AddLine(ImVec2(px, origin.y), ImVec2(px, origin.y + TIMELINE_MARK_HEIGHT), IM_COL32(230, 60, 60, 255));
+
+        segmentRates.push_back(ImVec2(px, bottom - track.SegmentBitsPerSecond(sample) * scale));
+
+        if (bHovered && x == mouseX) {
+            ImGui::SetTooltip("PCR PID 0x%04X, PCR:%llu, Offset:%llu\n%.3f Mbit/s, Segment:%.3f Mbit/s\nAccuracy:%.0f ns, Jitter:%.0f ns",
+                              track.PID(), (unsigned long long)track.PCR(sample), (unsigned long long)track.Offset(sample),
+                              track.BitsPerSecond(sample) / 1000000.0, track.SegmentBitsPerSecond(sample) / 1000000.0,
+                              track.AccuracyNs(sample), track.JitterNs(sample));
+        }
+    }
+
+    pDrawList->AddPolyline(segmentRates.data(), (int)segmentRates.size(), IM_COL32(230, 230, 230, 255), false, 1.f);
+}
+
+// Compressed frame sizes of the file, above the seek bar.  Each pixel column spans the
+// smallest to the largest frame under it, the line is their average.  The wheel zooms,
+// dragging with the right button pans, a double click shows the whole file again and
+// a click seeks there.  Columns with conformance errors get a red mark along the top,
+// and once the check is done the TS rate of the PCR PID pcrTrack is drawn below.
+// Returns false while it is collapsed, a lazily opened index starts out that way.
+static bool DrawTimeline(const MpegTS_XML &mpts, const FrameSizePyramid &sizePyramid, const FrameTable &frameTable, const ConformanceChecker &checker, size_t pcrTrack, unsigned int frameDisplaying, uint64_t bytePosOfLastAU, int &seekValue)
+{
+    static double viewFirst = 0.0;
+    static double viewFrames = 0.0;
+
+    if (!ImGui::CollapsingHeader("Frame Sizes", mpts.LazyChunks() ? 0 : ImGuiTreeNodeFlags_DefaultOpen))
+        return false;
+
+    if (!sizePyramid.IsReady()) {
+        ImGui::Text("Reading frame sizes: %u of %u", frameTable.RowsFilled(), frameTable.Rows());
+        return true;
+    }
+
+    uint32_t frames = sizePyramid.Frames();
+
+    if (0 == frames)
+        return true;
+
+    float width = MAX(ImGui::GetContentRegionAvail().x, 1.f);
+    double minFrames = MIN((double)frames, TIMELINE_MIN_FRAMES);
+
+    if (viewFrames <= 0.0)
+        viewFrames = frames;
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::InvisibleButton("##Timeline", ImVec2(width, TIMELINE_HEIGHT));
+
+    ImGuiIO &io = ImGui::GetIO();
+    bool bHovered = ImGui::IsItemHovered();
+    float mouseX = io.MousePos.x - origin.x;
+
+    if (bHovered && 0.f != io.MouseWheel) {
+        // Keep the frame under the mouse where it is
+        double mouseFrame = viewFirst + mouseX * viewFrames / width;
+        viewFrames = MAX(minFrames, MIN((double)frames, viewFrames * pow(0.8, io.MouseWheel)));
+        viewFirst = mouseFrame - mouseX * viewFrames / width;
+    }
+
+    if (bHovered && ImGui::IsMouseDragging(1))
+        viewFirst -= io.MouseDelta.x * viewFrames / width;
+
+    if (bHovered && ImGui::IsMouseDoubleClicked(0)) {
+        viewFirst = 0.0;
+        viewFrames = frames;
+    }
+
+    viewFirst = MAX(0.0, MIN(viewFirst, (double)frames - viewFrames));
+
+    double framesPerPixel = viewFrames / width;
+    uint32_t viewEnd = MIN(frames, (uint32_t)ceil(viewFirst + viewFrames));
+    FrameSizeSpan view = sizePyramid.Query((uint32_t)viewFirst, viewEnd);
+
+    float bottom = origin.y + TIMELINE_HEIGHT;
+    float scale = view.maxBytes ? (TIMELINE_HEIGHT - 2.f) / (float)view.maxBytes : 0.f;
+
+    ImDrawList *pDrawList = ImGui::GetWindowDrawList();
+    pDrawList->AddRectFilled(origin, ImVec2(origin.x + width, bottom), IM_COL32(20, 20, 20, 255));
+
+    // One query per pixel column, at most two pyramid entries per level
+    static std::vector<ImVec2> averages;
+    averages.clear();
+
+    for (int x = 0; x < (int)width; x++) {
+        uint32_t first = (uint32_t)(viewFirst + x * framesPerPixel);
+        uint32_t last = MAX(first + 1, (uint32_t)(viewFirst + (x + 1) * framesPerPixel));
+
+        FrameSizeSpan span = sizePyramid.Query(first, last);
+
+        if (0 == span.count)
+            break;
+
+        float px = origin.x + x + 0.5f;
+
+        pDrawList->AddLine(ImVec2(px, bottom - span.minBytes * scale), ImVec2(px, bottom - span.maxBytes * scale - 1.f), IM_COL32(70, 110, 160, 255));
+
+        // Any event from the first byte of these frames up to the next frame
+        if (checker.EventCount()) {
+            uint64_t begin = frameTable.Row(first).firstByteLocation;
+            uint64_t end = last < frames ? frameTable.Row(last).firstByteLocation : UINT64_MAX;
+            size_t e = checker.FirstEventAt(begin);
+
+            if (e < checker.EventCount() && checker.Event(e).offset < end)
+                pDrawList->AddLine(ImVec2(px, origin.y), ImVec2(px, origin.y + TIMELINE_MARK_HEIGHT), IM_COL32(230, 60, 60, 255));
+        }
+
+        averages.push_back(ImVec2(px, bottom - (float)((double)span.sumBytes / span.count) * scale));
+    }
+
+    pDrawList->AddPolyline(averages.data(), (int)averages.size(), IM_COL32(230, 230, 230, 255), false, 1.f);
+
+    if (frameDisplaying >= viewFirst && frameDisplaying < viewFirst + viewFrames) {
+        float px = origin.x + (float)((frameDisplaying - viewFirst) / framesPerPixel);
+        pDrawList->AddLine(ImVec2(px, origin.y), ImVec2(px, bottom), IM_COL32(255, 200, 0, 255));
+    }
+
+    if (bHovered) {
+        uint32_t frame = MIN(frames - 1, (uint32_t)MAX(0.0, viewFirst + mouseX * framesPerPixel));
+        const FrameTableRow &row = frameTable.Row(frame);
+
+        ImGui::SetTooltip("Frame:%u, Type:%c, Bytes:%llu, Offset:%llu", frame, row.frameType ? row.frameType : '?', (unsigned long long)sizePyramid.Query(frame, frame + 1).sumBytes, (unsigned long long)row.firstByteLocation);
+
+        if (ImGui::IsItemClicked(0) && bytePosOfLastAU)
+            seekValue = MIN(100, (int)(100.0 * (double)row.firstByteLocation / (double)bytePosOfLastAU));
+    }
+
+    if (checker.IsDone() && pcrTrack < checker.PCR().Tracks())
+        DrawPCRTrack(checker.PCR().Track(pcrTrack), frameTable, viewFirst, framesPerPixel, frames, width);
+
+    // Bitrate over the DTS span of the view, the 33 bit DTS can wrap once
+    double mbps = 0.0;
+
+    if (view.count > 1) {
+        uint64_t firstDTS = frameTable.Row((uint32_t)viewFirst).dts;
+        uint64_t lastDTS = frameTable.Row(viewEnd - 1).dts;
+
+        if (lastDTS < firstDTS)
+            lastDTS += 1ull << 33;
+
+        double seconds = (double)(lastDTS - firstDTS) / 90000.0 * view.count / (view.count - 1);
+
+        if (seconds > 0.0)
+            mbps = (double)view.sumBytes * 8.0 / seconds / 1000000.0;
+    }
+
+    ImGui::Text("Frames %u-%u, Largest:%u bytes, Average:%llu bytes, %.2f Mbit/s", (uint32_t)viewFirst, viewEnd - 1, view.maxBytes, (unsigned long long)(view.count ? view.sumBytes / view.count : 0), mbps);
+
+    return true;
+}
+
+// TR 101 290 counts and events of the last check, each event with the frame it falls in.
+// The check reads the file again on its own thread with its own I/O.
+static void DrawConformanceWindow(const MpegTS_XML &mpts, const FrameTable &frameTable, ConformanceChecker &checker, size_t &pcrTrack)
+{
+    ImGui::Begin("Conformance");
+
+    if (!checker.IsStarted()) {
+        if (ImGui::Button("Check")) {
+            // The async backend charges the memory budget, which is not thread safe
+            eInputBackend backend = eInputMmap == g_options.inputBackend ? eInputMmap : eInputPread;
+            checker.Start(backend, mpts.m_mpegTSDescriptor.fileName, mpts.m_mpegTSDescriptor.packetSize);
+        }
+
+        ImGui::SameLine();
+        ImGui::Text("Sync, continuity, PAT/PMT, PID, TEI, CRC, PCR and PTS checks over every packet");
+
+        ImGui::End(); // Conformance
+        return;
+    }
+
+    if (!checker.IsDone()) {
+        float fraction = checker.BytesTotal() ? (float)((double)checker.BytesChecked() / (double)checker.BytesTotal()) : 0.f;
+        ImGui::ProgressBar(fraction);
+    }
+
+    ImGui::Columns(3, "ConformanceCounts");
+    ImGui::Text("Priority");
+    ImGui::NextColumn();
+    ImGui::Text("Check");
+    ImGui::NextColumn();
+    ImGui::Text("Errors");
+    ImGui::NextColumn();
+    ImGui::Separator();
+
+    for (int i = 0; i < eNumConformanceChecks; i++) {
+        eConformanceCheck check = (eConformanceCheck)i;
+
+        ImGui::Text("%d", ConformancePriority(check));
+        ImGui::NextColumn();
+        ImGui::Text("%s", ConformanceCheckName(check));
+        ImGui::NextColumn();
+        ImGui::Text("%llu", (unsigned long long)checker.Count(check));
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+
+    // Clicking a PCR PID shows it on the timeline
+    if (checker.IsDone() && checker.PCR().Tracks()) {
+        static const char *pcrColumnNames[] = { "PCR PID", "PCRs", "Runs", "Min Mbit/s", "Mean Mbit/s", "Max Mbit/s", "Max gap (ms)", "Accuracy (ns)", "Past 500 ns", "Jitter (ns)" };
+        const int numPCRColumns = IM_ARRAYSIZE(pcrColumnNames);
+
+        ImGui::Separator();
+        ImGui::Columns(numPCRColumns, "PCRTracks");
+
+        for (int i = 0; i < numPCRColumns; i++) {
+            ImGui::Text("%s", pcrColumnNames[i]);
+            ImGui::NextColumn();
+        }
+
+        ImGui::Separator();
+
+        for (size_t t = 0; t < checker.PCR().Tracks(); t++) {
+            const PCRTrack &track = checker.PCR().Track(t);
+            const PCRSummary &summary = track.Summary();
+
+            char label[32];
+            snprintf(label, sizeof(label), "0x%04X", track.PID());
+
+            if (ImGui::Selectable(label, t == pcrTrack, ImGuiSelectableFlags_SpanAllColumns))
+                pcrTrack = t;
+            ImGui::NextColumn();
+            ImGui::Text("%u", summary.samples);
+            ImGui::NextColumn();
+            ImGui::Text("%u", summary.runs);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", summary.minBitsPerSecond / 1000000.0);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", summary.meanBitsPerSecond / 1000000.0);
+            ImGui::NextColumn();
+            ImGui::Text("%.3f", summary.maxBitsPerSecond / 1000000.0);
+            ImGui::NextColumn();
+            ImGui::Text("%.2f", summary.maxIntervalMs);
+            ImGui::NextColumn();
+            ImGui::Text("%.0f", summary.maxAccuracyNs);
+            ImGui::NextColumn();
+            ImGui::Text("%u", summary.accuracyErrors);
+            ImGui::NextColumn();
+            ImGui::Text("%.0f to %.0f%s", summary.minJitterNs, summary.maxJitterNs, summary.bArrivalTimes ? "" : " *");
+            ImGui::NextColumn();
+        }
+
+        ImGui::Columns(1);
+        ImGui::Text("* No arrival times in 188 byte packets, the jitter is the accuracy");
+    }
+
+    if (checker.IsDone() && ImGui::CollapsingHeader("Programs and services")) {
+        const PSITables &psi = checker.PSI();
+
+        ImGui::Text("transport_stream_id %d, %llu sections, %llu new or changed, %llu CRC errors, %llu version changes",
+                    psi.TransportStreamId(), (unsigned long long)psi.Sections(), (unsigned long long)psi.SectionsParsed(),
+                    (unsigned long long)psi.CRCErrors(), (unsigned long long)psi.VersionChangeCount());
+
+        for (const PSIProgram &program : psi.Programs()) {
+            if (ImGui::TreeNode((void*)(intptr_t)program.programNumber, "Program %u, PMT PID 0x%04X, PCR PID 0x%04X, version %d",
+                                program.programNumber, program.pmtPID, program.pcrPID, program.version)) {
+                for (const PSIStream &stream : program.streams)
+                    ImGui::BulletText("PID 0x%04X, stream_type 0x%02X", stream.pid, stream.streamType);
+
+                ImGui::TreePop();
+            }
+        }
+
+        for (const PSIService &service : psi.Services()) {
+            if (ImGui::TreeNode((void*)(intptr_t)(0x10000 + service.serviceId), "Service %u, %s", service.serviceId, service.name.c_str())) {
+                ImGui::BulletText("Provider %s, service_type 0x%02X, running_status %u", service.provider.c_str(), service.serviceType, service.runningStatus);
+                ImGui::BulletText("%u EIT sections", service.eitSections);
+                if (!service.presentEvent.empty())
+                    ImGui::BulletText("Present: %s", service.presentEvent.c_str());
+                if (!service.followingEvent.empty())
+                    ImGui::BulletText("Following: %s", service.followingEvent.c_str());
+
+                ImGui::TreePop();
+            }
+        }
+
+        if (!psi.VersionChanges().empty() && ImGui::TreeNode("Version changes")) {
+            for (const PSIVersionChange &change : psi.VersionChanges())
+                ImGui::BulletText("Offset %llu, PID 0x%04X, table_id 0x%02X, extension %u: version %u to %u",
+                                  (unsigned long long)change.offset, change.pid, change.tableId, change.extension, change.oldVersion, change.newVersion);
+
+            ImGui::TreePop();
+        }
+    }
+
+    size_t numEvents = checker.EventCount();
+
+    if (checker.ErrorCount() > numEvents)
+        ImGui::Text("Only the first %u of %llu errors are listed", CONFORMANCE_MAX_EVENTS, (unsigned long long)checker.ErrorCount());
+
+    // Frames are known once the table has every row
+    bool bFrames = frameTable.RowsFilled() == frameTable.Rows();
+
+    ImGui::Separator();
+    ImGui::Columns(5, "ConformanceEvents");
+    ImGui::Text("Frame");
+    ImGui::NextColumn();
+    ImGui::Text("Offset");
+    ImGui::NextColumn();
+    ImGui::Text("PID");
+    ImGui::NextColumn();
+    ImGui::Text("Check");
+    ImGui::NextColumn();
+    ImGui::Text("Detail");
+    ImGui::NextColumn();
+    ImGui::Columns(1);
+
+    ImGui::BeginChild("ConformanceEventRows");
+    ImGui::Columns(5, "ConformanceEventRows", false);
+
+    ImGuiListClipper clipper((int)numEvents, ImGui::GetTextLineHeightWithSpacing());
+
+    while (clipper.Step()) {
+        for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; i++) {
+            const ConformanceEvent &event = checker.Event(i);
+            int64_t frame = bFrames ? frameTable.FrameAt(event.offset) : -1;
+
+            char detail[128];
+            ConformanceEventText(event, detail, sizeof(detail));
+
+            if (frame >= 0)
+                ImGui::Text("%lld", (long long)frame);
+            else
+                ImGui::Text("-");
+            ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)event.offset);
+            ImGui::NextColumn();
+            if (0xFFFF != event.pid)
+                ImGui::Text("0x%04X", event.pid);
+            else
+                ImGui::Text("-");
+            ImGui::NextColumn();
+            ImGui::Text("%s", ConformanceCheckName((eConformanceCheck)event.check));
+            ImGui::NextColumn();
+            ImGui::Text("%s", detail);
+            ImGui::NextColumn();
+        }
+    }
+
+    ImGui::Columns(1);
+    ImGui::EndChild();
+
+    ImGui::End(); // Conformance
+}
+
+// Every video AU in one table, only the visible rows are drawn.
+// Clicking a column header sorts by it, clicking it again reverses the order.
+// Returns false while it is collapsed
+static bool DrawFrameTable(const MpegTS_XML &mpts, FrameTable &frameTable)
+{
+    static const char *columnNames[] = { "Frame", "Type", "PTS", "DTS", "Packets", "Bytes", "Offset" };
+    static const eFrameTableKey columnKeys[] = { eFrameKeyDecode, eFrameKeyType, eFrameKeyPTS, eFrameKeyDTS, eFrameKeySize, eFrameKeySize, eFrameKeyDecode };
+    static const int columnDigits[] = { 8, 4, 12, 12, 7, 11, 14 };
+    const int numColumns = IM_ARRAYSIZE(columnNames);
+
+    static int sortColumn = 0;
+    static bool bDescending = false;
+
+    if (!ImGui::CollapsingHeader("All Frames"))
+        return false;
+
+    if (frameTable.RowsFilled() < frameTable.Rows())
+        ImGui::Text("Reading frames: %u of %u", frameTable.RowsFilled(), frameTable.Rows());
+
+    // The header stays put while the rows scroll, both column sets get the same widths
+    float columnWidths[numColumns];
+    float digitWidth = ImGui::CalcTextSize("0").x;
+
+    for (int i = 0; i < numColumns; i++)
+        columnWidths[i] = (float)columnDigits[i] * digitWidth + 2.f * ImGui::GetStyle().ItemSpacing.x;
+
+    ImGui::Columns(numColumns, "FrameTableHeader");
+
+    for (int i = 0; i < numColumns - 1; i++)
+        ImGui::SetColumnWidth(i, columnWidths[i]);
+
+    for (int i = 0; i < numColumns; i++) {
+        const char *pMark = "";
+
+        if (i == sortColumn)
+            pMark = !frameTable.IsSorted(columnKeys[i]) ? " ..." : (bDescending ? " v" : " ^");
+
+        // The ### keeps the id when the mark changes
+        char label[64];
+        snprintf(label, sizeof(label), "%s%s###FrameColumn%d", columnNames[i], pMark, i);
+
+        if (ImGui::Selectable(label, i == sortColumn)) {
+            if (i == sortColumn) {
+                bDescending = !bDescending;
+            } else {
+                sortColumn = i;
+                bDescending = false;
+            }
+        }
+
+        ImGui::NextColumn();
+    }
+
+    ImGui::Columns(1);
+
+    float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    ImGui::BeginChild("FrameTableRows", ImVec2(0, MAX(ImGui::GetContentRegionAvail().y, 10.f * rowHeight)));
+
+    ImGui::Columns(numColumns, "FrameTableRows", false);
+
+    for (int i = 0; i < numColumns - 1; i++)
+        ImGui::SetColumnWidth(i, columnWidths[i]);
+
+    eFrameTableKey key = columnKeys[sortColumn];
+    uint64_t packetSize = mpts.m_mpegTSDescriptor.packetSize;
+
+    ImGuiListClipper clipper((int)frameTable.RowsFilled(), rowHeight);
+
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            uint32_t index = frameTable.Order(key, bDescending, (uint32_t)row);
+            const FrameTableRow &frameRow = frameTable.Row(index);
+
+            ImGui::Text("%u", index);
+            ImGui::NextColumn();
+            ImGui::Text("%c", frameRow.frameType ? frameRow.frameType : '?');
+            ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)frameRow.pts);
+            ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)frameRow.dts);
+            ImGui::NextColumn();
+            ImGui::Text("%u", frameRow.numPackets);
+            ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)frameRow.numPackets * packetSize);
+            ImGui::NextColumn();
+            ImGui::Text("%llu", (unsigned long long)frameRow.firstByteLocation);
+            ImGui::NextColumn();
+        }
+    }
+
+    ImGui::Columns(1);
+    ImGui::EndChild();
+
+    return true;
+}
+
+// Nothing reads the DOM once the packet list is indexed, under a memory cap it is the first thing to go
+class XmlDocumentConsumer : public BudgetConsumer
+{
+public:
+    XmlDocumentConsumer() : m_pDoc(new tinyxml2::XMLDocument), m_pins(0) {}
+    ~XmlDocumentConsumer() { BudgetRemoveAll(this); delete m_pDoc; }
+
+    // The document is not evicted while a Pin is held, another thread going over the cap may try
+    class Pin
+    {
+    public:
+        Pin(XmlDocumentConsumer& consumer) : m_consumer(consumer)
+        {
+            std::lock_guard<std::mutex> lock(m_consumer.m_mutex);
+
+            if (!m_consumer.m_pDoc)
+                m_consumer.m_pDoc = new tinyxml2::XMLDocument;
+
+            m_consumer.m_pins++;
+        }
+
+        ~Pin()
+        {
+            std::lock_guard<std::mutex> lock(m_consumer.m_mutex);
+            m_consumer.m_pins--;
+        }
+
+        tinyxml2::XMLDocument& Document() { return *m_consumer.m_pDoc; }
+
+    private:
+        Pin(const Pin&);
+        Pin& operator=(const Pin&);
+
+        XmlDocumentConsumer& m_consumer;
+    };
+
+    const char* BudgetName() const { return "XML DOM"; }
+
+    // Deleting the document also frees tinyxml2's node pools, Clear() keeps them
+    bool BudgetEvict(uint64_t)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_pins)
+            return false;
+
+        delete m_pDoc;
+        m_pDoc = NULL;
+        return true;
+    }
+
+private:
+    tinyxml2::XMLDocument* m_pDoc;
+    unsigned int m_pins;
+    std::mutex m_mutex;
+};
+
+static bool RunGUI(MpegTS_XML &mpts)
+{
+    static PlayState g_playState = eStopped;
+
+    std::string windowTitle = "Mpeg2-Ts Parser GUI: ";
+    windowTitle += mpts.m_mpegTSDescriptor.fileName;
+    if (0 != InitOpenGL(windowTitle))
+        return false;
+
+    g_pTexturePresenter = new TexturePresenter(g_window, "");
+
+    if (NULL == g_pTexturePresenter) {
+        CloseOpenGL();
+        return false;
+    }
+
+    unsigned int err = GLFW_NO_ERROR;
+
+    ImGui::CreateContext();
+    ImGui_ImplGlfwGL3_Init(g_window, true);
+    ImGui::StyleColorsDark();
+
+    int ret = 0;
+    int frame_num = 0;
+    bool bNeedFrame = false;
+
+    unsigned int frameDisplaying = 0;
+    uint64_t fileBytePos = 0;
+    size_t framesToDecode = 0;
+    size_t framesDecoded = 0;
+
+    float red = 114.f;
+    float redInc = -3.f;
+    float green = 144.f;
+    float greenInc = 5.f;
+    float blue = 154.f;
+    float blueInc = 7.f;
+
+    unsigned int numVideoFrames = mpts.m_videoAccessUnitsDecode.size() - 1;
+    uint64_t bytePosOfLastAU = BytePosOfLastAU(mpts);
+
+    FrameTable frameTable;
+    FrameSizePyramid sizePyramid;
+    ConformanceChecker checker;
+    ProgramAnalyzer programAnalyzer;
+    size_t pcrTrack = 0;
+    bool bFrameRowsShown = false;
+
+    Renderer renderer;
+
+#if DUMP_OUTPUT_FILE
+    WriteAllFramesToFile(mpts);
+    return true;
+#endif
+
+    g_pFrame = SeekToFrame(0, 0);
+
+    if (!g_pFrame) {
+        fprintf(stderr, "Error: Unable to decode %s\n", mpts.m_mpegTSDescriptor.fileName.c_str());
+        return false;
+    }
+
+    bool bNewFrame = true;
+
+    while (!glfwWindowShouldClose(g_window)) {
+        glClearColor(0.f, 0.f, 0.f, 1.f);
+        renderer.Clear();
+
+        ImGui_ImplGlfwGL3_NewFrame();
+
+        // Every AU is read once, a slice per GUI frame, for the frame table and the timeline.  Only
+        // while one of them was open last frame, a lazily opened index is parsed as playback needs it.
+        if (bFrameRowsShown && frameTable.Fill(mpts.m_videoAccessUnitsDecode, FRAME_TABLE_FILL_MS))
+            sizePyramid.Build(frameTable, mpts.m_mpegTSDescriptor.packetSize);
+
+        ImGui::Begin("Playback Controls");
+
+        static int seekValueLast = 0;
+        int seekValue = seekValueLast;
+
+        bFrameRowsShown = DrawTimeline(mpts, sizePyramid, frameTable, checker, pcrTrack, frameDisplaying, bytePosOfLastAU, seekValue);
+
+        ImGui::SliderInt("##Seek", &seekValue, 0, 100);
+
+        ImGui::SameLine();
+
+        //        ImVec4 color = ImVec4(red/255.0f, green/255.0f, blue/255.0f, 1.f);
+        //        ImGui::ColorButton("ColorButton", *(ImVec4*)&color, 0x00020000, ImVec2(20,20));
+
+        // Keyboard or Play Button
+        if ((ImGui::GetIO().KeysDownDuration[32] > 0.f && ImGui::GetIO().KeysDownDuration[32] < 0.04f) ||
+            ImGui::ArrowButton("Play", ImGuiDir_Right)) {
+            if (eStopped == g_playState) {
+                framesToDecode = numVideoFrames - frameDisplaying;
+                g_playState = ePlaying;
+                bNeedFrame = true;
+            } else {
+                g_playState = eStopped;
+                bNeedFrame = false;
+            }
+        }
+
+        // Right Arrow Key
+        if (ImGui::IsKeyPressed(KEY_RIGHT_ARROW)) {
+            g_playState = eStopped;
+            bNeedFrame = true;
+            framesDecoded = 0;
+            framesToDecode = 1;
+        }
+
+        bool bForceSeek = false;
+
+        // Left Arrow Key
+        if (ImGui::IsKeyPressed(KEY_LEFT_ARROW)) {
+            seekValue--;
+            seekValue = MAX(0, seekValue);
+
+            if (seekValueLast == seekValue &&
+                frameDisplaying != 0)
+                bForceSeek = true;
+        }
+
+        fileBytePos = (uint64_t)((double)bytePosOfLastAU * ((double)seekValue / 100.0));
+
+        static uint64_t lastFileBytePos = 0;
+
+        if (seekValueLast != seekValue ||
+            bForceSeek) {
+            g_playState = eStopped;
+            seekValueLast = seekValue;
+            lastFileBytePos = fileBytePos;
+
+            //avformat_flush(g_ifmt_ctx);
+            //avio_flush(g_ifmt_ctx->pb);
+
+            /* Timestamp based testing with cars_2_toy_story
+            size_t lastTimestamp = 33495336;
+            size_t timeStampPos = (size_t) ((float) lastTimestamp * ((float) seekValue / 100.f));
+            av_seek_frame(g_ifmt_ctx, mpts.m_videoStreamIndex, timeStampPos, 0);
+            */
+
+            if (g_pFrame)
+                av_frame_free(&g_pFrame);
+
+            frameDisplaying = mpts.VideoKeyFrameFromBytePos(fileBytePos);
+            g_pFrame = SeekToFrame(frameDisplaying, fileBytePos);
+
+            // Decode order to presentation order, the leading pictures of an open GOP are skipped
+            frameDisplaying = mpts.BuildPresentationUnits(frameDisplaying);
+
+            printf("----------\n");
+
+            /*
+                        while(g_pFrame && AV_PICTURE_TYPE_I != g_pFrame->pict_type)
+                        {
+                            switch(g_pFrame->pict_type)
+                            {
+                                case AV_PICTURE_TYPE_P:
+                                    printf("%d: P Frame\n", frameDisplaying);
+                                break;
+
+                                case AV_PICTURE_TYPE_B:
+                                    printf("%d: B Frame\n", frameDisplaying);
+                                break;
+                            }
+
+                            frameDisplaying++;
+
+                            av_frame_free(&g_pFrame);
+
+                            g_pFrame = GetNextVideoFrame();
+                        }
+            */
+
+            bNeedFrame = false;
+            bNewFrame = true;
+        } else {
+            // If still frames to read
+            if (bNeedFrame) {
+                if (g_pFrame)
+                    av_frame_free(&g_pFrame);
+
+                g_pFrame = GetNextVideoFrame();
+
+                if (g_pFrame) {
+                    framesDecoded++;
+
+                    //IncAndClamp(red, redInc, 0.f, 255.f);
+                    //IncAndClamp(green, greenInc, 0.f, 255.f);
+                    //IncAndClamp(blue, blueInc, 0.f, 255.f);
+
+                    frameDisplaying++;
+
+                    if (framesDecoded == framesToDecode)
+                        bNeedFrame = false;
+
+                    float percent = ((float)frameDisplaying / (float)numVideoFrames) * 100.f;
+                    seekValue = (int)percent;
+                    seekValueLast = seekValue;
+                    bNewFrame = true;
+
+                    if (bNewFrame)
+                        mpts.UpdatePresentationUnits(frameDisplaying);
+                }
+            }
+        }
+
+        if (g_pFrame)
+            WriteFrame(g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx, g_pFrame, 0, g_pTexturePresenter, bNewFrame);
+
+        char frameType = ' ';
+
+        if (g_pFrame) {
+            switch (g_pFrame->pict_type) {
+                case AV_PICTURE_TYPE_I:
+                    frameType = 'I';
+                    break;
+                case AV_PICTURE_TYPE_P:
+                    frameType = 'P';
+                    break;
+                case AV_PICTURE_TYPE_B:
+                    frameType = 'B';
+                    break;
+            }
+        }
+
+        ImGui::Text("Displaying:%d of %d, Type:%c, Offset:%llu", frameDisplaying, numVideoFrames, frameType, (int64_t)fileBytePos);
+
+        ImGui::End(); // Seek
+
+        ImGui::Begin("Frames");
+
+        if (ImGui::CollapsingHeader(mpts.m_videoAccessUnitsPresentation[0].esd.name.c_str())) {
+            unsigned int frame = frameDisplaying;
+            unsigned int high = frame + mpts.m_videoAccessUnitsPresentation.size(); // TODO: Make this GOP size
+            high = MIN(high, numVideoFrames);
+
+            if (mpts.m_videoAccessUnitsPresentation.size()) {
+                for (unsigned int i = frame, j = 0; i < high; i++, j++) {
+                    AccessUnit& au = mpts.m_videoAccessUnitsPresentation[j];
+
+                    size_t numPackets = mpts.VideoNumPackets(au);
+
+                    if (ImGui::TreeNode((void*)au.frameNumber, "Frame:%u, Type:%s, PTS:%ld, Packets:%llu, PID:%ld", au.frameNumber, au.frameType.c_str(), au.pts, numPackets, au.esd.pid)) {
+                        if (ImGui::SmallButton("View")) {
+                            if (frame > frameDisplaying) {
+                                framesToDecode = frame - frameDisplaying;
+                                bNeedFrame = true;
+                                framesDecoded = 0;
+                            }
+                        };
+
+                        ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+
+                        static std::vector<AccessUnitElement> elements;
+                        mpts.GetVideoAccessUnitElements(au, elements);
+
+                        for (std::vector<AccessUnitElement>::iterator j = elements.begin(); j < elements.end(); j++) {
+                            if ("I" == au.frameType) {
+                                ImGui::TreeNodeEx((void*)(intptr_t)frame, nodeFlags, "Closed GOP:%d Byte Location:%llu, Num Packets:%llu", au.closed_gop, j->startByteLocation, j->numPackets);
+                            } else {
+                                ImGui::TreeNodeEx((void*)(intptr_t)frame, nodeFlags, "Byte Location:%llu, Num Packets:%llu", j->startByteLocation, j->numPackets);
+                            }
+                        }
+
+                        ImGui::TreePop();
+                    }
+
+                    frame++;
+                }
+            }
+        }
+
+        if (DrawFrameTable(mpts, frameTable))
+            bFrameRowsShown = true;
+
+        /*
+            unsigned int frame = frameDisplaying;
+
+            unsigned int high = frame + mpts.m_videoAccessUnitsPresentation.size(); // TODO: Make this GOP size
+
+            high = MIN(high, numVideoFrames);
+
+            if(mpts.m_videoAccessUnitsPresentation.size())
+            {
+                if (ImGui::CollapsingHeader(mpts.m_videoAccessUnitsPresentation[0].esd.name.c_str()))
+                {
+                    for(unsigned int i = frame; i < high; i++)
+                    {
+                        AccessUnit &au = mpts.m_videoAccessUnitsPresentation[i];
+
+                        size_t numPackets = 0;
+                        for (std::vector<AccessUnitElement>::iterator j = au.accessUnitElements.begin(); j < au.accessUnitElements.end(); j++)
+                            numPackets += j->numPackets;
+
+                        if(ImGui::TreeNode((void*) au.frameNumber, "Frame:%u, Type:%s, PTS:%ld, Packets:%llu, PID:%ld", au.frameNumber, au.frameType.c_str(), au.pts, numPackets, au.esd.pid))
+                        {
+                            if (ImGui::SmallButton("View"))
+                            {
+                                if(frame > frameDisplaying)
+                                {
+                                    framesToDecode = frame - frameDisplaying;
+                                    bNeedFrame = true;
+                                    framesDecoded = 0;
+                                }
+                            };
+
+                            ImGuiTreeNodeFlags nodeFlags = ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen;
+
+                            for (std::vector<AccessUnitElement>::iterator j = au.accessUnitElements.begin(); j < au.accessUnitElements.end(); j++)
+                            {
+                                ImGui::TreeNodeEx((void*)(intptr_t)frame, nodeFlags, "Byte Location:%llu, Num Packets:%llu", j->startByteLocation, j->numPackets);
+                            }
+
+                            ImGui::TreePop();
+                        }
+
+                        frame++;
+                    }
+                }
+            }
+    */
+
+    /*
+            frame = 1;
+            if (ImGui::CollapsingHeader("Audio"))
+            {
+                for(std::vector<AccessUnit>::iterator i = mpts.m_audioAccessUnits.begin(); i < mpts.m_audioAccessUnits.end(); i++)
+                {
+                    size_t numPackets = 0;
+                    for (std::vector<AccessUnitElement>::iterator j = i->accessUnitElements.begin(); j < i->accessUnitElements.end(); j++)
+                        numPackets += j->numPackets;
+
+                    if(ImGui::TreeNode((void*) frame, "Frame:%d, Name:%s, Packets:%d, PID:%ld", frame, i->esd.name.c_str(), numPackets, i->esd.pid))
+                    {
+                        for (std::vector<AccessUnitElement>::iterator j = i->accessUnitElements.begin(); j < i->accessUnitElements.end(); j++)
+                        {
+                            if (ImGui::TreeNode((void*)(intptr_t)frame, "Byte Location:%d, Num Packets:%d", j->startByteLocation, j->numPackets))
+                                ImGui::TreePop();
+                        }
+
+                        ImGui::TreePop();
+                    }
+
+                    frame++;
+                }
+            }
+    */
+
+        ImGui::End(); // Frames
+
+        DrawPerformanceWindow();
+        DrawMemoryWindow(mpts);
+        DrawStreamsWindow(mpts, programAnalyzer);
+        DrawConformanceWindow(mpts, frameTable, checker, pcrTrack);
+
+        {
+            PROFILE_SCOPE(eProfileImGui);
+            ImGui::Render();
+            ImGui_ImplGlfwGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+
+        /* Swap front and back buffers */
+        {
+            PROFILE_SCOPE(eProfilePresent);
+            glfwSwapBuffers(g_window);
+        }
+
+        ProfilerEndFrame();
+
+        BudgetEnforce();
+
+        /* Poll for and process events */
+        glfwPollEvents();
+
+        bNewFrame = false;
+    }
+
+    if (g_pFrame)
+        av_frame_free(&g_pFrame);
+
+    if (g_pTexturePresenter)
+        delete g_pTexturePresenter;
+
+    ImGui_ImplGlfwGL3_Shutdown();
+    ImGui::DestroyContext();
+
+    CloseOpenGL();
+
+    return true;
+}
+
+static int InitFilter(FilteringContext* fctx,
+    AVStream* st,
+    AVCodecContext* dec_ctx,
+    //AVCodecContext *enc_ctx,
+                      const char *filter_spec)
+{
+    char args[512];
+    int ret = 0;
+
+    const AVFilter* cur_filter = NULL;
+    AVFilterContext* cur_ctx = NULL;
+    AVFilterContext* prev_ctx = NULL;
+
+    //    AVCodecContext *codec_ctx;
+    //    ret = avcodec_parameters_to_context(codec_ctx, st->codecpar);
+
+    AVFilterGraph* filter_graph = avfilter_graph_alloc();
+    if (!filter_graph) {
+        av_log(NULL, AV_LOG_ERROR, "Can not create filter graph\n");
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    fctx->filter_graph = filter_graph;
+
+    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+        // Create Video Source
+        //////////////////////
+        cur_filter = avfilter_get_by_name("buffer");
+
+        if (!cur_filter) {
+            av_log(NULL, AV_LOG_ERROR, "Filter video source not found\n");
+            ret = AVERROR_UNKNOWN;
+            goto end;
+        }
+
+        snprintf(args, sizeof(args),
+            "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d:frame_rate=%d/%d",
+            st->codecpar->width, st->codecpar->height,
+            st->codecpar->format,
+            st->time_base.num, st->time_base.den,
+            st->codecpar->sample_aspect_ratio.num, st->codecpar->sample_aspect_ratio.den,
+            st->r_frame_rate.num, st->r_frame_rate.den);
+
+        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "src",
+            args, NULL, filter_graph);
+
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create video source\n");
+            goto end;
+        }
+
+        fctx->buffersrc_ctx = cur_ctx;
+        prev_ctx = cur_ctx;
+
+        // dec_ctx num and den are flipped at this point, store into dst un-flipped
+        AVRational dst;
+        dst.num = dec_ctx->time_base.den;
+        dst.den = dec_ctx->time_base.num;
+
+#define DO_DEINTERLACING 0
+#if DO_DEINTERLACING
+
+        // Perform deinterlacing?
+        /////////////////////////
+        if (IsDeinterlacing(fr_code)) {
+            cur_filter = avfilter_get_by_name("yadif");
+
+            if (!cur_filter) {
+                av_log(NULL, AV_LOG_ERROR, "Filter yadif not found\n");
+                ret = AVERROR_UNKNOWN;
+                goto end;
+            }
+
+            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "yadif",
+                NULL, NULL, filter_graph);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot create yadif filter\n");
+                goto end;
+            }
+
+            ret = avfilter_link(prev_ctx, 0,
+                cur_ctx, 0);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot link yadif filter\n");
+                goto end;
+            }
+
+            prev_ctx = cur_ctx;
+        }
+#endif
+
+#define DO_FRAME_RATE_CONVERSION 0
+#if DO_FRAME_RATE_CONVERSION
+
+        // Perform frame rate conversion?
+        /////////////////////////////////
+        if (st->r_frame_rate.num != dst.num ||
+            st->r_frame_rate.den != dst.den) {
+            /*
+            st->codec->field_order
+
+            enum AVFieldOrder {
+                AV_FIELD_UNKNOWN,
+                AV_FIELD_PROGRESSIVE,
+                AV_FIELD_TT,          //< Top coded_first, top displayed first
+                AV_FIELD_BB,          //< Bottom coded first, bottom displayed first
+                AV_FIELD_TB,          //< Top coded first, bottom displayed first
+                AV_FIELD_BT,          //< Bottom coded first, top displayed first
+            };
+            */
+
+            // All of the following code is based on CSourceAssembly::ConfigureAVISynthFRConverter()
+
+            /*
+            if (m_bSourceIsVFR)
+            {
+                // TODO: For the time being, don't convert VFR between PAL and NTSC.
+                // Currently the VFR->CFR is done in the MC FR Converter.
+                // Converting between NTSC/PAL here would lose sync.
+                m_hr = E_INVALIDARG;
+                SetError(ERR_UnsupportedFrameRate, L"BuildVideoPreprocessingPath", L"VFR unsupported in PAL<->NTSC conversion");
+                goto ConfigureAVISynthFRConverter_Failed;
+            }
+            */
+
+            // TODO: Pull this in from the json.
+            bool bIsTelecine = false;
+            EFrameRateConversionCode fr_code = CalculateFrameRateConversion(st->r_frame_rate, dst, bIsTelecine);
+
+            if (fr_code == kNTSCInverseTelecine_to_PAL ||
+                fr_code == kNTSCInverseTelecine_to_NTSCFilm ||
+                fr_code == kNTSC60pInverseTelecine_to_NTSCFilm ||
+                fr_code == kNTSC60pInverseTelecine_to_PAL) {
+                //double frameRate = 23.976;
+                if (fr_code == EFrameRateConversionCode::kNTSC60pInverseTelecine_to_NTSCFilm ||
+                    fr_code == EFrameRateConversionCode::kNTSC60pInverseTelecine_to_PAL) {
+                    // TODO
+                    //wcscpy_s(script, _countof(script), L"TDecimate(cycleR=3, Cycle=5)");
+
+                    // Insert Decimate
+                    /*
+                    cur_filter = avfilter_get_by_name("decimate");
+
+                    if (!cur_filter)
+                    {
+                        av_log(NULL, AV_LOG_ERROR, "Filter decimate not found\n");
+                        ret = AVERROR_UNKNOWN;
+                        goto end;
+                    }
+
+                    ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "decimate",
+                                                       NULL, NULL, filter_graph);
+
+                    if (ret < 0)
+                    {
+                        av_log(NULL, AV_LOG_ERROR, "Cannot create decimate filter\n");
+                        goto end;
+                    }
+
+                    ret = avfilter_link(prev_ctx, 0, cur_ctx, 0);
+
+                    if (ret < 0)
+                    {
+                        av_log(NULL, AV_LOG_ERROR, "Cannot link decimate filter\n");
+                        goto end;
+                    }
+
+                    prev_ctx = cur_ctx;
+                    */
+                } else {
+                    //wcscpy_s(script, _countof(script), L"TFM()TDecimate()");
+
+                    // Insert FieldMatch
+                    cur_filter = avfilter_get_by_name("fieldmatch");
+
+                    if (!cur_filter) {
+                        av_log(NULL, AV_LOG_ERROR, "Filter fieldmatch not found\n");
+                        ret = AVERROR_UNKNOWN;
+                        goto end;
+                    }
+
+                    ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "fieldmatch",
+                        NULL, NULL, filter_graph);
+
+                    if (ret < 0) {
+                        av_log(NULL, AV_LOG_ERROR, "Cannot create fieldmatch filter\n");
+                        goto end;
+                    }
+
+                    ret = avfilter_link(prev_ctx, 0, cur_ctx, 0);
+
+                    if (ret < 0) {
+                        av_log(NULL, AV_LOG_ERROR, "Cannot link fieldmatch filter\n");
+                        goto end;
+                    }
+
+                    prev_ctx = cur_ctx;
+
+                    // Insert Decimate
+                    cur_filter = avfilter_get_by_name("decimate");
+
+                    if (!cur_filter) {
+                        av_log(NULL, AV_LOG_ERROR, "Filter decimate not found\n");
+                        ret = AVERROR_UNKNOWN;
+                        goto end;
+                    }
+
+                    ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "decimate",
+                        NULL, NULL, filter_graph);
+
+                    if (ret < 0) {
+                        av_log(NULL, AV_LOG_ERROR, "Cannot create decimate filter\n");
+                        goto end;
+                    }
+
+                    ret = avfilter_link(prev_ctx, 0, cur_ctx, 0);
+
+                    if (ret < 0) {
+                        av_log(NULL, AV_LOG_ERROR, "Cannot link decimate filter\n");
+                        goto end;
+                    }
+
+                    prev_ctx = cur_ctx;
+                }
+
+                // Speed up video to 25fps if desired (e.g. NTSC film to PAL conversion)
+                if (fr_code == EFrameRateConversionCode::kNTSCInverseTelecine_to_PAL ||
+                    fr_code == EFrameRateConversionCode::kNTSC60pInverseTelecine_to_PAL) {
+                    //wcscat_s(script, _countof(script), L"AssumeFPS(25, 1, sync_audio=false)");
+                    //frameRate = 25.0;
+                    dst.num = 25;
+                    dst.den = 1;
+                } else {
+                    dst.num = 24000;
+                    dst.den = 1001;
+                }
+
+                // Update output frame rate
+                // TODO: code review -- move otu to BuildFilterGraph everything that changes the output frame 
+                //if (m_pTUM->GetFrameRatePassThru() && m_iTranscodeStage == TranscodeStages::kMainContentStage)
+                //    m_pTUM->SetOutputFrameRate(frameRate);
+            } else if (fr_code == kNTSC60p_to_PAL) {
+                /*
+                // Perform frame rate conversion to 50i
+                wcscpy_s(script, _countof(script), L"ChangeFPS(50.00)\n"); // or blend via ConvertFPS
+
+                                                                           // Re-interlace
+                bool isTFF = m_pTUM->IsInterlacedTopFieldFirst();
+                wcscat_s(script, _countof(script), (isTFF) ? L"AssumeTFF()\n" : L"AssumeBFF()\n");
+                wcscat_s(script, _countof(script), L"SeparateFields()\n");
+                wcscat_s(script, _countof(script), L"SelectEvery(4,0,3)\n");
+                wcscat_s(script, _countof(script), L"Weave()\n");
+
+                wcscat_s(script, _countof(script), L"AssumeFPS(25, 1, sync_audio=false)");
+                */
+            }
+
+            cur_filter = avfilter_get_by_name("fps");
+            if (!cur_filter) {
+                av_log(NULL, AV_LOG_ERROR, "Filter fps not found\n");
+                ret = AVERROR_UNKNOWN;
+                goto end;
+            }
+
+            char fps[32];
+            char num[10];
+            char den[10];
+            snprintf(num, sizeof(num), "%d", dst.num);
+            snprintf(den, sizeof(den), "%d", dst.den);
+            strcpy(fps, num);
+            strcat(fps, "/");
+            strcat(fps, den);
+
+            snprintf(args, sizeof(args), "fps=%s", fps);
+
+            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "fps",
+                args, NULL, filter_graph);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot create fps\n");
+                goto end;
+            }
+
+            ret = avfilter_link(prev_ctx, 0,
+                cur_ctx, 0);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot link fps\n");
+                goto end;
+            }
+
+            prev_ctx = cur_ctx;
+        }
+#endif
+
+#define DO_AVISYNTH 0
+#if DO_AVISYNTH
+
+        // Create avisynth?
+        ///////////////////
+        if (g_options.avisynth) {
+            cur_filter = avfilter_get_by_name("avisynth");
+            if (!cur_filter) {
+                av_log(NULL, AV_LOG_ERROR, "Filter avisynth not found\n");
+                ret = AVERROR_UNKNOWN;
+                goto end;
+            }
+
+            snprintf(args, sizeof(args),
+                "script=%s",
+                g_options.avisynth_script);
+
+            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "avisynth",
+                args, NULL, filter_graph);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot create avisynth\n");
+                goto end;
+            }
+
+            ret = avfilter_link(prev_ctx, 0,
+                cur_ctx, 0);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot link avisynth\n");
+                goto end;
+            }
+
+            prev_ctx = cur_ctx;
+        }
+#endif
+
+#define DO_SCALING 0
+#if DO_SCALING
+
+        // Create Video Scaler?
+        ///////////////////////
+        if (enc_ctx->width != st->codecpar->width || enc_ctx->height != st->codecpar->height) {
+            cur_filter = avfilter_get_by_name("scale");
+            if (!cur_filter) {
+                av_log(NULL, AV_LOG_ERROR, "Filter video_scale not found\n");
+                ret = AVERROR_UNKNOWN;
+                goto end;
+            }
+
+            snprintf(args, sizeof(args),
+                "width=%d:height=%d",
+                enc_ctx->width, enc_ctx->height);
+
+            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "scale",
+                args, NULL, filter_graph);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot create video scaler\n");
+                goto end;
+            }
+
+            ret = avfilter_link(prev_ctx, 0,
+                cur_ctx, 0);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot link video scaler\n");
+                goto end;
+            }
+
+            prev_ctx = cur_ctx;
+        }
+#endif
+
+#define DO_VIDEO_TRIM 0
+#if DO_VIDEO_TRIM
+
+        // Create Video Trim?
+        /////////////////////
+        if (g_options.start_time != -1 || g_options.end_time != -1) {
+            cur_filter = avfilter_get_by_name("trim");
+            if (!cur_filter) {
+                av_log(NULL, AV_LOG_ERROR, "Filter video_trim not found\n");
+                ret = AVERROR_UNKNOWN;
+                goto end;
+            }
+
+            memset(args, 0, sizeof(args));
+
+            if (g_options.start_time != -1) {
+                snprintf(args, sizeof(args),
+                    "start=%d",
+                    g_options.start_time);
+            }
+
+            if (g_options.end_time != -1) {
+                char end[32];
+                snprintf(end, sizeof(end),
+                    (g_options.start_time != -1) ? ":end=%d" : "end=%d",
+                    g_options.end_time);
+                strcat(args, end);
+            }
+
+            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "video_trim",
+                args, NULL, filter_graph);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot create video trim\n");
+                goto end;
+            }
+
+            ret = avfilter_link(prev_ctx, 0,
+                cur_ctx, 0);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot link video trim\n");
+                goto end;
+            }
+
+            prev_ctx = cur_ctx;
+        }
+#endif
+
+        // Create Video Sink
+        ////////////////////
+        cur_filter = avfilter_get_by_name("buffersink");
+        if (!cur_filter) {
+            av_log(NULL, AV_LOG_ERROR, "Filter video sink element not found\n");
+            ret = AVERROR_UNKNOWN;
+            goto end;
+        }
+
+        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "sink",
+            NULL, NULL, filter_graph);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create video sink\n");
+            goto end;
+        }
+
+        ret = av_opt_set_bin(cur_ctx, "pix_fmts",
+            (uint8_t*)&dec_ctx->pix_fmt, sizeof(dec_ctx->pix_fmt),
+            //(uint8_t*)&enc_ctx->pix_fmt, sizeof(enc_ctx->pix_fmt),
+            AV_OPT_SEARCH_CHILDREN);
+
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot set output pixel format\n");
+            goto end;
+        }
+
+        ret = avfilter_link(prev_ctx, 0,
+            cur_ctx, 0);
+
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot link video sink\n");
+            goto end;
+        }
+
+        fctx->buffersink_ctx = cur_ctx;
+    } else if (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO) {
+        // Create the audio source
+        //////////////////////////
+        cur_filter = avfilter_get_by_name("abuffer");
+        if (!cur_filter) {
+            av_log(NULL, AV_LOG_ERROR, "Filter audio source not found\n");
+            ret = AVERROR_UNKNOWN;
+            goto end;
+        }
+
+        snprintf(args, sizeof(args),
+            "time_base=%d/%d:sample_rate=%d:sample_fmt=%s:channel_layout=0x%llx",
+            st->time_base.num, st->time_base.den, st->codecpar->sample_rate,
+            av_get_sample_fmt_name((AVSampleFormat)st->codecpar->format),
+            st->codecpar->channel_layout);
+
+        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "src",
+            args, NULL, filter_graph);
+
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create audio source\n");
+            goto end;
+        }
+
+        fctx->buffersrc_ctx = cur_ctx;
+        prev_ctx = cur_ctx;
+
+#define DO_AUDIO_TRIM 0
+#if DO_AUDIO_TRIM
+        // Create audio trim?
+        /////////////////////
+        if (g_options.start_time != -1 || g_options.end_time != -1) {
+            cur_filter = avfilter_get_by_name("atrim");
+            if (!cur_filter) {
+                av_log(NULL, AV_LOG_ERROR, "Filter audio_trim not found\n");
+                ret = AVERROR_UNKNOWN;
+                goto end;
+            }
+
+            memset(args, 0, sizeof(args));
+
+            if (g_options.start_time != -1) {
+                snprintf(args, sizeof(args),
+                    "start=%d",
+                    g_options.start_time);
+            }
+
+            if (g_options.end_time != -1) {
+                char end[32];
+                snprintf(end, sizeof(end),
+                    (g_options.start_time != -1) ? ":end=%d" : "end=%d",
+                    g_options.end_time);
+                strcat(args, end);
+            }
+
+            ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "audio_trim",
+                args, NULL, filter_graph);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot create audio trim\n");
+                goto end;
+            }
+
+            ret = avfilter_link(prev_ctx, 0,
+                cur_ctx, 0);
+
+            if (ret < 0) {
+                av_log(NULL, AV_LOG_ERROR, "Cannot link audio trim\n");
+                goto end;
+            }
+
+            prev_ctx = cur_ctx;
+        }
+#endif
+
+        // Create the audio sink
+        ////////////////////////
+        cur_filter = avfilter_get_by_name("abuffersink");
+        if (!cur_filter) {
+            av_log(NULL, AV_LOG_ERROR, "Filter audio sink not found\n");
+            ret = AVERROR_UNKNOWN;
+            goto end;
+        }
+
+        ret = avfilter_graph_create_filter(&cur_ctx, cur_filter, "sink",
+            NULL, NULL, filter_graph);
+
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot create audio sink\n");
+            goto end;
+        }
+
+        ret = avfilter_link(prev_ctx, 0,
+            cur_ctx, 0);
+
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Cannot link audio sink\n");
+            goto end;
+        }
+
+        fctx->buffersink_ctx = cur_ctx;
+    } else {
+        ret = AVERROR_UNKNOWN;
+        goto end;
+    }
+
+    if ((ret = avfilter_graph_config(filter_graph, NULL)) < 0)
+        goto end;
+
+end:
+    return ret;
+}
+
+static int InitFilters(void)
+{
+    const char* filter_spec;
+    unsigned int i;
+    int ret;
+
+    g_filter_ctx = (FilteringContext*)av_malloc_array(g_ifmt_ctx->nb_streams, sizeof(*g_filter_ctx));
+
+    if (!g_filter_ctx)
+        return AVERROR(ENOMEM);
+
+#ifdef DEBUG
+    char p_graph[2048] = { 0 };
+#endif
+
+    for (i = 0; i < g_ifmt_ctx->nb_streams; i++) {
+        g_filter_ctx[i].buffersrc_ctx = NULL;
+        g_filter_ctx[i].buffersink_ctx = NULL;
+        g_filter_ctx[i].filter_graph = NULL;
+
+        if (!(g_ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO
+            || g_ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO))
+            continue;
+
+        if (g_ifmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+            filter_spec = "null"; /* passthrough (dummy) filter for video */
+        else
+            filter_spec = "anull"; /* passthrough (dummy) filter for audio */
+
+        ret = InitFilter(&g_filter_ctx[i],
+            g_ifmt_ctx->streams[i],
+            //g_stream_ctx[i].enc_ctx,
+            g_stream_ctx[i].dec_ctx,
+            filter_spec);
+
+        if (ret)
+            return ret;
+
+#ifdef DEBUG
+        strcpy(p_graph, avfilter_graph_dump(g_filter_ctx[i].filter_graph, NULL));
+#endif
+    }
+
+    return 0;
+}
+
+// Adler-32 of the visible picture, padding bytes past the width are left out
+static uint32_t FrameChecksum(const AVFrame *pFrame)
+{
+    const AVPixFmtDescriptor *pDesc = av_pix_fmt_desc_get((AVPixelFormat)pFrame->format);
+    unsigned long checksum = 1;
+
+    if (!pDesc)
+        return 0;
+
+    for (int plane = 0; plane < AV_NUM_DATA_POINTERS && pFrame->data[plane]; plane++) {
+        int height = pFrame->height;
+        int bytes = av_image_get_linesize((AVPixelFormat)pFrame->format, pFrame->width, plane);
+
+        if (plane == 1 || plane == 2)
+            height = AV_CEIL_RSHIFT(height, pDesc->log2_chroma_h);
+
+        for (int y = 0; y < height && bytes > 0; y++)
+            checksum = av_adler32_update(checksum, pFrame->data[plane] + y * pFrame->linesize[plane], bytes);
+    }
+
+    return (uint32_t)checksum;
+}
+
+struct DemuxBenchResult
+{
+    const char *name;
+    double seconds;
+    uint64_t packets;
+    uint64_t payloadBytes;
+    uint64_t bytesRead;
+    uint64_t readCalls;
+    std::vector<uint32_t> frameChecksums;
+};
+
+// Decodes the whole video stream through one packet source
+static bool BenchPacketSource(eDemuxBackend backend, MpegTS_XML &mpts, DemuxBenchResult &result)
+{
+    PacketSource *pSource = CreatePacketSource(backend, mpts, g_pInput, g_ifmt_ctx);
+
+    if (!pSource)
+        return false;
+
+    result.name = pSource->Name();
+    result.frameChecksums.clear();
+
+    g_pDecoder->Flush();
+
+    if (!pSource->Seek(0, 0)) {
+        delete pSource;
+        return false;
+    }
+
+    uint64_t bytesRead = g_pInput->BytesRead();
+    uint64_t readCalls = g_pInput->ReadCalls();
+    int64_t start = av_gettime_relative();
+
+    while (AVFrame *pFrame = g_pDecoder->DecodeNextFrame(pSource)) {
+        result.frameChecksums.push_back(FrameChecksum(pFrame));
+        av_frame_free(&pFrame);
+    }
+
+    result.seconds = (double)(av_gettime_relative() - start) / 1000000.0;
+    result.packets = pSource->PacketsRead();
+    result.payloadBytes = pSource->PayloadBytes();
+    result.bytesRead = g_pInput->BytesRead() - bytesRead;
+    result.readCalls = g_pInput->ReadCalls() - readCalls;
+
+    delete pSource;
+
+    return true;
+}
+
+// Runs both packet sources over the whole file and checks they decode the same pictures
+static bool RunDemuxBenchmark(MpegTS_XML &mpts)
+{
+    const eDemuxBackend backends[] = { eDemuxInternal, eDemuxFFmpeg };
+    DemuxBenchResult results[2];
+
+    // Read calls are the system calls made through the I/O layer, mmap makes none
+    printf("Demux benchmark: %s, I/O backend %s\n", mpts.m_mpegTSDescriptor.fileName.c_str(), g_pInput->Name());
+    printf("%-10s %10s %10s %10s %10s %12s %14s %12s %10s\n",
+           "demux", "frames", "seconds", "frames/s", "packets", "payload MB", "bytes read", "read calls", "checksum");
+
+    for (int b = 0; b < 2; b++) {
+        DemuxBenchResult &r = results[b];
+
+        if (!BenchPacketSource(backends[b], mpts, r)) {
+            fprintf(stderr, "Error: Could not run the %s demux\n", DemuxBackendName(backends[b]));
+            return false;
+        }
+
+        unsigned long checksum = 1;
+        for (auto frameChecksum : r.frameChecksums)
+            checksum = av_adler32_update(checksum, (const uint8_t*)&frameChecksum, sizeof(frameChecksum));
+
+        printf("%-10s %10zu %10.3f %10.1f %10llu %12.2f %14llu %12llu %08lx\n",
+               r.name, r.frameChecksums.size(), r.seconds,
+               r.seconds > 0.0 ? (double)r.frameChecksums.size() / r.seconds : 0.0,
+               r.packets, (double)r.payloadBytes / (1024.0 * 1024.0),
+               r.bytesRead, r.readCalls, checksum);
+    }
+
+    std::vector<uint32_t> &a = results[0].frameChecksums;
+    std::vector<uint32_t> &b = results[1].frameChecksums;
+    size_t common = MIN(a.size(), b.size());
+    size_t mismatch = 0;
+
+    while (mismatch < common && a[mismatch] == b[mismatch])
+        mismatch++;
+
+    if (mismatch == common && a.size() == b.size())
+        printf("Decoded frames: match (%zu frames)\n", common);
+    else if (mismatch == common)
+        printf("Decoded frames: MISMATCH, %s decoded %zu frames and %s %zu\n", results[0].name, a.size(), results[1].name, b.size());
+    else
+        printf("Decoded frames: MISMATCH at decode order frame %zu\n", mismatch);
+
+    return true;
+}
+
+enum eSeekPattern
+{
+    eSeekRandom,        // Anywhere in the file
+    eSeekSequential,    // Forward one slider step at a time
+    eSeekShort,         // Small hops either way around the current position
+    eSeekLong,          // Jumps across roughly half the file
+    eSeekBackward,      // Back one slider step at a time, like the left arrow key
+    eSeekNumPatterns
+};
+
+static const char *g_seekPatternNames[] = { "random", "sequential", "short", "long", "backward" };
+
+// Next byte position for a seek pattern, in [0, lastBytePos]
+static uint64_t NextSeekTarget(eSeekPattern pattern, uint64_t current, uint64_t lastBytePos, std::mt19937_64 &rng)
+{
+    // One step of the 0-100 seek slider
+    uint64_t step = MAX(lastBytePos / 100, 1);
+
+    switch (pattern) {
+        case eSeekRandom:
+            return std::uniform_int_distribution<uint64_t>(0, lastBytePos)(rng);
+
+        case eSeekSequential:
+            return current + step > lastBytePos ? 0 : current + step;
+
+        case eSeekShort: {
+            int64_t hop = std::uniform_int_distribution<int64_t>(-(int64_t)step * 2, (int64_t)step * 2)(rng);
+            int64_t target = (int64_t)current + hop;
+            return (uint64_t)MIN(MAX(target, 0), (int64_t)lastBytePos);
+        }
+
+        case eSeekLong: {
+            uint64_t jump = std::uniform_int_distribution<uint64_t>(lastBytePos * 2 / 5, lastBytePos * 3 / 5)(rng);
+            return (current + jump) % (lastBytePos + 1);
+        }
+
+        case eSeekBackward:
+            return current < step ? lastBytePos : current - step;
+
+        default:
+            return 0;
+    }
+}
+
+// Sorted samples in, the value at percentile p out
+static double Percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    size_t i = (size_t)(p * (double)sorted.size() + 0.5);
+    i = MIN(MAX(i, 1), sorted.size());
+
+    return sorted[i - 1];
+}
+
+// Replays seek patterns through the same path the seek slider takes and reports time-to-frame
+static bool RunSeekBenchmark(MpegTS_XML &mpts)
+{
+    uint64_t lastBytePos = (uint64_t)BytePosOfLastAU(mpts);
+    std::mt19937_64 rng(g_options.seed);
+
+    printf("Seek benchmark: %s, demux %s, I/O backend %s, %u seeks per pattern, seed %u\n",
+           mpts.m_mpegTSDescriptor.fileName.c_str(), g_pPacketSource->Name(), g_pInput->Name(),
+           g_options.seeksPerPattern, g_options.seed);
+    printf("%-11s %7s %7s %9s %9s %9s %9s %13s %12s\n",
+           "pattern", "seeks", "failed", "p50 ms", "p95 ms", "p99 ms", "max ms", "packets/seek", "max packets");
+
+    for (int pattern = 0; pattern < eSeekNumPatterns; pattern++) {
+        std::vector<double> milliseconds;
+        uint64_t packets = 0;
+        uint64_t maxPackets = 0;
+        unsigned int failed = 0;
+        uint64_t current = 0;
+
+        milliseconds.reserve(g_options.seeksPerPattern);
+
+        for (unsigned int s = 0; s < g_options.seeksPerPattern; s++) {
+            current = NextSeekTarget((eSeekPattern)pattern, current, lastBytePos, rng);
+
+            uint64_t bytePos = current;
+            uint64_t packetsBefore = g_pPacketSource->PacketsRead();
+            int64_t start = av_gettime_relative();
+
+            // The slider seek in RunGUI, minus the texture upload
+            unsigned int frameNumber = mpts.VideoKeyFrameFromBytePos(bytePos);
+            AVFrame *pFrame = SeekToFrame(frameNumber, bytePos);
+
+            if (pFrame)
+                mpts.BuildPresentationUnits(frameNumber);
+
+            int64_t elapsed = av_gettime_relative() - start;
+
+            if (!pFrame) {
+                failed++;
+                continue;
+            }
+
+            av_frame_free(&pFrame);
+
+            uint64_t seekPackets = g_pPacketSource->PacketsRead() - packetsBefore;
+
+            milliseconds.push_back((double)elapsed / 1000.0);
+            packets += seekPackets;
+            maxPackets = MAX(maxPackets, seekPackets);
+        }
+
+        std::sort(milliseconds.begin(), milliseconds.end());
+
+        size_t n = MAX(milliseconds.size(), 1);
+
+        printf("%-11s %7zu %7u %9.3f %9.3f %9.3f %9.3f %13.2f %12llu\n",
+               g_seekPatternNames[pattern], milliseconds.size(), failed,
+               Percentile(milliseconds, 0.50), Percentile(milliseconds, 0.95), Percentile(milliseconds, 0.99),
+               milliseconds.empty() ? 0.0 : milliseconds.back(),
+               (double)packets / (double)n, maxPackets);
+    }
+
+    return true;
+}
+
+// TR 101 290 checks over the whole file, each event with the video frame it falls in,
+// then the rate, accuracy and jitter of every PCR PID and the programs and services of the PSI
+static bool RunConformanceCheck(MpegTS_XML &mpts)
+{
+    ConformanceChecker checker;
+
+    printf("Conformance check: %s, I/O backend %s\n", mpts.m_mpegTSDescriptor.fileName.c_str(), g_pInput->Name());
+
+    int64_t start = av_gettime_relative();
+
+    if (!checker.Run(g_pInput, mpts.m_mpegTSDescriptor.packetSize)) {
+        fprintf(stderr, "Error: Could not read %s\n", mpts.m_mpegTSDescriptor.fileName.c_str());
+        return false;
+    }
+
+    double seconds = (double)(av_gettime_relative() - start) / 1000000.0;
+    double megabytes = (double)checker.BytesChecked() / (1024.0 * 1024.0);
+
+    printf("%.2f MB in %.3f seconds, %.1f MB/s\n\n", megabytes, seconds, seconds > 0.0 ? megabytes / seconds : 0.0);
+    printf("%-8s %-24s %12s\n", "priority", "check", "errors");
+
+    for (int i = 0; i < eNumConformanceChecks; i++) {
+        eConformanceCheck check = (eConformanceCheck)i;
+        printf("%-8d %-24s %12llu\n", ConformancePriority(check), ConformanceCheckName(check), (unsigned long long)checker.Count(check));
+    }
+
+    const PCRAnalysis &pcr = checker.PCR();
+
+    if (pcr.Tracks()) {
+        printf("\n%-8s %8s %5s %10s %10s %10s %10s %10s %8s %19s\n",
+               "pcr pid", "pcrs", "runs", "min Mb/s", "mean Mb/s", "max Mb/s", "max gap ms", "accuracy", "> 500ns", "jitter ns");
+
+        for (size_t t = 0; t < pcr.Tracks(); t++) {
+            const PCRTrack &track = pcr.Track(t);
+            const PCRSummary &summary = track.Summary();
+
+            printf("0x%04X   %8u %5u %10.3f %10.3f %10.3f %10.2f %10.0f %8u %9.0f to %6.0f%s\n",
+                   track.PID(), summary.samples, summary.runs,
+                   summary.minBitsPerSecond / 1000000.0, summary.meanBitsPerSecond / 1000000.0, summary.maxBitsPerSecond / 1000000.0,
+                   summary.maxIntervalMs, summary.maxAccuracyNs, summary.accuracyErrors,
+                   summary.minJitterNs, summary.maxJitterNs, summary.bArrivalTimes ? "" : " *");
+        }
+
+        if (188 == mpts.m_mpegTSDescriptor.packetSize)
+            printf("* No arrival times in 188 byte packets, the jitter is the accuracy\n");
+    }
+
+    const PSITables &psi = checker.PSI();
+
+    printf("\ntransport_stream_id %d: %llu sections, %llu new or changed, %llu CRC errors, %llu version changes\n",
+           psi.TransportStreamId(), (unsigned long long)psi.Sections(), (unsigned long long)psi.SectionsParsed(),
+           (unsigned long long)psi.CRCErrors(), (unsigned long long)psi.VersionChangeCount());
+
+    for (const PSIProgram &program : psi.Programs()) {
+        printf("program %u: PMT PID 0x%04X, PCR PID 0x%04X, version %d\n", program.programNumber, program.pmtPID, program.pcrPID, program.version);
+
+        for (const PSIStream &stream : program.streams)
+            printf("    PID 0x%04X stream_type 0x%02X\n", stream.pid, stream.streamType);
+    }
+
+    for (const PSIService &service : psi.Services()) {
+        printf("service %u: %s / %s, %u EIT sections", service.serviceId, service.provider.c_str(), service.name.c_str(), service.eitSections);
+        if (!service.presentEvent.empty())
+            printf(", now %s", service.presentEvent.c_str());
+        printf("\n");
+    }
+
+    for (const PSIVersionChange &change : psi.VersionChanges())
+        printf("version change at %llu: PID 0x%04X table_id 0x%02X extension %u, %u to %u\n",
+               (unsigned long long)change.offset, change.pid, change.tableId, change.extension, change.oldVersion, change.newVersion);
+
+    if (g_options.pcrFileName) {
+        if (!pcr.WriteCSV(g_options.pcrFileName)) {
+            fprintf(stderr, "Error: Could not write %s\n", g_options.pcrFileName);
+            return false;
+        }
+
+        printf("PCRs written to %s\n", g_options.pcrFileName);
+    }
+
+    if (0 == checker.EventCount())
+        return true;
+
+    printf("\n%-10s %14s %6s %-24s %s\n", "frame", "offset", "pid", "check", "detail");
+
+    for (size_t i = 0; i < checker.EventCount(); i++) {
+        const ConformanceEvent &event = checker.Event(i);
+
+        // The last AU that starts at or before the event
+        unsigned int next = mpts.m_videoAccessUnitsDecode.LowerBound(event.offset + 1);
+
+        char frame[16] = "-";
+        if (next > 0)
+            snprintf(frame, sizeof(frame), "%u", next - 1);
+
+        char pid[8] = "-";
+        if (0xFFFF != event.pid)
+            snprintf(pid, sizeof(pid), "0x%04X", event.pid);
+
+        char detail[128];
+        ConformanceEventText(event, detail, sizeof(detail));
+
+        printf("%-10s %14llu %6s %-24s %s\n", frame, (unsigned long long)event.offset, pid, ConformanceCheckName((eConformanceCheck)event.check), detail);
+    }
+
+    if (checker.ErrorCount() > checker.EventCount())
+        printf("... %llu more errors not listed\n", (unsigned long long)(checker.ErrorCount() - checker.EventCount()));
+
+    return true;
+}
+
+// Every program of the PAT analyzed on its own worker in one pass over the file
+static bool RunProgramAnalysis(MpegTS_XML &mpts)
+{
+    ProgramAnalyzer analyzer;
+
+    if (!analyzer.Run(mpts, g_pInput, g_options.numWorkers))
+        return false;
+
+    double megabytes = (double)analyzer.BytesRead() / (1024.0 * 1024.0);
+    double seconds = analyzer.Seconds();
+
+    printf("Program analysis: %s, I/O backend %s\n", mpts.m_mpegTSDescriptor.fileName.c_str(), g_pInput->Name());
+    printf("%zu programs on %u workers, %.2f MB in %.3f seconds, %.1f MB/s\n\n", analyzer.Programs(), analyzer.Workers(),
+           megabytes, seconds, seconds > 0.0 ? megabytes / seconds : 0.0);
+    printf("%-8s %6s %6s %9s %7s %17s %6s %15s %19s %6s %9s %11s %6s\n",
+           "program", "video", "audio", "Mb/s", "frames", "I/P/B", "gops", "gop min/mean/max", "A/V ms min/mean/max", "quant", "decoded", "size", "luma");
+
+    for (size_t i = 0; i < analyzer.Programs(); i++) {
+        const ProgramReport &report = analyzer.Report(i);
+        char video[16], audio[16], types[32], gop[32], av[32], size[16];
+
+        snprintf(video, sizeof(video), "0x%04lX", report.videoPID);
+        snprintf(audio, sizeof(audio), "0x%04lX", report.audioPID);
+        snprintf(types, sizeof(types), "%u/%u/%u", report.framesOfType[0], report.framesOfType[1], report.framesOfType[2]);
+        snprintf(gop, sizeof(gop), "%u/%.1f/%u", report.minGOPLength, report.meanGOPLength, report.maxGOPLength);
+        snprintf(av, sizeof(av), "%.0f/%.0f/%.0f", report.minAVOffsetMs, report.meanAVOffsetMs, report.maxAVOffsetMs);
+        snprintf(size, sizeof(size), "%dx%d", report.width, report.height);
+
+        printf("%-8u %6s %6s %9.3f %7u %17s %6u %15s %19s %6.1f %4u/%-4u %11s %6.1f\n",
+               report.programNumber, report.videoPID < 0 ? "-" : video, report.audioPID < 0 ? "-" : audio, report.bitsPerSecond / 1000000.0, report.frames, types, report.gops,
+               report.gops ? gop : "-", report.avSamples ? av : "-", report.meanQuantiserScale, report.framesDecoded, report.framesDecoded + report.decodeErrors,
+               report.width ? size : "-", report.meanLuma);
+    }
+
+    return true;
+}
+
+// The XML and its gzip start with text or 0x1F, a TS with a sync byte, after the 4 byte prefix of 192 byte packets
+static bool IsTransportStream(const char *fileName)
+{
+    FILE *pFile = fopen(fileName, "rb");
+
+    if (!pFile)
+        return false;
+
+    uint8_t start[5] = { 0 };
+    size_t size = fread(start, 1, sizeof(start), pFile);
+
+    fclose(pFile);
+
+    return sizeof(start) == size && (0x47 == start[0] || 0x47 == start[4]);
+}
+
+static void PrintUsage(const char *appName)
+{
+    fprintf(stderr, "Usage: %s [options] input.xml|input.ts\n", appName);
+    fprintf(stderr, "  The file input.xml is generated by mpts_parser\n");
+    fprintf(stderr, "  It may also be gzip compressed, input.xml.gz\n");
+    fprintf(stderr, "  A transport stream, input.ts, is indexed straight from its packets instead\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --io <stdio|pread|mmap|async>  How the transport stream is read (default: pread)\n");
+    fprintf(stderr, "  --demux <internal|ffmpeg>      Where video packets come from (default: internal)\n");
+    fprintf(stderr, "  --bench-demux                  Decode the file with both demuxers, report throughput and compare, no GUI\n");
+    fprintf(stderr, "  --bench-seek                   Replay random, sequential, short, long and backward seeks, report time-to-frame, no GUI\n");
+    fprintf(stderr, "  --seeks <n>                    Seeks per pattern for --bench-seek (default: 200)\n");
+    fprintf(stderr, "  --seed <n>                     Random seed for --bench-seek (default: 1)\n");
+    fprintf(stderr, "  --profile                      Start with the pipeline profiler on, see the Performance window\n");
+    fprintf(stderr, "  --trace <file.json>            Profile and write a Chrome trace of every stage on exit\n");
+    fprintf(stderr, "  --metrics <file|unix:path>     Write Prometheus metrics to a file or a Unix socket periodically\n");
+    fprintf(stderr, "  --metrics-interval <seconds>   How often --metrics is written (default: 10)\n");
+    fprintf(stderr, "  --mem-report                   Print current and peak memory per subsystem after loading and on exit\n");
+    fprintf(stderr, "  --mem-limit <MB>               Cap the process, evicting the cheapest least recently used data first\n");
+    fprintf(stderr, "  --index-cache <MB>             Resident AU index pages before they go to a temporary file (default: 256)\n");
+    fprintf(stderr, "  --full-load                    Parse every AU of a terse file up front instead of as it is used\n");
+    fprintf(stderr, "  --check                        Run the TR 101 290 priority 1 and 2 transport checks, list each error with its frame, no GUI\n");
+    fprintf(stderr, "  --pcr-csv <file.csv>           With --check, write the rate, accuracy and jitter at every PCR\n");
+    fprintf(stderr, "  --program <number>             Program of an MPTS to play (default: the first in the PAT)\n");
+    fprintf(stderr, "  --analyze-programs             GOPs, A/V sync, bit rate and sampled decodes of every program in one pass, no GUI\n");
+    fprintf(stderr, "  --workers <n>                  Threads the programs are shared out over (default: one per core)\n");
+}
+
+static bool ParseCommandLine(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--io") && i + 1 < argc) {
+            if (!InputBackendFromName(argv[++i], g_options.inputBackend)) {
+                fprintf(stderr, "Error: Unknown I/O backend: %s\n", argv[i]);
+                return false;
+            }
+        } else if (0 == strcmp(argv[i], "--demux") && i + 1 < argc) {
+            if (!DemuxBackendFromName(argv[++i], g_options.demuxBackend)) {
+                fprintf(stderr, "Error: Unknown demux backend: %s\n", argv[i]);
+                return false;
+            }
+        } else if (0 == strcmp(argv[i], "--bench-demux")) {
+            g_options.bBenchDemux = true;
+        } else if (0 == strcmp(argv[i], "--bench-seek")) {
+            g_options.bBenchSeek = true;
+        } else if (0 == strcmp(argv[i], "--seeks") && i + 1 < argc) {
+            g_options.seeksPerPattern = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--seed") && i + 1 < argc) {
+            g_options.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--profile")) {
+            g_options.bProfile = true;
+        } else if (0 == strcmp(argv[i], "--trace") && i + 1 < argc) {
+            g_options.bProfile = true;
+            g_options.traceFileName = argv[++i];
+        } else if (0 == strcmp(argv[i], "--metrics") && i + 1 < argc) {
+            g_options.metricsTarget = argv[++i];
+        } else if (0 == strcmp(argv[i], "--metrics-interval") && i + 1 < argc) {
+            g_options.metricsInterval = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (0 == strcmp(argv[i], "--mem-report")) {
+            g_options.bMemReport = true;
+        } else if (0 == strcmp(argv[i], "--mem-limit") && i + 1 < argc) {
+            g_options.memLimit = strtoull(argv[++i], NULL, 10) << 20;
+        } else if (0 == strcmp(argv[i], "--index-cache") && i + 1 < argc) {
+            g_options.indexCache = strtoull(argv[++i], NULL, 10) << 20;
+        } else if (0 == strcmp(argv[i], "--full-load")) {
+            g_options.bFullLoad = true;
+        } else if (0 == strcmp(argv[i], "--check")) {
+            g_options.bCheck = true;
+        } else if (0 == strcmp(argv[i], "--pcr-csv") && i + 1 < argc) {
+            g_options.bCheck = true;
+            g_options.pcrFileName = argv[++i];
+        } else if (0 == strcmp(argv[i], "--program") && i + 1 < argc) {
+            g_options.programNumber = (int)strtol(argv[++i], NULL, 0);
+        } else if (0 == strcmp(argv[i], "--analyze-programs")) {
+            g_options.bAnalyzePrograms = true;
+        } else if (0 == strcmp(argv[i], "--workers") && i + 1 < argc) {
+            g_options.numWorkers = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if ('-' == argv[i][0] && '-' == argv[i][1]) {
+            fprintf(stderr, "Error: Unknown option: %s\n", argv[i]);
+            return false;
+        } else {
+            g_options.xmlFileName = argv[i];
+        }
+    }
+
+    return NULL != g_options.xmlFileName;
+}
+
+// Final metrics snapshot, memory report and Chrome trace, once the work is done
+static void WriteReports()
+{
+    MetricsStopExport();
+
+    if (g_options.bMemReport) {
+        printf("\nMemory on exit:\n");
+        MemoryPrintReport(stdout);
+
+        if (BudgetLimit())
+            printf("Memory cap %llu MB: %llu evictions, %llu bytes evicted\n", BudgetLimit() >> 20, BudgetEvictions(), BudgetEvictedBytes());
+    }
+
+    if (!g_options.traceFileName)
+        return;
+
+    if (ProfilerWriteChromeTrace(g_options.traceFileName))
+        printf("Trace: %llu events written to %s, %llu dropped\n", ProfilerEventCount(), g_options.traceFileName, ProfilerDroppedEvents());
+}
+
+// It all starts here
+int main(int argc, char* argv[])
+{
+    //    DoMyXMLTest(argv[1]);
+    //    DoMyXMLTest2();
+    //    return 0;
+
+    /*
+        if(1)
+        {
+            DoFFMpegOpenGLTest("F:\\streams\\mpeg2\\muppets_take_manhattan.mpg");
+            return 0;
+        }
+    */
+
+    if (!ParseCommandLine(argc, argv)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    if (g_options.bProfile)
+        ProfilerEnable(true);
+
+    // Started first so parsing the XML is visible too
+    if (g_options.metricsTarget && !MetricsStartExport(g_options.metricsTarget, g_options.metricsInterval))
+        return 1;
+
+    printf("%s: Opening and analyzing %s, this can take a while...\n", argv[0], g_options.xmlFileName);
+
+    BudgetSetLimit(g_options.memLimit);
+    PagedStore::SetCacheLimit(g_options.indexCache);
+
+    MpegTS_XML mpts;
+    XmlDocumentConsumer xmlDocument;
+
+    mpts.SelectProgram(g_options.programNumber);
+
+    bool bTransportStream = IsTransportStream(g_options.xmlFileName);
+
+    if (bTransportStream) {
+        // Without the XML the TS is read twice: for the PAT and PMTs, then for every PES of every stream
+        g_pInput = CreateInputSource(g_options.inputBackend);
+
+        if (!g_pInput || !g_pInput->Open(g_options.xmlFileName)) {
+            fprintf(stderr, "Error: Could not open %s with the %s I/O backend\n", g_options.xmlFileName, InputBackendName(g_options.inputBackend));
+            return 1;
+        }
+
+        if (!mpts.OpenTransportStream(g_options.xmlFileName, g_pInput)) {
+            fprintf(stderr, "Error: Could not index the transport stream %s\n", g_options.xmlFileName);
+            return 1;
+        }
+
+        printf("%s: %u video and %u audio frames indexed from the TS\n", argv[0], mpts.m_videoAccessUnitsDecode.size(), mpts.m_audioAccessUnits.size());
+    } else if (!g_options.bFullLoad && mpts.OpenLazy(g_options.xmlFileName)) {
+        // A terse file only has its frames located up front, each chunk of AUs is parsed when first used
+        printf("%s: %u video and %u audio frames, parsed as they are used\n", argv[0], mpts.m_videoAccessUnitsDecode.size(), mpts.m_audioAccessUnits.size());
+    } else {
+        // Open the source xml file that describes the MPTS
+        XmlDocumentConsumer::Pin xmlPin(xmlDocument);
+        tinyxml2::XMLDocument& doc = xmlPin.Document();
+        tinyxml2::XMLError xmlError = LoadXMLFile(doc, g_options.xmlFileName);
+
+        if (tinyxml2::XML_SUCCESS != xmlError) {
+            fprintf(stderr, "Error: TinyXml2 could not open file: %s\n", g_options.xmlFileName);
+            return 1;
+        }
+
+        tinyxml2::XMLElement* root = doc.FirstChildElement("file");
+
+        if (nullptr == root) {
+            fprintf(stderr, "Error: %s does not contain a <file> element at the start!\n", g_options.xmlFileName);
+            return 1;
+        }
+
+        mpts.ParsePMT(root);
+
+        // Get simple info about the file
+        mpts.ParseMpegTSDescriptor(root);
+
+        // Build current access units
+        mpts.ParsePacketList(root);
+
+        // Costs nothing to drop once the pin goes at the end of this block, doc and root must not be used after it
+        BudgetInsert(&xmlDocument, 0, MemoryCurrent(eMemXmlDom), 0.0);
+    }
+
+    if (-1 != g_options.programNumber && mpts.PlayedProgram() < 0) {
+        fprintf(stderr, "Error: Program %d is not in the PAT of %s, or its PMT lists no streams\n", g_options.programNumber, g_options.xmlFileName);
+        return 1;
+    }
+
+    if (mpts.Programs().size() > 1 && mpts.PlayedProgram() >= 0) {
+        printf("%s: %zu programs, %zu streams, playing program %u\n", argv[0], mpts.Programs().size(), mpts.Streams().size(),
+               mpts.Programs()[mpts.PlayedProgram()].programNumber);
+    }
+
+    // Opened first, the FFmpeg demuxer reads through it too.  A TS was opened to be indexed.
+    if (!bTransportStream) {
+        g_pInput = CreateInputSource(g_options.inputBackend);
+
+        if (!g_pInput || !g_pInput->Open(mpts.m_mpegTSDescriptor.fileName)) {
+            fprintf(stderr, "Error: Could not open %s with the %s I/O backend\n", mpts.m_mpegTSDescriptor.fileName.c_str(), InputBackendName(g_options.inputBackend));
+            return 1;
+        }
+    }
+
+    // Only the packet headers are read, FFmpeg is not needed
+    if (g_options.bCheck) {
+        bool bOK = RunConformanceCheck(mpts);
+
+        delete g_pInput;
+
+        WriteReports();
+
+        return bOK ? 0 : 1;
+    }
+
+    if (g_options.bAnalyzePrograms) {
+        bool bOK = RunProgramAnalysis(mpts);
+
+        delete g_pInput;
+
+        WriteReports();
+
+        return bOK ? 0 : 1;
+    }
+
+    if (0 != OpenInputFile(mpts))
+        return 1;
+
+    g_pDecoder = new VideoDecoder(g_stream_ctx[mpts.m_videoStreamIndex].dec_ctx);
+
+    if (g_options.bMemReport) {
+        printf("\nMemory after loading %s:\n", g_options.xmlFileName);
+        MemoryPrintReport(stdout);
+    }
+
+    BudgetEnforce();
+
+    if (g_options.bBenchDemux) {
+        bool bOK = RunDemuxBenchmark(mpts);
+
+        delete g_pDecoder;
+        CloseInputFile(mpts);
+        delete g_pInput;
+
+        WriteReports();
+
+        return bOK ? 0 : 1;
+    }
+
+    g_pPacketSource = CreatePacketSource(g_options.demuxBackend, mpts, g_pInput, g_ifmt_ctx);
+
+    if (g_options.bBenchSeek) {
+        bool bOK = RunSeekBenchmark(mpts);
+
+        delete g_pPacketSource;
+        delete g_pDecoder;
+        CloseInputFile(mpts);
+        delete g_pInput;
+
+        WriteReports();
+
+        return bOK ? 0 : 1;
+    }
+
+    if (0 != InitFilters())
+        return 1;
+
+    // Show as GUI
+    if (RunGUI(mpts)) {
+        delete g_pPacketSource;
+        delete g_pDecoder;
+        CloseInputFile(mpts);
+
+        printf("I/O backend %s: %llu read calls, %llu bytes read\n", g_pInput->Name(), g_pInput->ReadCalls(), g_pInput->BytesRead());
+        delete g_pInput;
+
+        WriteReports();
+
+        return 0;
+    }
+
+    return 1;
 }
\ No newline at end of file
@@ -0,0 +1,591 @@
+#include "mp2ts_au_store.h"
+#include "mp2ts_xml.h"
+
+#include <cstring>
+
+static inline void WriteVarint(std::vector<uint8_t> &data, uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        data.push_back((uint8_t) (value | 0x80));
+        value >>= 7;
+    }
+
+    data.push_back((uint8_t) value);
+}
+
+static inline const uint8_t *ReadVarint(const uint8_t *p, uint64_t &value)
+{
+    uint64_t byte = *p++;
+    value = byte & 0x7F;
+
+    // One and two byte values are by far the most common, no loop for those
+    if(byte & 0x80)
+    {
+        unsigned int shift = 7;
+
+        do
+        {
+            byte = *p++;
+            value |= (byte & 0x7F) << shift;
+            shift += 7;
+        } while(byte & 0x80);
+    }
+
+    return p;
+}
+
+static inline uint64_t ZigZagEncode(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t ZigZagDecode(uint64_t value)
+{
+    return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+void AccessUnitElementStore::Clear()
+{
+    m_count = 0;
+    m_prevEnd = 0;
+    m_next = 0;
+    m_writeOffset = 0;
+    m_openBlock = NO_BLOCK;
+    m_open.clear();
+    m_blocks.clear();
+    m_pages.Clear();
+}
+
+void AccessUnitElementStore::Reserve(uint32_t count)
+{
+    Clear();
+
+    Block block = { 0, 0, 0 };
+    m_blocks.assign((count + BLOCK_SIZE - 1) >> BLOCK_SHIFT, block);
+    m_count = count;
+}
+
+void AccessUnitElementStore::SetWritePosition(uint32_t index)
+{
+    if(NO_BLOCK != m_openBlock)
+        CloseBlock();
+
+    // Blocks are anchored on their own, nothing carries over from what was written last
+    m_next = index & ~(BLOCK_SIZE - 1);
+    m_prevEnd = 0;
+}
+
+void AccessUnitElementStore::CloseBlock()
+{
+    Block &block = m_blocks[m_openBlock];
+    size_t n = m_open.size();
+
+    // A block that fits in a page starts on the next page rather than straddle two
+    uint64_t inPage = m_writeOffset % PAGE_SIZE_BYTES;
+
+    if(n <= PAGE_SIZE_BYTES && inPage + n > PAGE_SIZE_BYTES)
+        m_writeOffset += PAGE_SIZE_BYTES - inPage;
+
+    block.dataOffset = m_writeOffset;
+    block.dataSize = (uint32_t) n;
+
+    for(size_t written = 0; written < n; )
+    {
+        size_t chunk = PAGE_SIZE_BYTES - (size_t) (m_writeOffset % PAGE_SIZE_BYTES);
+
+        if(chunk > n - written)
+            chunk = n - written;
+
+        uint8_t *pPage = m_pages.Write(m_writeOffset, chunk);
+
+        // A page that could not be read back leaves the block unreadable
+        if(pPage)
+            memcpy(pPage, m_open.data() + written, chunk);
+        else
+            block.dataSize = 0;
+
+        written += chunk;
+        m_writeOffset += chunk;
+    }
+
+    m_open.clear();
+    m_openBlock = NO_BLOCK;
+}
+
+const uint8_t *AccessUnitElementStore::BlockData(size_t block) const
+{
+    if(block == m_openBlock)
+        return m_open.data();
+
+    // Every AU takes at least its element count, so a block without data was never written
+    if(0 == m_blocks[block].dataSize)
+        return NULL;
+
+    return m_pages.Read(m_blocks[block].dataOffset, m_blocks[block].dataSize, m_scratch);
+}
+
+uint32_t AccessUnitElementStore::Add(const std::vector<AccessUnitElement> &elements)
+{
+    if(0 == (m_next & (BLOCK_SIZE - 1)))
+    {
+        if(NO_BLOCK != m_openBlock)
+            CloseBlock();
+
+        m_openBlock = m_next >> BLOCK_SHIFT;
+
+        if(m_openBlock >= m_blocks.size())
+            m_blocks.resize(m_openBlock + 1);
+
+        // Anchor on the first element so the first delta of the block is 0
+        if(elements.size())
+            m_prevEnd = elements[0].startByteLocation;
+
+        Block &block = m_blocks[m_openBlock];
+        block.anchorByteLocation = m_prevEnd;
+        block.dataOffset = 0;
+        block.dataSize = 0;
+    }
+
+    WriteVarint(m_open, elements.size());
+
+    for(const AccessUnitElement &aue : elements)
+    {
+        int64_t delta = (int64_t) (aue.startByteLocation - m_prevEnd);
+
+        if(0 == delta % m_packetSize)
+            WriteVarint(m_open, ZigZagEncode(delta / m_packetSize) << 1);
+        else
+            WriteVarint(m_open, (ZigZagEncode(delta) << 1) | 1);
+
+        WriteVarint(m_open, aue.numPackets);
+
+        m_prevEnd = aue.startByteLocation + aue.numPackets * m_packetSize;
+    }
+
+    if(m_next >= m_count)
+        m_count = m_next + 1;
+
+    return m_next++;
+}
+
+const uint8_t *AccessUnitElementStore::DecodeElement(const uint8_t *p, uint64_t &prevEnd, uint64_t &startByteLocation, uint64_t &numPackets) const
+{
+    uint64_t value = 0;
+    p = ReadVarint(p, value);
+
+    int64_t delta = ZigZagDecode(value >> 1);
+
+    if(0 == (value & 1))
+        delta *= m_packetSize;
+
+    startByteLocation = prevEnd + delta;
+
+    p = ReadVarint(p, numPackets);
+
+    prevEnd = startByteLocation + numPackets * m_packetSize;
+
+    return p;
+}
+
+const uint8_t *AccessUnitElementStore::SkipAccessUnit(const uint8_t *p, uint64_t &prevEnd) const
+{
+    uint64_t count = 0;
+    p = ReadVarint(p, count);
+
+    uint64_t startByteLocation = 0;
+    uint64_t numPackets = 0;
+
+    for(uint64_t i = 0; i < count; i++)
+        p = DecodeElement(p, prevEnd, startByteLocation, numPackets);
+
+    return p;
+}
+
+const uint8_t *AccessUnitElementStore::Seek(uint32_t index, uint64_t &prevEnd) const
+{
+    const uint8_t *p = BlockData(index >> BLOCK_SHIFT);
+
+    if(!p)
+        return NULL;
+
+    prevEnd = m_blocks[index >> BLOCK_SHIFT].anchorByteLocation;
+
+    for(uint32_t i = index & ~(BLOCK_SIZE - 1); i < index; i++)
+        p = SkipAccessUnit(p, prevEnd);
+
+    return p;
+}
+
+size_t AccessUnitElementStore::Get(uint32_t index, std::vector<AccessUnitElement> &elements) const
+{
+    elements.clear();
+
+    if(index >= m_count)
+        return 0;
+
+    uint64_t prevEnd = 0;
+    const uint8_t *p = Seek(index, prevEnd);
+
+    if(!p)
+        return 0;
+
+    uint64_t count = 0;
+    p = ReadVarint(p, count);
+
+    for(uint64_t i = 0; i < count; i++)
+    {
+        AccessUnitElement aue;
+        p = DecodeElement(p, prevEnd, aue.startByteLocation, aue.numPackets);
+        elements.push_back(aue);
+    }
+
+    return elements.size();
+}
+
+bool AccessUnitElementStore::FirstByteLocation(uint32_t index, uint64_t &location) const
+{
+    if(index >= m_count)
+        return false;
+
+    uint64_t prevEnd = 0;
+    const uint8_t *p = Seek(index, prevEnd);
+
+    if(!p)
+        return false;
+
+    uint64_t count = 0;
+    p = ReadVarint(p, count);
+
+    // An AU without elements sits where the previous one ended
+    location = prevEnd;
+
+    if(count)
+    {
+        uint64_t numPackets = 0;
+        DecodeElement(p, prevEnd, location, numPackets);
+    }
+
+    return true;
+}
+
+uint64_t AccessUnitElementStore::NumPackets(uint32_t index) const
+{
+    if(index >= m_count)
+        return 0;
+
+    uint64_t prevEnd = 0;
+    const uint8_t *p = Seek(index, prevEnd);
+
+    if(!p)
+        return 0;
+
+    uint64_t count = 0;
+    p = ReadVarint(p, count);
+
+    uint64_t total = 0;
+    uint64_t startByteLocation = 0;
+    uint64_t numPackets = 0;
+
+    for(uint64_t i = 0; i < count; i++)
+    {
+        p = DecodeElement(p, prevEnd, startByteLocation, numPackets);
+        total += numPackets;
+    }
+
+    return total;
+}
+
+uint32_t AccessUnitElementStore::LowerBound(uint64_t bytePos) const
+{
+    if(0 == m_count)
+        return 0;
+
+    // First block whose anchor is >= bytePos
+    size_t low = 0;
+    size_t high = m_blocks.size();
+
+    while(low < high)
+    {
+        size_t mid = (low + high) / 2;
+
+        if(m_blocks[mid].anchorByteLocation < bytePos)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    // The answer is either in the block before it, or is its first AU
+    if(0 == low)
+        return 0;
+
+    uint32_t index = (uint32_t) (low - 1) << BLOCK_SHIFT;
+    uint32_t end = (uint32_t) low << BLOCK_SHIFT;
+
+    if(end > m_count)
+        end = m_count;
+
+    uint64_t prevEnd = m_blocks[low - 1].anchorByteLocation;
+    const uint8_t *p = BlockData(low - 1);
+
+    // Of a block that cannot be read, the first AU of the next is the first known to be far enough
+    if(!p)
+        return end;
+
+    for(; index < end; index++)
+    {
+        uint64_t count = 0;
+        const uint8_t *pElements = ReadVarint(p, count);
+
+        uint64_t firstByteLocation = prevEnd;
+
+        if(count)
+        {
+            uint64_t scratchEnd = prevEnd;
+            uint64_t numPackets = 0;
+            DecodeElement(pElements, scratchEnd, firstByteLocation, numPackets);
+        }
+
+        if(firstByteLocation >= bytePos)
+            return index;
+
+        p = SkipAccessUnit(p, prevEnd);
+    }
+
+    return end;
+}
+
+size_t AccessUnitElementStore::MemoryUsage() const
+{
+    return (size_t) m_pages.ResidentBytes() + m_open.capacity() + m_blocks.capacity() * sizeof(Block) + sizeof(*this);
+}
+
+AccessUnitIndex::AccessUnitIndex(const char *recordsName, eMemSubsystem recordsSubsystem, const char *elementsName, eMemSubsystem elementsSubsystem)
+    : m_streamType(0)
+    , m_pid(-1)
+    , m_count(0)
+    , m_pLoader(NULL)
+    , m_records(recordsName, recordsSubsystem)
+    , m_elements(elementsName, elementsSubsystem)
+{
+}
+
+void AccessUnitIndex::Clear()
+{
+    m_streamName.clear();
+    m_streamType = 0;
+    m_pid = -1;
+    m_count = 0;
+    m_pLoader = NULL;
+    m_records.Clear();
+    m_elements.Clear();
+}
+
+void AccessUnitIndex::Reserve(uint32_t count, AccessUnitLoader *pLoader)
+{
+    Clear();
+
+    // The record pages of a reserved index are created zero filled, so not loaded
+    m_count = count;
+    m_pLoader = pLoader;
+    m_elements.Reserve(count);
+}
+
+uint32_t AccessUnitIndex::Add(const AccessUnit &au)
+{
+    if(-1 == m_pid)
+    {
+        m_streamName = au.esd.name;
+        m_streamType = (int) au.esd.streamType;
+        m_pid = au.esd.pid;
+    }
+
+    uint32_t index = m_elements.Add(au.accessUnitElements);
+
+    Record record;
+    record.pts = au.pts;
+    record.dts = au.dts;
+    record.pts_seconds = au.pts_seconds;
+    record.dts_seconds = au.dts_seconds;
+    record.frameNumber = au.frameNumber;
+    record.frameType = au.frameType.empty() ? 0 : au.frameType[0];
+    record.closed_gop = au.closed_gop;
+    record.bLoaded = 1;
+    record.random_access = au.random_access;
+
+    uint8_t *pRecord = m_records.Write(RecordOffset(index), sizeof(Record));
+
+    if(pRecord)
+        memcpy(pRecord, &record, sizeof(Record));
+
+    if(index >= m_count)
+        m_count = index + 1;
+
+    return index;
+}
+
+bool AccessUnitIndex::IsLoaded(uint32_t index) const
+{
+    if(index >= m_count)
+        return false;
+
+    if(!m_pLoader)
+        return true;
+
+    const Record *pRecord = (const Record *) m_records.Read(RecordOffset(index), sizeof(Record), m_scratch);
+
+    return pRecord && pRecord->bLoaded;
+}
+
+const AccessUnitIndex::Record *AccessUnitIndex::GetRecord(uint32_t index) const
+{
+    if(index >= m_count)
+        return NULL;
+
+    // Records never cross a page, so this is always a pointer into the page
+    const Record *pRecord = (const Record *) m_records.Read(RecordOffset(index), sizeof(Record), m_scratch);
+
+    if(!pRecord || pRecord->bLoaded || !m_pLoader)
+        return pRecord;
+
+    // Loading only fills in AUs that were reserved, to everyone else the index does not change
+    if(!m_pLoader->LoadAccessUnits(const_cast<AccessUnitIndex &>(*this), index))
+        return NULL;
+
+    pRecord = (const Record *) m_records.Read(RecordOffset(index), sizeof(Record), m_scratch);
+
+    return pRecord && pRecord->bLoaded ? pRecord : NULL;
+}
+
+AccessUnit AccessUnitIndex::operator[](uint32_t index) const
+{
+    const Record *pRecord = GetRecord(index);
+
+    // After GetRecord(), loading the first region sets the stream descriptor
+    AccessUnit au(m_streamName, (eStreamType) m_streamType, m_pid);
+
+    if(!pRecord)
+        return au;
+
+    au.pts = pRecord->pts;
+    au.dts = pRecord->dts;
+    au.pts_seconds = pRecord->pts_seconds;
+    au.dts_seconds = pRecord->dts_seconds;
+    au.frameNumber = pRecord->frameNumber;
+    au.decodeFrameNumber = index;
+    au.closed_gop = pRecord->closed_gop;
+    au.random_access = pRecord->random_access;
+
+    if(pRecord->frameType)
+        au.frameType = std::string(1, pRecord->frameType);
+
+    return au;
+}
+
+AccessUnit AccessUnitIndex::back() const
+{
+    return (*this)[m_count - 1];
+}
+
+char AccessUnitIndex::FrameType(uint32_t index) const
+{
+    const Record *pRecord = GetRecord(index);
+    return pRecord ? pRecord->frameType : 0;
+}
+
+bool AccessUnitIndex::RandomAccess(uint32_t index) const
+{
+    const Record *pRecord = GetRecord(index);
+    return pRecord && pRecord->random_access;
+}
+
+unsigned int AccessUnitIndex::FrameNumber(uint32_t index) const
+{
+    const Record *pRecord = GetRecord(index);
+    return pRecord ? pRecord->frameNumber : 0;
+}
+
+uint64_t AccessUnitIndex::PTS(uint32_t index) const
+{
+    const Record *pRecord = GetRecord(index);
+    return pRecord ? pRecord->pts : 0;
+}
+
+uint64_t AccessUnitIndex::DTS(uint32_t index) const
+{
+    const Record *pRecord = GetRecord(index);
+    return pRecord ? pRecord->dts : 0;
+}
+
+size_t AccessUnitIndex::GetElements(uint32_t index, std::vector<AccessUnitElement> &elements) const
+{
+    elements.clear();
+
+    if(!GetRecord(index))
+        return 0;
+
+    return m_elements.Get(index, elements);
+}
+
+bool AccessUnitIndex::FirstByteLocation(uint32_t index, uint64_t &location) const
+{
+    return GetRecord(index) && m_elements.FirstByteLocation(index, location);
+}
+
+uint64_t AccessUnitIndex::FirstByteLocation(uint32_t index) const
+{
+    uint64_t location = 0;
+
+    if(!FirstByteLocation(index, location))
+        return 0;
+
+    return location;
+}
+
+uint64_t AccessUnitIndex::NumPackets(uint32_t index) const
+{
+    return GetRecord(index) ? m_elements.NumPackets(index) : 0;
+}
+
+uint32_t AccessUnitIndex::LowerBound(uint64_t bytePos) const
+{
+    if(!m_pLoader)
+        return m_elements.LowerBound(bytePos);
+
+    // The block anchors of regions that are not loaded yet are unknown.  Binary search
+    // the AUs themselves instead, only the regions on the search path get loaded.
+    // An AU that cannot be read says nothing about bytePos, the first one after it
+    // that can is compared instead.  The AUs in between are never the answer.
+    uint32_t low = 0;
+    uint32_t high = m_count;
+    uint32_t found = m_count;
+
+    while(low < high)
+    {
+        uint32_t mid = low + (high - low) / 2;
+        uint32_t known = mid;
+        uint64_t location = 0;
+
+        while(known < high && !FirstByteLocation(known, location))
+            known++;
+
+        if(known < high && location < bytePos)
+        {
+            low = known + 1;
+        }
+        else
+        {
+            if(known < high)
+                found = known;
+
+            high = mid;
+        }
+    }
+
+    return found;
+}
+
+size_t AccessUnitIndex::MemoryUsage() const
+{
+    return (size_t) m_records.ResidentBytes() + m_elements.MemoryUsage() + sizeof(*this);
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mp2ts_page_cache.h"
+
+struct AccessUnitElement;
+struct AccessUnit;
+
+/*
+    Compact storage for the AccessUnitElements of every AU in one elementary stream.
+
+    Elements are stored as varints in one byte stream:
+
+        AU:      varint element count, followed by that many elements
+        Element: varint (zigzag(delta) << 1 | unaligned), varint numPackets
+
+    delta is the distance from the end of the previous element to the start of this one.
+    It is counted in packets, or in bytes if the start is not on a packet boundary
+    from the previous element (the unaligned bit).  Every BLOCK_SIZE AUs an absolute anchor
+    is written, so any AU is decoded by skipping at most BLOCK_SIZE-1 AUs of its block.
+
+    A typical slice costs 2-3 bytes instead of the 16 bytes of an AccessUnitElement.
+
+    The encoded blocks live in a PagedStore, only the block directory stays in memory.
+    A block is filled in memory and written to the pages once it is complete, it only
+    crosses a page boundary if it is larger than a page.
+
+    Blocks need not be written in order.  After Reserve(), SetWritePosition() moves
+    the writer to any block, which is how a lazily loaded index fills in regions.
+    Only AUs of blocks that were written can be read.
+*/
+class AccessUnitElementStore
+{
+public:
+
+    enum { BLOCK_SHIFT = 6, BLOCK_SIZE = 1 << BLOCK_SHIFT };
+
+    AccessUnitElementStore(const char *name, eMemSubsystem subsystem)
+        : m_packetSize(188)
+        , m_count(0)
+        , m_prevEnd(0)
+        , m_next(0)
+        , m_writeOffset(0)
+        , m_openBlock(NO_BLOCK)
+        , m_pages(name, subsystem)
+    {
+    }
+
+    void SetPacketSize(uint8_t packetSize) { m_packetSize = packetSize ? packetSize : 188; }
+    void Clear();
+
+    // Appends the elements of the next AU in decode order, returns its index
+    uint32_t Add(const std::vector<AccessUnitElement> &elements);
+
+    // Sizes the store for count AUs that are added later, in any order of blocks
+    void Reserve(uint32_t count);
+
+    // The next Add() writes AU index, which must be the first of a block
+    void SetWritePosition(uint32_t index);
+
+    // Decodes the elements of AU index into elements, returns the number of elements.
+    // An AU whose block could not be read has none, and no first byte location.
+    size_t Get(uint32_t index, std::vector<AccessUnitElement> &elements) const;
+
+    bool FirstByteLocation(uint32_t index, uint64_t &location) const;
+    uint64_t NumPackets(uint32_t index) const;
+
+    // Index of the first AU whose first byte location is >= bytePos, size() if none.
+    // Byte locations grow in decode order, so the block anchors are binary searched.
+    uint32_t LowerBound(uint64_t bytePos) const;
+
+    uint32_t size() const { return m_count; }
+    bool empty() const { return 0 == m_count; }
+
+    // Resident bytes of the store, for reporting
+    size_t MemoryUsage() const;
+
+private:
+
+    enum { NO_BLOCK = 0xFFFFFFFF };
+
+    struct Block
+    {
+        uint64_t anchorByteLocation;    // Absolute end position the first AU of the block is relative to
+        uint64_t dataOffset;            // Offset of the first AU of the block in m_pages
+        uint32_t dataSize;
+    };
+
+    // Encoded AUs of a block, NULL if it was not written or its pages could not be read.
+    // The last block is still being filled and is in m_open.
+    const uint8_t *BlockData(size_t block) const;
+    void CloseBlock();
+
+    // Walks to the start of AU index, returns the position in m_data and the running end position.  NULL if its block cannot be read.
+    const uint8_t *Seek(uint32_t index, uint64_t &prevEnd) const;
+    const uint8_t *DecodeElement(const uint8_t *p, uint64_t &prevEnd, uint64_t &startByteLocation, uint64_t &numPackets) const;
+    const uint8_t *SkipAccessUnit(const uint8_t *p, uint64_t &prevEnd) const;
+
+    uint8_t                 m_packetSize;
+    uint32_t                m_count;
+    uint64_t                m_prevEnd;
+    uint32_t                m_next;         // Index the next Add() writes
+    uint64_t                m_writeOffset;
+    uint32_t                m_openBlock;    // Block being filled in m_open, NO_BLOCK if none
+    std::vector<uint8_t>    m_open;
+    std::vector<Block>      m_blocks;
+    mutable PagedStore      m_pages;
+    mutable std::vector<uint8_t> m_scratch;
+};
+
+/*
+    The decode order AUs of one elementary stream, for captures larger than memory.
+
+    Each AU is a fixed size record in a PagedStore, so AU i is found by arithmetic
+    and only the pages in use are resident.  Its elements go to an AccessUnitElementStore.
+    The stream descriptor is the same for every AU and is kept once.
+
+    An index can also be sized up front with Reserve() and filled in later by an
+    AccessUnitLoader, which is called the first time an AU that is not loaded yet
+    is looked at.
+*/
+class AccessUnitIndex;
+
+class AccessUnitLoader
+{
+public:
+    virtual ~AccessUnitLoader() {}
+
+    // Adds the AUs of the region around index, at least index itself.  Returns false if it could not.
+    virtual bool LoadAccessUnits(AccessUnitIndex &accessUnits, uint32_t index) = 0;
+};
+
+class AccessUnitIndex
+{
+public:
+
+    AccessUnitIndex(const char *recordsName, eMemSubsystem recordsSubsystem, const char *elementsName, eMemSubsystem elementsSubsystem);
+
+    void Clear();
+    void SetPacketSize(uint8_t packetSize) { m_elements.SetPacketSize(packetSize); }
+
+    // Appends au in decode order, with the elements in au.accessUnitElements.  Returns its index.
+    uint32_t Add(const AccessUnit &au);
+
+    // count AUs, loaded by pLoader when they are first used.
+    // A loader moves to where it adds with SetWritePosition().
+    void Reserve(uint32_t count, AccessUnitLoader *pLoader);
+    void SetWritePosition(uint32_t index) { m_elements.SetWritePosition(index); }
+    bool IsLoaded(uint32_t index) const;
+
+    // AU index, without its elements
+    AccessUnit operator[](uint32_t index) const;
+    AccessUnit back() const;
+
+    // Single fields, without building an AccessUnit
+    char FrameType(uint32_t index) const;
+    bool RandomAccess(uint32_t index) const;
+    unsigned int FrameNumber(uint32_t index) const;
+    uint64_t PTS(uint32_t index) const;
+    uint64_t DTS(uint32_t index) const;
+
+    // Elements of AU index.  An AU that could not be loaded or read has none.
+    size_t GetElements(uint32_t index, std::vector<AccessUnitElement> &elements) const;
+    bool FirstByteLocation(uint32_t index, uint64_t &location) const;
+    uint64_t FirstByteLocation(uint32_t index) const;   // 0 if it could not be loaded or read
+    uint64_t NumPackets(uint32_t index) const;
+
+    // Index of the first AU whose first byte location is >= bytePos, size() if none.
+    // AUs that could not be loaded or read are passed over, never returned.
+    uint32_t LowerBound(uint64_t bytePos) const;
+
+    uint32_t size() const { return m_count; }
+    bool empty() const { return 0 == m_count; }
+
+    // Resident bytes, for reporting
+    size_t MemoryUsage() const;
+
+private:
+
+    struct Record
+    {
+        uint64_t    pts;
+        uint64_t    dts;
+        float       pts_seconds;
+        float       dts_seconds;
+        uint32_t    frameNumber;
+        char        frameType;      // First letter of AccessUnit::frameType, 0 if it was empty
+        uint8_t     closed_gop;
+        uint8_t     bLoaded;        // 0 in the zero filled pages of a reserved index
+        uint8_t     random_access;
+    };
+
+    enum { RECORDS_PER_PAGE = PAGE_SIZE_BYTES / sizeof(Record) };
+
+    static uint64_t RecordOffset(uint32_t index)
+    {
+        return (uint64_t) (index / RECORDS_PER_PAGE) * PAGE_SIZE_BYTES + (index % RECORDS_PER_PAGE) * sizeof(Record);
+    }
+
+    // Record of index, loading it first if it is not loaded yet.  NULL if that failed, or its page could not be read.
+    const Record *GetRecord(uint32_t index) const;
+
+    std::string                     m_streamName;
+    int                             m_streamType;
+    long                            m_pid;
+    uint32_t                        m_count;
+    AccessUnitLoader                *m_pLoader;
+    mutable PagedStore              m_records;
+    mutable std::vector<uint8_t>    m_scratch;
+    AccessUnitElementStore          m_elements;
+};
@@ -0,0 +1,880 @@
+#include "mp2ts_avc.h"
+#include "mp2ts_bitstream.h"
+
+#include <cstring>
+
+// Parameter set ids, ISO/IEC 14496-10 7.4.2 and ITU-T H.265 7.4.3
+#define H264_MAX_SPS 32
+#define H264_MAX_PPS 256
+#define HEVC_MAX_SPS 16
+#define HEVC_MAX_PPS 64
+
+// NAL unit types, ISO/IEC 14496-10 Table 7-1
+#define H264_NAL_SLICE 1
+#define H264_NAL_IDR_SLICE 5
+#define H264_NAL_SEI 6
+#define H264_NAL_SPS 7
+#define H264_NAL_PPS 8
+
+// NAL unit types, ITU-T H.265 Table 7-1
+#define HEVC_NAL_RADL_N 6
+#define HEVC_NAL_RASL_R 9
+#define HEVC_NAL_RSV_VCL_N14 14
+#define HEVC_NAL_BLA_W_LP 16
+#define HEVC_NAL_IDR_W_RADL 19
+#define HEVC_NAL_IDR_N_LP 20
+#define HEVC_NAL_CRA 21
+#define HEVC_NAL_RSV_IRAP_23 23
+#define HEVC_NAL_VPS 32
+#define HEVC_NAL_SPS 33
+#define HEVC_NAL_PPS 34
+#define HEVC_NAL_EOS 36
+#define HEVC_NAL_PREFIX_SEI 39
+
+// recovery_point SEI payloadType, the same for both
+#define SEI_RECOVERY_POINT 6
+
+// Unescaped bytes of a slice, enough for the header up to the POC.  Parameter sets and SEI get more.
+#define AVC_SLICE_HEADER_BYTES 64
+#define AVC_MAX_HEADER_BYTES 4096
+
+// Largest picture the size of an SPS is believed for
+#define AVC_MAX_DIMENSION 16384
+
+// Rank of each H.264 slice_type % 5: P, B, I, SP, SI.  0 I, 1 P, 2 B.
+static const int g_h264SliceRank[5] = { 1, 2, 0, 1, 0 };
+
+static const char g_rankTypes[3] = { 'I', 'P', 'B' };
+
+// scaling_list(), 7.3.2.1.1.1, only read past
+static void SkipScalingList(BitReader &bits, int size)
+{
+    uint32_t lastScale = 8;
+    uint32_t nextScale = 8;
+
+    for(int j = 0; j < size && !bits.Overrun(); j++)
+    {
+        if(nextScale)
+            nextScale = (lastScale + (uint32_t) bits.ReadSE()) & 0xFF;
+
+        if(nextScale)
+            lastScale = nextScale;
+    }
+}
+
+AVCHeaderParser::AVCHeaderParser()
+{
+    Reset(false);
+}
+
+void AVCHeaderParser::Reset(bool bHEVC)
+{
+    m_bHEVC = bHEVC;
+    memset(&m_sequence, 0, sizeof(m_sequence));
+
+    // Value initialised, none valid
+    m_h264SPS.assign(bHEVC ? 0 : H264_MAX_SPS, H264SPS());
+    m_h264PPS.assign(bHEVC ? 0 : H264_MAX_PPS, H264PPS());
+    m_hevcSPS.assign(bHEVC ? HEVC_MAX_SPS : 0, HEVCSPS());
+    m_hevcPPS.assign(bHEVC ? HEVC_MAX_PPS : 0, HEVCPPS());
+
+    m_pictures = 0;
+    m_rank = -1;
+    m_bRecoveryPoint = false;
+
+    m_prevPocMsb = 0;
+    m_prevPocLsb = 0;
+    m_prevFrameNum = 0;
+    m_prevFrameNumOffset = 0;
+
+    m_prevTid0Poc = 0;
+    m_bFirstPicture = true;
+}
+
+bool AVCHeaderParser::Parse(const uint8_t *p, size_t size, AVCPicture &picture)
+{
+    memset(&picture, 0, sizeof(picture));
+
+    m_pictures = 0;
+    m_rank = -1;
+    m_bRecoveryPoint = false;
+
+    const uint8_t *pEnd = p + size;
+    const uint8_t *pStart = FindStartCode(p, pEnd);
+
+    while(pStart + 3 < pEnd)
+    {
+        const uint8_t *pNAL = pStart + 3;
+        const uint8_t *pNext = FindStartCode(pNAL, pEnd);
+
+        // The zero_byte of a 4 byte start code stays on the end of the NAL unit before it, nothing reads that far
+        if(m_bHEVC)
+            ParseHEVCNAL(pNAL, pNext - pNAL, picture);
+        else
+            ParseH264NAL(pNAL, pNext - pNAL, picture);
+
+        pStart = pNext;
+    }
+
+    if(m_rank >= 0)
+        picture.type = g_rankTypes[m_rank];
+
+    // An H.264 stream may have no IDR after the first, its I pictures with a recovery point are where to start
+    if(m_bRecoveryPoint && 'I' == picture.type)
+        picture.bRandomAccess = true;
+
+    return m_pictures > 0;
+}
+
+void AVCHeaderParser::Unescape(const uint8_t *p, size_t size, size_t maxBytes)
+{
+    m_rbsp.resize(size < maxBytes ? size : maxBytes);
+
+    size_t n = 0;
+    unsigned int zeros = 0;
+
+    for(size_t i = 0; i < size && n < m_rbsp.size(); i++)
+    {
+        uint8_t byte = p[i];
+
+        // emulation_prevention_three_byte
+        if(zeros >= 2 && 3 == byte)
+        {
+            zeros = 0;
+            continue;
+        }
+
+        zeros = 0 == byte ? zeros + 1 : 0;
+        m_rbsp[n++] = byte;
+    }
+
+    m_rbsp.resize(n);
+}
+
+bool AVCHeaderParser::RecoveryPoint() const
+{
+    const uint8_t *p = m_rbsp.data();
+    size_t size = m_rbsp.size();
+    size_t i = 0;
+
+    // sei_message()s up to the rbsp_trailing_bits
+    while(i + 2 <= size && 0x80 != p[i])
+    {
+        uint32_t payloadType = 0;
+        uint32_t payloadSize = 0;
+
+        for(; i < size && 0xFF == p[i]; i++)
+            payloadType += 255;
+
+        if(i == size)
+            break;
+
+        payloadType += p[i++];
+
+        for(; i < size && 0xFF == p[i]; i++)
+            payloadSize += 255;
+
+        if(i == size)
+            break;
+
+        payloadSize += p[i++];
+
+        if(SEI_RECOVERY_POINT == payloadType)
+            return true;
+
+        i += payloadSize;
+    }
+
+    return false;
+}
+
+void AVCHeaderParser::AddSlice(AVCPicture &picture, bool bNewPicture, int rank, bool bPOC, int32_t poc)
+{
+    if(bNewPicture)
+    {
+        m_pictures++;
+
+        // Both fields of a pair in one AU: the one shown first
+        if(bPOC && (!picture.bPOC || poc < picture.poc))
+        {
+            picture.poc = poc;
+            picture.bPOC = true;
+        }
+    }
+
+    if(1 == m_pictures)
+    {
+        picture.slices++;
+
+        if(rank > m_rank)
+            m_rank = rank;
+    }
+}
+
+void AVCHeaderParser::ParseH264NAL(const uint8_t *p, size_t size, AVCPicture &picture)
+{
+    if(size < 2)
+        return;
+
+    uint8_t nalRefIdc = (p[0] >> 5) & 3;
+    uint8_t nalUnitType = p[0] & 0x1F;
+
+    switch(nalUnitType)
+    {
+    case H264_NAL_SLICE:
+    case H264_NAL_IDR_SLICE:
+        Unescape(p + 1, size - 1, AVC_SLICE_HEADER_BYTES);
+        ParseH264Slice(nalUnitType, nalRefIdc, picture);
+        break;
+
+    case H264_NAL_SEI:
+        Unescape(p + 1, size - 1, AVC_MAX_HEADER_BYTES);
+        m_bRecoveryPoint = m_bRecoveryPoint || RecoveryPoint();
+        break;
+
+    case H264_NAL_SPS:
+        Unescape(p + 1, size - 1, AVC_MAX_HEADER_BYTES);
+        ParseH264SPS();
+        picture.bParameterSets = true;
+        break;
+
+    case H264_NAL_PPS:
+        Unescape(p + 1, size - 1, AVC_MAX_HEADER_BYTES);
+        ParseH264PPS();
+        picture.bParameterSets = true;
+        break;
+    }
+}
+
+void AVCHeaderParser::ParseH264SPS()
+{
+    BitReader bits(m_rbsp.data(), m_rbsp.size());
+
+    H264SPS sps = H264SPS();
+    sps.profile = (uint8_t) bits.Read(8);
+    bits.Skip(8);   // constraint_set flags, reserved_zero_2bits
+    sps.level = (uint8_t) bits.Read(8);
+
+    uint32_t id = bits.ReadUE();
+
+    if(bits.Overrun() || id >= H264_MAX_SPS)
+        return;
+
+    uint32_t chromaFormat = 1;
+    sps.bSeparateColourPlane = false;
+
+    // The profiles with chroma_format_idc, 7.3.2.1.1
+    switch(sps.profile)
+    {
+    case 44: case 83: case 86: case 100: case 110: case 118: case 122: case 128: case 134: case 135: case 138: case 139: case 244:
+        chromaFormat = bits.ReadUE();
+
+        if(3 == chromaFormat)
+            sps.bSeparateColourPlane = bits.ReadFlag();
+
+        bits.ReadUE();  // bit_depth_luma_minus8
+        bits.ReadUE();  // bit_depth_chroma_minus8
+        bits.Skip(1);   // qpprime_y_zero_transform_bypass_flag
+
+        if(bits.ReadFlag())
+        {
+            for(int i = 0; i < (3 != chromaFormat ? 8 : 12); i++)
+            {
+                if(bits.ReadFlag())
+                    SkipScalingList(bits, i < 6 ? 16 : 64);
+            }
+        }
+        break;
+    }
+
+    uint32_t log2MaxFrameNum = bits.ReadUE() + 4;
+    uint32_t pocType = bits.ReadUE();
+    uint32_t log2MaxPocLsb = 4;
+
+    sps.bDeltaPicOrderAlwaysZero = false;
+    sps.offsetForNonRefPic = 0;
+    sps.offsetForTopToBottomField = 0;
+
+    if(0 == pocType)
+    {
+        log2MaxPocLsb = bits.ReadUE() + 4;
+    }
+    else if(1 == pocType)
+    {
+        sps.bDeltaPicOrderAlwaysZero = bits.ReadFlag();
+        sps.offsetForNonRefPic = bits.ReadSE();
+        sps.offsetForTopToBottomField = bits.ReadSE();
+
+        uint32_t numRefFramesInPocCycle = bits.ReadUE();
+
+        if(numRefFramesInPocCycle > 255)
+            return;
+
+        for(uint32_t i = 0; i < numRefFramesInPocCycle; i++)
+            sps.offsetForRefFrame.push_back(bits.ReadSE());
+    }
+
+    bits.ReadUE();  // max_num_ref_frames
+    bits.Skip(1);   // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t widthInMbs = bits.ReadUE() + 1;
+    uint32_t heightInMapUnits = bits.ReadUE() + 1;
+
+    sps.bFrameMbsOnly = bits.ReadFlag();
+
+    if(!sps.bFrameMbsOnly)
+        bits.Skip(1);   // mb_adaptive_frame_field_flag
+
+    bits.Skip(1);   // direct_8x8_inference_flag
+
+    uint32_t crop[4] = { 0, 0, 0, 0 };
+
+    if(bits.ReadFlag())
+    {
+        for(int i = 0; i < 4; i++)
+            crop[i] = bits.ReadUE();
+    }
+
+    if(bits.Overrun() || chromaFormat > 3 || pocType > 2 || log2MaxFrameNum > 16 || log2MaxPocLsb > 16 ||
+       widthInMbs > AVC_MAX_DIMENSION / 16 || heightInMapUnits > AVC_MAX_DIMENSION / 16)
+        return;
+
+    // Cropping is in chroma samples, and in field lines unless frame_mbs_only_flag, 7.4.2.1.1
+    uint32_t chromaArrayType = sps.bSeparateColourPlane ? 0 : chromaFormat;
+    uint32_t cropUnitX = 0 == chromaArrayType || 3 == chromaArrayType ? 1 : 2;
+    uint32_t cropUnitY = (1 == chromaArrayType ? 2 : 1) * (sps.bFrameMbsOnly ? 1 : 2);
+    uint32_t width = widthInMbs * 16;
+    uint32_t height = heightInMapUnits * 16 * (sps.bFrameMbsOnly ? 1 : 2);
+
+    if(cropUnitX * (crop[0] + crop[1]) < width)
+        width -= cropUnitX * (crop[0] + crop[1]);
+
+    if(cropUnitY * (crop[2] + crop[3]) < height)
+        height -= cropUnitY * (crop[2] + crop[3]);
+
+    sps.bValid = true;
+    sps.chromaFormat = (uint8_t) chromaFormat;
+    sps.width = (uint16_t) width;
+    sps.height = (uint16_t) height;
+    sps.log2MaxFrameNum = (uint8_t) log2MaxFrameNum;
+    sps.pocType = (uint8_t) pocType;
+    sps.log2MaxPocLsb = (uint8_t) log2MaxPocLsb;
+
+    m_h264SPS[id] = sps;
+}
+
+void AVCHeaderParser::ParseH264PPS()
+{
+    BitReader bits(m_rbsp.data(), m_rbsp.size());
+
+    uint32_t id = bits.ReadUE();
+    uint32_t spsId = bits.ReadUE();
+    bits.Skip(1);   // entropy_coding_mode_flag
+    bool bBottomFieldPicOrderInFramePresent = bits.ReadFlag();
+
+    if(bits.Overrun() || id >= H264_MAX_PPS || spsId >= H264_MAX_SPS)
+        return;
+
+    H264PPS &pps = m_h264PPS[id];
+    pps.bValid = true;
+    pps.spsId = (uint8_t) spsId;
+    pps.bBottomFieldPicOrderInFramePresent = bBottomFieldPicOrderInFramePresent;
+}
+
+void AVCHeaderParser::ParseH264Slice(uint8_t nalUnitType, uint8_t nalRefIdc, AVCPicture &picture)
+{
+    BitReader bits(m_rbsp.data(), m_rbsp.size());
+
+    uint32_t firstMB = bits.ReadUE();
+    uint32_t sliceType = bits.ReadUE();
+    uint32_t ppsId = bits.ReadUE();
+
+    if(bits.Overrun() || sliceType > 9)
+        return;
+
+    // Without arbitrary slice order the first slice of each picture starts at macroblock 0
+    bool bNewPicture = 0 == m_pictures || 0 == firstMB;
+    bool bIDR = H264_NAL_IDR_SLICE == nalUnitType;
+    bool bReference = 0 != nalRefIdc;
+    int rank = g_h264SliceRank[sliceType % 5];
+
+    if(0 == m_pictures)
+    {
+        picture.nalUnitType = nalUnitType;
+        picture.bIDR = bIDR;
+        picture.bRandomAccess = bIDR;
+        picture.bReference = bReference;
+    }
+
+    const H264PPS *pPPS = ppsId < H264_MAX_PPS && m_h264PPS[ppsId].bValid ? &m_h264PPS[ppsId] : NULL;
+    const H264SPS *pSPS = pPPS && m_h264SPS[pPPS->spsId].bValid ? &m_h264SPS[pPPS->spsId] : NULL;
+
+    if(!bNewPicture || !pSPS)
+    {
+        AddSlice(picture, bNewPicture, rank, false, 0);
+        return;
+    }
+
+    const H264SPS &sps = *pSPS;
+
+    if(sps.bSeparateColourPlane)
+        bits.Skip(2);   // colour_plane_id
+
+    uint32_t frameNum = bits.Read(sps.log2MaxFrameNum);
+    bool bField = false;
+    bool bBottomField = false;
+
+    if(!sps.bFrameMbsOnly)
+    {
+        bField = bits.ReadFlag();
+
+        if(bField)
+            bBottomField = bits.ReadFlag();
+    }
+
+    if(bIDR)
+        bits.ReadUE();  // idr_pic_id
+
+    uint32_t pocLsb = 0;
+    int32_t deltaPocBottom = 0;
+    int32_t deltaPoc[2] = { 0, 0 };
+
+    if(0 == sps.pocType)
+    {
+        pocLsb = bits.Read(sps.log2MaxPocLsb);
+
+        if(m_h264PPS[ppsId].bBottomFieldPicOrderInFramePresent && !bField)
+            deltaPocBottom = bits.ReadSE();
+    }
+    else if(1 == sps.pocType && !sps.bDeltaPicOrderAlwaysZero)
+    {
+        deltaPoc[0] = bits.ReadSE();
+
+        if(m_h264PPS[ppsId].bBottomFieldPicOrderInFramePresent && !bField)
+            deltaPoc[1] = bits.ReadSE();
+    }
+
+    if(bits.Overrun())
+    {
+        AddSlice(picture, bNewPicture, rank, false, 0);
+        return;
+    }
+
+    if(0 == m_pictures)
+    {
+        picture.bField = bField;
+
+        m_sequence.bValid = true;
+        m_sequence.profile = sps.profile;
+        m_sequence.level = sps.level;
+        m_sequence.chromaFormat = sps.chromaFormat;
+        m_sequence.width = sps.width;
+        m_sequence.height = sps.height;
+        m_sequence.bFrameMbsOnly = sps.bFrameMbsOnly;
+    }
+
+    int32_t poc = H264POC(sps, bIDR, bReference, bField, bBottomField, frameNum, pocLsb, deltaPocBottom, deltaPoc);
+
+    AddSlice(picture, bNewPicture, rank, true, poc);
+}
+
+int32_t AVCHeaderParser::H264POC(const H264SPS &sps, bool bIDR, bool bReference, bool bField, bool bBottomField,
+                                 uint32_t frameNum, uint32_t pocLsb, int32_t deltaPocBottom, const int32_t deltaPoc[2])
+{
+    int32_t top = 0;
+    int32_t bottom = 0;
+
+    if(0 == sps.pocType)
+    {
+        // 8.2.1.1, from the previous reference picture
+        int32_t maxPocLsb = 1 << sps.log2MaxPocLsb;
+        int32_t lsb = (int32_t) pocLsb;
+        int32_t msb;
+
+        if(bIDR)
+        {
+            m_prevPocMsb = 0;
+            m_prevPocLsb = 0;
+        }
+
+        if(lsb < m_prevPocLsb && m_prevPocLsb - lsb >= maxPocLsb / 2)
+            msb = m_prevPocMsb + maxPocLsb;
+        else if(lsb > m_prevPocLsb && lsb - m_prevPocLsb > maxPocLsb / 2)
+            msb = m_prevPocMsb - maxPocLsb;
+        else
+            msb = m_prevPocMsb;
+
+        // A field has the one count, msb + lsb whichever field it is
+        top = msb + lsb;
+        bottom = bField ? top : top + deltaPocBottom;
+
+        if(bReference)
+        {
+            m_prevPocMsb = msb;
+            m_prevPocLsb = lsb;
+        }
+    }
+    else
+    {
+        // 8.2.1.2 and 8.2.1.3, from the frame_num of the previous picture
+        int32_t maxFrameNum = 1 << sps.log2MaxFrameNum;
+        int32_t frameNumOffset = bIDR ? 0 : m_prevFrameNum > frameNum ? m_prevFrameNumOffset + maxFrameNum : m_prevFrameNumOffset;
+
+        if(1 == sps.pocType)
+        {
+            int32_t cycle = (int32_t) sps.offsetForRefFrame.size();
+            int32_t absFrameNum = cycle ? frameNumOffset + (int32_t) frameNum : 0;
+
+            if(!bReference && absFrameNum > 0)
+                absFrameNum--;
+
+            int32_t expected = 0;
+
+            if(absFrameNum > 0)
+            {
+                int32_t deltaPerCycle = 0;
+
+                for(int32_t offset : sps.offsetForRefFrame)
+                    deltaPerCycle += offset;
+
+                int32_t cycles = (absFrameNum - 1) / cycle;
+                int32_t inCycle = (absFrameNum - 1) % cycle;
+
+                expected = cycles * deltaPerCycle;
+
+                for(int32_t i = 0; i <= inCycle; i++)
+                    expected += sps.offsetForRefFrame[i];
+            }
+
+            if(!bReference)
+                expected += sps.offsetForNonRefPic;
+
+            if(!bField)
+            {
+                top = expected + deltaPoc[0];
+                bottom = top + sps.offsetForTopToBottomField + deltaPoc[1];
+            }
+            else
+            {
+                top = expected + deltaPoc[0] + (bBottomField ? sps.offsetForTopToBottomField : 0);
+                bottom = top;
+            }
+        }
+        else
+        {
+            // Output order is decode order
+            top = bIDR ? 0 : 2 * (frameNumOffset + (int32_t) frameNum) - (bReference ? 0 : 1);
+            bottom = top;
+        }
+
+        m_prevFrameNum = frameNum;
+        m_prevFrameNumOffset = frameNumOffset;
+    }
+
+    return top < bottom ? top : bottom;
+}
+
+void AVCHeaderParser::ParseHEVCNAL(const uint8_t *p, size_t size, AVCPicture &picture)
+{
+    if(size < 3)
+        return;
+
+    uint8_t nalUnitType = (p[0] >> 1) & 0x3F;
+    uint8_t layerId = ((p[0] & 1) << 5) | (p[1] >> 3);
+    uint8_t temporalIdPlus1 = p[1] & 7;
+
+    // Only the base layer
+    if(layerId || !temporalIdPlus1)
+        return;
+
+    if(nalUnitType <= HEVC_NAL_CRA)
+    {
+        Unescape(p + 2, size - 2, AVC_SLICE_HEADER_BYTES);
+        ParseHEVCSlice(nalUnitType, temporalIdPlus1 - 1, picture);
+        return;
+    }
+
+    switch(nalUnitType)
+    {
+    case HEVC_NAL_VPS:
+        picture.bParameterSets = true;
+        break;
+
+    case HEVC_NAL_SPS:
+        Unescape(p + 2, size - 2, AVC_MAX_HEADER_BYTES);
+        ParseHEVCSPS();
+        picture.bParameterSets = true;
+        break;
+
+    case HEVC_NAL_PPS:
+        Unescape(p + 2, size - 2, AVC_MAX_HEADER_BYTES);
+        ParseHEVCPPS();
+        picture.bParameterSets = true;
+        break;
+
+    case HEVC_NAL_EOS:
+        // The next picture starts a coded video sequence, a CRA there too
+        m_bFirstPicture = true;
+        break;
+
+    case HEVC_NAL_PREFIX_SEI:
+        Unescape(p + 2, size - 2, AVC_MAX_HEADER_BYTES);
+        m_bRecoveryPoint = m_bRecoveryPoint || RecoveryPoint();
+        break;
+    }
+}
+
+void AVCHeaderParser::ParseHEVCSPS()
+{
+    BitReader bits(m_rbsp.data(), m_rbsp.size());
+
+    bits.Skip(4);   // sps_video_parameter_set_id
+    uint32_t maxSubLayersMinus1 = bits.Read(3);
+    bits.Skip(1);   // sps_temporal_id_nesting_flag
+
+    // profile_tier_level(1, sps_max_sub_layers_minus1), 7.3.3
+    HEVCSPS sps = HEVCSPS();
+    bits.Skip(3);   // general_profile_space, general_tier_flag
+    sps.profile = (uint8_t) bits.Read(5);
+    bits.Skip(32);  // general_profile_compatibility_flag
+    bits.Skip(32);  // Source and constraint flags, 48 bits
+    bits.Skip(16);
+    sps.level = (uint8_t) bits.Read(8);
+
+    bool bSubLayerProfilePresent[8];
+    bool bSubLayerLevelPresent[8];
+
+    for(uint32_t i = 0; i < maxSubLayersMinus1; i++)
+    {
+        bSubLayerProfilePresent[i] = bits.ReadFlag();
+        bSubLayerLevelPresent[i] = bits.ReadFlag();
+    }
+
+    if(maxSubLayersMinus1 > 0)
+    {
+        for(uint32_t i = maxSubLayersMinus1; i < 8; i++)
+            bits.Skip(2);   // reserved_zero_2bits
+    }
+
+    for(uint32_t i = 0; i < maxSubLayersMinus1; i++)
+    {
+        if(bSubLayerProfilePresent[i])
+            bits.SkipLong(88);
+
+        if(bSubLayerLevelPresent[i])
+            bits.Skip(8);
+    }
+
+    uint32_t id = bits.ReadUE();
+    uint32_t chromaFormat = bits.ReadUE();
+
+    sps.bSeparateColourPlane = false;
+
+    if(3 == chromaFormat)
+        sps.bSeparateColourPlane = bits.ReadFlag();
+
+    uint32_t width = bits.ReadUE();
+    uint32_t height = bits.ReadUE();
+    uint32_t window[4] = { 0, 0, 0, 0 };
+
+    if(bits.ReadFlag())
+    {
+        for(int i = 0; i < 4; i++)
+            window[i] = bits.ReadUE();
+    }
+
+    bits.ReadUE();  // bit_depth_luma_minus8
+    bits.ReadUE();  // bit_depth_chroma_minus8
+
+    uint32_t log2MaxPocLsb = bits.ReadUE() + 4;
+    bool bSubLayerOrderingInfoPresent = bits.ReadFlag();
+
+    for(uint32_t i = bSubLayerOrderingInfoPresent ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; i++)
+    {
+        bits.ReadUE();  // sps_max_dec_pic_buffering_minus1
+        bits.ReadUE();  // sps_max_num_reorder_pics
+        bits.ReadUE();  // sps_max_latency_increase_plus1
+    }
+
+    uint32_t log2MinCbSize = bits.ReadUE() + 3;
+    uint32_t log2CtbSize = log2MinCbSize + bits.ReadUE();
+
+    if(bits.Overrun() || id >= HEVC_MAX_SPS || chromaFormat > 3 || log2MaxPocLsb > 16 || log2CtbSize < 4 || log2CtbSize > 6 ||
+       0 == width || 0 == height || width > AVC_MAX_DIMENSION || height > AVC_MAX_DIMENSION)
+        return;
+
+    uint32_t ctbSize = 1 << log2CtbSize;
+    uint32_t picSizeInCtbs = ((width + ctbSize - 1) >> log2CtbSize) * ((height + ctbSize - 1) >> log2CtbSize);
+    uint32_t sliceAddressBits = 0;
+
+    while((1u << sliceAddressBits) < picSizeInCtbs)
+        sliceAddressBits++;
+
+    // The conformance window is in chroma samples, 7.4.3.2.1
+    uint32_t chromaArrayType = sps.bSeparateColourPlane ? 0 : chromaFormat;
+    uint32_t subWidth = 1 == chromaArrayType || 2 == chromaArrayType ? 2 : 1;
+    uint32_t subHeight = 1 == chromaArrayType ? 2 : 1;
+
+    if(subWidth * (window[0] + window[1]) < width)
+        width -= subWidth * (window[0] + window[1]);
+
+    if(subHeight * (window[2] + window[3]) < height)
+        height -= subHeight * (window[2] + window[3]);
+
+    sps.bValid = true;
+    sps.chromaFormat = (uint8_t) chromaFormat;
+    sps.width = (uint16_t) width;
+    sps.height = (uint16_t) height;
+    sps.log2MaxPocLsb = (uint8_t) log2MaxPocLsb;
+    sps.sliceAddressBits = (uint8_t) sliceAddressBits;
+
+    m_hevcSPS[id] = sps;
+}
+
+void AVCHeaderParser::ParseHEVCPPS()
+{
+    BitReader bits(m_rbsp.data(), m_rbsp.size());
+
+    uint32_t id = bits.ReadUE();
+    uint32_t spsId = bits.ReadUE();
+    bool bDependentSliceSegmentsEnabled = bits.ReadFlag();
+    bool bOutputFlagPresent = bits.ReadFlag();
+    uint32_t numExtraSliceHeaderBits = bits.Read(3);
+
+    if(bits.Overrun() || id >= HEVC_MAX_PPS || spsId >= HEVC_MAX_SPS)
+        return;
+
+    HEVCPPS &pps = m_hevcPPS[id];
+    pps.bValid = true;
+    pps.spsId = (uint8_t) spsId;
+    pps.bDependentSliceSegmentsEnabled = bDependentSliceSegmentsEnabled;
+    pps.bOutputFlagPresent = bOutputFlagPresent;
+    pps.numExtraSliceHeaderBits = (uint8_t) numExtraSliceHeaderBits;
+}
+
+void AVCHeaderParser::ParseHEVCSlice(uint8_t nalUnitType, uint8_t temporalId, AVCPicture &picture)
+{
+    BitReader bits(m_rbsp.data(), m_rbsp.size());
+
+    bool bIRAP = nalUnitType >= HEVC_NAL_BLA_W_LP && nalUnitType <= HEVC_NAL_RSV_IRAP_23;
+    bool bFirstSliceSegment = bits.ReadFlag();
+
+    if(bIRAP)
+        bits.Skip(1);   // no_output_of_prior_pics_flag
+
+    uint32_t ppsId = bits.ReadUE();
+
+    if(bits.Overrun())
+        return;
+
+    bool bNewPicture = bFirstSliceSegment || 0 == m_pictures;
+
+    if(0 == m_pictures)
+    {
+        // BLA and IDR, 16 to 20, start afresh.  A CRA can have leading pictures that are not decodable.
+        picture.nalUnitType = nalUnitType;
+        picture.bIDR = bIRAP && nalUnitType <= HEVC_NAL_IDR_N_LP;
+        picture.bRandomAccess = bIRAP;
+        picture.bReference = nalUnitType > HEVC_NAL_RSV_VCL_N14 || 1 == (nalUnitType & 1);
+    }
+
+    const HEVCPPS *pPPS = ppsId < HEVC_MAX_PPS && m_hevcPPS[ppsId].bValid ? &m_hevcPPS[ppsId] : NULL;
+    const HEVCSPS *pSPS = pPPS && m_hevcSPS[pPPS->spsId].bValid ? &m_hevcSPS[pPPS->spsId] : NULL;
+
+    // The slice_type is behind syntax the PPS sizes.  An IRAP picture only has I slices.
+    if(!pSPS)
+    {
+        AddSlice(picture, bNewPicture, bIRAP ? 0 : -1, false, 0);
+        return;
+    }
+
+    const HEVCPPS &pps = *pPPS;
+    const HEVCSPS &sps = *pSPS;
+
+    if(!bFirstSliceSegment)
+    {
+        bool bDependentSliceSegment = pps.bDependentSliceSegmentsEnabled && bits.ReadFlag();
+
+        // Carries on the slice before it, with its slice_type
+        if(bDependentSliceSegment)
+            return;
+
+        if(sps.sliceAddressBits)
+            bits.Skip(sps.sliceAddressBits);
+    }
+
+    if(pps.numExtraSliceHeaderBits)
+        bits.Skip(pps.numExtraSliceHeaderBits);     // slice_reserved_flag
+
+    uint32_t sliceType = bits.ReadUE();
+
+    if(bits.Overrun() || sliceType > 2)
+        return;
+
+    // 0 B, 1 P, 2 I
+    int rank = 2 - (int) sliceType;
+
+    if(!bFirstSliceSegment)
+    {
+        AddSlice(picture, bNewPicture, rank, false, 0);
+        return;
+    }
+
+    if(pps.bOutputFlagPresent)
+        bits.Skip(1);   // pic_output_flag
+
+    if(sps.bSeparateColourPlane)
+        bits.Skip(2);   // colour_plane_id
+
+    uint32_t pocLsb = 0;
+
+    if(HEVC_NAL_IDR_W_RADL != nalUnitType && HEVC_NAL_IDR_N_LP != nalUnitType)
+        pocLsb = bits.Read(sps.log2MaxPocLsb);
+
+    if(bits.Overrun())
+    {
+        AddSlice(picture, bNewPicture, rank, false, 0);
+        return;
+    }
+
+    // 8.3.1, msb from the previous TemporalId 0 picture unless this is an IRAP with NoRaslOutputFlag
+    int32_t maxPocLsb = 1 << sps.log2MaxPocLsb;
+    int32_t lsb = (int32_t) pocLsb;
+    int32_t msb = 0;
+
+    if(!bIRAP || (HEVC_NAL_CRA <= nalUnitType && !m_bFirstPicture))
+    {
+        int32_t prevLsb = m_prevTid0Poc & (maxPocLsb - 1);
+        int32_t prevMsb = m_prevTid0Poc - prevLsb;
+
+        if(lsb < prevLsb && prevLsb - lsb >= maxPocLsb / 2)
+            msb = prevMsb + maxPocLsb;
+        else if(lsb > prevLsb && lsb - prevLsb > maxPocLsb / 2)
+            msb = prevMsb - maxPocLsb;
+        else
+            msb = prevMsb;
+    }
+
+    int32_t poc = msb + lsb;
+
+    // Not RADL, RASL or a sub-layer non-reference picture
+    bool bSubLayerNonReference = nalUnitType <= HEVC_NAL_RSV_VCL_N14 && 0 == (nalUnitType & 1);
+
+    if(0 == temporalId && !(nalUnitType >= HEVC_NAL_RADL_N && nalUnitType <= HEVC_NAL_RASL_R) && !bSubLayerNonReference)
+        m_prevTid0Poc = poc;
+
+    m_bFirstPicture = false;
+
+    if(0 == m_pictures)
+    {
+        m_sequence.bValid = true;
+        m_sequence.profile = sps.profile;
+        m_sequence.level = sps.level;
+        m_sequence.chromaFormat = sps.chromaFormat;
+        m_sequence.width = sps.width;
+        m_sequence.height = sps.height;
+        m_sequence.bFrameMbsOnly = true;
+    }
+
+    AddSlice(picture, bNewPicture, rank, true, poc);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// From the SPS of the last picture, ISO/IEC 14496-10 7.3.2.1 and ITU-T H.265 7.3.2.2
+struct AVCSequence
+{
+    bool        bValid;             // An SPS was seen and a slice referred to it
+    uint8_t     profile;            // profile_idc, general_profile_idc of HEVC
+    uint8_t     level;              // level_idc, general_level_idc of HEVC
+    uint8_t     chromaFormat;       // 0 monochrome, 1 4:2:0, 2 4:2:2, 3 4:4:4
+    uint16_t    width;              // After the cropping or conformance window
+    uint16_t    height;
+    bool        bFrameMbsOnly;      // No field pictures or MBAFF, always set for HEVC
+};
+
+// The headers of one AU, of the first field of a field pair
+struct AVCPicture
+{
+    char        type;               // I, P or B, the most predicted slice type.  0 without a slice.
+    uint8_t     nalUnitType;        // Of the first slice
+    bool        bIDR;               // IDR, and BLA of HEVC: nothing before it is referenced
+    bool        bRandomAccess;      // Decoding can start here: IDR, CRA, BLA, or an I picture with a recovery point SEI
+    bool        bReference;         // nal_ref_idc of H.264, not a sub-layer non-reference picture of HEVC
+    bool        bField;             // A field of H.264, the AU may hold the pair
+    bool        bParameterSets;     // The AU carries an SPS or a PPS
+    bool        bPOC;               // The parameter sets for poc were there
+    int32_t     poc;                // PicOrderCnt, the lower of the fields of the AU
+    uint32_t    slices;             // Slices of the first picture, dependent slice segments of HEVC not counted
+};
+
+/*
+    Reads the parameter sets and slice headers of H.264 and HEVC straight from
+    the ES, without a decoder, for the picture type, the random access points
+    and the picture order count of every AU.
+
+    NAL units are found with FindStartCode() and only their first bytes are
+    unescaped, 00 00 03 back to 00 00, which is all a slice header up to the
+    POC needs.  The SPS and PPS are kept between AUs, by id, as are the POC
+    state of the previous reference picture for H.264 and of the previous
+    TemporalId 0 picture for HEVC.  POC types 0, 1 and 2 of H.264 are worked
+    out as in 8.2.1, except that memory_management_control_operation 5 is not
+    looked for: dec_ref_pic_marking sits behind the reference list syntax, and
+    the POC of the pictures after an MMCO 5 comes out offset until the next IDR.
+*/
+class AVCHeaderParser
+{
+public:
+
+    AVCHeaderParser();
+
+    // Forgets the parameter sets and the POC state, after a seek.  bHEVC picks the syntax.
+    void Reset(bool bHEVC);
+
+    // Headers of the ES payload of one AU.  False if it has no slice.
+    bool Parse(const uint8_t *p, size_t size, AVCPicture &picture);
+
+    const AVCSequence &Sequence() const { return m_sequence; }
+
+private:
+
+    struct H264SPS
+    {
+        bool        bValid;
+        uint8_t     profile;
+        uint8_t     level;
+        uint8_t     chromaFormat;
+        bool        bSeparateColourPlane;
+        bool        bFrameMbsOnly;
+        uint16_t    width;
+        uint16_t    height;
+        uint8_t     log2MaxFrameNum;
+        uint8_t     pocType;
+        uint8_t     log2MaxPocLsb;
+        bool        bDeltaPicOrderAlwaysZero;
+        int32_t     offsetForNonRefPic;
+        int32_t     offsetForTopToBottomField;
+        std::vector<int32_t> offsetForRefFrame;
+    };
+
+    struct H264PPS
+    {
+        bool        bValid;
+        uint8_t     spsId;
+        bool        bBottomFieldPicOrderInFramePresent;
+    };
+
+    struct HEVCSPS
+    {
+        bool        bValid;
+        uint8_t     profile;
+        uint8_t     level;
+        uint8_t     chromaFormat;
+        bool        bSeparateColourPlane;
+        uint16_t    width;
+        uint16_t    height;
+        uint8_t     log2MaxPocLsb;
+        uint8_t     sliceAddressBits;   // Ceil(Log2(PicSizeInCtbsY))
+    };
+
+    struct HEVCPPS
+    {
+        bool        bValid;
+        uint8_t     spsId;
+        bool        bDependentSliceSegmentsEnabled;
+        bool        bOutputFlagPresent;
+        uint8_t     numExtraSliceHeaderBits;
+    };
+
+    // Copies the RBSP of the NAL unit at p, without its header, to m_rbsp, at most maxBytes of it
+    void Unescape(const uint8_t *p, size_t size, size_t maxBytes);
+
+    bool RecoveryPoint() const;
+
+    void ParseH264NAL(const uint8_t *p, size_t size, AVCPicture &picture);
+    void ParseH264SPS();
+    void ParseH264PPS();
+    void ParseH264Slice(uint8_t nalUnitType, uint8_t nalRefIdc, AVCPicture &picture);
+    int32_t H264POC(const H264SPS &sps, bool bIDR, bool bReference, bool bField, bool bBottomField,
+                    uint32_t frameNum, uint32_t pocLsb, int32_t deltaPocBottom, const int32_t deltaPoc[2]);
+
+    void ParseHEVCNAL(const uint8_t *p, size_t size, AVCPicture &picture);
+    void ParseHEVCSPS();
+    void ParseHEVCPPS();
+    void ParseHEVCSlice(uint8_t nalUnitType, uint8_t temporalId, AVCPicture &picture);
+
+    // Adds a slice of slice type rank 0 I, 1 P, 2 B to the picture, and the POC of its picture
+    void AddSlice(AVCPicture &picture, bool bNewPicture, int rank, bool bPOC, int32_t poc);
+
+    bool                    m_bHEVC;
+    AVCSequence             m_sequence;
+    std::vector<uint8_t>    m_rbsp;
+
+    std::vector<H264SPS>    m_h264SPS;
+    std::vector<H264PPS>    m_h264PPS;
+    std::vector<HEVCSPS>    m_hevcSPS;
+    std::vector<HEVCPPS>    m_hevcPPS;
+
+    // Within the AU being parsed
+    unsigned int            m_pictures;
+    int                     m_rank;
+    bool                    m_bRecoveryPoint;
+
+    // H.264 8.2.1: the previous reference picture for type 0, the previous picture for types 1 and 2
+    int32_t                 m_prevPocMsb;
+    int32_t                 m_prevPocLsb;
+    uint32_t                m_prevFrameNum;
+    int32_t                 m_prevFrameNumOffset;
+
+    // HEVC 8.3.1: the previous TemporalId 0 picture.  A CRA that is the first picture starts at 0 like an IDR.
+    int32_t                 m_prevTid0Poc;
+    bool                    m_bFirstPicture;
+};
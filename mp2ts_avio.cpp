@@ -0,0 +1,126 @@
+#include "mp2ts_avio.h"
+#include "mp2ts_input.h"
+#include "mp2ts_profiler.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavformat/avio.h>
+    #include <libavutil/mem.h>
+    #include <libavutil/error.h>
+}
+
+#include <cstdio>
+#include <cerrno>
+
+// Size of the AVIOContext buffer, a multiple of both 188 and 192 byte packets
+#define AVIO_BUFFER_SIZE (188 * 192 * 8)
+
+struct InputAVIOState
+{
+    InputSource *pInput;
+    uint64_t position;
+};
+
+static int ReadPacket(void *opaque, uint8_t *buf, int buf_size)
+{
+    InputAVIOState *pState = (InputAVIOState *) opaque;
+    InputSource *pInput = pState->pInput;
+
+    if(pState->position >= pInput->Size())
+        return AVERROR_EOF;
+
+    uint64_t remaining = pInput->Size() - pState->position;
+    int size = remaining < (uint64_t) buf_size ? (int) remaining : buf_size;
+
+    // With the mmap backend this is a memcpy out of the mapping, no system call
+    {
+        PROFILE_SCOPE(eProfileRead);
+
+        if(!pInput->ReadAt(pState->position, buf, size))
+            return AVERROR(EIO);
+    }
+
+    pState->position += size;
+
+    // Same readahead policy as the internal demux path: ask for the next buffer now
+    pInput->Prefetch(pState->position, size);
+
+    return size;
+}
+
+static int64_t Seek(void *opaque, int64_t offset, int whence)
+{
+    InputAVIOState *pState = (InputAVIOState *) opaque;
+    int64_t size = (int64_t) pState->pInput->Size();
+    int64_t position = 0;
+
+    switch(whence & ~AVSEEK_FORCE)
+    {
+        case AVSEEK_SIZE:
+            return size;
+
+        case SEEK_SET:
+            position = offset;
+        break;
+
+        case SEEK_CUR:
+            position = (int64_t) pState->position + offset;
+        break;
+
+        case SEEK_END:
+            position = size + offset;
+        break;
+
+        default:
+            return AVERROR(EINVAL);
+    }
+
+    if(position < 0)
+        return AVERROR(EINVAL);
+
+    pState->position = (uint64_t) position;
+
+    return position;
+}
+
+AVIOContext *CreateInputAVIOContext(InputSource *pInput)
+{
+    if(!pInput)
+        return NULL;
+
+    InputAVIOState *pState = (InputAVIOState *) av_mallocz(sizeof(InputAVIOState));
+    uint8_t *pBuffer = (uint8_t *) av_malloc(AVIO_BUFFER_SIZE);
+
+    if(!pState || !pBuffer)
+    {
+        av_free(pState);
+        av_free(pBuffer);
+        return NULL;
+    }
+
+    pState->pInput = pInput;
+    pState->position = 0;
+
+    AVIOContext *pContext = avio_alloc_context(pBuffer, AVIO_BUFFER_SIZE, 0, pState, ReadPacket, NULL, Seek);
+
+    if(!pContext)
+    {
+        av_free(pState);
+        av_free(pBuffer);
+        return NULL;
+    }
+
+    return pContext;
+}
+
+void FreeInputAVIOContext(AVIOContext **ppContext)
+{
+    if(!ppContext || !*ppContext)
+        return;
+
+    // FFmpeg may have replaced the buffer, free whatever it holds now
+    av_freep(&(*ppContext)->buffer);
+    av_freep(&(*ppContext)->opaque);
+    avio_context_free(ppContext);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+struct AVIOContext;
+class InputSource;
+
+// Creates an AVIOContext whose read and seek callbacks go through pInput,
+// so the FFmpeg demuxer shares the analyzer's I/O backend, page cache footprint
+// and readahead.  pInput must outlive the context.
+AVIOContext *CreateInputAVIOContext(InputSource *pInput);
+
+// Frees a context from CreateInputAVIOContext, avformat_close_input does not
+void FreeInputAVIOContext(AVIOContext **ppContext);
@@ -0,0 +1,103 @@
+#include "mp2ts_bitstream.h"
+
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define BITSTREAM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+unsigned int CountLeadingZeros(uint32_t value)
+{
+    if(0 == value)
+        return 32;
+
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanReverse(&bit, value);
+    return 31 - bit;
+#else
+    return __builtin_clz(value);
+#endif
+}
+
+#if BITSTREAM_SSE2
+
+static inline unsigned int CountTrailingZeros(uint32_t value)
+{
+#if defined(_MSC_VER)
+    unsigned long bit;
+    _BitScanForward(&bit, value);
+    return bit;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *pEnd)
+{
+    // Every 00 00 pair of 16 positions at once: the zero bytes at q and at q + 1.
+    // A pair followed by 01 is a prefix.  Slice data of any codec is mostly free of
+    // 00 00, emulation prevention keeps it out of H.264 and HEVC, so nearly every
+    // vector is rejected with one compare and no branch per byte.
+    const __m128i zero = _mm_setzero_si128();
+    const uint8_t *q = p;
+
+    // q + 17 is the last byte a vector reads, q + 15 + 2 the 01 of the last pair it tests
+    while(pEnd - q >= 18)
+    {
+        __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) q), zero);
+        __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) (q + 1)), zero);
+        uint32_t pairs = (uint32_t) _mm_movemask_epi8(_mm_and_si128(first, second));
+
+        while(pairs)
+        {
+            unsigned int i = CountTrailingZeros(pairs);
+
+            if(1 == q[i + 2])
+                return q + i;
+
+            pairs &= pairs - 1;
+        }
+
+        q += 16;
+    }
+
+    for(; q + 3 <= pEnd; q++)
+    {
+        if(0 == q[0] && 0 == q[1] && 1 == q[2])
+            return q;
+    }
+
+    return pEnd;
+}
+
+#else
+
+const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *pEnd)
+{
+    // The 01 of a prefix is rare in coded data, memchr skips to the next one a vector at a time
+    const uint8_t *q = p + 2;
+
+    while(q < pEnd)
+    {
+        q = (const uint8_t *) memchr(q, 1, pEnd - q);
+
+        if(!q)
+            break;
+
+        if(0 == q[-1] && 0 == q[-2])
+            return q - 2;
+
+        // The 01 just found cannot be either of the two zeros of the next prefix
+        q += 3;
+    }
+
+    return pEnd;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// First 00 00 01 start code prefix at or after p that lies wholly before pEnd, pEnd if there is none.
+// Tests 16 positions at a time with SSE2 where it is available.
+const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *pEnd);
+
+// Leading zero bits of value, 32 for 0
+unsigned int CountLeadingZeros(uint32_t value);
+
+/*
+    Reads an ES MSB first.
+
+    Up to 64 bits are held in a cache that Refill() tops up with one unaligned
+    8 byte load while at least 8 bytes remain, so a read is a shift and a mask
+    with a rarely taken refill branch.  The last few bytes are loaded one at a
+    time.  Reads past the end give zero bits and set Overrun().
+*/
+class BitReader
+{
+public:
+
+    BitReader(const uint8_t *p, size_t size)
+        : m_p(p)
+        , m_pEnd(p + size)
+        , m_cache(0)
+        , m_bits(0)
+        , m_bOverrun(false)
+    {
+        Refill();
+    }
+
+    // 1 to 32 bits
+    uint32_t Peek(unsigned int n)
+    {
+        if(m_bits < n)
+            Fill(n);
+
+        return (uint32_t) (m_cache >> (64 - n));
+    }
+
+    // 1 to 32 bits
+    void Skip(unsigned int n)
+    {
+        if(m_bits < n)
+            Fill(n);
+
+        m_cache <<= n;
+        m_bits -= n;
+    }
+
+    // 1 to 32 bits
+    uint32_t Read(unsigned int n)
+    {
+        uint32_t value = Peek(n);
+
+        m_cache <<= n;
+        m_bits -= n;
+
+        return value;
+    }
+
+    bool ReadFlag() { return 0 != Read(1); }
+
+    // Exp-Golomb ue(v) of H.264 and HEVC, up to 2^32 - 2
+    uint32_t ReadUE()
+    {
+        if(m_bits < 32)
+            Refill();
+
+        // The zero bits past the end count as leading zeros, the reads below then overrun
+        unsigned int zeros = CountLeadingZeros((uint32_t) (m_cache >> 32));
+
+        if(zeros > 31)
+        {
+            m_bOverrun = true;
+            return 0;
+        }
+
+        Skip(zeros);
+
+        return Read(zeros + 1) - 1;
+    }
+
+    // se(v), ue(v) mapped to 0, 1, -1, 2, -2...
+    int32_t ReadSE()
+    {
+        uint32_t code = ReadUE();
+
+        return (code & 1) ? (int32_t) ((code >> 1) + 1) : -(int32_t) (code >> 1);
+    }
+
+    // Any number of bits
+    void SkipLong(size_t n)
+    {
+        for(; n > 32; n -= 32)
+            Skip(32);
+
+        if(n)
+            Skip((unsigned int) n);
+    }
+
+    bool Overrun() const { return m_bOverrun; }
+
+private:
+
+    void Refill()
+    {
+        if(m_pEnd - m_p >= 8)
+        {
+            uint64_t value = ((uint64_t) m_p[0] << 56) | ((uint64_t) m_p[1] << 48) | ((uint64_t) m_p[2] << 40) | ((uint64_t) m_p[3] << 32) |
+                             ((uint64_t) m_p[4] << 24) | ((uint64_t) m_p[5] << 16) | ((uint64_t) m_p[6] << 8) | (uint64_t) m_p[7];
+
+            // Whole bytes that fit, the part of the next one is loaded again the next time
+            m_cache |= value >> m_bits;
+            m_p += (63 - m_bits) >> 3;
+            m_bits |= 56;
+        }
+        else
+        {
+            while(m_bits <= 56 && m_p < m_pEnd)
+            {
+                m_cache |= (uint64_t) *m_p++ << (56 - m_bits);
+                m_bits += 8;
+            }
+        }
+    }
+
+    void Fill(unsigned int n)
+    {
+        Refill();
+
+        if(m_bits < n)
+        {
+            // The cache is zero past the end
+            m_bOverrun = true;
+            m_bits = n;
+        }
+    }
+
+    const uint8_t   *m_p;
+    const uint8_t   *m_pEnd;
+    uint64_t        m_cache;        // Next bits from the top down
+    unsigned int    m_bits;         // Valid bits in m_cache
+    bool            m_bOverrun;
+};
@@ -0,0 +1,257 @@
+#include "mp2ts_budget.h"
+#include "mp2ts_memory.h"
+
+#include <cassert>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+typedef std::pair<BudgetConsumer *, uint64_t> BudgetKey;
+
+struct BudgetEntry
+{
+    uint64_t    bytes;
+    double      cost;
+    double      priority;
+    bool        bPending;       // Out of the queue, an enforcement pass is evicting it or found it busy
+};
+
+static std::mutex g_budgetMutex;
+static std::condition_variable g_evictionDone;
+static uint64_t g_budgetLimit = 0;
+static double g_budgetInflation = 0.0;     // L of GreedyDual-Size
+static uint64_t g_evictableBytes = 0;
+static uint64_t g_evictions = 0;
+static uint64_t g_evictedBytes = 0;
+static bool g_bOverBudgetReported = false;
+static std::thread::id g_budgetThread;      // Set by BudgetSetLimit(), the only thread that may evict
+
+static std::map<BudgetKey, BudgetEntry> g_budgetEntries;
+static std::set<std::pair<double, BudgetKey> > g_budgetQueue;     // Lowest priority first
+static std::map<BudgetConsumer *, unsigned int> g_evictionsInFlight;
+
+static double Priority(uint64_t bytes, double cost)
+{
+    return g_budgetInflation + cost / (double) (bytes ? bytes : 1);
+}
+
+static void RemoveEntry(std::map<BudgetKey, BudgetEntry>::iterator i)
+{
+    g_budgetQueue.erase(std::make_pair(i->second.priority, i->first));
+    g_evictableBytes -= i->second.bytes;
+    g_budgetEntries.erase(i);
+}
+
+// Called with the lock held, which is released while the owners evict.  exclude is an entry
+// that was just inserted, it is not evicted from under the owner that is still inserting it.
+static void Enforce(std::unique_lock<std::mutex> &lock, const BudgetKey *pExclude)
+{
+    if(0 == g_budgetLimit)
+        return;
+
+    // The consumers are not thread safe, their data is only dropped on the thread that uses it
+    assert(std::this_thread::get_id() == g_budgetThread);
+
+    std::vector<BudgetKey> busy;
+
+    while(MemoryTotal() > g_budgetLimit && !g_budgetQueue.empty())
+    {
+        // Enough of the lowest priority entries to get back under the cap, if they all go
+        uint64_t excess = MemoryTotal() - g_budgetLimit;
+        uint64_t collected = 0;
+        std::vector<std::pair<double, BudgetKey> > victims;
+
+        while(collected < excess && !g_budgetQueue.empty())
+        {
+            std::pair<double, BudgetKey> victim = *g_budgetQueue.begin();
+            g_budgetQueue.erase(g_budgetQueue.begin());
+
+            std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.find(victim.second);
+            i->second.bPending = true;
+
+            if(pExclude && victim.second == *pExclude)
+            {
+                busy.push_back(victim.second);
+                continue;
+            }
+
+            victims.push_back(victim);
+            collected += i->second.bytes;
+            g_evictionsInFlight[victim.second.first]++;
+        }
+
+        // Owners take their own locks to evict, calling them under ours could deadlock against them
+        std::vector<bool> evicted(victims.size());
+
+        lock.unlock();
+
+        for(size_t n = 0; n < victims.size(); n++)
+            evicted[n] = victims[n].second.first->BudgetEvict(victims[n].second.second);
+
+        lock.lock();
+
+        for(size_t n = 0; n < victims.size(); n++)
+        {
+            const BudgetKey &key = victims[n].second;
+
+            if(0 == --g_evictionsInFlight[key.first])
+                g_evictionsInFlight.erase(key.first);
+
+            // Removed by its owner meanwhile, or inserted again and no longer ours
+            std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.find(key);
+
+            if(i == g_budgetEntries.end() || !i->second.bPending)
+                continue;
+
+            if(!evicted[n])
+            {
+                busy.push_back(key);
+                continue;
+            }
+
+            g_budgetInflation = victims[n].first;
+            g_evictions++;
+            g_evictedBytes += i->second.bytes;
+            g_evictableBytes -= i->second.bytes;
+            g_budgetEntries.erase(i);
+        }
+
+        g_evictionDone.notify_all();
+    }
+
+    // At the priority they have now, a use while they were out of the queue counts
+    for(size_t n = 0; n < busy.size(); n++)
+    {
+        std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.find(busy[n]);
+
+        if(i != g_budgetEntries.end() && i->second.bPending)
+        {
+            i->second.bPending = false;
+            g_budgetQueue.insert(std::make_pair(i->second.priority, i->first));
+        }
+    }
+
+    if(MemoryTotal() > g_budgetLimit)
+    {
+        if(!g_bOverBudgetReported)
+            fprintf(stderr, "Warning: %llu MB in use, over the %llu MB memory cap with nothing left to evict\n",
+                    (unsigned long long) (MemoryTotal() >> 20), (unsigned long long) (g_budgetLimit >> 20));
+
+        g_bOverBudgetReported = true;
+    }
+    else
+    {
+        g_bOverBudgetReported = false;
+    }
+}
+
+void BudgetSetLimit(uint64_t bytes)
+{
+    std::unique_lock<std::mutex> lock(g_budgetMutex);
+
+    g_budgetLimit = bytes;
+    g_budgetThread = std::this_thread::get_id();
+    Enforce(lock, NULL);
+}
+
+uint64_t BudgetLimit()
+{
+    std::lock_guard<std::mutex> lock(g_budgetMutex);
+    return g_budgetLimit;
+}
+
+void BudgetInsert(BudgetConsumer *pOwner, uint64_t key, uint64_t bytes, double cost)
+{
+    std::unique_lock<std::mutex> lock(g_budgetMutex);
+
+    BudgetKey budgetKey(pOwner, key);
+    std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.find(budgetKey);
+
+    if(i != g_budgetEntries.end())
+        RemoveEntry(i);
+
+    BudgetEntry entry;
+    entry.bytes = bytes;
+    entry.cost = cost;
+    entry.priority = Priority(bytes, cost);
+    entry.bPending = false;
+
+    g_budgetEntries[budgetKey] = entry;
+    g_budgetQueue.insert(std::make_pair(entry.priority, budgetKey));
+    g_evictableBytes += bytes;
+
+    Enforce(lock, &budgetKey);
+}
+
+void BudgetTouch(BudgetConsumer *pOwner, uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(g_budgetMutex);
+
+    std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.find(BudgetKey(pOwner, key));
+
+    if(i == g_budgetEntries.end())
+        return;
+
+    if(i->second.bPending)
+    {
+        i->second.priority = Priority(i->second.bytes, i->second.cost);
+        return;
+    }
+
+    g_budgetQueue.erase(std::make_pair(i->second.priority, i->first));
+    i->second.priority = Priority(i->second.bytes, i->second.cost);
+    g_budgetQueue.insert(std::make_pair(i->second.priority, i->first));
+}
+
+void BudgetRemove(BudgetConsumer *pOwner, uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(g_budgetMutex);
+
+    std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.find(BudgetKey(pOwner, key));
+
+    if(i != g_budgetEntries.end())
+        RemoveEntry(i);
+}
+
+void BudgetRemoveAll(BudgetConsumer *pOwner)
+{
+    std::unique_lock<std::mutex> lock(g_budgetMutex);
+
+    // The owner is going away, another thread may still be inside its BudgetEvict()
+    while(g_evictionsInFlight.count(pOwner))
+        g_evictionDone.wait(lock);
+
+    std::map<BudgetKey, BudgetEntry>::iterator i = g_budgetEntries.lower_bound(BudgetKey(pOwner, 0));
+
+    while(i != g_budgetEntries.end() && i->first.first == pOwner)
+        RemoveEntry(i++);
+}
+
+void BudgetEnforce()
+{
+    std::unique_lock<std::mutex> lock(g_budgetMutex);
+    Enforce(lock, NULL);
+}
+
+uint64_t BudgetEvictableBytes()
+{
+    std::lock_guard<std::mutex> lock(g_budgetMutex);
+    return g_evictableBytes;
+}
+
+uint64_t BudgetEvictions()
+{
+    std::lock_guard<std::mutex> lock(g_budgetMutex);
+    return g_evictions;
+}
+
+uint64_t BudgetEvictedBytes()
+{
+    std::lock_guard<std::mutex> lock(g_budgetMutex);
+    return g_evictedBytes;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    One memory cap for the whole process.
+
+    What counts against the cap is MemoryTotal(), every subsystem the memory
+    accounting sees.  Data that can be dropped and rebuilt later is registered
+    here as entries, each with its size and the cost of bringing it back.
+    When the total goes over the cap, entries are evicted across all consumers
+    by GreedyDual-Size: an entry's priority is the inflation value L plus
+    cost / bytes, using an entry resets its priority, and evicting one raises L
+    to its priority.  Cheap, large and long unused entries go first.
+
+    With no limit set nothing is ever evicted.
+
+    Enforcement runs on the main thread only, the thread that called
+    BudgetSetLimit(): the consumers it evicts from, PagedStore and the lazy
+    XML loader, are not thread safe.  With a limit set, BudgetInsert() and
+    BudgetEnforce() must be called from that thread, which is asserted.
+*/
+
+class BudgetConsumer
+{
+public:
+    virtual ~BudgetConsumer() {}
+
+    virtual const char *BudgetName() const = 0;
+
+    // Drop the data of key and free its memory.  Return false if it cannot go right now,
+    // a read in flight for example.  Called on the main thread, without the budget's lock
+    // held.  Must not call back into the budget.
+    virtual bool BudgetEvict(uint64_t key) = 0;
+};
+
+// 0 is no limit.  Called once on the main thread, before anything is inserted.
+void BudgetSetLimit(uint64_t bytes);
+uint64_t BudgetLimit();
+
+// cost is roughly the microseconds it takes to rebuild the entry.
+// Inserting an existing key updates its size and cost and counts as a use.
+void BudgetInsert(BudgetConsumer *pOwner, uint64_t key, uint64_t bytes, double cost);
+void BudgetTouch(BudgetConsumer *pOwner, uint64_t key);
+
+// The owner dropped the data itself.  BudgetRemoveAll() also waits for an eviction of the
+// owner that is still running, call it before the owner goes away.
+void BudgetRemove(BudgetConsumer *pOwner, uint64_t key);
+void BudgetRemoveAll(BudgetConsumer *pOwner);
+
+// Evicts until the process is under its cap or nothing evictable is left
+void BudgetEnforce();
+
+uint64_t BudgetEvictableBytes();
+uint64_t BudgetEvictions();
+uint64_t BudgetEvictedBytes();
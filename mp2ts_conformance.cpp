@@ -0,0 +1,589 @@
+#include "mp2ts_conformance.h"
+#include "mp2ts_demux.h"
+#include "mp2ts_metrics.h"
+
+#include <cstdio>
+#include <cstring>
+
+// Bytes read at a time
+#define CONFORMANCE_BLOCK_SIZE (4 * 1024 * 1024)
+
+// TR 101 290 5.2.1: sync is lost after 2 bad sync bytes in a row, and acquired after 5 good ones
+#define SYNC_LOSS_PACKETS 2
+#define SYNC_ACQUIRE_PACKETS 5
+
+// Limits, in milliseconds
+#define PAT_INTERVAL_MS 500
+#define PMT_INTERVAL_MS 500
+#define PID_INTERVAL_MS 5000
+#define PCR_REPETITION_MS 40
+#define PCR_DISCONTINUITY_MS 100
+#define PTS_INTERVAL_MS 700
+
+#define CLOCK_TICKS_PER_MS 27000
+
+// A PCR is 33 bits of 90 kHz base times 300, plus the 27 MHz extension
+#define PCR_WRAP ((1ull << 33) * 300)
+
+#define NULL_PID 0x1FFF
+
+// Events that are not about one PID
+#define NO_PID 0xFFFF
+
+struct ConformanceCheckInfo
+{
+    const char  *name;
+    int         priority;
+};
+
+static const ConformanceCheckInfo g_checkInfo[eNumConformanceChecks] =
+{
+    { "1.1 TS_sync_loss",                           1 },
+    { "1.2 Sync_byte_error",                        1 },
+    { "1.3 PAT_error",                              1 },
+    { "1.4 Continuity_count_error",                 1 },
+    { "1.5 PMT_error",                              1 },
+    { "1.6 PID_error",                              1 },
+    { "2.1 Transport_error",                        2 },
+    { "2.2 CRC_error",                              2 },
+    { "2.3a PCR_repetition_error",                  2 },
+    { "2.3b PCR_discontinuity_indicator_error",     2 },
+    { "2.5 PTS_error",                              2 }
+};
+
+const char *ConformanceCheckName(eConformanceCheck check)
+{
+    return g_checkInfo[check].name;
+}
+
+int ConformancePriority(eConformanceCheck check)
+{
+    return g_checkInfo[check].priority;
+}
+
+void ConformanceEventText(const ConformanceEvent &event, char *pText, size_t size)
+{
+    snprintf(pText, size, event.pFormat, event.value1, event.value2);
+}
+
+// Forward distance from PCR a to PCR b
+static uint64_t PCRDelta(uint64_t a, uint64_t b)
+{
+    return (b + PCR_WRAP - a) % PCR_WRAP;
+}
+
+ConformanceChecker::ConformanceChecker()
+    : m_packetSize(188)
+    , m_syncOffset(0)
+    , m_clockPID(-1)
+    , m_packetIndex(0)
+    , m_clockPacket(0)
+    , m_clockTime(0)
+    , m_ticksPerPacket(0.0)
+    , m_eventCount(0)
+    , m_bytesChecked(0)
+    , m_bytesTotal(0)
+    , m_bStarted(false)
+    , m_bCancel(false)
+    , m_bDone(false)
+{
+    for(int i = 0; i < eNumConformanceChecks; i++)
+        m_counts[i].store(0, std::memory_order_relaxed);
+}
+
+ConformanceChecker::~ConformanceChecker()
+{
+    Cancel();
+
+    if(m_thread.joinable())
+        m_thread.join();
+}
+
+void ConformanceChecker::Reset(unsigned int packetSize)
+{
+    m_packetSize = packetSize;
+    m_syncOffset = 192 == packetSize ? 4 : 0;
+
+    PIDState empty;
+    memset(&empty, 0, sizeof(empty));
+    empty.lastTime = -1;
+    empty.lastPTSTime = -1;
+    empty.lastPCRTime = -1;
+    empty.lastCC = -1;
+
+    m_pids.assign(8192, empty);
+
+    m_clockPID = -1;
+    m_packetIndex = 0;
+    m_clockPacket = 0;
+    m_clockTime = 0;
+    m_ticksPerPacket = 0.0;
+
+    m_pcrAnalysis.Reset(packetSize);
+    m_psi.Reset();
+
+    // Never grows past this, so the GUI can read events while more are added
+    m_events.clear();
+    m_events.reserve(CONFORMANCE_MAX_EVENTS);
+    m_eventCount.store(0, std::memory_order_release);
+
+    for(int i = 0; i < eNumConformanceChecks; i++)
+        m_counts[i].store(0, std::memory_order_relaxed);
+
+    m_bytesChecked.store(0, std::memory_order_relaxed);
+}
+
+uint64_t ConformanceChecker::ErrorCount() const
+{
+    uint64_t count = 0;
+
+    for(int i = 0; i < eNumConformanceChecks; i++)
+        count += Count((eConformanceCheck) i);
+
+    return count;
+}
+
+size_t ConformanceChecker::FirstEventAt(uint64_t offset) const
+{
+    size_t low = 0;
+    size_t high = EventCount();
+
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if(m_events[middle].offset < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+bool ConformanceChecker::Start(eInputBackend backend, const std::string &fileName, unsigned int packetSize)
+{
+    if(m_bStarted)
+        return false;
+
+    InputSource *pInput = CreateInputSource(backend);
+
+    if(!pInput || !pInput->Open(fileName))
+    {
+        fprintf(stderr, "Error: Could not open %s for the conformance check\n", fileName.c_str());
+        delete pInput;
+        return false;
+    }
+
+    m_bStarted = true;
+    m_bytesTotal.store(pInput->Size(), std::memory_order_relaxed);
+    m_thread = std::thread(&ConformanceChecker::ThreadMain, this, pInput, packetSize);
+
+    return true;
+}
+
+void ConformanceChecker::ThreadMain(InputSource *pInput, unsigned int packetSize)
+{
+    Run(pInput, packetSize);
+
+    pInput->Close();
+    delete pInput;
+}
+
+void ConformanceChecker::Cancel()
+{
+    m_bCancel.store(true, std::memory_order_relaxed);
+}
+
+void ConformanceChecker::Report(eConformanceCheck check, uint64_t offset, uint16_t pid, const char *pFormat, uint32_t value1, uint32_t value2)
+{
+    m_counts[check].fetch_add(1, std::memory_order_relaxed);
+    MetricsAdd(eMetricConformanceErrors);
+
+    if(m_events.size() >= CONFORMANCE_MAX_EVENTS)
+        return;
+
+    ConformanceEvent event;
+    event.offset = offset;
+    event.pFormat = pFormat;
+    event.value1 = value1;
+    event.value2 = value2;
+    event.pid = pid;
+    event.check = (uint8_t) check;
+
+    m_events.push_back(event);
+    m_eventCount.store(m_events.size(), std::memory_order_release);
+}
+
+int64_t ConformanceChecker::Now() const
+{
+    if(m_ticksPerPacket <= 0.0)
+        return -1;
+
+    return m_clockTime + (int64_t) (m_ticksPerPacket * (double) (m_packetIndex - m_clockPacket));
+}
+
+bool ConformanceChecker::FindSync(const uint8_t *pBlock, size_t size, size_t &pos, bool bLastBlock) const
+{
+    for(; pos + m_packetSize <= size; pos++)
+    {
+        size_t packets = SYNC_ACQUIRE_PACKETS;
+
+        if(pos + packets * m_packetSize > size)
+        {
+            // Wait for the next block, unless the file ends first
+            if(!bLastBlock)
+                return false;
+
+            packets = (size - pos) / m_packetSize;
+        }
+
+        size_t k = 0;
+
+        while(k < packets && 0x47 == pBlock[pos + k * m_packetSize + m_syncOffset])
+            k++;
+
+        if(k == packets)
+            return true;
+    }
+
+    return false;
+}
+
+bool ConformanceChecker::Run(InputSource *pInput, unsigned int packetSize)
+{
+    Reset(packetSize);
+
+    m_bytesTotal.store(pInput->Size(), std::memory_order_relaxed);
+
+    std::vector<uint8_t> scratch;
+    uint64_t fileSize = pInput->Size();
+    uint64_t offset = 0;
+    bool bInSync = false;
+    unsigned int badSyncs = 0;
+    bool bOK = true;
+
+    while(offset + m_packetSize <= fileSize && !m_bCancel.load(std::memory_order_relaxed))
+    {
+        size_t n = (size_t) (fileSize - offset < CONFORMANCE_BLOCK_SIZE ? fileSize - offset : CONFORMANCE_BLOCK_SIZE);
+        bool bLastBlock = offset + n >= fileSize;
+
+        const uint8_t *pBlock = pInput->Fetch(offset, n, scratch);
+
+        if(!pBlock)
+        {
+            fprintf(stderr, "Error: Could not read %zu bytes at offset %llu\n", n, (unsigned long long) offset);
+            bOK = false;
+            break;
+        }
+
+        size_t pos = 0;
+        uint64_t packetsBefore = m_packetIndex;
+
+        while(pos + m_packetSize <= n)
+        {
+            if(!bInSync)
+            {
+                if(!FindSync(pBlock, n, pos, bLastBlock))
+                    break;
+
+                bInSync = true;
+                badSyncs = 0;
+            }
+
+            m_packetIndex++;
+
+            uint8_t syncByte = pBlock[pos + m_syncOffset];
+
+            if(0x47 != syncByte)
+            {
+                Report(eCheckSyncByte, offset + pos, NO_PID, "sync byte 0x%02x", syncByte);
+
+                if(++badSyncs >= SYNC_LOSS_PACKETS)
+                {
+                    Report(eCheckSyncLoss, offset + pos, NO_PID, "%u bad sync bytes in a row", badSyncs);
+
+                    // Look for the packet grid again from the byte after this sync byte
+                    bInSync = false;
+                    pos++;
+                    continue;
+                }
+
+                pos += m_packetSize;
+                continue;
+            }
+
+            badSyncs = 0;
+
+            CheckPacket(pBlock + pos, offset + pos);
+
+            pos += m_packetSize;
+        }
+
+        MetricsAdd(eMetricPacketsChecked, m_packetIndex - packetsBefore);
+
+        // What was not looked at is read again with the next block
+        offset += bLastBlock && pos + m_packetSize > n ? n : pos;
+
+        m_bytesChecked.store(offset, std::memory_order_relaxed);
+    }
+
+    Finish(offset);
+
+    m_pcrAnalysis.Analyze();
+
+    m_bDone.store(true, std::memory_order_release);
+
+    return bOK;
+}
+
+void ConformanceChecker::CheckPacket(const uint8_t *pPacket, uint64_t offset)
+{
+    TSPacketHeader header;
+    ParsePacketHeader(pPacket, (int) m_packetSize, header);
+
+    uint16_t pid = header.pid;
+    PIDState &state = m_pids[pid];
+
+    // Nothing else in the packet can be trusted
+    if(header.transportErrorIndicator)
+    {
+        Report(eCheckTransport, offset, pid, "transport_error_indicator set");
+        return;
+    }
+
+    state.bSeen = 1;
+
+    if(header.bHasPCR)
+    {
+        // The TP_extra_header of a 192 byte packet ends in a 30 bit arrival_time_stamp
+        uint32_t arrivalTime = m_syncOffset ? (uint32_t) pPacket[0] << 24 | pPacket[1] << 16 | pPacket[2] << 8 | pPacket[3] : 0;
+        CheckPCR(state, header, offset, arrivalTime);
+    }
+
+    if(NULL_PID != pid)
+        CheckContinuity(state, header, offset);
+
+    const uint8_t *pPayload = pPacket + header.payloadOffset;
+    const uint8_t *pEnd = pPacket + m_packetSize;
+    bool bSectionStart = header.payloadUnitStartIndicator && pPayload < pEnd;
+
+    uint8_t role = m_psi.Role(pid);
+
+    if(0 == pid || (role & PSI_ROLE_PMT))
+    {
+        eConformanceCheck check = 0 == pid ? eCheckPAT : eCheckPMT;
+
+        if(header.transportScramblingControl)
+        {
+            Report(check, offset, pid, "scrambled, transport_scrambling_control %u", header.transportScramblingControl);
+        }
+        else if(bSectionStart)
+        {
+            // pointer_field, then the section
+            const uint8_t *pSection = pPayload + 1 + *pPayload;
+
+            if(pSection < pEnd)
+            {
+                uint8_t tableId = *pSection;
+
+                if(0 == pid && 0x00 != tableId)
+                {
+                    Report(eCheckPAT, offset, pid, "table_id 0x%02x on PID 0", tableId);
+                }
+                else if(0 == pid)
+                {
+                    state.bSectionSeen = 1;
+                    CheckInterval(state.lastTime, eCheckPAT, PAT_INTERVAL_MS, offset, pid);
+                }
+                else if(0x02 == tableId)
+                {
+                    state.bSectionSeen = 1;
+                    CheckInterval(state.lastTime, eCheckPMT, PMT_INTERVAL_MS, offset, pid);
+                }
+            }
+        }
+    }
+
+    if(role & PSI_ROLE_SECTIONS)
+    {
+        unsigned int failures = m_psi.Packet(header, pPayload, pEnd, offset);
+
+        for(unsigned int i = 0; i < failures; i++)
+            Report(eCheckCRC, offset, pid, "table_id 0x%02x failed its CRC_32", m_psi.LastFailedTableId());
+    }
+
+    if(role & PSI_ROLE_ES)
+    {
+        CheckInterval(state.lastTime, eCheckPID, PID_INTERVAL_MS, offset, pid);
+
+        if(bSectionStart && !header.transportScramblingControl)
+            CheckPTS(state, pPayload, pEnd, offset, pid);
+    }
+}
+
+void ConformanceChecker::CheckContinuity(PIDState &state, const TSPacketHeader &header, uint64_t offset)
+{
+    // Only packets with a payload count
+    if(!(header.adaptationFieldControl & 1))
+        return;
+
+    uint8_t cc = header.continuityCounter;
+
+    if(state.lastCC < 0 || header.discontinuityIndicator)
+    {
+        state.lastCC = cc;
+        state.repeats = 0;
+        return;
+    }
+
+    if(cc == state.lastCC)
+    {
+        // One repeat is allowed
+        if(++state.repeats >= 2)
+            Report(eCheckContinuity, offset, header.pid, "packet sent %u times", state.repeats + 1);
+
+        return;
+    }
+
+    uint8_t expected = (state.lastCC + 1) & 0x0F;
+
+    if(cc != expected)
+        Report(eCheckContinuity, offset, header.pid, "continuity_counter %u, expected %u", cc, expected);
+
+    state.lastCC = cc;
+    state.repeats = 0;
+}
+
+void ConformanceChecker::CheckPCR(PIDState &state, const TSPacketHeader &header, uint64_t offset, uint32_t arrivalTime)
+{
+    uint64_t delta = state.bHasPCR ? PCRDelta(state.lastPCR, header.pcr) : 0;
+    bool bContinuous = state.bHasPCR && !header.discontinuityIndicator;
+
+    if(bContinuous)
+    {
+        if(delta > PCR_WRAP / 2)
+        {
+            Report(eCheckPCRDiscontinuity, offset, header.pid, "PCR went back %u ms", (uint32_t) ((PCR_WRAP - delta) / CLOCK_TICKS_PER_MS));
+            bContinuous = false;
+        }
+        else if(delta > PCR_DISCONTINUITY_MS * CLOCK_TICKS_PER_MS)
+        {
+            Report(eCheckPCRDiscontinuity, offset, header.pid, "PCR jumped %u ms", (uint32_t) (delta / CLOCK_TICKS_PER_MS));
+            bContinuous = false;
+        }
+        else if(delta > PCR_REPETITION_MS * CLOCK_TICKS_PER_MS)
+        {
+            Report(eCheckPCRRepetition, offset, header.pid, "%u ms since the last PCR", (uint32_t) (delta / CLOCK_TICKS_PER_MS));
+        }
+    }
+
+    // The first PID with a PCR is the clock.  Over a discontinuity it runs on at the last rate.
+    if(m_clockPID < 0)
+        m_clockPID = header.pid;
+
+    if(header.pid == m_clockPID && state.bHasPCR && m_packetIndex > m_clockPacket)
+    {
+        uint64_t packets = m_packetIndex - m_clockPacket;
+
+        if(bContinuous && delta > 0)
+        {
+            m_ticksPerPacket = (double) delta / (double) packets;
+            m_clockTime += (int64_t) delta;
+        }
+        else
+        {
+            m_clockTime += (int64_t) (m_ticksPerPacket * (double) packets);
+        }
+    }
+
+    if(header.pid == m_clockPID)
+        m_clockPacket = m_packetIndex;
+
+    m_pcrAnalysis.Add(header.pid, offset, header.pcr, !bContinuous, arrivalTime);
+
+    state.lastPCR = header.pcr;
+    state.lastPCRTime = Now();
+    state.bHasPCR = 1;
+}
+
+void ConformanceChecker::CheckInterval(int64_t &lastTime, eConformanceCheck check, unsigned int limitMs, uint64_t offset, uint16_t pid)
+{
+    int64_t now = Now();
+
+    if(now < 0)
+        return;
+
+    if(lastTime >= 0 && now - lastTime > (int64_t) limitMs * CLOCK_TICKS_PER_MS)
+        Report(check, offset, pid, "%u ms since the last", (uint32_t) ((now - lastTime) / CLOCK_TICKS_PER_MS));
+
+    lastTime = now;
+}
+
+void ConformanceChecker::CheckIntervalToEnd(int64_t lastTime, int64_t end, eConformanceCheck check, unsigned int limitMs, uint64_t offset, uint16_t pid)
+{
+    if(lastTime >= 0 && end - lastTime > (int64_t) limitMs * CLOCK_TICKS_PER_MS)
+        Report(check, offset, pid, "%u ms from the last to the end of the stream", (uint32_t) ((end - lastTime) / CLOCK_TICKS_PER_MS));
+}
+
+void ConformanceChecker::CheckPTS(PIDState &state, const uint8_t *p, const uint8_t *pEnd, uint64_t offset, uint16_t pid)
+{
+    // packet_start_code_prefix, stream_id, PES_packet_length, then the optional header with PTS_DTS_flags
+    if(pEnd - p < 9 || 0 != p[0] || 0 != p[1] || 1 != p[2])
+        return;
+
+    uint8_t streamId = p[3];
+
+    // program_stream_map, padding, private_stream_2, ECM, EMM, DSMCC, H.222.1 type E and the directory have no PTS
+    if(0xBC == streamId || 0xBE == streamId || 0xBF == streamId || 0xF0 == streamId ||
+       0xF1 == streamId || 0xF2 == streamId || 0xF8 == streamId || 0xFF == streamId)
+        return;
+
+    // '10' marker bits of an MPEG-2 PES header, then PTS_DTS_flags
+    if(0x80 == (p[6] & 0xC0) && (p[7] & 0x80))
+        CheckInterval(state.lastPTSTime, eCheckPTS, PTS_INTERVAL_MS, offset, pid);
+}
+
+void ConformanceChecker::Finish(uint64_t offset)
+{
+    if(!m_pids[0].bSectionSeen)
+        Report(eCheckPAT, offset, 0, "no PAT in the stream");
+
+    // A table or stream that stops before the end is only late against the end of the stream.
+    // Not when the check was cancelled, the end is wherever it stopped.
+    int64_t end = m_bCancel.load(std::memory_order_relaxed) ? -1 : Now();
+
+    if(end >= 0)
+    {
+        CheckIntervalToEnd(m_pids[0].lastTime, end, eCheckPAT, PAT_INTERVAL_MS, offset, 0);
+
+        for(unsigned int pid = 1; pid < m_pids.size(); pid++)
+        {
+            const PIDState &state = m_pids[pid];
+            uint8_t role = m_psi.Role((uint16_t) pid);
+
+            if(role & PSI_ROLE_PMT)
+                CheckIntervalToEnd(state.lastTime, end, eCheckPMT, PMT_INTERVAL_MS, offset, (uint16_t) pid);
+
+            if(role & PSI_ROLE_ES)
+            {
+                CheckIntervalToEnd(state.lastTime, end, eCheckPID, PID_INTERVAL_MS, offset, (uint16_t) pid);
+                CheckIntervalToEnd(state.lastPTSTime, end, eCheckPTS, PTS_INTERVAL_MS, offset, (uint16_t) pid);
+            }
+
+            if(state.bHasPCR)
+                CheckIntervalToEnd(state.lastPCRTime, end, eCheckPCRRepetition, PCR_REPETITION_MS, offset, (uint16_t) pid);
+        }
+    }
+
+    for(unsigned int pid = 1; pid < m_pids.size(); pid++)
+    {
+        const PIDState &state = m_pids[pid];
+
+        if((m_psi.Role((uint16_t) pid) & PSI_ROLE_PMT) && !state.bSectionSeen)
+            Report(eCheckPMT, offset, (uint16_t) pid, "listed in the PAT but never sent");
+
+        if((m_psi.Role((uint16_t) pid) & PSI_ROLE_ES) && !state.bSeen)
+            Report(eCheckPID, offset, (uint16_t) pid, "listed in a PMT but never sent");
+    }
+}
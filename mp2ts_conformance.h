@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "mp2ts_input.h"
+#include "mp2ts_pcr.h"
+#include "mp2ts_psi.h"
+
+// Events kept for display, the counts go on past it
+#define CONFORMANCE_MAX_EVENTS 100000
+
+struct TSPacketHeader;
+
+// The ETSI TR 101 290 priority 1 and 2 checks that only need the packet headers
+enum eConformanceCheck
+{
+    eCheckSyncLoss,             // 1.1  Two or more consecutive bad sync bytes
+    eCheckSyncByte,             // 1.2  Sync byte other than 0x47
+    eCheckPAT,                  // 1.3  PAT missing for 0.5 s, scrambled or the wrong table_id
+    eCheckContinuity,           // 1.4  Lost, repeated or out of order packets of a PID
+    eCheckPMT,                  // 1.5  PMT missing for 0.5 s or scrambled
+    eCheckPID,                  // 1.6  A PID the PMT lists missing for 5 s
+    eCheckTransport,            // 2.1  transport_error_indicator set
+    eCheckCRC,                  // 2.2  A PAT, PMT, SDT or EIT section failed its CRC_32
+    eCheckPCRRepetition,        // 2.3a PCRs of a PID more than 40 ms apart
+    eCheckPCRDiscontinuity,     // 2.3b PCR jump over 100 ms, or backwards, without the discontinuity_indicator
+    eCheckPTS,                  // 2.5  PTSs of a PID more than 700 ms apart
+    eNumConformanceChecks
+};
+
+const char *ConformanceCheckName(eConformanceCheck check);
+int ConformancePriority(eConformanceCheck check);
+
+struct ConformanceEvent
+{
+    uint64_t    offset;         // Byte offset of the packet in the TS
+    const char  *pFormat;       // printf format of the detail, with up to two %u for value1 and value2
+    uint32_t    value1;
+    uint32_t    value2;
+    uint16_t    pid;
+    uint8_t     check;          // eConformanceCheck
+};
+
+// Detail of event as text
+void ConformanceEventText(const ConformanceEvent &event, char *pText, size_t size);
+
+/*
+    A streaming TR 101 290 checker over the packet headers of the whole TS.
+
+    One sequential pass reads the file in large blocks and looks at the 4 byte
+    header of every packet, the adaptation field when there is one, and the first
+    bytes of the payload only for PES headers.  The packets of the PAT, the
+    PMTs, the SDT and the EIT go through PSITables, whose reassembled sections
+    say which PIDs are PMTs and elementary streams.
+
+    Intervals are measured on a clock built from the first PID that carries a
+    PCR, extrapolated between PCRs by packet count, so a check that needs the
+    time is only made once two PCRs have been seen.  At the end of the file
+    every interval still open is checked against the time of the last packet.
+
+    The events are kept in the order they are found, up to CONFORMANCE_MAX_EVENTS.
+    Past that only the counts go up.  While Start() runs the check on its own
+    thread, EventCount(), Event() and Count() can be read from another.
+
+    The PCRs of every PID are kept along the way and analyzed at the end of
+    the pass.  PCR() and PSI() can be read once IsDone().
+*/
+class ConformanceChecker
+{
+public:
+
+    ConformanceChecker();
+    ~ConformanceChecker();
+
+    // Checks the whole file on the calling thread.  False if it could not be read.
+    bool Run(InputSource *pInput, unsigned int packetSize);
+
+    // Checks on a background thread, with its own InputSource of backend
+    bool Start(eInputBackend backend, const std::string &fileName, unsigned int packetSize);
+    void Cancel();
+
+    bool IsStarted() const { return m_bStarted; }
+    bool IsDone() const { return m_bDone.load(std::memory_order_acquire); }
+
+    uint64_t BytesChecked() const { return m_bytesChecked.load(std::memory_order_relaxed); }
+    uint64_t BytesTotal() const { return m_bytesTotal.load(std::memory_order_relaxed); }
+
+    uint64_t Count(eConformanceCheck check) const { return m_counts[check].load(std::memory_order_relaxed); }
+    uint64_t ErrorCount() const;
+
+    size_t EventCount() const { return m_eventCount.load(std::memory_order_acquire); }
+    const ConformanceEvent &Event(size_t i) const { return m_events[i]; }
+
+    // First event at or after offset, the events are found in file order
+    size_t FirstEventAt(uint64_t offset) const;
+
+    const PCRAnalysis &PCR() const { return m_pcrAnalysis; }
+    const PSITables &PSI() const { return m_psi; }
+
+private:
+
+    ConformanceChecker(const ConformanceChecker &);
+    ConformanceChecker &operator=(const ConformanceChecker &);
+
+    struct PIDState
+    {
+        int64_t     lastTime;       // Last PAT/PMT section, or last packet of an ES PID, -1 if none
+        int64_t     lastPTSTime;
+        int64_t     lastPCRTime;
+        uint64_t    lastPCR;
+        uint8_t     bSeen;
+        uint8_t     bSectionSeen;   // A PAT or PMT section started on it
+        uint8_t     bHasPCR;
+        int8_t      lastCC;         // -1 before the first packet with a payload
+        uint8_t     repeats;        // Times the last packet was repeated
+    };
+
+    void Reset(unsigned int packetSize);
+    void CheckPacket(const uint8_t *pPacket, uint64_t offset);
+    void CheckContinuity(PIDState &state, const TSPacketHeader &header, uint64_t offset);
+    void CheckPCR(PIDState &state, const TSPacketHeader &header, uint64_t offset, uint32_t arrivalTime);
+    void CheckInterval(int64_t &lastTime, eConformanceCheck check, unsigned int limitMs, uint64_t offset, uint16_t pid);
+    void CheckIntervalToEnd(int64_t lastTime, int64_t end, eConformanceCheck check, unsigned int limitMs, uint64_t offset, uint16_t pid);
+    void CheckPTS(PIDState &state, const uint8_t *p, const uint8_t *pEnd, uint64_t offset, uint16_t pid);
+    void Finish(uint64_t offset);
+
+    // Start of the first SYNC_ACQUIRE_PACKETS packets in a row from pos, false if more data is needed
+    bool FindSync(const uint8_t *pBlock, size_t size, size_t &pos, bool bLastBlock) const;
+
+    void Report(eConformanceCheck check, uint64_t offset, uint16_t pid, const char *pFormat, uint32_t value1 = 0, uint32_t value2 = 0);
+
+    // Clock in 27 MHz ticks at the current packet, -1 until two PCRs were seen
+    int64_t Now() const;
+
+    void ThreadMain(InputSource *pInput, unsigned int packetSize);
+
+    unsigned int                    m_packetSize;
+    unsigned int                    m_syncOffset;       // 4 for 192 byte packets
+    std::vector<PIDState>           m_pids;
+
+    // Clock
+    int                             m_clockPID;
+    uint64_t                        m_packetIndex;
+    uint64_t                        m_clockPacket;      // Packet of the last clock PCR
+    int64_t                         m_clockTime;        // Unwrapped time of the last clock PCR
+    double                          m_ticksPerPacket;   // 0 until two PCRs were seen
+
+    PCRAnalysis                     m_pcrAnalysis;
+    PSITables                       m_psi;
+
+    std::vector<ConformanceEvent>   m_events;
+    std::atomic<size_t>             m_eventCount;
+    std::atomic<uint64_t>           m_counts[eNumConformanceChecks];
+    std::atomic<uint64_t>           m_bytesChecked;
+    std::atomic<uint64_t>           m_bytesTotal;
+
+    bool                            m_bStarted;
+    std::atomic<bool>               m_bCancel;
+    std::atomic<bool>               m_bDone;
+    std::thread                     m_thread;
+};
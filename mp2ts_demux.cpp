@@ -0,0 +1,577 @@
+#include "mp2ts_demux.h"
+#include "mp2ts_input.h"
+#include "mp2ts_xml.h"
+#include "mp2ts_profiler.h"
+#include "mp2ts_metrics.h"
+#include "mp2ts_memory.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libavutil/error.h>
+}
+
+#include <cstdio>
+#include <cstring>
+
+static size_t inline increment_ptr(const uint8_t *&p, size_t bytes)
+{
+    p += bytes;
+    return bytes;
+}
+
+static inline uint16_t read_2_bytes(const uint8_t *p)
+{
+    uint16_t ret = *p++;
+    ret <<= 8;
+    ret |= *p++;
+
+    return ret;
+}
+
+static inline uint32_t read_4_bytes(const uint8_t *p)
+{
+    uint32_t ret = 0;
+    uint32_t val = *p++;
+    ret = val << 24;
+    val = *p++;
+    ret |= val << 16;
+    val = *p++;
+    ret |= val << 8;
+    ret |= *p;
+
+    return ret;
+}
+
+// Fills the adaptation field flags and PCR of header, returns the bytes to skip past the field
+static inline uint8_t process_adaptation_field(const uint8_t *&p, TSPacketHeader &header)
+{
+    uint8_t adaptation_field_length = *p;
+
+    if (adaptation_field_length > 0) {
+        uint8_t flags = p[1];
+
+        header.discontinuityIndicator = (flags & 0x80) >> 7;
+        header.randomAccessIndicator = (flags & 0x40) >> 6;
+
+        // program_clock_reference_base, 6 reserved bits, program_clock_reference_extension
+        if ((flags & 0x10) && adaptation_field_length >= 7) {
+            uint64_t base = ((uint64_t)read_4_bytes(p + 2) << 1) | (p[6] >> 7);
+            uint16_t extension = ((p[6] & 0x01) << 8) | p[7];
+
+            header.bHasPCR = 1;
+            header.pcr = base * 300 + extension;
+        }
+    }
+
+    return adaptation_field_length + 1;
+}
+
+bool ParsePacketHeader(const uint8_t *packet, int packetSize, TSPacketHeader &header)
+{
+    const uint8_t* p = packet;
+
+    if (192 == packetSize)
+        increment_ptr(p, 4);
+
+    if (0x47 != *p)
+        return false;
+
+    // Skip the sync byte 0x47
+    increment_ptr(p, 1);
+
+    uint16_t PID = read_2_bytes(p);
+    increment_ptr(p, 2);
+
+    header.transportErrorIndicator = (PID & 0x8000) >> 15;
+    header.payloadUnitStartIndicator = (PID & 0x4000) >> 14;
+    header.transportPriority = (PID & 0x2000) >> 13;
+    header.pid = PID & 0x1FFF;
+
+    // Move beyond the 32 bit header
+    uint8_t final_byte = *p;
+    increment_ptr(p, 1);
+
+    header.transportScramblingControl = (final_byte & 0xC0) >> 6;
+    header.adaptationFieldControl = (final_byte & 0x30) >> 4;
+    header.continuityCounter = final_byte & 0x0F;
+
+    header.discontinuityIndicator = 0;
+    header.randomAccessIndicator = 0;
+    header.bHasPCR = 0;
+    header.pcr = 0;
+
+    /*
+        Table 2-5  Adaptation field control values
+            Value  Description
+             00    Reserved for future use by ISO/IEC
+             01    No adaptation_field, payload only
+             10    Adaptation_field only, no payload
+             11    Adaptation_field followed by payload
+    */
+
+    uint8_t adaptation_field_length = 0;
+
+    if (2 == header.adaptationFieldControl || 3 == header.adaptationFieldControl)
+        adaptation_field_length = process_adaptation_field(p, header);
+
+    increment_ptr(p, adaptation_field_length);
+
+    if (2 == header.adaptationFieldControl || p - packet >= packetSize)
+        header.payloadOffset = packetSize;
+    else
+        header.payloadOffset = (int)(p - packet);
+
+    return true;
+}
+
+// 33 bit PTS or DTS from the 5 bytes at p, marker bits dropped
+static inline uint64_t read_timestamp(const uint8_t *p)
+{
+    return ((uint64_t)(p[0] & 0x0E) << 29) |
+           ((uint64_t)p[1] << 22) | ((uint64_t)(p[2] & 0xFE) << 14) |
+           ((uint64_t)p[3] << 7) | ((uint64_t)p[4] >> 1);
+}
+
+int ParsePESHeader(const uint8_t *p, const uint8_t *pEnd, PESHeader &header)
+{
+    header.streamId = 0;
+    header.bHasPTS = false;
+    header.bHasDTS = false;
+    header.pts = 0;
+    header.dts = 0;
+
+    if (pEnd - p < 9 || 0 != p[0] || 0 != p[1] || 1 != p[2])
+        return -1;
+
+    header.streamId = p[3];
+
+    // Only the '10' marker bits of an MPEG-2 PES header are followed by PTS_DTS_flags
+    if (0x80 != (p[6] & 0xC0))
+        return 6;
+
+    int size = 9 + p[8];
+
+    if (pEnd - p < size)
+        return -1;
+
+    uint8_t ptsDtsFlags = p[7] >> 6;
+
+    if ((ptsDtsFlags & 2) && size >= 14) {
+        header.pts = read_timestamp(p + 9);
+        header.bHasPTS = true;
+
+        if (3 == ptsDtsFlags && size >= 19) {
+            header.dts = read_timestamp(p + 14);
+            header.bHasDTS = true;
+        }
+    }
+
+    return size;
+}
+
+int FindData(const uint8_t *packet, int packetSize)
+{
+    TSPacketHeader header;
+
+    if (!ParsePacketHeader(packet, packetSize, header)) {
+        fprintf(stderr, "Error: Packet does not start with 0x47\n");
+        return -1;
+    }
+
+    if (header.payloadOffset >= packetSize)
+        return packetSize;
+
+    const uint8_t* p = packet + header.payloadOffset;
+
+    /*
+        The first packet of a PES starts with its header, PES_header_data_length says
+        where the ES starts behind it.  That holds for every codec, so the ES itself is
+        not looked at: H.264 and HEVC NAL units go through as they are, where skipping
+        to the next start code at or below 0xB8 only ever suited MPEG-1/2.
+    */
+    if (header.payloadUnitStartIndicator) {
+        PESHeader pes;
+        int headerSize = ParsePESHeader(p, packet + packetSize, pes);
+
+        if (headerSize > 0)
+            increment_ptr(p, headerSize);
+    }
+
+    return (int)(p - packet);
+}
+
+
+// Elements of an AU closer together than this are fetched with a single read.
+// The packets of other PIDs in the gap are read and skipped.
+#define COALESCE_GAP_BYTES (256 * 1024)
+
+struct ReadSpan
+{
+    uint64_t start;
+    uint64_t end;
+    size_t firstElement;
+    size_t lastElement;     // One past the last element in the span
+};
+
+// Reused for every read, grows to the largest span seen.  Not touched by the mmap backend.
+static std::vector<uint8_t> g_spanBuffer;
+
+// Groups the elements of an AU into the reads that will fetch them
+static void BuildReadSpans(const std::vector<AccessUnitElement> &elements, unsigned int packetSize, std::vector<ReadSpan> &spans)
+{
+    spans.clear();
+
+    size_t first = 0;
+
+    while (first < elements.size()) {
+        ReadSpan span;
+        span.start = elements[first].startByteLocation;
+        span.end = span.start + elements[first].numPackets * packetSize;
+        span.firstElement = first;
+
+        size_t last = first + 1;
+
+        // Merge following elements while the gap to them is small
+        while (last < elements.size() &&
+               elements[last].startByteLocation >= span.end &&
+               elements[last].startByteLocation - span.end <= COALESCE_GAP_BYTES) {
+            span.end = elements[last].startByteLocation + elements[last].numPackets * packetSize;
+            last++;
+        }
+
+        span.lastElement = last;
+        spans.push_back(span);
+
+        first = last;
+    }
+}
+
+void PrefetchAccessUnit(InputSource *pInput, const std::vector<AccessUnitElement> &elements, unsigned int packetSize)
+{
+    static std::vector<ReadSpan> spans;
+
+    BuildReadSpans(elements, packetSize, spans);
+
+    for (auto span : spans)
+        pInput->Prefetch(span.start, (size_t)(span.end - span.start));
+}
+
+uint64_t MaxPayloadSize(const std::vector<AccessUnitElement> &elements, unsigned int packetSize)
+{
+    uint64_t numPackets = 0;
+
+    for (auto aue : elements)
+        numPackets += aue.numPackets;
+
+    return numPackets * packetSize;
+}
+
+size_t ReadAccessUnitPayload(InputSource *pInput, const std::vector<AccessUnitElement> &elements, unsigned int packetSize, uint8_t *pPayload)
+{
+    static std::vector<ReadSpan> spans;
+
+    size_t numBytes = 0;
+
+    BuildReadSpans(elements, packetSize, spans);
+
+    for (auto span : spans) {
+        const uint8_t* pSpan = NULL;
+
+        {
+            PROFILE_SCOPE(eProfileRead);
+            pSpan = pInput->Fetch(span.start, (size_t)(span.end - span.start), g_spanBuffer);
+        }
+
+        if (!pSpan) {
+            fprintf(stderr, "Error: Could not read %llu bytes at offset %llu\n", span.end - span.start, span.start);
+            break;
+        }
+
+        PROFILE_SCOPE(eProfileFindData);
+
+        for (size_t e = span.firstElement; e < span.lastElement; e++) {
+            const uint8_t* pPacket = pSpan + (elements[e].startByteLocation - span.start);
+
+            for (uint64_t i = 0; i < elements[e].numPackets; i++, pPacket += packetSize) {
+                int count = FindData(pPacket, packetSize);
+
+                if (count > 0 && count < (int)packetSize) {
+                    memcpy(pPayload + numBytes, pPacket + count, packetSize - count);
+                    numBytes += packetSize - count;
+                }
+            }
+        }
+    }
+
+    return numBytes;
+}
+
+
+/*
+    Video AUs in decode order as located by mpts_parser.
+    No demuxer runs, the payload is cut straight out of the TS packets.
+*/
+class InternalPacketSource : public PacketSource
+{
+public:
+
+    InternalPacketSource(MpegTS_XML &mpts, InputSource *pInput)
+        : m_mpts(mpts)
+        , m_pInput(pInput)
+        , m_decodeFrameNumber(0)
+    {
+    }
+
+    bool ReadPacket(AVPacket *pPacket)
+    {
+        const AccessUnitIndex &accessUnits = m_mpts.m_videoAccessUnitsDecode;
+        unsigned int packetSize = m_mpts.m_mpegTSDescriptor.packetSize;
+
+        if(m_decodeFrameNumber >= accessUnits.size())
+            return false;
+
+        const AccessUnit au = accessUnits[m_decodeFrameNumber];
+
+        m_mpts.GetVideoAccessUnitElements(au, m_elements);
+
+        av_init_packet(pPacket);
+
+        // Assemble the payload straight into the packet buffer, no intermediate copy
+        size_t maxBytes = (size_t) MaxPayloadSize(m_elements, packetSize);
+
+        pPacket->buf = av_buffer_alloc((int) maxBytes + AV_INPUT_BUFFER_PADDING_SIZE);
+
+        if(!pPacket->buf)
+        {
+            av_log(NULL, AV_LOG_ERROR, "Could not allocate a %zu byte packet\n", maxBytes);
+            return false;
+        }
+
+        size_t numBytes = ReadAccessUnitPayload(m_pInput, m_elements, packetSize, pPacket->buf->data);
+        memset(pPacket->buf->data + numBytes, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+        pPacket->data = pPacket->buf->data;
+        pPacket->size = (int) numBytes;
+        pPacket->dts = au.dts;
+        pPacket->pts = au.pts;
+        pPacket->pos = m_elements.size() ? (int64_t) m_elements[0].startByteLocation : -1;
+
+        if(au.random_access)
+            pPacket->flags |= AV_PKT_FLAG_KEY;
+
+        m_decodeFrameNumber++;
+        m_packetsRead++;
+        m_payloadBytes += numBytes;
+
+        // Let the backend start fetching the next AU while this one decodes
+        if(m_decodeFrameNumber < accessUnits.size())
+        {
+            m_mpts.GetVideoAccessUnitElements(accessUnits[m_decodeFrameNumber], m_elements);
+            PrefetchAccessUnit(m_pInput, m_elements, packetSize);
+        }
+
+        return true;
+    }
+
+    bool Seek(unsigned int frameNumber, uint64_t bytePos)
+    {
+        m_decodeFrameNumber = frameNumber;
+        return frameNumber < m_mpts.m_videoAccessUnitsDecode.size();
+    }
+
+    const char *Name() const { return "internal"; }
+
+private:
+    MpegTS_XML                      &m_mpts;
+    InputSource                     *m_pInput;
+    unsigned int                    m_decodeFrameNumber;
+    std::vector<AccessUnitElement>  m_elements;
+};
+
+/*
+    av_read_frame on the format context opened over the same InputSource
+*/
+class FFmpegPacketSource : public PacketSource
+{
+public:
+
+    FFmpegPacketSource(AVFormatContext *pFormatContext, int videoStreamIndex)
+        : m_pFormatContext(pFormatContext)
+        , m_videoStreamIndex(videoStreamIndex)
+    {
+    }
+
+    bool ReadPacket(AVPacket *pPacket)
+    {
+        PROFILE_SCOPE(eProfileDemux);
+
+        while(av_read_frame(m_pFormatContext, pPacket) >= 0)
+        {
+            if(pPacket->stream_index == m_videoStreamIndex)
+            {
+                m_packetsRead++;
+                m_payloadBytes += pPacket->size;
+                return true;
+            }
+
+            av_packet_unref(pPacket);
+        }
+
+        return false;
+    }
+
+    bool Seek(unsigned int frameNumber, uint64_t bytePos)
+    {
+        int64_t pos = (int64_t) bytePos;
+        return avformat_seek_file(m_pFormatContext, m_videoStreamIndex, pos, pos, pos, AVSEEK_FLAG_BYTE) >= 0;
+    }
+
+    const char *Name() const { return "ffmpeg"; }
+
+private:
+    AVFormatContext *m_pFormatContext;
+    int             m_videoStreamIndex;
+};
+
+PacketSource *CreatePacketSource(eDemuxBackend backend, MpegTS_XML &mpts, InputSource *pInput, AVFormatContext *pFormatContext)
+{
+    switch(backend)
+    {
+        case eDemuxInternal:
+            return new InternalPacketSource(mpts, pInput);
+
+        case eDemuxFFmpeg:
+            return new FFmpegPacketSource(pFormatContext, mpts.m_videoStreamIndex);
+    }
+
+    return NULL;
+}
+
+static const char *g_demuxBackendNames[] = { "internal", "ffmpeg" };
+
+bool DemuxBackendFromName(const char *name, eDemuxBackend &backend)
+{
+    for(unsigned int i = 0; i < sizeof(g_demuxBackendNames) / sizeof(g_demuxBackendNames[0]); i++)
+    {
+        if(0 == strcmp(name, g_demuxBackendNames[i]))
+        {
+            backend = (eDemuxBackend) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char *DemuxBackendName(eDemuxBackend backend)
+{
+    return g_demuxBackendNames[backend];
+}
+
+// The decoder's own pools are allocated with av_malloc and cannot be seen,
+// this is what the frame handed to the caller references
+static uint64_t FrameBufferBytes(const AVFrame *pFrame)
+{
+    uint64_t bytes = 0;
+
+    for(int i = 0; i < AV_NUM_DATA_POINTERS && pFrame->buf[i]; i++)
+        bytes += pFrame->buf[i]->size;
+
+    return bytes;
+}
+
+static eMetricHistogram DecodeMetric(enum AVPictureType pictureType)
+{
+    switch(pictureType)
+    {
+        case AV_PICTURE_TYPE_I: return eMetricDecodeI;
+        case AV_PICTURE_TYPE_P: return eMetricDecodeP;
+        case AV_PICTURE_TYPE_B: return eMetricDecodeB;
+        default:                return eMetricDecodeOther;
+    }
+}
+
+AVFrame *VideoDecoder::DecodeNextFrame(PacketSource *pSource)
+{
+    AVFrame *pFrame = av_frame_alloc();
+
+    if(!pFrame)
+    {
+        av_log(NULL, AV_LOG_ERROR, "Decode thread could not allocate frame\n");
+        return NULL;
+    }
+
+    uint64_t start = MetricsNow();
+
+    while(1)
+    {
+        int ret = 0;
+
+        {
+            PROFILE_SCOPE(eProfileReceiveFrame);
+            ret = avcodec_receive_frame(m_pCodecContext, pFrame);
+        }
+
+        if(ret >= 0)
+        {
+            m_framesDecoded++;
+
+            MetricsAdd(eMetricFramesDecoded);
+            MetricsObserve(DecodeMetric(pFrame->pict_type), MetricsNow() - start);
+
+            MemorySet(eMemDecoder, FrameBufferBytes(pFrame));
+
+            return pFrame;
+        }
+
+        if(ret != AVERROR(EAGAIN))
+        {
+            if(ret != AVERROR_EOF)
+                av_log(NULL, AV_LOG_ERROR, "Error while receiving a frame from the decoder\n");
+
+            break;
+        }
+
+        // The decoder needs more input
+        AVPacket packet;
+
+        if(pSource->ReadPacket(&packet))
+        {
+            {
+                PROFILE_SCOPE(eProfileSendPacket);
+                ret = avcodec_send_packet(m_pCodecContext, &packet);
+            }
+
+            av_packet_unref(&packet);
+
+            if(ret < 0)
+            {
+                av_log(NULL, AV_LOG_ERROR, "Error while sending a packet to the decoder\n");
+                break;
+            }
+        }
+        else if(!m_bDraining)
+        {
+            // End of the stream, collect the frames the decoder is still holding
+            avcodec_send_packet(m_pCodecContext, NULL);
+            m_bDraining = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    av_frame_free(&pFrame);
+
+    return NULL;
+}
+
+void VideoDecoder::Flush()
+{
+    avcodec_flush_buffers(m_pCodecContext);
+    m_bDraining = false;
+}
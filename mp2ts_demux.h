@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct AVPacket;
+struct AVFrame;
+struct AVFormatContext;
+struct AVCodecContext;
+struct AccessUnitElement;
+class InputSource;
+class MpegTS_XML;
+
+enum eDemuxBackend
+{
+    eDemuxInternal,     // AUs located by the mpts_parser XML, payload pulled out of the TS by FindData
+    eDemuxFFmpeg        // av_read_frame
+};
+
+/*
+    Hands out video packets in decode order.
+    The decode loop in VideoDecoder is the same for every source.
+*/
+class PacketSource
+{
+public:
+
+    PacketSource()
+        : m_packetsRead(0)
+        , m_payloadBytes(0)
+    {
+    }
+
+    virtual ~PacketSource() {}
+
+    // Fills pPacket with the next video packet, false at the end of the stream
+    virtual bool ReadPacket(AVPacket *pPacket) = 0;
+
+    // The next ReadPacket() returns the AU with decode order frameNumber, which starts at bytePos
+    virtual bool Seek(unsigned int frameNumber, uint64_t bytePos) = 0;
+
+    virtual const char *Name() const = 0;
+
+    uint64_t PacketsRead() const { return m_packetsRead; }
+    uint64_t PayloadBytes() const { return m_payloadBytes; }
+
+protected:
+    uint64_t m_packetsRead;
+    uint64_t m_payloadBytes;
+};
+
+PacketSource *CreatePacketSource(eDemuxBackend backend, MpegTS_XML &mpts, InputSource *pInput, AVFormatContext *pFormatContext);
+
+bool DemuxBackendFromName(const char *name, eDemuxBackend &backend);
+const char *DemuxBackendName(eDemuxBackend backend);
+
+/*
+    The send/receive decode loop shared by all packet sources
+*/
+class VideoDecoder
+{
+public:
+
+    VideoDecoder(AVCodecContext *pCodecContext)
+        : m_pCodecContext(pCodecContext)
+        , m_bDraining(false)
+        , m_framesDecoded(0)
+    {
+    }
+
+    // Feeds packets from pSource until the decoder returns a frame.
+    // Returns NULL at the end of the stream or on error, the caller frees the frame.
+    AVFrame *DecodeNextFrame(PacketSource *pSource);
+
+    // Drops everything buffered in the decoder, call after a seek
+    void Flush();
+
+    AVCodecContext *CodecContext() const { return m_pCodecContext; }
+    uint64_t FramesDecoded() const { return m_framesDecoded; }
+
+private:
+    AVCodecContext *m_pCodecContext;
+    bool            m_bDraining;
+    uint64_t        m_framesDecoded;
+};
+
+// The 4 byte TS packet header, and what the checks need from the adaptation field
+struct TSPacketHeader
+{
+    uint16_t    pid;
+    uint8_t     transportErrorIndicator;
+    uint8_t     payloadUnitStartIndicator;
+    uint8_t     transportPriority;
+    uint8_t     transportScramblingControl;
+    uint8_t     adaptationFieldControl;
+    uint8_t     continuityCounter;
+    uint8_t     discontinuityIndicator;
+    uint8_t     randomAccessIndicator;
+    uint8_t     bHasPCR;
+    uint64_t    pcr;                // 27 MHz, base * 300 + extension
+    int         payloadOffset;      // From the start of the packet, packetSize if there is no payload
+};
+
+// Parses the header of a 188 or 192 byte TS packet, false if it does not start with 0x47
+bool ParsePacketHeader(const uint8_t *packet, int packetSize, TSPacketHeader &header);
+
+// What the indexers and analyses need from a PES header
+struct PESHeader
+{
+    uint8_t     streamId;
+    bool        bHasPTS;
+    bool        bHasDTS;
+    uint64_t    pts;                // 90 kHz
+    uint64_t    dts;
+};
+
+// PES header at p: its size, or -1 if p is not the start of a PES or the header runs past pEnd
+int ParsePESHeader(const uint8_t *p, const uint8_t *pEnd, PESHeader &header);
+
+// Returns the offset of the ES payload in a TS packet, past the PES header of the first packet of a PES.
+// packetSize if there is none, -1 on a bad packet.
+int FindData(const uint8_t *packet, int packetSize);
+
+// Upper bound of the ES payload carried by elements
+uint64_t MaxPayloadSize(const std::vector<AccessUnitElement> &elements, unsigned int packetSize);
+
+// Reads the packets of an AU with as few reads as possible and writes their
+// ES payload to pPayload, which must hold MaxPayloadSize() bytes.
+// Returns the number of payload bytes written.
+size_t ReadAccessUnitPayload(InputSource *pInput, const std::vector<AccessUnitElement> &elements, unsigned int packetSize, uint8_t *pPayload);
+
+// Lets the input backend start fetching an AU we are about to decode
+void PrefetchAccessUnit(InputSource *pInput, const std::vector<AccessUnitElement> &elements, unsigned int packetSize);
@@ -0,0 +1,208 @@
+#include "mp2ts_es_index.h"
+#include "mp2ts_demux.h"
+#include "mp2ts_bitstream.h"
+#include "mp2ts_memory.h"
+
+#include <cstring>
+
+// vop_start_code of MPEG-4 part 2
+#define MPEG4_VOP_START_CODE 0xB6
+
+#define PTS_MASK ((1ull << 33) - 1)
+
+ESIndexer::ESIndexer(const ElementaryStreamDescriptor &esd, bool bVideo)
+    : m_streamType(esd.streamType)
+    , m_bVideo(bVideo)
+    , m_bInAccessUnit(false)
+    , m_au(esd.name, esd.streamType, esd.pid)
+    , m_bUnparsed(false)
+    , m_bHasPTS(false)
+    , m_lastPTS(0)
+    , m_bPOCAnchor(false)
+    , m_anchorPOC(0)
+    , m_anchorPTS(0)
+    , m_ticksPerPOC(0)
+{
+    m_avc.Reset(eHEVC_Video == m_streamType);
+}
+
+bool ESIndexer::Packet(const uint8_t *pPacket, unsigned int packetSize, const TSPacketHeader &header, uint64_t offset, bool bNewElement, AccessUnit &au)
+{
+    bool bEnded = false;
+    const uint8_t *p = pPacket + header.payloadOffset;
+    const uint8_t *pEnd = pPacket + packetSize;
+    bool bPayload = (header.adaptationFieldControl & 1) && p < pEnd;
+
+    if(header.payloadUnitStartIndicator && bPayload)
+    {
+        // A start that is not a PES header we can read, split across packets or
+        // scrambled, still ends the AU before.  The new one has no time stamps
+        // and its payload is not parsed, the header would be read as ES bytes.
+        PESHeader pes;
+        int headerSize = ParsePESHeader(p, pEnd, pes);
+
+        if(headerSize < 0)
+        {
+            pes.bHasPTS = false;
+            pes.bHasDTS = false;
+        }
+
+        if(m_bInAccessUnit)
+        {
+            EndAccessUnit(au);
+            bEnded = true;
+        }
+
+        m_bInAccessUnit = true;
+        m_au.accessUnitElements.clear();
+        m_au.frameType = "";
+        m_au.closed_gop = 0;
+        m_au.random_access = 0;
+
+        // A frame without a DTS is decoded at its PTS, as for the XML.  One without
+        // a PTS either may still get one from its POC once its headers are parsed.
+        m_bHasPTS = pes.bHasPTS;
+        m_au.pts = pes.bHasPTS ? pes.pts : pes.bHasDTS ? pes.dts : m_lastPTS;
+        m_au.dts = pes.bHasDTS ? pes.dts : m_au.pts;
+        m_au.pts_seconds = (float) ((double) m_au.pts / 90000.0);
+        m_au.dts_seconds = (float) ((double) m_au.dts / 90000.0);
+
+        m_es.clear();
+        m_bUnparsed = headerSize < 0;
+
+        if(headerSize > 0)
+            p += headerSize;
+
+        bNewElement = true;
+    }
+
+    if(!m_bInAccessUnit)
+        return bEnded;
+
+    if(bNewElement || m_au.accessUnitElements.empty())
+        m_au.accessUnitElements.push_back(AccessUnitElement((int64_t) offset, 1));
+    else
+        m_au.accessUnitElements.back().numPackets++;
+
+    if(m_bVideo && bPayload && !header.transportScramblingControl && !m_bUnparsed)
+    {
+        if(m_es.size() + (pEnd - p) > ES_INDEX_MAX_PES_BYTES)
+        {
+            m_bUnparsed = true;
+            m_es.clear();
+        }
+        else
+        {
+            MemoryScope memoryScope(eMemInputBuffers);
+            m_es.insert(m_es.end(), p, pEnd);
+        }
+    }
+
+    return bEnded;
+}
+
+bool ESIndexer::Finish(AccessUnit &au)
+{
+    if(!m_bInAccessUnit)
+        return false;
+
+    EndAccessUnit(au);
+    m_bInAccessUnit = false;
+
+    return true;
+}
+
+void ESIndexer::EndAccessUnit(AccessUnit &au)
+{
+    if(m_bVideo && !m_bUnparsed)
+        ParseHeaders();
+
+    m_lastPTS = m_au.pts;
+
+    // The caller's AU gets this one, the elements vector it hands back is reused
+    std::swap(au, m_au);
+}
+
+void ESIndexer::ParseHeaders()
+{
+    const uint8_t *p = m_es.data();
+    size_t size = m_es.size();
+
+    switch(m_streamType)
+    {
+    case eMPEG1_Video:
+    case eMPEG2_Video:
+        {
+            MPEG2Picture picture;
+
+            if(m_mpeg2.Parse(p, size, picture) && 'D' != picture.type)
+            {
+                m_au.frameType = std::string(1, picture.type);
+                m_au.closed_gop = 'I' == picture.type && picture.bClosedGOP;
+                m_au.random_access = 'I' == picture.type;
+            }
+        }
+        break;
+
+    case eH264_Video:
+    case eHEVC_Video:
+        {
+            AVCPicture picture;
+
+            if(m_avc.Parse(p, size, picture) && picture.type)
+            {
+                m_au.frameType = std::string(1, picture.type);
+
+                // Leading pictures of a CRA or a recovery point are skipped like the B frames of an open GOP
+                m_au.closed_gop = picture.bIDR;
+                m_au.random_access = picture.bRandomAccess;
+
+                if(picture.bPOC)
+                    POCTimeStamp(picture);
+            }
+        }
+        break;
+
+    case eMPEG4_Video:
+        for(const uint8_t *q = FindStartCode(p, p + size); q + 4 < p + size; q = FindStartCode(q + 3, p + size))
+        {
+            // vop_coding_type, S(GMC) VOPs are counted with P
+            if(MPEG4_VOP_START_CODE == q[3])
+            {
+                int type = q[4] >> 6;
+
+                m_au.frameType = 0 == type ? "I" : 2 == type ? "B" : "P";
+                m_au.random_access = 0 == type;
+                break;
+            }
+        }
+        break;
+    }
+}
+
+void ESIndexer::POCTimeStamp(const AVCPicture &picture)
+{
+    // The POC starts again at an IDR
+    if(picture.bIDR)
+        m_bPOCAnchor = false;
+
+    if(m_bHasPTS)
+    {
+        if(m_bPOCAnchor && picture.poc > m_anchorPOC)
+        {
+            int64_t ticks = (int64_t) ((m_au.pts - m_anchorPTS) & PTS_MASK) / (picture.poc - m_anchorPOC);
+
+            if(ticks > 0 && ticks < 90000)
+                m_ticksPerPOC = ticks;
+        }
+
+        m_bPOCAnchor = true;
+        m_anchorPOC = picture.poc;
+        m_anchorPTS = m_au.pts;
+    }
+    else if(m_bPOCAnchor && m_ticksPerPOC)
+    {
+        m_au.pts = (m_anchorPTS + (uint64_t) ((int64_t) (picture.poc - m_anchorPOC) * m_ticksPerPOC)) & PTS_MASK;
+        m_au.pts_seconds = (float) ((double) m_au.pts / 90000.0);
+    }
+}
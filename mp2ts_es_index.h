@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mp2ts_xml.h"
+#include "mp2ts_mpeg2.h"
+#include "mp2ts_avc.h"
+
+struct TSPacketHeader;
+
+// Largest video PES buffered to have its headers parsed, the type of a larger one stays unknown
+#define ES_INDEX_MAX_PES_BYTES (8 * 1024 * 1024)
+
+/*
+    Builds the AUs of one elementary stream from its TS packets, for an index
+    made without the mpts_parser XML.
+
+    Each PES is one AU.  Its elements are the runs of its packets with no
+    packet of another PID in between, as mpts_parser writes them, and its PTS
+    and DTS come from the PES header.  The payload of a video PES is buffered
+    and its headers are parsed once the next PES starts: MPEG2HeaderParser
+    for MPEG-1/2 and AVCHeaderParser for H.264 and HEVC give the picture type,
+    whether the GOP is closed and whether decoding can start there.  MPEG-4
+    part 2 only has the type of its first VOP looked up.  Packets ahead of
+    the first PES start are dropped, an AU without its start cannot be decoded.
+    A packet that starts a PES always starts a new AU, even if its header
+    cannot be read; that AU is then left untyped.
+
+    A PES without a PTS, which only has to be there every 0.7 s, gets one for
+    its presentation order.  For H.264 and HEVC it is worked out from its POC
+    and the last picture with both, at the PTS ticks per POC step seen so far.
+    Otherwise it is the DTS, failing that the PTS of the AU before.
+*/
+class ESIndexer
+{
+public:
+
+    ESIndexer(const ElementaryStreamDescriptor &esd, bool bVideo);
+
+    // A packet of the stream at offset.  bNewElement if the packet before it in the file is of another PID.
+    // Returns true if the packet starts a PES and so ends the AU before it, which is then moved to au.
+    bool Packet(const uint8_t *pPacket, unsigned int packetSize, const TSPacketHeader &header, uint64_t offset, bool bNewElement, AccessUnit &au);
+
+    // After the last packet, moves the AU being built to au.  False if there is none.
+    bool Finish(AccessUnit &au);
+
+private:
+
+    ESIndexer(const ESIndexer &);
+    ESIndexer &operator=(const ESIndexer &);
+
+    // Fills in the type, closed GOP and random access of the AU being built from its payload
+    void ParseHeaders();
+    void EndAccessUnit(AccessUnit &au);
+
+    // The PTS of an AU whose PES has none from the POC of its picture, or an anchor from one with both
+    void POCTimeStamp(const AVCPicture &picture);
+
+    int                     m_streamType;
+    bool                    m_bVideo;
+    bool                    m_bInAccessUnit;
+    AccessUnit              m_au;
+
+    std::vector<uint8_t>    m_es;               // Payload of the video PES being built
+    bool                    m_bUnparsed;        // More than ES_INDEX_MAX_PES_BYTES of it, or its PES header was unreadable
+    bool                    m_bHasPTS;          // Of the PES being built
+    uint64_t                m_lastPTS;          // Of the AU before, given or filled in
+
+    // The last picture with both a PTS and a POC, none across an IDR, and the PTS ticks per POC step
+    bool                    m_bPOCAnchor;
+    int32_t                 m_anchorPOC;
+    uint64_t                m_anchorPTS;
+    int64_t                 m_ticksPerPOC;
+
+    MPEG2HeaderParser       m_mpeg2;
+    AVCHeaderParser         m_avc;
+};
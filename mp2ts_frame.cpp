@@ -0,0 +1,80 @@
+#include "mp2ts_frame.h"
+#include "mp2ts_profiler.h"
+#include "mp2ts_memory.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavutil/frame.h>
+    #include <libavutil/imgutils.h>
+    #include <libavutil/pixdesc.h>
+    #include <libswscale/swscale.h>
+}
+
+#include <cstdio>
+
+void FlipAvFrame(AVFrame *pFrame)
+{
+    // We need to flip the video image
+    //  See: https://lists.ffmpeg.org/pipermail/ffmpeg-user/2011-May/000976.html
+    pFrame->data[0] += pFrame->linesize[0] * (pFrame->height - 1);
+    pFrame->linesize[0] = -(pFrame->linesize[0]);
+
+    pFrame->data[1] += pFrame->linesize[1] * ((pFrame->height/2) - 1);
+    pFrame->linesize[1] = -(pFrame->linesize[1]);
+
+    pFrame->data[2] += pFrame->linesize[2] * ((pFrame->height/2) - 1);
+    pFrame->linesize[2] = -(pFrame->linesize[2]);
+}
+
+bool ConvertFrameToRGBA(const AVFrame *frame, int width, int height, uint8_t *dst_data[4], int dst_linesize[4])
+{
+    PROFILE_SCOPE(eProfileConvert);
+
+    enum AVPixelFormat dst_pix_fmt = AV_PIX_FMT_RGBA;
+
+    if(dst_data[0])
+    {
+        av_freep(&dst_data[0]);
+        MemorySet(eMemRGBA, 0);
+    }
+
+    // create scaling context
+    struct SwsContext *sws_ctx = sws_getContext(frame->width, frame->height, (enum AVPixelFormat)frame->format,
+                                                frame->width, frame->height, dst_pix_fmt,
+                                                SWS_BILINEAR, NULL, NULL, NULL);
+    if(!sws_ctx)
+    {
+        fprintf(stderr,
+            "Impossible to create scale context for the conversion "
+            "fmt:%s s:%dx%d -> fmt:%s s:%dx%d\n",
+            av_get_pix_fmt_name((enum AVPixelFormat)frame->format), frame->width, frame->height,
+            av_get_pix_fmt_name(dst_pix_fmt), frame->width, frame->height);
+        return false;
+    }
+
+    // buffer is going to be rawvideo file, no alignment
+    int dst_size = av_image_alloc(dst_data, dst_linesize, width, height, dst_pix_fmt, 1);
+
+    if(dst_size < 0)
+    {
+        fprintf(stderr, "Could not allocate destination image\n");
+        sws_freeContext(sws_ctx);
+        return false;
+    }
+
+    MemorySet(eMemRGBA, (uint64_t) dst_size);
+
+    /* convert to destination format */
+    sws_scale(sws_ctx,
+        (const uint8_t* const*)frame->data,
+        frame->linesize,
+        0,
+        frame->height,
+        dst_data,
+        dst_linesize);
+
+    sws_freeContext(sws_ctx);
+
+    return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+struct AVFrame;
+
+// Flips a decoded picture upside down for OpenGL by pointing each plane
+// at its last row and negating the line sizes, no pixels are copied
+void FlipAvFrame(AVFrame *pFrame);
+
+// Converts frame to RGBA for the texture presenter.
+// Frees what dst_data[0] holds, then allocates a width x height image into dst_data/dst_linesize.
+bool ConvertFrameToRGBA(const AVFrame *frame, int width, int height, uint8_t *dst_data[4], int dst_linesize[4]);
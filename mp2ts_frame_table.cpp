@@ -0,0 +1,173 @@
+#include "mp2ts_frame_table.h"
+#include "mp2ts_au_store.h"
+#include "mp2ts_memory.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Rows copied between looks at the clock
+#define FRAME_TABLE_FILL_STEP 256
+
+static int TypeRank(char frameType)
+{
+    switch(frameType)
+    {
+        case 'I': return 0;
+        case 'P': return 1;
+        case 'B': return 2;
+    }
+
+    return 3;
+}
+
+// Ties are kept in decode order, so the order of a key does not depend on the sort
+struct FrameTableLess
+{
+    const FrameTableRow *pRows;
+    eFrameTableKey key;
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        const FrameTableRow &ra = pRows[a];
+        const FrameTableRow &rb = pRows[b];
+
+        switch(key)
+        {
+            case eFrameKeyType:
+                if(TypeRank(ra.frameType) != TypeRank(rb.frameType))
+                    return TypeRank(ra.frameType) < TypeRank(rb.frameType);
+            break;
+
+            case eFrameKeyPTS:
+                if(ra.pts != rb.pts)
+                    return ra.pts < rb.pts;
+            break;
+
+            case eFrameKeyDTS:
+                if(ra.dts != rb.dts)
+                    return ra.dts < rb.dts;
+            break;
+
+            case eFrameKeySize:
+                if(ra.numPackets != rb.numPackets)
+                    return ra.numPackets < rb.numPackets;
+            break;
+
+            default:
+            break;
+        }
+
+        return a < b;
+    }
+};
+
+FrameTable::FrameTable()
+    : m_count(0)
+    , m_sortedKeys(1 << eFrameKeyDecode)
+{
+}
+
+FrameTable::~FrameTable()
+{
+    if(m_sorter.joinable())
+        m_sorter.join();
+}
+
+bool FrameTable::Fill(const AccessUnitIndex &accessUnits, double budgetMs)
+{
+    if(m_rows.empty())
+    {
+        m_count = accessUnits.size();
+
+        MemoryScope memoryScope(eMemFrameTable);
+        m_rows.reserve(m_count);
+    }
+
+    if(m_rows.size() == m_count)
+        return true;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    while(m_rows.size() < m_count)
+    {
+        for(uint32_t i = 0; i < FRAME_TABLE_FILL_STEP && m_rows.size() < m_count; i++)
+        {
+            uint32_t index = (uint32_t) m_rows.size();
+
+            FrameTableRow row;
+            row.frameType = accessUnits.FrameType(index);
+            row.pts = accessUnits.PTS(index);
+            row.dts = accessUnits.DTS(index);
+            row.firstByteLocation = accessUnits.FirstByteLocation(index);
+            row.numPackets = (uint32_t) accessUnits.NumPackets(index);
+
+            m_rows.push_back(row);
+        }
+
+        if(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() >= budgetMs)
+            break;
+    }
+
+    if(m_rows.size() < m_count)
+        return false;
+
+    // The rows do not change from here on, the sorter only reads them
+    m_sorter = std::thread(&FrameTable::Sort, this);
+
+    return true;
+}
+
+bool FrameTable::IsSorted(eFrameTableKey key) const
+{
+    return 0 != (m_sortedKeys.load(std::memory_order_acquire) & (1 << key));
+}
+
+uint32_t FrameTable::Order(eFrameTableKey key, bool bDescending, uint32_t row) const
+{
+    if(bDescending)
+        row = (uint32_t) m_rows.size() - 1 - row;
+
+    if(eFrameKeyDecode == key || !IsSorted(key))
+        return row;
+
+    return m_orders[key][row];
+}
+
+int64_t FrameTable::FrameAt(uint64_t offset) const
+{
+    // Byte locations grow in decode order
+    size_t low = 0;
+    size_t high = m_rows.size();
+
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if(m_rows[middle].firstByteLocation <= offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return (int64_t) low - 1;
+}
+
+void FrameTable::Sort()
+{
+    MemoryScope memoryScope(eMemFrameTable);
+
+    for(int k = eFrameKeyDecode + 1; k < eFrameNumKeys; k++)
+    {
+        std::vector<uint32_t> &order = m_orders[k];
+        order.resize(m_rows.size());
+
+        for(uint32_t i = 0; i < (uint32_t) order.size(); i++)
+            order[i] = i;
+
+        FrameTableLess less = { m_rows.data(), (eFrameTableKey) k };
+        std::sort(order.begin(), order.end(), less);
+
+        // Published one key at a time, the first columns sort before the last is done
+        m_sortedKeys.fetch_or(1 << k, std::memory_order_release);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+class AccessUnitIndex;
+
+enum eFrameTableKey
+{
+    eFrameKeyDecode,            // Decode order, the order the rows are read in
+    eFrameKeyType,              // I, P, B, then anything else
+    eFrameKeyPTS,
+    eFrameKeyDTS,
+    eFrameKeySize,              // Packets, bytes are packets times the packet size
+    eFrameNumKeys
+};
+
+struct FrameTableRow
+{
+    uint64_t    pts;
+    uint64_t    dts;
+    uint64_t    firstByteLocation;
+    uint32_t    numPackets;
+    char        frameType;
+};
+
+/*
+    The video AUs of the whole file, for the table in the Frames window.
+
+    The rows are copied out of the AU index a slice at a time on the GUI thread,
+    the index is not thread safe and a lazy load parses the XML as it is read.
+    Once every row is in, one background thread sorts a permutation of the rows
+    for each key.  Picking a column only changes which permutation Order() reads,
+    a descending order reads it backwards.  Until its permutation is ready a key
+    is shown in decode order.
+*/
+class FrameTable
+{
+public:
+
+    FrameTable();
+    ~FrameTable();
+
+    // Copies rows until all are in or budgetMs has passed, then starts the sort.
+    // Returns true once every row is in.
+    bool Fill(const AccessUnitIndex &accessUnits, double budgetMs);
+
+    uint32_t RowsFilled() const { return (uint32_t) m_rows.size(); }
+    uint32_t Rows() const { return m_count; }
+
+    bool IsSorted(eFrameTableKey key) const;
+
+    // Decode order index of the AU at row when sorted by key
+    uint32_t Order(eFrameTableKey key, bool bDescending, uint32_t row) const;
+
+    const FrameTableRow &Row(uint32_t index) const { return m_rows[index]; }
+
+    // Decode order index of the AU that starts last at or before offset, among the rows
+    // filled so far.  -1 if none does.
+    int64_t FrameAt(uint64_t offset) const;
+
+private:
+
+    FrameTable(const FrameTable &);
+    FrameTable &operator=(const FrameTable &);
+
+    void Sort();
+
+    uint32_t                    m_count;
+    std::vector<FrameTableRow>  m_rows;
+    std::vector<uint32_t>       m_orders[eFrameNumKeys];    // None for eFrameKeyDecode
+    std::atomic<uint32_t>       m_sortedKeys;               // Bit per key whose order is ready
+    std::thread                 m_sorter;
+};
@@ -0,0 +1,375 @@
+#include "mp2ts_gzip.h"
+#include "mp2ts_memory.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// zlib
+#include "zlib.h"
+
+#define GZIP_CHUNK_SIZE (1024 * 1024)
+#define GZIP_MAX_QUEUED_CHUNKS 8
+
+// mpts_parser XML rarely inflates to more than this many times its compressed size.
+// A larger ISIZE is a corrupt or truncated trailer, the buffer grows past the hint if needed.
+#define GZIP_MAX_HINT_RATIO 64
+
+/*
+    The compressed file is read on a worker thread while the calling thread inflates.
+    TinyXml2 can only parse a complete buffer, so the overlap we get is between the
+    disk reads and the inflate.  The inflated buffer is handed straight to
+    XMLDocument::Parse, no temporary file is written.
+*/
+
+struct GzipChunk
+{
+    std::vector<unsigned char> data;
+    size_t size;
+
+    GzipChunk()
+        : data(GZIP_CHUNK_SIZE)
+        , size(0)
+    {
+    }
+};
+
+class GzipChunkQueue
+{
+public:
+
+    GzipChunkQueue()
+        : m_bDone(false)
+        , m_bError(false)
+    {
+    }
+
+    // Called by the reader thread, blocks while the queue is full
+    void Push(GzipChunk *pChunk)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_queue.size() < GZIP_MAX_QUEUED_CHUNKS; });
+        m_queue.push_back(pChunk);
+        m_notEmpty.notify_one();
+    }
+
+    // Called by the inflating thread, returns NULL once the reader is done and the queue is drained
+    GzipChunk *Pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return !m_queue.empty() || m_bDone; });
+
+        if(m_queue.empty())
+            return NULL;
+
+        GzipChunk *pChunk = m_queue.front();
+        m_queue.pop_front();
+        m_notFull.notify_one();
+
+        return pChunk;
+    }
+
+    // Finished chunks go back to the reader so we only ever allocate a handful of them
+    void Recycle(GzipChunk *pChunk)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(pChunk);
+    }
+
+    GzipChunk *GetFreeChunk()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if(m_free.empty())
+            return new GzipChunk();
+
+        GzipChunk *pChunk = m_free.back();
+        m_free.pop_back();
+
+        return pChunk;
+    }
+
+    void SetDone(bool bError)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bDone = true;
+        m_bError = bError;
+        m_notEmpty.notify_all();
+    }
+
+    bool HadError()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bError;
+    }
+
+    ~GzipChunkQueue()
+    {
+        for(GzipChunk *pChunk : m_queue)
+            delete pChunk;
+
+        for(GzipChunk *pChunk : m_free)
+            delete pChunk;
+    }
+
+private:
+    std::mutex                  m_mutex;
+    std::condition_variable     m_notEmpty;
+    std::condition_variable     m_notFull;
+    std::deque<GzipChunk*>      m_queue;
+    std::vector<GzipChunk*>     m_free;
+    bool                        m_bDone;
+    bool                        m_bError;
+};
+
+static int64_t FileSize(FILE *fp)
+{
+#ifdef _WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    int64_t size = _ftelli64(fp);
+    _fseeki64(fp, 0, SEEK_SET);
+#else
+    fseeko(fp, 0, SEEK_END);
+    int64_t size = ftello(fp);
+    fseeko(fp, 0, SEEK_SET);
+#endif
+
+    return size;
+}
+
+// The last 4 bytes of a gzip member are the uncompressed size modulo 2^32.
+// Only used as a hint to size the output buffer, and capped at GZIP_MAX_HINT_RATIO.
+static size_t UncompressedSizeHint(FILE *fp, int64_t compressedSize)
+{
+    size_t hint = 0;
+
+    if(compressedSize >= 18)
+    {
+        unsigned char isize[4] = {0};
+
+#ifdef _WIN32
+        _fseeki64(fp, compressedSize - 4, SEEK_SET);
+#else
+        fseeko(fp, compressedSize - 4, SEEK_SET);
+#endif
+        if(1 == fread(isize, 4, 1, fp))
+            hint = (size_t) isize[0] | ((size_t) isize[1] << 8) | ((size_t) isize[2] << 16) | ((size_t) isize[3] << 24);
+
+#ifdef _WIN32
+        _fseeki64(fp, 0, SEEK_SET);
+#else
+        fseeko(fp, 0, SEEK_SET);
+#endif
+    }
+
+    // ISIZE wraps above 4GB, fall back to a typical compression ratio
+    if(hint < (size_t) compressedSize)
+        hint = (size_t) compressedSize * 10;
+
+    if(hint / GZIP_MAX_HINT_RATIO > (size_t) compressedSize)
+        hint = (size_t) compressedSize * GZIP_MAX_HINT_RATIO;
+
+    return hint;
+}
+
+static void ReadCompressedFile(FILE *fp, GzipChunkQueue *pQueue)
+{
+    bool bError = false;
+
+    while(1)
+    {
+        GzipChunk *pChunk = pQueue->GetFreeChunk();
+        pChunk->size = fread(pChunk->data.data(), 1, pChunk->data.size(), fp);
+
+        if(0 == pChunk->size)
+        {
+            bError = ferror(fp) ? true : false;
+            pQueue->Recycle(pChunk);
+            break;
+        }
+
+        pQueue->Push(pChunk);
+    }
+
+    pQueue->SetDone(bError);
+}
+
+bool IsGzipFile(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "rb");
+
+    if(!fp)
+        return false;
+
+    unsigned char magic[2] = {0};
+    bool bGzip = (1 == fread(magic, 2, 1, fp) && 0x1f == magic[0] && 0x8b == magic[1]);
+
+    fclose(fp);
+
+    return bGzip;
+}
+
+char *InflateXMLFile(const char *fileName, size_t &size)
+{
+    FILE *fp = fopen(fileName, "rb");
+
+    if(!fp)
+    {
+        fprintf(stderr, "Error: Could not open %s\n", fileName);
+        return NULL;
+    }
+
+    int64_t compressedSize = FileSize(fp);
+
+    // One byte over an exact hint lets inflate see the end of the stream without the buffer growing
+    size_t capacity = UncompressedSizeHint(fp, compressedSize) + 1;
+    char *pXML = (char *) malloc(capacity);
+
+    size = 0;
+
+    if(!pXML)
+    {
+        fprintf(stderr, "Error: Out of memory inflating %s\n", fileName);
+        fclose(fp);
+        return NULL;
+    }
+
+    MemoryAdd(eMemXmlDom, (int64_t) capacity);
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // 16 + MAX_WBITS tells zlib to expect a gzip header and trailer
+    if(Z_OK != inflateInit2(&stream, 16 + MAX_WBITS))
+    {
+        free(pXML);
+        MemoryAdd(eMemXmlDom, -(int64_t) capacity);
+        fclose(fp);
+        return NULL;
+    }
+
+    GzipChunkQueue queue;
+    std::thread reader(ReadCompressedFile, fp, &queue);
+
+    int zret = Z_OK;
+    bool bError = false;
+    bool bOutOfMemory = false;
+    bool bEnd = false;
+
+    while(GzipChunk *pChunk = queue.Pop())
+    {
+        stream.next_in = pChunk->data.data();
+        stream.avail_in = (uInt) pChunk->size;
+
+        while(stream.avail_in && !bError && !bEnd)
+        {
+            if(Z_STREAM_END == zret)
+            {
+                // Concatenated gzip members, start the next one.  Anything else after a
+                // member, such as the zero padding of a tape or a block device, is ignored.
+                if(0x1f != stream.next_in[0] || (stream.avail_in > 1 && 0x8b != stream.next_in[1]))
+                {
+                    bEnd = true;
+                    break;
+                }
+
+                inflateReset(&stream);
+            }
+
+            // Only once the output is full, so an exact hint is never grown
+            if(size == capacity)
+            {
+                char *pGrown = (char *) realloc(pXML, capacity * 2);
+
+                if(!pGrown)
+                {
+                    bError = true;
+                    bOutOfMemory = true;
+                    break;
+                }
+
+                pXML = pGrown;
+                MemoryAdd(eMemXmlDom, (int64_t) capacity);
+                capacity *= 2;
+            }
+
+            stream.next_out = (Bytef *) (pXML + size);
+            stream.avail_out = (uInt) (capacity - size < 0x40000000 ? capacity - size : 0x40000000);
+
+            uInt availOut = stream.avail_out;
+            zret = inflate(&stream, Z_NO_FLUSH);
+            size += availOut - stream.avail_out;
+
+            if(Z_OK != zret && Z_STREAM_END != zret && Z_BUF_ERROR != zret)
+                bError = true;
+        }
+
+        queue.Recycle(pChunk);
+
+        // Keep draining so the reader thread can finish
+        if(bError || bEnd)
+            continue;
+    }
+
+    reader.join();
+    inflateEnd(&stream);
+    fclose(fp);
+
+    if(bError || queue.HadError() || Z_STREAM_END != zret)
+    {
+        if(bOutOfMemory)
+            fprintf(stderr, "Error: Out of memory inflating %s\n", fileName);
+        else
+            fprintf(stderr, "Error: Could not decompress %s: %s\n", fileName, stream.msg ? stream.msg : "truncated or corrupt gzip stream");
+
+        free(pXML);
+        MemoryAdd(eMemXmlDom, -(int64_t) capacity);
+        return NULL;
+    }
+
+    // Give back the slack of the last doubling, the text may be held for the whole session
+    if(size && size < capacity)
+    {
+        char *pShrunk = (char *) realloc(pXML, size);
+
+        if(pShrunk)
+            pXML = pShrunk;
+    }
+
+    // From here on the buffer is counted as size bytes, which FreeXMLText() gives back
+    MemoryAdd(eMemXmlDom, -(int64_t) (capacity - size));
+
+    return pXML;
+}
+
+void FreeXMLText(char *pText, size_t size)
+{
+    free(pText);
+    MemoryAdd(eMemXmlDom, -(int64_t) size);
+}
+
+tinyxml2::XMLError LoadXMLFile(tinyxml2::XMLDocument &doc, const char *fileName)
+{
+    MemoryScope memoryScope(eMemXmlDom);
+
+    if(!IsGzipFile(fileName))
+        return doc.LoadFile(fileName);
+
+    size_t size = 0;
+    char *pXML = InflateXMLFile(fileName, size);
+
+    if(!pXML)
+        return tinyxml2::XML_ERROR_FILE_READ_ERROR;
+
+    // Held alongside the DOM until Parse() has copied it
+    tinyxml2::XMLError xmlError = doc.Parse(pXML, size);
+
+    FreeXMLText(pXML, size);
+
+    return xmlError;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+// Tinyxml
+#include "tinyxml2.h"
+
+// Loads an XML file generated by mpts_parser into doc.
+// If the file is gzip compressed (.xml.gz) it is inflated on the fly,
+// otherwise this behaves exactly like doc.LoadFile(fileName).
+tinyxml2::XMLError LoadXMLFile(tinyxml2::XMLDocument &doc, const char *fileName);
+
+// Inflates a .xml.gz into a malloc'd buffer of size bytes, counted against eMemXmlDom.
+// Returns NULL on error.  Release it with FreeXMLText().
+char *InflateXMLFile(const char *fileName, size_t &size);
+void FreeXMLText(char *pText, size_t size);
+
+// Returns true if fileName starts with the gzip magic bytes 0x1f 0x8b
+bool IsGzipFile(const char *fileName);
@@ -0,0 +1,888 @@
+#include "mp2ts_input.h"
+#include "mp2ts_metrics.h"
+#include "mp2ts_memory.h"
+#include "mp2ts_budget.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/syscall.h>
+    #if defined(__linux__) && defined(__NR_io_uring_setup)
+        #include <linux/io_uring.h>
+        #define HAVE_IO_URING 1
+    #endif
+#endif
+
+// Number of reads the async backend keeps in flight
+#define ASYNC_SLOTS 8
+
+const uint8_t *InputSource::Fetch(uint64_t offset, size_t size, std::vector<uint8_t> &scratch)
+{
+    if(scratch.size() < size + INPUT_FETCH_PADDING)
+    {
+        MemoryScope memoryScope(eMemInputBuffers);
+        scratch.resize(size + INPUT_FETCH_PADDING);
+    }
+
+    if(!ReadAt(offset, scratch.data(), size))
+        return NULL;
+
+    memset(scratch.data() + size, 0, INPUT_FETCH_PADDING);
+
+    return scratch.data();
+}
+
+/*
+    Native file helpers shared by the pread, mmap and async backends
+*/
+
+#ifdef _WIN32
+typedef HANDLE NativeHandle;
+#define INVALID_NATIVE_HANDLE INVALID_HANDLE_VALUE
+#else
+typedef int NativeHandle;
+#define INVALID_NATIVE_HANDLE -1
+#endif
+
+static NativeHandle NativeOpen(const std::string &fileName, uint64_t &fileSize, bool bSequential, bool bOverlapped)
+{
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+
+    if(bSequential)
+        flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+
+    if(bOverlapped)
+        flags |= FILE_FLAG_OVERLAPPED;
+
+    HANDLE h = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, flags, NULL);
+
+    if(INVALID_HANDLE_VALUE == h)
+        return INVALID_NATIVE_HANDLE;
+
+    LARGE_INTEGER size;
+
+    if(!GetFileSizeEx(h, &size))
+    {
+        CloseHandle(h);
+        return INVALID_NATIVE_HANDLE;
+    }
+
+    fileSize = (uint64_t) size.QuadPart;
+
+    return h;
+#else
+    (void) bOverlapped;
+
+    int fd = open(fileName.c_str(), O_RDONLY);
+
+    if(-1 == fd)
+        return INVALID_NATIVE_HANDLE;
+
+    struct stat st;
+
+    if(0 != fstat(fd, &st))
+    {
+        close(fd);
+        return INVALID_NATIVE_HANDLE;
+    }
+
+    fileSize = (uint64_t) st.st_size;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    // Doubles the kernel readahead window on Linux
+    if(bSequential)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    return fd;
+#endif
+}
+
+static void NativeClose(NativeHandle &handle)
+{
+    if(INVALID_NATIVE_HANDLE == handle)
+        return;
+
+#ifdef _WIN32
+    CloseHandle(handle);
+#else
+    close(handle);
+#endif
+
+    handle = INVALID_NATIVE_HANDLE;
+}
+
+// Positional read, loops over short reads.  Returns the number of bytes read.
+static size_t NativeReadAt(NativeHandle handle, uint64_t offset, void *pBuffer, size_t size, uint64_t &readCalls)
+{
+    size_t total = 0;
+    uint8_t *p = (uint8_t *) pBuffer;
+
+    while(total < size)
+    {
+#ifdef _WIN32
+        // Works for both synchronous and FILE_FLAG_OVERLAPPED handles
+        OVERLAPPED ov;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD) (offset + total);
+        ov.OffsetHigh = (DWORD) ((offset + total) >> 32);
+
+        DWORD toRead = (DWORD) ((size - total) < 0x40000000 ? (size - total) : 0x40000000);
+        DWORD got = 0;
+
+        readCalls++;
+
+        if(!ReadFile(handle, p + total, toRead, NULL, &ov))
+        {
+            if(ERROR_IO_PENDING != GetLastError())
+                break;
+        }
+
+        if(!GetOverlappedResult(handle, &ov, &got, TRUE) || 0 == got)
+            break;
+#else
+        readCalls++;
+
+        ssize_t got = pread(handle, p + total, size - total, (off_t) (offset + total));
+
+        if(got <= 0)
+            break;
+#endif
+
+        total += got;
+    }
+
+    return total;
+}
+
+/*
+    stdio: fseek + fread on an unbuffered FILE
+*/
+class StdioInputSource : public InputSource
+{
+public:
+
+    StdioInputSource()
+        : m_fp(NULL)
+    {
+    }
+
+    ~StdioInputSource() { Close(); }
+
+    bool Open(const std::string &fileName)
+    {
+        m_fp = fopen(fileName.c_str(), "rb");
+
+        if(!m_fp)
+            return false;
+
+        // Spans are read with one large fread each, stdio buffering would only add a copy
+        setvbuf(m_fp, NULL, _IONBF, 0);
+
+        if(!Seek(0, SEEK_END))
+            return false;
+
+#ifdef _WIN32
+        m_fileSize = _ftelli64(m_fp);
+#else
+        m_fileSize = ftello(m_fp);
+#endif
+
+        return true;
+    }
+
+    void Close()
+    {
+        if(m_fp)
+            fclose(m_fp);
+
+        m_fp = NULL;
+    }
+
+    bool ReadAt(uint64_t offset, void *pBuffer, size_t size)
+    {
+        m_readCalls++;
+
+        if(!Seek(offset, SEEK_SET))
+            return false;
+
+        if(1 != fread(pBuffer, size, 1, m_fp))
+            return false;
+
+        m_bytesRead += size;
+        MetricsAdd(eMetricBytesRead, size);
+
+        return true;
+    }
+
+    const char *Name() const { return "stdio"; }
+
+private:
+
+    bool Seek(uint64_t offset, int origin)
+    {
+#ifdef _WIN32
+        return 0 == _fseeki64(m_fp, (int64_t) offset, origin);
+#else
+        return 0 == fseeko(m_fp, (off_t) offset, origin);
+#endif
+    }
+
+    FILE *m_fp;
+};
+
+/*
+    pread: positional reads straight into the caller's buffer, readahead hints to the kernel
+*/
+class PreadInputSource : public InputSource
+{
+public:
+
+    PreadInputSource()
+        : m_handle(INVALID_NATIVE_HANDLE)
+    {
+    }
+
+    ~PreadInputSource() { Close(); }
+
+    bool Open(const std::string &fileName)
+    {
+        m_handle = NativeOpen(fileName, m_fileSize, true, false);
+        return INVALID_NATIVE_HANDLE != m_handle;
+    }
+
+    void Close()
+    {
+        NativeClose(m_handle);
+    }
+
+    bool ReadAt(uint64_t offset, void *pBuffer, size_t size)
+    {
+        size_t got = NativeReadAt(m_handle, offset, pBuffer, size, m_readCalls);
+        m_bytesRead += got;
+        MetricsAdd(eMetricBytesRead, got);
+
+        return got == size;
+    }
+
+    void Prefetch(uint64_t offset, size_t size)
+    {
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+        posix_fadvise(m_handle, (off_t) offset, (off_t) size, POSIX_FADV_WILLNEED);
+#else
+        (void) offset;
+        (void) size;
+#endif
+    }
+
+    const char *Name() const { return "pread"; }
+
+private:
+    NativeHandle m_handle;
+};
+
+/*
+    mmap: the whole file is mapped once, reads are pointers into the mapping
+*/
+class MmapInputSource : public InputSource
+{
+public:
+
+    MmapInputSource()
+        : m_handle(INVALID_NATIVE_HANDLE)
+#ifdef _WIN32
+        , m_mapping(NULL)
+#endif
+        , m_pData(NULL)
+    {
+    }
+
+    ~MmapInputSource() { Close(); }
+
+    bool Open(const std::string &fileName)
+    {
+        m_handle = NativeOpen(fileName, m_fileSize, false, false);
+
+        if(INVALID_NATIVE_HANDLE == m_handle || 0 == m_fileSize)
+            return false;
+
+#ifdef _WIN32
+        m_mapping = CreateFileMappingA(m_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+        if(!m_mapping)
+            return false;
+
+        m_pData = (const uint8_t *) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        void *p = mmap(NULL, (size_t) m_fileSize, PROT_READ, MAP_SHARED, m_handle, 0);
+        m_pData = (MAP_FAILED == p) ? NULL : (const uint8_t *) p;
+#endif
+
+        return NULL != m_pData;
+    }
+
+    void Close()
+    {
+        if(m_pData)
+        {
+#ifdef _WIN32
+            UnmapViewOfFile(m_pData);
+#else
+            munmap((void *) m_pData, (size_t) m_fileSize);
+#endif
+        }
+
+#ifdef _WIN32
+        if(m_mapping)
+            CloseHandle(m_mapping);
+
+        m_mapping = NULL;
+#endif
+
+        m_pData = NULL;
+        NativeClose(m_handle);
+    }
+
+    bool ReadAt(uint64_t offset, void *pBuffer, size_t size)
+    {
+        if(offset + size > m_fileSize)
+            return false;
+
+        memcpy(pBuffer, m_pData + offset, size);
+        m_bytesRead += size;
+        MetricsAdd(eMetricBytesRead, size);
+
+        return true;
+    }
+
+    const uint8_t *Fetch(uint64_t offset, size_t size, std::vector<uint8_t> &scratch)
+    {
+        // Only the last few bytes of the file lack the padding, those get copied
+        if(offset + size + INPUT_FETCH_PADDING > m_fileSize)
+            return InputSource::Fetch(offset, size, scratch);
+
+        m_bytesRead += size;
+        MetricsAdd(eMetricBytesRead, size);
+
+        return m_pData + offset;
+    }
+
+    void Prefetch(uint64_t offset, size_t size)
+    {
+#ifndef _WIN32
+        uint64_t pageMask = (uint64_t) sysconf(_SC_PAGESIZE) - 1;
+        uint64_t start = offset & ~pageMask;
+
+        if(offset + size <= m_fileSize)
+            madvise((void *) (m_pData + start), (size_t) (offset + size - start), MADV_WILLNEED);
+#else
+        (void) offset;
+        (void) size;
+#endif
+    }
+
+    const uint8_t *Data() const { return m_pData; }
+
+    const char *Name() const { return "mmap"; }
+
+private:
+    NativeHandle    m_handle;
+#ifdef _WIN32
+    HANDLE          m_mapping;
+#endif
+    const uint8_t  *m_pData;
+};
+
+/*
+    async: Prefetch() queues reads into a small set of slots, ReadAt() is served
+    from a slot when one covers the request, otherwise it is a plain positional read.
+    Uses io_uring on Linux and overlapped I/O on Windows.  When neither is
+    available it behaves like the pread backend.
+
+    Slot buffers are registered with the memory budget, an idle slot can be
+    dropped and is reallocated by the next Prefetch() that uses it.
+*/
+class AsyncInputSource : public InputSource, public BudgetConsumer
+{
+public:
+
+    AsyncInputSource()
+        : m_handle(INVALID_NATIVE_HANDLE)
+        , m_bQueueAvailable(false)
+        , m_nextSlot(0)
+        , m_hits(0)
+#ifdef HAVE_IO_URING
+        , m_ringFd(-1)
+        , m_pSqRing(NULL)
+        , m_pCqRing(NULL)
+        , m_pSqes(NULL)
+        , m_sqRingSize(0)
+        , m_cqRingSize(0)
+        , m_sqeCount(0)
+#endif
+    {
+    }
+
+    ~AsyncInputSource() { Close(); }
+
+    bool Open(const std::string &fileName)
+    {
+        m_handle = NativeOpen(fileName, m_fileSize, true, true);
+
+        if(INVALID_NATIVE_HANDLE == m_handle)
+            return false;
+
+        m_bQueueAvailable = InitQueue();
+
+        if(!m_bQueueAvailable)
+            fprintf(stderr, "Warning: Asynchronous reads are not available, the async backend will read synchronously\n");
+
+        return true;
+    }
+
+    void Close()
+    {
+        for(unsigned int i = 0; i < ASYNC_SLOTS; i++)
+            Wait(m_slots[i]);
+
+        BudgetRemoveAll(this);
+
+        CloseQueue();
+        NativeClose(m_handle);
+    }
+
+    bool ReadAt(uint64_t offset, void *pBuffer, size_t size)
+    {
+        for(unsigned int i = 0; i < ASYNC_SLOTS; i++)
+        {
+            Slot &slot = m_slots[i];
+
+            if(eSlotIdle != slot.State() && offset >= slot.offset && offset + size <= slot.offset + slot.size)
+            {
+                Wait(slot);
+
+                if(eSlotDone == slot.State() && offset + size <= slot.offset + slot.got)
+                {
+                    memcpy(pBuffer, slot.buffer.data() + (offset - slot.offset), size);
+                    m_hits++;
+                    MetricsAdd(eMetricReadCacheHits);
+                    BudgetTouch(this, i);
+                    return true;
+                }
+            }
+        }
+
+        MetricsAdd(eMetricReadCacheMisses);
+
+        size_t got = NativeReadAt(m_handle, offset, pBuffer, size, m_readCalls);
+        m_bytesRead += got;
+        MetricsAdd(eMetricBytesRead, got);
+
+        return got == size;
+    }
+
+    void Prefetch(uint64_t offset, size_t size)
+    {
+        if(!m_bQueueAvailable || 0 == size)
+            return;
+
+        for(unsigned int i = 0; i < ASYNC_SLOTS; i++)
+        {
+            Slot &slot = m_slots[i];
+
+            if(eSlotIdle != slot.State() && offset >= slot.offset && offset + size <= slot.offset + slot.size)
+                return;
+        }
+
+        // Round robin, never block on a read that is still in flight
+        for(unsigned int n = 0; n < ASYNC_SLOTS; n++)
+        {
+            Slot &slot = m_slots[(m_nextSlot + n) % ASYNC_SLOTS];
+
+            if(eSlotInFlight == slot.State())
+                continue;
+
+            m_nextSlot = (m_nextSlot + n + 1) % ASYNC_SLOTS;
+
+            if(slot.buffer.size() < size)
+            {
+                MemoryScope memoryScope(eMemInputBuffers);
+                slot.buffer.resize(size);
+            }
+
+            slot.offset = offset;
+            slot.size = size;
+            slot.got = 0;
+
+            if(Submit(slot, (unsigned int) (&slot - m_slots)))
+            {
+                slot.SetState(eSlotInFlight);
+                m_readCalls++;
+
+                // Re-reading costs about a millisecond per MB
+                BudgetInsert(this, &slot - m_slots, slot.buffer.capacity(), 100.0 + slot.buffer.capacity() / 1000.0);
+            }
+            else
+            {
+                slot.SetState(eSlotIdle);
+            }
+
+            return;
+        }
+    }
+
+    const char *Name() const { return "async"; }
+
+    uint64_t Hits() const { return m_hits; }
+
+    const char *BudgetName() const { return "async prefetch"; }
+
+    bool BudgetEvict(uint64_t key)
+    {
+        Slot &slot = m_slots[key];
+
+        if(eSlotInFlight == slot.State())
+            return false;
+
+        std::vector<uint8_t>().swap(slot.buffer);
+        slot.SetState(eSlotIdle);
+
+        return true;
+    }
+
+private:
+
+    enum eSlotState
+    {
+        eSlotIdle,
+        eSlotInFlight,
+        eSlotDone
+    };
+
+    struct Slot
+    {
+        std::vector<uint8_t> buffer;
+        uint64_t offset;
+        size_t size;
+        size_t got;
+        std::atomic<eSlotState> state;      // Also read by the budget, from whichever thread enforces it
+#ifdef _WIN32
+        OVERLAPPED ov;
+#endif
+
+        Slot()
+            : offset(0)
+            , size(0)
+            , got(0)
+            , state(eSlotIdle)
+        {
+#ifdef _WIN32
+            memset(&ov, 0, sizeof(ov));
+#endif
+        }
+
+        // Acquire pairs with the release of the thread that completed the read or dropped the buffer
+        eSlotState State() const { return state.load(std::memory_order_acquire); }
+        void SetState(eSlotState newState) { state.store(newState, std::memory_order_release); }
+    };
+
+    void Complete(Slot &slot, int64_t result)
+    {
+        slot.got = result > 0 ? (size_t) result : 0;
+        slot.SetState(eSlotDone);
+        m_bytesRead += slot.got;
+        MetricsAdd(eMetricBytesRead, slot.got);
+    }
+
+#ifdef _WIN32
+
+    bool InitQueue()
+    {
+        for(unsigned int i = 0; i < ASYNC_SLOTS; i++)
+        {
+            m_slots[i].ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+
+            if(!m_slots[i].ov.hEvent)
+                return false;
+        }
+
+        return true;
+    }
+
+    void CloseQueue()
+    {
+        for(unsigned int i = 0; i < ASYNC_SLOTS; i++)
+        {
+            if(m_slots[i].ov.hEvent)
+                CloseHandle(m_slots[i].ov.hEvent);
+
+            m_slots[i].ov.hEvent = NULL;
+        }
+    }
+
+    bool Submit(Slot &slot, unsigned int index)
+    {
+        (void) index;
+
+        ResetEvent(slot.ov.hEvent);
+        slot.ov.Offset = (DWORD) slot.offset;
+        slot.ov.OffsetHigh = (DWORD) (slot.offset >> 32);
+
+        if(!ReadFile(m_handle, slot.buffer.data(), (DWORD) slot.size, NULL, &slot.ov))
+            return ERROR_IO_PENDING == GetLastError();
+
+        return true;
+    }
+
+    void Wait(Slot &slot)
+    {
+        if(eSlotInFlight != slot.State())
+            return;
+
+        DWORD got = 0;
+
+        if(GetOverlappedResult(m_handle, &slot.ov, &got, TRUE))
+            Complete(slot, got);
+        else
+            Complete(slot, 0);
+    }
+
+#elif defined(HAVE_IO_URING)
+
+    bool InitQueue()
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+
+        m_ringFd = (int) syscall(__NR_io_uring_setup, ASYNC_SLOTS, &params);
+
+        if(m_ringFd < 0)
+            return false;
+
+        m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+        bool bSingleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) ? true : false;
+
+        if(bSingleMmap)
+            m_sqRingSize = m_cqRingSize = (m_sqRingSize > m_cqRingSize) ? m_sqRingSize : m_cqRingSize;
+
+        m_pSqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+
+        if(MAP_FAILED == m_pSqRing)
+        {
+            m_pSqRing = NULL;
+            CloseQueue();
+            return false;
+        }
+
+        if(bSingleMmap)
+            m_pCqRing = m_pSqRing;
+        else
+        {
+            m_pCqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_CQ_RING);
+
+            if(MAP_FAILED == m_pCqRing)
+            {
+                m_pCqRing = NULL;
+                CloseQueue();
+                return false;
+            }
+        }
+
+        m_sqeCount = params.sq_entries;
+        void *pSqes = mmap(NULL, m_sqeCount * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+
+        if(MAP_FAILED == pSqes)
+        {
+            CloseQueue();
+            return false;
+        }
+
+        m_pSqes = (struct io_uring_sqe *) pSqes;
+
+        uint8_t *sq = (uint8_t *) m_pSqRing;
+        m_pSqHead = (unsigned int *) (sq + params.sq_off.head);
+        m_pSqTail = (unsigned int *) (sq + params.sq_off.tail);
+        m_pSqMask = (unsigned int *) (sq + params.sq_off.ring_mask);
+        m_pSqArray = (unsigned int *) (sq + params.sq_off.array);
+
+        uint8_t *cq = (uint8_t *) m_pCqRing;
+        m_pCqHead = (unsigned int *) (cq + params.cq_off.head);
+        m_pCqTail = (unsigned int *) (cq + params.cq_off.tail);
+        m_pCqMask = (unsigned int *) (cq + params.cq_off.ring_mask);
+        m_pCqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+        return true;
+    }
+
+    void CloseQueue()
+    {
+        if(m_pSqes)
+            munmap(m_pSqes, m_sqeCount * sizeof(struct io_uring_sqe));
+
+        if(m_pCqRing && m_pCqRing != m_pSqRing)
+            munmap(m_pCqRing, m_cqRingSize);
+
+        if(m_pSqRing)
+            munmap(m_pSqRing, m_sqRingSize);
+
+        if(m_ringFd >= 0)
+            close(m_ringFd);
+
+        m_pSqes = NULL;
+        m_pCqRing = NULL;
+        m_pSqRing = NULL;
+        m_ringFd = -1;
+    }
+
+    bool Submit(Slot &slot, unsigned int index)
+    {
+        // We are the only producer, the kernel only moves the head
+        unsigned int tail = *m_pSqTail;
+        unsigned int sqeIndex = tail & *m_pSqMask;
+
+        struct io_uring_sqe *sqe = &m_pSqes[sqeIndex];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = m_handle;
+        sqe->off = slot.offset;
+        sqe->addr = (uint64_t) (uintptr_t) slot.buffer.data();
+        sqe->len = (uint32_t) slot.size;
+        sqe->user_data = index;
+
+        m_pSqArray[sqeIndex] = sqeIndex;
+        __atomic_store_n(m_pSqTail, tail + 1, __ATOMIC_RELEASE);
+
+        if(1 == syscall(__NR_io_uring_enter, m_ringFd, 1, 0, 0, NULL, 0))
+            return true;
+
+        // The kernel did not take the entry, take it back so the next submit does not send it along with its own
+        if(__atomic_load_n(m_pSqHead, __ATOMIC_ACQUIRE) != tail + 1)
+            __atomic_store_n(m_pSqTail, tail, __ATOMIC_RELEASE);
+
+        return false;
+    }
+
+    void Reap()
+    {
+        unsigned int head = *m_pCqHead;
+        unsigned int tail = __atomic_load_n(m_pCqTail, __ATOMIC_ACQUIRE);
+
+        for(; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &m_pCqes[head & *m_pCqMask];
+
+            if(cqe->user_data < ASYNC_SLOTS)
+                Complete(m_slots[cqe->user_data], cqe->res);
+        }
+
+        __atomic_store_n(m_pCqHead, head, __ATOMIC_RELEASE);
+    }
+
+    void Wait(Slot &slot)
+    {
+        while(eSlotInFlight == slot.State())
+        {
+            Reap();
+
+            if(eSlotInFlight == slot.State())
+            {
+                if(syscall(__NR_io_uring_enter, m_ringFd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0)
+                {
+                    Complete(slot, 0);
+                    break;
+                }
+            }
+        }
+    }
+
+#else
+
+    bool InitQueue() { return false; }
+    void CloseQueue() {}
+    bool Submit(Slot &, unsigned int) { return false; }
+    void Wait(Slot &) {}
+
+#endif
+
+    NativeHandle    m_handle;
+    bool            m_bQueueAvailable;
+    Slot            m_slots[ASYNC_SLOTS];
+    unsigned int    m_nextSlot;
+    uint64_t        m_hits;
+
+#ifdef HAVE_IO_URING
+    int                     m_ringFd;
+    void                   *m_pSqRing;
+    void                   *m_pCqRing;
+    struct io_uring_sqe    *m_pSqes;
+    size_t                  m_sqRingSize;
+    size_t                  m_cqRingSize;
+    unsigned int            m_sqeCount;
+    unsigned int           *m_pSqHead;
+    unsigned int           *m_pSqTail;
+    unsigned int           *m_pSqMask;
+    unsigned int           *m_pSqArray;
+    unsigned int           *m_pCqHead;
+    unsigned int           *m_pCqTail;
+    unsigned int           *m_pCqMask;
+    struct io_uring_cqe    *m_pCqes;
+#endif
+};
+
+InputSource *CreateInputSource(eInputBackend backend)
+{
+    switch(backend)
+    {
+        case eInputStdio:
+            return new StdioInputSource();
+
+        case eInputPread:
+            return new PreadInputSource();
+
+        case eInputMmap:
+            return new MmapInputSource();
+
+        case eInputAsync:
+            return new AsyncInputSource();
+    }
+
+    return NULL;
+}
+
+static const char *g_inputBackendNames[] = { "stdio", "pread", "mmap", "async" };
+
+bool InputBackendFromName(const char *name, eInputBackend &backend)
+{
+    for(unsigned int i = 0; i < sizeof(g_inputBackendNames) / sizeof(g_inputBackendNames[0]); i++)
+    {
+        if(0 == strcmp(name, g_inputBackendNames[i]))
+        {
+            backend = (eInputBackend) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const char *InputBackendName(eInputBackend backend)
+{
+    return g_inputBackendNames[backend];
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Bytes past the requested size that Fetch() guarantees are readable.
+// FindData can look a few bytes beyond the end of the last packet.
+#define INPUT_FETCH_PADDING 8
+
+enum eInputBackend
+{
+    eInputStdio,    // fseek + fread
+    eInputPread,    // Positional reads with access pattern hints (posix_fadvise / FILE_FLAG_SEQUENTIAL_SCAN)
+    eInputMmap,     // Whole file mapped, Fetch() is zero copy
+    eInputAsync     // Queued asynchronous reads (io_uring / overlapped I/O) started by Prefetch()
+};
+
+/*
+    All reads of the transport stream go through an InputSource,
+    so backends can be swapped per run and compared on the same workload.
+*/
+class InputSource
+{
+public:
+
+    InputSource()
+        : m_fileSize(0)
+        , m_bytesRead(0)
+        , m_readCalls(0)
+    {
+    }
+
+    virtual ~InputSource() {}
+
+    virtual bool Open(const std::string &fileName) = 0;
+    virtual void Close() = 0;
+
+    // Reads exactly size bytes at offset into pBuffer
+    virtual bool ReadAt(uint64_t offset, void *pBuffer, size_t size) = 0;
+
+    // Returns size bytes at offset followed by INPUT_FETCH_PADDING readable bytes,
+    // or NULL on error.  Backends that can hand out their own memory do so,
+    // the others read into scratch.  Valid until the next call or until scratch changes.
+    virtual const uint8_t *Fetch(uint64_t offset, size_t size, std::vector<uint8_t> &scratch);
+
+    // Hint that [offset, offset+size) will be read soon
+    virtual void Prefetch(uint64_t, size_t) {}
+
+    // Mapped view of the whole file if the backend has one, otherwise NULL
+    virtual const uint8_t *Data() const { return NULL; }
+
+    virtual const char *Name() const = 0;
+
+    uint64_t Size() const { return m_fileSize; }
+
+    // Counters for comparing backends
+    uint64_t BytesRead() const { return m_bytesRead; }
+    uint64_t ReadCalls() const { return m_readCalls; }
+
+protected:
+    uint64_t m_fileSize;
+    uint64_t m_bytesRead;
+    uint64_t m_readCalls;
+};
+
+InputSource *CreateInputSource(eInputBackend backend);
+
+bool InputBackendFromName(const char *name, eInputBackend &backend);
+const char *InputBackendName(eInputBackend backend);
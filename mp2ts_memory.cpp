@@ -0,0 +1,162 @@
+#include "mp2ts_memory.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Right in front of the memory handed out.  Keeps the 16 byte alignment malloc gives on 64-bit targets.
+struct MemoryHeader
+{
+    uint64_t    size;
+    uint32_t    subsystem;
+    uint32_t    offset;         // From the start of the malloc block to the memory handed out
+};
+
+static_assert(16 == sizeof(MemoryHeader), "MemoryHeader must keep malloc alignment");
+
+static thread_local eMemSubsystem g_memSubsystem = eMemOther;
+
+// Zero initialized before any constructor runs, operator new can be called that early
+static std::atomic<int64_t> g_memCurrent[eMemNumSubsystems];
+static std::atomic<int64_t> g_memPeak[eMemNumSubsystems];
+static std::atomic<int64_t> g_memTotal;
+static std::atomic<int64_t> g_memTotalPeak;
+
+static const char *g_memSubsystemNames[eMemNumSubsystems] =
+{
+    "Other",
+    "XML DOM",
+    "Decode order AUs",
+    "Presentation order AUs",
+    "Audio AUs",
+    "AU element store",
+    "Input buffers",
+    "Decoder frames",
+    "RGBA buffer",
+    "Frame table",
+    "Timeline",
+    "PCR analysis",
+    "Other stream AUs"
+};
+
+static void UpdatePeak(std::atomic<int64_t> &peak, int64_t value)
+{
+    int64_t old = peak.load(std::memory_order_relaxed);
+
+    while(value > old && !peak.compare_exchange_weak(old, value, std::memory_order_relaxed))
+        ;
+}
+
+void MemoryAdd(eMemSubsystem subsystem, int64_t bytes)
+{
+    int64_t current = g_memCurrent[subsystem].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t total = g_memTotal.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+
+    if(bytes > 0)
+    {
+        UpdatePeak(g_memPeak[subsystem], current);
+        UpdatePeak(g_memTotalPeak, total);
+    }
+}
+
+void MemorySet(eMemSubsystem subsystem, uint64_t bytes)
+{
+    int64_t previous = g_memCurrent[subsystem].exchange((int64_t) bytes, std::memory_order_relaxed);
+    int64_t total = g_memTotal.fetch_add((int64_t) bytes - previous, std::memory_order_relaxed) + (int64_t) bytes - previous;
+
+    UpdatePeak(g_memPeak[subsystem], (int64_t) bytes);
+    UpdatePeak(g_memTotalPeak, total);
+}
+
+MemoryScope::MemoryScope(eMemSubsystem subsystem)
+    : m_previous(g_memSubsystem)
+{
+    g_memSubsystem = subsystem;
+}
+
+MemoryScope::~MemoryScope()
+{
+    g_memSubsystem = m_previous;
+}
+
+void *MemoryTaggedAlloc(size_t size, size_t alignment)
+{
+    // A stricter alignment than the header gives pads ahead of the header
+    size_t padding = alignment > sizeof(MemoryHeader) ? alignment - 1 : 0;
+
+    if(size > SIZE_MAX - sizeof(MemoryHeader) - padding)
+        return NULL;
+
+    uint8_t *pBlock = (uint8_t *) malloc(sizeof(MemoryHeader) + padding + size);
+
+    if(!pBlock)
+        return NULL;
+
+    uintptr_t start = (uintptr_t) (pBlock + sizeof(MemoryHeader));
+
+    if(padding)
+        start = (start + padding) & ~(uintptr_t) (alignment - 1);
+
+    MemoryHeader *pHeader = (MemoryHeader *) start - 1;
+    pHeader->size = size;
+    pHeader->subsystem = g_memSubsystem;
+    pHeader->offset = (uint32_t) (start - (uintptr_t) pBlock);
+
+    MemoryAdd(g_memSubsystem, (int64_t) size);
+
+    return (void *) start;
+}
+
+void MemoryTaggedFree(void *p)
+{
+    if(!p)
+        return;
+
+    MemoryHeader *pHeader = (MemoryHeader *) p - 1;
+
+    MemoryAdd((eMemSubsystem) pHeader->subsystem, -(int64_t) pHeader->size);
+
+    free((uint8_t *) p - pHeader->offset);
+}
+
+const char *MemorySubsystemName(eMemSubsystem subsystem)
+{
+    return g_memSubsystemNames[subsystem];
+}
+
+uint64_t MemoryCurrent(eMemSubsystem subsystem)
+{
+    int64_t current = g_memCurrent[subsystem].load(std::memory_order_relaxed);
+    return current > 0 ? (uint64_t) current : 0;
+}
+
+uint64_t MemoryPeak(eMemSubsystem subsystem)
+{
+    return (uint64_t) g_memPeak[subsystem].load(std::memory_order_relaxed);
+}
+
+uint64_t MemoryTotal()
+{
+    int64_t total = g_memTotal.load(std::memory_order_relaxed);
+    return total > 0 ? (uint64_t) total : 0;
+}
+
+uint64_t MemoryTotalPeak()
+{
+    return (uint64_t) g_memTotalPeak.load(std::memory_order_relaxed);
+}
+
+void MemoryPrintReport(FILE *fp)
+{
+    fprintf(fp, "%-24s %14s %14s\n", "Subsystem", "Current", "Peak");
+
+    for(int i = 0; i < eMemNumSubsystems; i++)
+    {
+        eMemSubsystem subsystem = (eMemSubsystem) i;
+
+        fprintf(fp, "%-24s %14llu %14llu\n", MemorySubsystemName(subsystem),
+                (unsigned long long) MemoryCurrent(subsystem), (unsigned long long) MemoryPeak(subsystem));
+    }
+
+    fprintf(fp, "%-24s %14llu %14llu\n", "Total", (unsigned long long) MemoryTotal(), (unsigned long long) MemoryTotalPeak());
+}
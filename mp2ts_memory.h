@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/*
+    Current and peak bytes per subsystem.
+
+    Heap allocations are tagged with the subsystem of the innermost MemoryScope
+    on the allocating thread, anything outside a scope is eMemOther.  The
+    executable routes every form of operator new and delete, nothrow and aligned
+    included, through MemoryTaggedAlloc() and MemoryTaggedFree(), which keep the
+    tag and size in a small header so a block is always returned to the subsystem
+    that allocated it, whichever form of delete frees it.
+
+    FFmpeg allocates with av_malloc, those subsystems are set with MemorySet()
+    from the sizes FFmpeg reports.
+*/
+
+enum eMemSubsystem
+{
+    eMemOther,
+    eMemXmlDom,                 // tinyxml2 document, and the inflated text of a .xml.gz
+    eMemDecodeUnits,            // m_videoAccessUnitsDecode
+    eMemPresentationUnits,      // m_videoAccessUnitsPresentation and the presentation order map
+    eMemAudioUnits,             // m_audioAccessUnits
+    eMemElementStore,           // Packed AccessUnitElements of the video AUs
+    eMemInputBuffers,           // Read scratch and prefetch buffers
+    eMemDecoder,                // Picture buffers of the last decoded frame
+    eMemRGBA,                   // RGBA conversion buffer in WriteFrame
+    eMemFrameTable,             // Rows and sort orders of the Frames table
+    eMemTimeline,               // Frame size pyramid of the timeline graph
+    eMemPCR,                    // PCR samples and their rates, accuracy and jitter
+    eMemStreamUnits,            // AU indices of the streams that are not played
+    eMemNumSubsystems
+};
+
+class MemoryScope
+{
+public:
+    MemoryScope(eMemSubsystem subsystem);
+    ~MemoryScope();
+
+private:
+    eMemSubsystem m_previous;
+};
+
+// NULL if out of memory, operator new throws
+void *MemoryTaggedAlloc(size_t size, size_t alignment = 16);
+void MemoryTaggedFree(void *p);
+
+// For memory that does not come from operator new
+void MemoryAdd(eMemSubsystem subsystem, int64_t bytes);
+void MemorySet(eMemSubsystem subsystem, uint64_t bytes);
+
+const char *MemorySubsystemName(eMemSubsystem subsystem);
+uint64_t MemoryCurrent(eMemSubsystem subsystem);
+uint64_t MemoryPeak(eMemSubsystem subsystem);
+
+// Sum over the subsystems, and the peak of that sum
+uint64_t MemoryTotal();
+uint64_t MemoryTotalPeak();
+
+// Table of current and peak bytes per subsystem
+void MemoryPrintReport(FILE *fp);
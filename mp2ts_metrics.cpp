@@ -0,0 +1,338 @@
+#include "mp2ts_metrics.h"
+
+#include <chrono>
+#include <cstdarg>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#ifdef _WIN32
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #include <winsock2.h>
+    #include <windows.h>
+    #include <afunix.h>
+    typedef SOCKET NativeSocket;
+    #define INVALID_NATIVE_SOCKET INVALID_SOCKET
+    #define CloseNativeSocket closesocket
+#else
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    typedef int NativeSocket;
+    #define INVALID_NATIVE_SOCKET -1
+    #define CloseNativeSocket close
+#endif
+
+struct MetricInfo
+{
+    const char *name;
+    const char *help;
+    const char *label;  // Label of one series of a histogram family, or NULL
+};
+
+static const MetricInfo g_counterInfo[eMetricNumCounters] =
+{
+    { "mp2ts_bytes_read_total",             "Bytes read from the transport stream.",                NULL },
+    { "mp2ts_packets_parsed_total",         "TS packets described by the XML.",                     NULL },
+    { "mp2ts_access_units_indexed_total",   "Video and audio access units built from the XML.",     NULL },
+    { "mp2ts_frames_decoded_total",         "Video frames decoded.",                                NULL },
+    { "mp2ts_read_cache_hits_total",        "Reads served from a prefetched buffer.",               NULL },
+    { "mp2ts_read_cache_misses_total",      "Reads that missed the prefetched buffers.",            NULL },
+    { "mp2ts_index_page_hits_total",        "AU index page lookups that found the page resident.",  NULL },
+    { "mp2ts_index_page_misses_total",      "AU index pages read back from disk.",                  NULL },
+    { "mp2ts_index_pages_written_total",    "AU index pages written to disk to make room.",         NULL },
+    { "mp2ts_xml_chunks_loaded_total",      "Chunks of XML frames parsed on demand.",               NULL },
+    { "mp2ts_ts_packets_checked_total",     "TS packets checked for TR 101 290 conformance.",       NULL },
+    { "mp2ts_conformance_errors_total",     "TR 101 290 priority 1 and 2 errors found.",            NULL }
+};
+
+// Series of one family must be adjacent
+static const MetricInfo g_histogramInfo[eMetricNumHistograms] =
+{
+    { "mp2ts_decode_seconds",               "Time to decode one video frame.",                      "frame_type=\"I\"" },
+    { "mp2ts_decode_seconds",               "Time to decode one video frame.",                      "frame_type=\"P\"" },
+    { "mp2ts_decode_seconds",               "Time to decode one video frame.",                      "frame_type=\"B\"" },
+    { "mp2ts_decode_seconds",               "Time to decode one video frame.",                      "frame_type=\"other\"" },
+    { "mp2ts_seek_seconds",                 "Time from a seek to its first decoded frame.",         NULL }
+};
+
+// 100 us to 10 s, about 2.5x apart
+static const double g_bucketBounds[METRIC_NUM_BUCKETS] =
+{
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+    0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+std::atomic<uint64_t> g_metricCounters[eMetricNumCounters];
+MetricHistogram g_metricHistograms[eMetricNumHistograms];
+
+static const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+MetricHistogram::MetricHistogram()
+    : m_sumNanoseconds(0)
+{
+    for(int i = 0; i <= METRIC_NUM_BUCKETS; i++)
+        m_buckets[i].store(0, std::memory_order_relaxed);
+}
+
+void MetricHistogram::Observe(uint64_t nanoseconds)
+{
+    double seconds = (double) nanoseconds / 1e9;
+
+    int bucket = 0;
+    while(bucket < METRIC_NUM_BUCKETS && seconds > g_bucketBounds[bucket])
+        bucket++;
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_sumNanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+double MetricHistogram::BucketBound(int bucket)
+{
+    return g_bucketBounds[bucket];
+}
+
+uint64_t MetricsNow()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+static void AppendLine(std::string &out, const char *format, ...)
+{
+    char line[256];
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    out += line;
+}
+
+std::string MetricsFormat()
+{
+    std::string out;
+
+    for(int i = 0; i < eMetricNumCounters; i++)
+    {
+        const MetricInfo &info = g_counterInfo[i];
+
+        AppendLine(out, "# HELP %s %s\n", info.name, info.help);
+        AppendLine(out, "# TYPE %s counter\n", info.name);
+        AppendLine(out, "%s %llu\n", info.name, (unsigned long long) g_metricCounters[i].load(std::memory_order_relaxed));
+    }
+
+    for(int i = 0; i < eMetricNumHistograms; i++)
+    {
+        const MetricInfo &info = g_histogramInfo[i];
+        const MetricHistogram &histogram = g_metricHistograms[i];
+
+        if(0 == i || strcmp(info.name, g_histogramInfo[i - 1].name))
+        {
+            AppendLine(out, "# HELP %s %s\n", info.name, info.help);
+            AppendLine(out, "# TYPE %s histogram\n", info.name);
+        }
+
+        const char *label = info.label ? info.label : "";
+        const char *comma = info.label ? "," : "";
+
+        // The buckets are read one at a time, the count is their total so the series stays consistent
+        uint64_t count = 0;
+
+        for(int b = 0; b <= METRIC_NUM_BUCKETS; b++)
+        {
+            count += histogram.Bucket(b);
+
+            if(b < METRIC_NUM_BUCKETS)
+                AppendLine(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", info.name, label, comma, MetricHistogram::BucketBound(b), (unsigned long long) count);
+            else
+                AppendLine(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", info.name, label, comma, (unsigned long long) count);
+        }
+
+        const char *open = info.label ? "{" : "";
+        const char *close = info.label ? "}" : "";
+
+        AppendLine(out, "%s_sum%s%s%s %.9f\n", info.name, open, label, close, (double) histogram.SumNanoseconds() / 1e9);
+        AppendLine(out, "%s_count%s%s%s %llu\n", info.name, open, label, close, (unsigned long long) count);
+    }
+
+    return out;
+}
+
+/*
+    Export
+*/
+
+static std::thread g_exportThread;
+static std::mutex g_exportMutex;
+static std::condition_variable g_exportWake;
+static bool g_bExportStop = false;
+static std::string g_exportTarget;
+static unsigned int g_exportInterval = 10;
+
+// Written next to the target and renamed over it
+static bool WriteMetricsFile(const std::string &fileName, const std::string &text)
+{
+    std::string tmpName = fileName + ".tmp";
+
+    FILE *fp = fopen(tmpName.c_str(), "wb");
+
+    if(!fp)
+        return false;
+
+    bool bOK = 1 == fwrite(text.data(), text.size(), 1, fp);
+    bOK = 0 == fclose(fp) && bOK;
+
+    if(!bOK)
+    {
+        remove(tmpName.c_str());
+        return false;
+    }
+
+#ifdef _WIN32
+    return 0 != MoveFileExA(tmpName.c_str(), fileName.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    return 0 == rename(tmpName.c_str(), fileName.c_str());
+#endif
+}
+
+// One connection per snapshot, the listener reads until the socket closes
+static bool WriteMetricsSocket(const std::string &path, const std::string &text)
+{
+    struct sockaddr_un address;
+
+    if(path.size() >= sizeof(address.sun_path))
+        return false;
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size());
+
+    NativeSocket s = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(INVALID_NATIVE_SOCKET == s)
+        return false;
+
+    bool bOK = 0 == connect(s, (struct sockaddr *) &address, sizeof(address));
+
+    const char *p = text.data();
+    size_t left = text.size();
+
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+
+    while(bOK && left)
+    {
+        int sent = (int) send(s, p, (int) left, flags);
+
+        if(sent <= 0)
+            bOK = false;
+        else
+        {
+            p += sent;
+            left -= sent;
+        }
+    }
+
+    CloseNativeSocket(s);
+
+    return bOK;
+}
+
+static bool WriteMetrics()
+{
+    std::string text = MetricsFormat();
+
+    if(0 == g_exportTarget.compare(0, 5, "unix:"))
+        return WriteMetricsSocket(g_exportTarget.substr(5), text);
+
+    return WriteMetricsFile(g_exportTarget, text);
+}
+
+static void ExportThread()
+{
+    bool bLastOK = true;
+
+    std::unique_lock<std::mutex> lock(g_exportMutex);
+
+    while(1)
+    {
+        bool bStop = g_exportWake.wait_for(lock, std::chrono::seconds(g_exportInterval), [] { return g_bExportStop; });
+
+        bool bOK = WriteMetrics();
+
+        // Only report changes, a missing listener should not flood stderr
+        if(bOK != bLastOK)
+            fprintf(stderr, bOK ? "Metrics: Writing to %s again\n" : "Warning: Metrics could not be written to %s\n", g_exportTarget.c_str());
+
+        bLastOK = bOK;
+
+        if(bStop)
+            break;
+    }
+}
+
+bool MetricsStartExport(const char *target, unsigned int intervalSeconds)
+{
+    if(g_exportThread.joinable())
+        return false;
+
+#ifdef _WIN32
+    if(0 == strncmp(target, "unix:", 5))
+    {
+        WSADATA wsaData;
+
+        if(0 != WSAStartup(MAKEWORD(2, 2), &wsaData))
+        {
+            fprintf(stderr, "Error: Winsock could not be started for %s\n", target);
+            return false;
+        }
+    }
+#endif
+
+    g_exportTarget = target;
+    g_exportInterval = intervalSeconds ? intervalSeconds : 1;
+    g_bExportStop = false;
+
+    g_exportThread = std::thread(ExportThread);
+
+    // Error paths that return from main still get a final snapshot, and never destroy a running thread
+    static bool bAtExit = false;
+
+    if(!bAtExit)
+        atexit(MetricsStopExport);
+
+    bAtExit = true;
+
+    return true;
+}
+
+void MetricsStopExport()
+{
+    if(!g_exportThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(g_exportMutex);
+        g_bExportStop = true;
+    }
+
+    g_exportWake.notify_one();
+    g_exportThread.join();
+
+#ifdef _WIN32
+    if(0 == g_exportTarget.compare(0, 5, "unix:"))
+        WSACleanup();
+#endif
+}
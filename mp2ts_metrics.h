@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+    Process wide counters and histograms for running under a supervisor.
+
+    Updating a metric is a relaxed atomic add, nothing else.  A background
+    thread started by MetricsStartExport() writes all of them at an interval
+    in the Prometheus text exposition format, to a file (for the node exporter
+    textfile collector) or to a Unix domain socket.
+*/
+
+enum eMetricCounter
+{
+    eMetricBytesRead,           // Bytes read from the transport stream, by every backend
+    eMetricPacketsParsed,       // TS packets described by the XML or read from the TS
+    eMetricAccessUnitsIndexed,  // Video and audio AUs built from the XML or the TS
+    eMetricFramesDecoded,       // Frames returned by VideoDecoder
+    eMetricReadCacheHits,       // Reads served from a prefetched buffer
+    eMetricReadCacheMisses,     // Reads that went to the file
+    eMetricIndexPageHits,       // AU index page lookups that found the page resident
+    eMetricIndexPageMisses,     // AU index pages read back from their temporary file
+    eMetricIndexPagesWritten,   // AU index pages written out to make room
+    eMetricXmlChunksLoaded,     // Chunks of frames parsed by a lazy load
+    eMetricPacketsChecked,      // TS packets looked at by the conformance checker
+    eMetricConformanceErrors,   // TR 101 290 errors it found
+    eMetricNumCounters
+};
+
+enum eMetricHistogram
+{
+    eMetricDecodeI,             // Time to decode one frame, by picture type
+    eMetricDecodeP,
+    eMetricDecodeB,
+    eMetricDecodeOther,
+    eMetricSeek,                // Seek request to first decoded frame
+    eMetricNumHistograms
+};
+
+// Upper bounds, in seconds, of the histogram buckets.  A final +Inf bucket is implied.
+#define METRIC_NUM_BUCKETS 16
+
+class MetricHistogram
+{
+public:
+
+    MetricHistogram();
+
+    void Observe(uint64_t nanoseconds);
+
+    // Non-cumulative bucket counts, the last one is +Inf
+    uint64_t Bucket(int bucket) const { return m_buckets[bucket].load(std::memory_order_relaxed); }
+    uint64_t SumNanoseconds() const { return m_sumNanoseconds.load(std::memory_order_relaxed); }
+
+    static double BucketBound(int bucket);
+
+private:
+    std::atomic<uint64_t> m_buckets[METRIC_NUM_BUCKETS + 1];
+    std::atomic<uint64_t> m_sumNanoseconds;
+};
+
+extern std::atomic<uint64_t> g_metricCounters[eMetricNumCounters];
+extern MetricHistogram g_metricHistograms[eMetricNumHistograms];
+
+inline void MetricsAdd(eMetricCounter counter, uint64_t n = 1)
+{
+    g_metricCounters[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+inline void MetricsObserve(eMetricHistogram histogram, uint64_t nanoseconds)
+{
+    g_metricHistograms[histogram].Observe(nanoseconds);
+}
+
+// Nanoseconds on a monotonic clock, for timing observations
+uint64_t MetricsNow();
+
+// Every metric in the Prometheus text format
+std::string MetricsFormat();
+
+// target is a file name, or unix:<path> for a stream socket something is listening on.
+// A file is replaced atomically, so a reader never sees half of it.
+bool MetricsStartExport(const char *target, unsigned int intervalSeconds);
+
+// Writes a final snapshot and stops the export thread
+void MetricsStopExport();
@@ -0,0 +1,243 @@
+#include "mp2ts_mpeg2.h"
+#include "mp2ts_bitstream.h"
+
+#include <cstring>
+
+// Start codes, ISO/IEC 13818-2 Table 6-1
+#define MPEG2_PICTURE_START_CODE 0x00
+#define MPEG2_SLICE_START_CODE_FIRST 0x01
+#define MPEG2_SLICE_START_CODE_LAST 0xAF
+#define MPEG2_SEQUENCE_HEADER_CODE 0xB3
+#define MPEG2_EXTENSION_START_CODE 0xB5
+#define MPEG2_GROUP_START_CODE 0xB8
+
+// extension_start_code_identifier, Table 6-2
+#define MPEG2_SEQUENCE_EXTENSION_ID 1
+#define MPEG2_PICTURE_CODING_EXTENSION_ID 8
+
+// Above this many lines slices carry slice_vertical_position_extension
+#define MPEG2_TALL_PICTURE 2800
+
+// quantiser_scale of each quantiser_scale_code when q_scale_type is 1, Table 7-6
+static const uint8_t g_nonLinearQuantiserScale[32] =
+{
+     0,  1,  2,  3,  4,  5,  6,  7,  8, 10, 12, 14, 16, 18, 20, 22,
+    24, 28, 32, 36, 40, 44, 48, 52, 56, 64, 72, 80, 88, 96, 104, 112
+};
+
+static const char g_pictureTypes[8] = { 0, 'I', 'P', 'B', 'D', 0, 0, 0 };
+
+MPEG2HeaderParser::MPEG2HeaderParser()
+{
+    Reset();
+}
+
+void MPEG2HeaderParser::Reset()
+{
+    memset(&m_sequence, 0, sizeof(m_sequence));
+}
+
+bool MPEG2HeaderParser::Parse(const uint8_t *p, size_t size, MPEG2Picture &picture)
+{
+    memset(&picture, 0, sizeof(picture));
+    picture.pictureStructure = 3;
+    picture.bProgressiveFrame = true;
+
+    bool bQScaleType = false;
+    bool bPictureHeader = false;
+    unsigned int pictureHeaders = 0;
+    uint64_t sumQuantiserScale = 0;
+
+    const uint8_t *pEnd = p + size;
+    const uint8_t *pStart = FindStartCode(p, pEnd);
+
+    while(pStart + 3 < pEnd)
+    {
+        uint8_t code = pStart[3];
+        const uint8_t *pHeader = pStart + 4;
+        const uint8_t *pNext = FindStartCode(pHeader, pEnd);
+        size_t headerSize = pNext - pHeader;
+
+        if(code >= MPEG2_SLICE_START_CODE_FIRST && code <= MPEG2_SLICE_START_CODE_LAST)
+        {
+            if(bPictureHeader)
+            {
+                BitReader bits(pHeader, headerSize);
+
+                if(m_sequence.height > MPEG2_TALL_PICTURE)
+                    bits.Skip(3);
+
+                uint32_t quantiserScaleCode = bits.Read(5);
+
+                // 0 is forbidden
+                if(!bits.Overrun() && quantiserScaleCode)
+                {
+                    uint8_t quantiserScale = !m_sequence.bMPEG2 ? (uint8_t) quantiserScaleCode :
+                                             bQScaleType ? g_nonLinearQuantiserScale[quantiserScaleCode] : (uint8_t) (2 * quantiserScaleCode);
+
+                    if(0 == picture.slices || quantiserScale < picture.minQuantiserScale)
+                        picture.minQuantiserScale = quantiserScale;
+
+                    if(quantiserScale > picture.maxQuantiserScale)
+                        picture.maxQuantiserScale = quantiserScale;
+
+                    sumQuantiserScale += quantiserScale;
+                    picture.slices++;
+                }
+            }
+        }
+        else
+        {
+            switch(code)
+            {
+            case MPEG2_PICTURE_START_CODE:
+                // The second field of a field pair keeps the first's header
+                if(0 == pictureHeaders++)
+                {
+                    ParsePictureHeader(pHeader, headerSize, picture);
+                    bPictureHeader = 0 != picture.type;
+                }
+                break;
+
+            case MPEG2_SEQUENCE_HEADER_CODE:
+                ParseSequenceHeader(pHeader, headerSize);
+                picture.bSequenceHeader = true;
+                break;
+
+            case MPEG2_EXTENSION_START_CODE:
+                ParseExtension(pHeader, headerSize, pictureHeaders <= 1 ? &picture : NULL, bQScaleType);
+                break;
+
+            case MPEG2_GROUP_START_CODE:
+                ParseGOPHeader(pHeader, headerSize, picture);
+                break;
+            }
+        }
+
+        pStart = pNext;
+    }
+
+    if(picture.slices)
+        picture.meanQuantiserScale = (float) sumQuantiserScale / (float) picture.slices;
+
+    return bPictureHeader;
+}
+
+void MPEG2HeaderParser::ParseSequenceHeader(const uint8_t *p, size_t size)
+{
+    BitReader bits(p, size);
+
+    uint32_t width = bits.Read(12);
+    uint32_t height = bits.Read(12);
+    uint32_t aspectRatio = bits.Read(4);
+    uint32_t frameRateCode = bits.Read(4);
+    uint32_t bitRateValue = bits.Read(18);
+    bits.Skip(1);   // marker_bit
+    uint32_t vbvBufferSizeValue = bits.Read(10);
+
+    if(bits.Overrun())
+        return;
+
+    // Until a sequence_extension says otherwise
+    memset(&m_sequence, 0, sizeof(m_sequence));
+    m_sequence.bValid = true;
+    m_sequence.width = (uint16_t) width;
+    m_sequence.height = (uint16_t) height;
+    m_sequence.aspectRatio = (uint8_t) aspectRatio;
+    m_sequence.frameRateCode = (uint8_t) frameRateCode;
+    m_sequence.bitRate = 0x3FFFF == bitRateValue ? 0 : bitRateValue * 400;
+    m_sequence.vbvBufferSize = vbvBufferSizeValue * 16 * 1024;
+    m_sequence.chromaFormat = 1;
+    m_sequence.bProgressive = true;
+}
+
+void MPEG2HeaderParser::ParseExtension(const uint8_t *p, size_t size, MPEG2Picture *pPicture, bool &bQScaleType)
+{
+    BitReader bits(p, size);
+
+    uint32_t id = bits.Read(4);
+
+    if(MPEG2_SEQUENCE_EXTENSION_ID == id && m_sequence.bValid)
+    {
+        uint32_t profileAndLevel = bits.Read(8);
+        bool bProgressive = bits.ReadFlag();
+        uint32_t chromaFormat = bits.Read(2);
+        uint32_t widthExtension = bits.Read(2);
+        uint32_t heightExtension = bits.Read(2);
+        uint32_t bitRateExtension = bits.Read(12);
+        bits.Skip(1);   // marker_bit
+        uint32_t vbvBufferSizeExtension = bits.Read(8);
+        bool bLowDelay = bits.ReadFlag();
+
+        if(bits.Overrun())
+            return;
+
+        m_sequence.bMPEG2 = true;
+        m_sequence.profileAndLevel = (uint8_t) profileAndLevel;
+        m_sequence.bProgressive = bProgressive;
+        m_sequence.chromaFormat = (uint8_t) chromaFormat;
+        m_sequence.width |= (uint16_t) (widthExtension << 12);
+        m_sequence.height |= (uint16_t) (heightExtension << 12);
+        m_sequence.bitRate = (uint32_t) ((((uint64_t) bitRateExtension << 18) | (m_sequence.bitRate / 400)) * 400);
+        m_sequence.vbvBufferSize = ((vbvBufferSizeExtension << 10) | (m_sequence.vbvBufferSize / (16 * 1024))) * 16 * 1024;
+        m_sequence.bLowDelay = bLowDelay;
+    }
+    else if(MPEG2_PICTURE_CODING_EXTENSION_ID == id)
+    {
+        bits.Skip(16);  // f_code[2][2]
+        bits.Skip(2);   // intra_dc_precision
+        uint32_t pictureStructure = bits.Read(2);
+        bool bTopFieldFirst = bits.ReadFlag();
+        bits.Skip(2);   // frame_pred_frame_dct, concealment_motion_vectors
+        bool bNonLinear = bits.ReadFlag();
+        bits.Skip(2);   // intra_vlc_format, alternate_scan
+        bool bRepeatFirstField = bits.ReadFlag();
+        bits.Skip(1);   // chroma_420_type
+        bool bProgressiveFrame = bits.ReadFlag();
+
+        if(bits.Overrun())
+            return;
+
+        // Each field has its own q_scale_type
+        bQScaleType = bNonLinear;
+
+        if(pPicture)
+        {
+            pPicture->pictureStructure = (uint8_t) pictureStructure;
+            pPicture->bTopFieldFirst = bTopFieldFirst;
+            pPicture->bRepeatFirstField = bRepeatFirstField;
+            pPicture->bProgressiveFrame = bProgressiveFrame;
+        }
+    }
+}
+
+void MPEG2HeaderParser::ParseGOPHeader(const uint8_t *p, size_t size, MPEG2Picture &picture)
+{
+    BitReader bits(p, size);
+
+    uint32_t timeCode = bits.Read(25);
+    bool bClosedGOP = bits.ReadFlag();
+    bool bBrokenLink = bits.ReadFlag();
+
+    if(bits.Overrun())
+        return;
+
+    picture.bGOPHeader = true;
+    picture.timeCode = timeCode;
+    picture.bClosedGOP = bClosedGOP;
+    picture.bBrokenLink = bBrokenLink;
+}
+
+void MPEG2HeaderParser::ParsePictureHeader(const uint8_t *p, size_t size, MPEG2Picture &picture)
+{
+    BitReader bits(p, size);
+
+    uint32_t temporalReference = bits.Read(10);
+    uint32_t pictureCodingType = bits.Read(3);
+
+    if(bits.Overrun())
+        return;
+
+    picture.temporalReference = (uint16_t) temporalReference;
+    picture.type = g_pictureTypes[pictureCodingType];
+}
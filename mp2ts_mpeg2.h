@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// From the last sequence header and sequence_extension, ISO/IEC 13818-2 6.2.2
+struct MPEG2Sequence
+{
+    bool        bValid;             // A sequence header was seen
+    bool        bMPEG2;             // It had a sequence_extension, MPEG-1 otherwise
+    uint16_t    width;
+    uint16_t    height;
+    uint8_t     aspectRatio;        // aspect_ratio_information
+    uint8_t     frameRateCode;
+    uint32_t    bitRate;            // bit/s, 0 for the variable rate of MPEG-1
+    uint32_t    vbvBufferSize;      // bits
+    uint8_t     profileAndLevel;
+    uint8_t     chromaFormat;       // 1 4:2:0, 2 4:2:2, 3 4:4:4
+    bool        bProgressive;
+    bool        bLowDelay;
+};
+
+// The headers of one AU, of the first field of a field pair
+struct MPEG2Picture
+{
+    char        type;               // I, P, B or D, 0 without a picture header
+    uint16_t    temporalReference;
+    bool        bSequenceHeader;    // The AU repeats or changes the sequence header
+    bool        bGOPHeader;
+    bool        bClosedGOP;
+    bool        bBrokenLink;
+    uint32_t    timeCode;           // The 25 bits of the GOP header
+
+    // picture_coding_extension, frame picture and progressive for MPEG-1
+    uint8_t     pictureStructure;   // 1 top field, 2 bottom field, 3 frame
+    bool        bTopFieldFirst;
+    bool        bRepeatFirstField;
+    bool        bProgressiveFrame;
+
+    uint32_t    slices;
+    uint8_t     minQuantiserScale;
+    uint8_t     maxQuantiserScale;
+    float       meanQuantiserScale; // Over the slices, the quantiser_scale each starts with
+};
+
+/*
+    Reads the sequence, GOP, picture and slice headers of MPEG-1 and MPEG-2
+    video straight from the ES, without a decoder.
+
+    Start codes are found with FindStartCode() and only the few bytes after
+    each are read, so a picture costs about a memchr over its payload.  Each
+    slice header gives its quantiser_scale_code, mapped to quantiser_scale
+    through the q_scale_type of the picture.  The sequence header is kept
+    between AUs: the size and slice_vertical_position_extension of a picture
+    depend on the last one seen.
+*/
+class MPEG2HeaderParser
+{
+public:
+
+    MPEG2HeaderParser();
+
+    // Forgets the sequence header, after a seek to another sequence
+    void Reset();
+
+    // Headers of the ES payload of one AU.  False if it has no picture header.
+    bool Parse(const uint8_t *p, size_t size, MPEG2Picture &picture);
+
+    const MPEG2Sequence &Sequence() const { return m_sequence; }
+
+private:
+
+    void ParseSequenceHeader(const uint8_t *p, size_t size);
+    // pPicture is NULL for the extensions of a second field
+    void ParseExtension(const uint8_t *p, size_t size, MPEG2Picture *pPicture, bool &bQScaleType);
+    void ParseGOPHeader(const uint8_t *p, size_t size, MPEG2Picture &picture);
+    void ParsePictureHeader(const uint8_t *p, size_t size, MPEG2Picture &picture);
+
+    MPEG2Sequence   m_sequence;
+};
@@ -0,0 +1,311 @@
+#include "mp2ts_page_cache.h"
+#include "mp2ts_metrics.h"
+
+#include <cstring>
+
+// Reading a page back is one small positional read, writing it first about doubles that
+#define PAGE_RELOAD_COST 300.0
+
+// A page moved to the head within the last 1/n of the resident pages' worth of uses is
+// still in the front part of the list, using it again leaves the LRU and the budget alone
+#define PAGE_TOUCH_FRACTION 4
+
+struct CachedPage
+{
+    uint8_t     *pData;
+    PagedStore  *pOwner;
+    uint64_t    number;
+    CachedPage  *pPrev;     // LRU list, most recent at the head
+    CachedPage  *pNext;
+    uint64_t    movedAt;    // g_cacheUses when it last went to the head
+    bool        bDirty;
+};
+
+// One LRU list for the resident pages of all stores
+static CachedPage *g_pLruHead = NULL;
+static CachedPage *g_pLruTail = NULL;
+static uint64_t g_cacheLimit = PAGE_CACHE_DEFAULT;
+static uint64_t g_cacheResidentPages = 0;
+static uint64_t g_cacheUses = 0;        // Moves to the head, at most this many pages went ahead of a page since its movedAt
+
+static bool SeekFile(FILE *fp, uint64_t offset)
+{
+#ifdef _WIN32
+    return 0 == _fseeki64(fp, (int64_t) offset, SEEK_SET);
+#else
+    return 0 == fseeko(fp, (off_t) offset, SEEK_SET);
+#endif
+}
+
+PagedStore::PagedStore(const char *name, eMemSubsystem subsystem)
+    : m_name(name)
+    , m_subsystem(subsystem)
+    , m_residentPages(0)
+    , m_fp(NULL)
+{
+}
+
+PagedStore::~PagedStore()
+{
+    Clear();
+}
+
+void PagedStore::Clear()
+{
+    BudgetRemoveAll(this);
+
+    for(size_t i = 0; i < m_pages.size(); i++)
+    {
+        if(m_pages[i].pResident)
+        {
+            // Dropped, not written back
+            m_pages[i].pResident->bDirty = false;
+            Evict(m_pages[i].pResident, false);
+        }
+    }
+
+    m_pages.clear();
+
+    if(m_fp)
+        fclose(m_fp);
+
+    m_fp = NULL;
+}
+
+uint8_t *PagedStore::Write(uint64_t offset, size_t n)
+{
+    (void) n;
+
+    CachedPage *pPage = GetPage(offset / PAGE_SIZE_BYTES);
+
+    if(!pPage)
+        return NULL;
+
+    pPage->bDirty = true;
+
+    return pPage->pData + offset % PAGE_SIZE_BYTES;
+}
+
+const uint8_t *PagedStore::Read(uint64_t offset, size_t n, std::vector<uint8_t> &scratch)
+{
+    size_t inPage = (size_t) (offset % PAGE_SIZE_BYTES);
+
+    if(inPage + n <= PAGE_SIZE_BYTES)
+    {
+        CachedPage *pPage = GetPage(offset / PAGE_SIZE_BYTES);
+        return pPage ? pPage->pData + inPage : NULL;
+    }
+
+    if(scratch.size() < n)
+        scratch.resize(n);
+
+    // One page at a time, loading the next may evict the previous
+    for(size_t copied = 0; copied < n; )
+    {
+        size_t chunk = PAGE_SIZE_BYTES - inPage;
+
+        if(chunk > n - copied)
+            chunk = n - copied;
+
+        CachedPage *pPage = GetPage((offset + copied) / PAGE_SIZE_BYTES);
+
+        if(!pPage)
+            return NULL;
+
+        memcpy(scratch.data() + copied, pPage->pData + inPage, chunk);
+
+        copied += chunk;
+        inPage = 0;
+    }
+
+    return scratch.data();
+}
+
+CachedPage *PagedStore::GetPage(uint64_t number)
+{
+    if(number >= m_pages.size())
+    {
+        PageSlot empty = { NULL, false };
+        m_pages.resize((size_t) number + 1, empty);
+    }
+
+    PageSlot &slot = m_pages[(size_t) number];
+    CachedPage *pPage = slot.pResident;
+
+    if(pPage)
+    {
+        // The budget's lock is not taken for a page that cannot be near the tail anyway
+        if(pPage != g_pLruHead && g_cacheUses - pPage->movedAt >= g_cacheResidentPages / PAGE_TOUCH_FRACTION)
+        {
+            // Move to the head
+            pPage->pPrev->pNext = pPage->pNext;
+
+            if(pPage->pNext)
+                pPage->pNext->pPrev = pPage->pPrev;
+            else
+                g_pLruTail = pPage->pPrev;
+
+            pPage->pPrev = NULL;
+            pPage->pNext = g_pLruHead;
+            g_pLruHead->pPrev = pPage;
+            g_pLruHead = pPage;
+            pPage->movedAt = ++g_cacheUses;
+
+            BudgetTouch(this, number);
+        }
+
+        MetricsAdd(eMetricIndexPageHits);
+
+        return pPage;
+    }
+
+    // Make room, the least recently used page of any store goes first
+    while(g_pLruTail && (g_cacheResidentPages + 1) * PAGE_SIZE_BYTES > g_cacheLimit)
+    {
+        CachedPage *pVictim = g_pLruTail;
+
+        if(!pVictim->pOwner->Evict(pVictim, true))
+            break;
+    }
+
+    {
+        MemoryScope memoryScope(m_subsystem);
+
+        pPage = new CachedPage;
+        pPage->pData = new uint8_t[PAGE_SIZE_BYTES];
+    }
+
+    pPage->pOwner = this;
+    pPage->number = number;
+    pPage->bDirty = false;
+
+    if(slot.bOnDisk)
+    {
+        MetricsAdd(eMetricIndexPageMisses);
+
+        // The slot stays on disk, the next use of the page tries again
+        if(!ReadPage(pPage))
+        {
+            delete [] pPage->pData;
+            delete pPage;
+
+            return NULL;
+        }
+    }
+    else
+    {
+        memset(pPage->pData, 0, PAGE_SIZE_BYTES);
+    }
+
+    pPage->pPrev = NULL;
+    pPage->pNext = g_pLruHead;
+
+    if(g_pLruHead)
+        g_pLruHead->pPrev = pPage;
+    else
+        g_pLruTail = pPage;
+
+    g_pLruHead = pPage;
+    pPage->movedAt = ++g_cacheUses;
+
+    slot.pResident = pPage;
+    m_residentPages++;
+    g_cacheResidentPages++;
+
+    BudgetInsert(this, number, PAGE_SIZE_BYTES, PAGE_RELOAD_COST);
+
+    return pPage;
+}
+
+bool PagedStore::Evict(CachedPage *pPage, bool bUnregister)
+{
+    if(pPage->bDirty)
+    {
+        if(!WritePage(pPage))
+            return false;
+
+        m_pages[(size_t) pPage->number].bOnDisk = true;
+    }
+
+    if(pPage->pPrev)
+        pPage->pPrev->pNext = pPage->pNext;
+    else
+        g_pLruHead = pPage->pNext;
+
+    if(pPage->pNext)
+        pPage->pNext->pPrev = pPage->pPrev;
+    else
+        g_pLruTail = pPage->pPrev;
+
+    m_pages[(size_t) pPage->number].pResident = NULL;
+    m_residentPages--;
+    g_cacheResidentPages--;
+
+    if(bUnregister)
+        BudgetRemove(this, pPage->number);
+
+    delete [] pPage->pData;
+    delete pPage;
+
+    return true;
+}
+
+bool PagedStore::BudgetEvict(uint64_t key)
+{
+    if(key >= m_pages.size() || !m_pages[(size_t) key].pResident)
+        return true;
+
+    return Evict(m_pages[(size_t) key].pResident, false);
+}
+
+bool PagedStore::WritePage(const CachedPage *pPage)
+{
+    if(!m_fp)
+    {
+        // Deleted by the C runtime when it is closed, or when the process exits
+        m_fp = tmpfile();
+
+        if(!m_fp)
+        {
+            fprintf(stderr, "Error: Could not create a temporary file for the %s pages\n", m_name);
+            return false;
+        }
+    }
+
+    if(!SeekFile(m_fp, pPage->number * PAGE_SIZE_BYTES) || 1 != fwrite(pPage->pData, PAGE_SIZE_BYTES, 1, m_fp))
+    {
+        fprintf(stderr, "Error: Could not write page %llu of the %s\n", (unsigned long long) pPage->number, m_name);
+        return false;
+    }
+
+    MetricsAdd(eMetricIndexPagesWritten);
+
+    return true;
+}
+
+bool PagedStore::ReadPage(CachedPage *pPage)
+{
+    if(!SeekFile(m_fp, pPage->number * PAGE_SIZE_BYTES) || 1 != fread(pPage->pData, PAGE_SIZE_BYTES, 1, m_fp))
+    {
+        fprintf(stderr, "Error: Could not read page %llu of the %s\n", (unsigned long long) pPage->number, m_name);
+        return false;
+    }
+
+    return true;
+}
+
+void PagedStore::SetCacheLimit(uint64_t bytes)
+{
+    // At least a couple of pages, a Read() crossing pages needs both in turn
+    g_cacheLimit = bytes < 4 * PAGE_SIZE_BYTES ? 4 * PAGE_SIZE_BYTES : bytes;
+}
+
+uint64_t PagedStore::CacheLimit()
+{
+    return g_cacheLimit;
+}
+
+uint64_t PagedStore::CacheResidentBytes()
+{
+    return g_cacheResidentPages * (uint64_t) PAGE_SIZE_BYTES;
+}
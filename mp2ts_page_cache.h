@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "mp2ts_memory.h"
+#include "mp2ts_budget.h"
+
+#define PAGE_SIZE_BYTES     (64 * 1024)
+#define PAGE_CACHE_DEFAULT  (256ull * 1024 * 1024)
+
+struct CachedPage;
+
+/*
+    A growable byte space in fixed size pages, with 64-bit offsets.
+
+    Pages are resident through one LRU cache shared by every PagedStore.
+    When the cache is over its limit, the least recently used page is written
+    to the store's temporary file if it changed.  Its next use reads it back.
+    A store that never goes over the limit never creates a file.
+
+    Every resident page is also a memory budget entry, so a process wide cap
+    can push pages out as well.
+
+    A pointer returned by Read() or Write() is valid until the next call on
+    any PagedStore, or the next budget enforcement.  They return NULL if the
+    page could not be read back from the file; the error is printed and the
+    next use of the page tries again.  Not thread safe.
+*/
+class PagedStore : public BudgetConsumer
+{
+public:
+
+    PagedStore(const char *name, eMemSubsystem subsystem);
+    ~PagedStore();
+
+    // Drops every page and the temporary file
+    void Clear();
+
+    // n bytes at offset to write, the range must not cross a page boundary
+    uint8_t *Write(uint64_t offset, size_t n);
+
+    // n bytes at offset.  A range that crosses pages is copied into scratch.
+    const uint8_t *Read(uint64_t offset, size_t n, std::vector<uint8_t> &scratch);
+
+    uint64_t PageCount() const { return m_pages.size(); }
+    uint64_t ResidentBytes() const { return m_residentPages * (uint64_t) PAGE_SIZE_BYTES; }
+
+    const char *BudgetName() const { return m_name; }
+    bool BudgetEvict(uint64_t key);
+
+    // Resident bytes of all stores together
+    static void SetCacheLimit(uint64_t bytes);
+    static uint64_t CacheLimit();
+    static uint64_t CacheResidentBytes();
+
+    // bUnregister is false when the budget already dropped the entry
+    bool Evict(CachedPage *pPage, bool bUnregister);
+
+private:
+
+    struct PageSlot
+    {
+        CachedPage  *pResident;
+        bool        bOnDisk;
+    };
+
+    // NULL if the page is on disk and could not be read back
+    CachedPage *GetPage(uint64_t number);
+    bool WritePage(const CachedPage *pPage);
+    bool ReadPage(CachedPage *pPage);
+
+    PagedStore(const PagedStore &);
+    PagedStore &operator=(const PagedStore &);
+
+    const char              *m_name;
+    eMemSubsystem           m_subsystem;
+    std::vector<PageSlot>   m_pages;
+    uint64_t                m_residentPages;
+    FILE                    *m_fp;
+};
@@ -0,0 +1,433 @@
+#include "mp2ts_pcr.h"
+#include "mp2ts_memory.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+
+// A PCR is 33 bits of 90 kHz base times 300, plus the 27 MHz extension
+#define PCR_WRAP ((1ull << 33) * 300)
+#define PCR_CLOCK 27000000.0
+
+// The arrival_time_stamp of a 192 byte packet is 30 bits of the 27 MHz clock
+#define ARRIVAL_MASK 0x3FFFFFFF
+
+// Windows of PCR time fitted for the piecewise constant rate
+#define PCR_WINDOW_TICKS 27000000
+#define PCR_WINDOW_MIN_SAMPLES 3
+
+// Windows whose rates differ by less than this fraction are one segment
+#define PCR_RATE_TOLERANCE 0.001
+
+// The TS rate counts 188 byte packets, not the 4 byte header of a 192 byte one
+#define TS_PACKET_BYTES 188.0
+
+#define MAX_PID 8192
+
+// Least squares line through points around their mean
+struct LineFit
+{
+    double  n;
+    double  meanX;
+    double  meanY;
+    double  sxx;        // Sum of (x - meanX)^2
+    double  sxy;        // Sum of (x - meanX)(y - meanY)
+
+    double Slope() const { return sxx > 0.0 ? sxy / sxx : 0.0; }
+    double At(double x) const { return meanY + Slope() * (x - meanX); }
+};
+
+// The sums run in four independent lanes, so they pipeline and vectorize instead of
+// waiting on one accumulator
+static LineFit FitLine(const double *x, const double *y, size_t n)
+{
+    LineFit fit = { (double) n, 0.0, 0.0, 0.0, 0.0 };
+
+    if(0 == n)
+        return fit;
+
+    double sumX[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double sumY[4] = { 0.0, 0.0, 0.0, 0.0 };
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        for(int k = 0; k < 4; k++)
+        {
+            sumX[k] += x[i + k];
+            sumY[k] += y[i + k];
+        }
+    }
+
+    for(; i < n; i++)
+    {
+        sumX[0] += x[i];
+        sumY[0] += y[i];
+    }
+
+    fit.meanX = (sumX[0] + sumX[1] + sumX[2] + sumX[3]) / fit.n;
+    fit.meanY = (sumY[0] + sumY[1] + sumY[2] + sumY[3]) / fit.n;
+
+    // Second pass around the means, the raw sums of squares lose everything to cancellation
+    double sxx[4] = { 0.0, 0.0, 0.0, 0.0 };
+    double sxy[4] = { 0.0, 0.0, 0.0, 0.0 };
+
+    for(i = 0; i + 4 <= n; i += 4)
+    {
+        for(int k = 0; k < 4; k++)
+        {
+            double dx = x[i + k] - fit.meanX;
+            sxx[k] += dx * dx;
+            sxy[k] += dx * (y[i + k] - fit.meanY);
+        }
+    }
+
+    for(; i < n; i++)
+    {
+        double dx = x[i] - fit.meanX;
+        sxx[0] += dx * dx;
+        sxy[0] += dx * (y[i] - fit.meanY);
+    }
+
+    fit.sxx = sxx[0] + sxx[1] + sxx[2] + sxx[3];
+    fit.sxy = sxy[0] + sxy[1] + sxy[2] + sxy[3];
+
+    return fit;
+}
+
+// a becomes the fit of the points of both, without another pass over them
+static void MergeLine(LineFit &a, const LineFit &b)
+{
+    double n = a.n + b.n;
+    double dx = b.meanX - a.meanX;
+    double dy = b.meanY - a.meanY;
+    double weight = a.n * b.n / n;
+
+    a.sxx += b.sxx + weight * dx * dx;
+    a.sxy += b.sxy + weight * dx * dy;
+    a.meanX += dx * b.n / n;
+    a.meanY += dy * b.n / n;
+    a.n = n;
+}
+
+// Bits per second of the TS over a line of PCR ticks against TS bytes
+static double LineBitsPerSecond(const LineFit &fit)
+{
+    double ticksPerByte = fit.Slope();
+
+    return ticksPerByte > 0.0 ? 8.0 * PCR_CLOCK / ticksPerByte : 0.0;
+}
+
+// Smallest and largest of n values, in four lanes like FitLine
+static void MinMax(const float *p, size_t n, float &lo, float &hi)
+{
+    float low[4] = { lo, lo, lo, lo };
+    float high[4] = { hi, hi, hi, hi };
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        for(int k = 0; k < 4; k++)
+        {
+            low[k] = p[i + k] < low[k] ? p[i + k] : low[k];
+            high[k] = p[i + k] > high[k] ? p[i + k] : high[k];
+        }
+    }
+
+    for(; i < n; i++)
+    {
+        low[0] = p[i] < low[0] ? p[i] : low[0];
+        high[0] = p[i] > high[0] ? p[i] : high[0];
+    }
+
+    for(int k = 0; k < 4; k++)
+    {
+        lo = low[k] < lo ? low[k] : lo;
+        hi = high[k] > hi ? high[k] : hi;
+    }
+}
+
+PCRTrack::PCRTrack(uint16_t pid)
+    : m_pid(pid)
+    , m_lastPCR(0)
+    , m_lastArrival(0)
+{
+    memset(&m_summary, 0, sizeof(m_summary));
+}
+
+void PCRTrack::Add(uint64_t offset, uint64_t pcr, bool bNewRun, bool bArrivalTimes, uint32_t arrivalTime)
+{
+    if(m_offsets.empty())
+        bNewRun = true;
+
+    if(bNewRun)
+        m_runs.push_back((uint32_t) m_offsets.size());
+
+    // Within a run a PCR only moves forward, by less than a wrap
+    m_pcrs.push_back(bNewRun ? pcr : m_pcrs.back() + (pcr + PCR_WRAP - m_lastPCR) % PCR_WRAP);
+    m_offsets.push_back(offset);
+    m_lastPCR = pcr;
+
+    // The arrival clock runs on over PCR discontinuities
+    if(bArrivalTimes)
+    {
+        arrivalTime &= ARRIVAL_MASK;
+        m_arrivals.push_back(m_arrivals.empty() ? arrivalTime : m_arrivals.back() + ((arrivalTime - m_lastArrival) & ARRIVAL_MASK));
+        m_lastArrival = arrivalTime;
+    }
+}
+
+size_t PCRTrack::FirstSampleAt(uint64_t offset) const
+{
+    size_t low = 0;
+    size_t high = m_offsets.size();
+
+    while(low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if(m_offsets[middle] < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+void PCRTrack::Analyze(unsigned int packetSize)
+{
+    size_t n = m_offsets.size();
+
+    m_bitsPerSecond.assign(n, 0.f);
+    m_segmentBitsPerSecond.assign(n, 0.f);
+    m_accuracyNs.assign(n, 0.f);
+    m_jitterNs.assign(m_arrivals.size() == n ? n : 0, 0.f);
+    m_segments.clear();
+
+    memset(&m_summary, 0, sizeof(m_summary));
+    m_summary.samples = (uint32_t) n;
+    m_summary.runs = (uint32_t) m_runs.size();
+    m_summary.bArrivalTimes = !m_jitterNs.empty();
+
+    if(0 == n)
+        return;
+
+    m_summary.minBitsPerSecond = HUGE_VAL;
+
+    double runBytes = 0.0;
+    double runTicks = 0.0;
+
+    for(size_t r = 0; r < m_runs.size(); r++)
+    {
+        uint32_t first = m_runs[r];
+        uint32_t end = r + 1 < m_runs.size() ? m_runs[r + 1] : (uint32_t) n;
+
+        AnalyzeRun(first, end, packetSize);
+
+        runBytes += (double) (m_offsets[end - 1] - m_offsets[first]) * TS_PACKET_BYTES / packetSize;
+        runTicks += (double) (m_pcrs[end - 1] - m_pcrs[first]);
+    }
+
+    std::vector<double>().swap(m_x);
+    std::vector<double>().swap(m_y);
+
+    if(m_summary.minBitsPerSecond > m_summary.maxBitsPerSecond)
+        m_summary.minBitsPerSecond = 0.0;
+
+    m_summary.meanBitsPerSecond = runTicks > 0.0 ? runBytes * 8.0 * PCR_CLOCK / runTicks : 0.0;
+
+    float lo = 0.f;
+    float hi = 0.f;
+    MinMax(m_accuracyNs.data(), n, lo, hi);
+    m_summary.maxAccuracyNs = hi > -lo ? hi : -lo;
+
+    uint32_t errors = 0;
+
+    for(size_t i = 0; i < n; i++)
+        errors += fabsf(m_accuracyNs[i]) > PCR_ACCURACY_NS;
+
+    m_summary.accuracyErrors = errors;
+
+    lo = hi = 0.f;
+    MinMax(m_summary.bArrivalTimes ? m_jitterNs.data() : m_accuracyNs.data(), n, lo, hi);
+    m_summary.minJitterNs = lo;
+    m_summary.maxJitterNs = hi;
+}
+
+void PCRTrack::AnalyzeRun(uint32_t first, uint32_t end, unsigned int packetSize)
+{
+    uint32_t count = end - first;
+    double bytesPerPacketByte = TS_PACKET_BYTES / packetSize;
+
+    m_x.resize(count);
+    m_y.resize(count);
+
+    double *x = m_x.data();
+    double *y = m_y.data();
+
+    // TS bytes and PCR ticks from the start of the run, small enough to keep every bit
+    for(uint32_t j = 0; j < count; j++)
+    {
+        x[j] = (double) (m_offsets[first + j] - m_offsets[first]) * bytesPerPacketByte;
+        y[j] = (double) (m_pcrs[first + j] - m_pcrs[first]);
+    }
+
+    // Instantaneous rate, constant from one PCR to the next
+    float *pBitsPerSecond = m_bitsPerSecond.data() + first;
+    double maxTicks = 0.0;
+
+    for(uint32_t j = 1; j < count; j++)
+    {
+        double ticks = y[j] - y[j - 1];
+        pBitsPerSecond[j] = ticks > 0.0 ? (float) ((x[j] - x[j - 1]) * 8.0 * PCR_CLOCK / ticks) : 0.f;
+        maxTicks = ticks > maxTicks ? ticks : maxTicks;
+    }
+
+    if(count > 1)
+    {
+        float lo = (float) m_summary.minBitsPerSecond;
+        float hi = (float) m_summary.maxBitsPerSecond;
+        MinMax(pBitsPerSecond + 1, count - 1, lo, hi);
+
+        m_summary.minBitsPerSecond = lo;
+        m_summary.maxBitsPerSecond = hi;
+    }
+
+    if(maxTicks / 27000.0 > m_summary.maxIntervalMs)
+        m_summary.maxIntervalMs = maxTicks / 27000.0;
+
+    // Piecewise constant rate, a line per window merged while the rates agree
+    size_t firstSegment = m_segments.size();
+    std::vector<LineFit> fits;
+
+    for(uint32_t j = 0; j < count; )
+    {
+        uint32_t k = j + 1;
+
+        while(k < count && (y[k] - y[j] < PCR_WINDOW_TICKS || k - j < PCR_WINDOW_MIN_SAMPLES))
+            k++;
+
+        LineFit fit = FitLine(x + j, y + j, k - j);
+        double bitsPerSecond = LineBitsPerSecond(fit);
+
+        if(!fits.empty())
+        {
+            PCRSegment &last = m_segments.back();
+            bool bShort = k - j < PCR_WINDOW_MIN_SAMPLES;
+
+            if(bShort || fabs(bitsPerSecond - last.bitsPerSecond) < PCR_RATE_TOLERANCE * last.bitsPerSecond)
+            {
+                MergeLine(fits.back(), fit);
+                last.end = first + k;
+                last.bitsPerSecond = LineBitsPerSecond(fits.back());
+                j = k;
+                continue;
+            }
+        }
+
+        PCRSegment segment = { first + j, first + k, bitsPerSecond };
+        m_segments.push_back(segment);
+        fits.push_back(fit);
+
+        j = k;
+    }
+
+    // Accuracy, how far each PCR is from its segment's line
+    for(size_t s = firstSegment; s < m_segments.size(); s++)
+    {
+        const PCRSegment &segment = m_segments[s];
+        const LineFit &fit = fits[s - firstSegment];
+        float bitsPerSecond = (float) segment.bitsPerSecond;
+
+        for(uint32_t i = segment.first; i < segment.end; i++)
+        {
+            uint32_t j = i - first;
+
+            m_accuracyNs[i] = (float) ((y[j] - fit.At(x[j])) * 1.0e9 / PCR_CLOCK);
+            m_segmentBitsPerSecond[i] = bitsPerSecond;
+        }
+    }
+
+    if(m_jitterNs.empty())
+        return;
+
+    // Jitter, the PCR less the arrival time, less the drift of one clock against the other
+    for(uint32_t j = 0; j < count; j++)
+    {
+        x[j] = (double) (m_arrivals[first + j] - m_arrivals[first]);
+        y[j] = (double) (m_pcrs[first + j] - m_pcrs[first]) - x[j];
+    }
+
+    for(size_t s = firstSegment; s < m_segments.size(); s++)
+    {
+        const PCRSegment &segment = m_segments[s];
+        uint32_t j0 = segment.first - first;
+
+        LineFit fit = FitLine(x + j0, y + j0, segment.end - segment.first);
+
+        for(uint32_t i = segment.first; i < segment.end; i++)
+        {
+            uint32_t j = i - first;
+
+            m_jitterNs[i] = (float) ((y[j] - fit.At(x[j])) * 1.0e9 / PCR_CLOCK);
+        }
+    }
+}
+
+PCRAnalysis::PCRAnalysis()
+    : m_packetSize(188)
+{
+}
+
+void PCRAnalysis::Reset(unsigned int packetSize)
+{
+    m_packetSize = packetSize;
+    m_trackOfPID.assign(MAX_PID, -1);
+    m_tracks.clear();
+}
+
+void PCRAnalysis::Add(uint16_t pid, uint64_t offset, uint64_t pcr, bool bNewRun, uint32_t arrivalTime)
+{
+    MemoryScope memoryScope(eMemPCR);
+
+    if(m_trackOfPID[pid] < 0)
+    {
+        m_trackOfPID[pid] = (int16_t) m_tracks.size();
+        m_tracks.push_back(PCRTrack(pid));
+    }
+
+    m_tracks[m_trackOfPID[pid]].Add(offset, pcr, bNewRun, 192 == m_packetSize, arrivalTime);
+}
+
+void PCRAnalysis::Analyze()
+{
+    MemoryScope memoryScope(eMemPCR);
+
+    for(size_t i = 0; i < m_tracks.size(); i++)
+        m_tracks[i].Analyze(m_packetSize);
+}
+
+bool PCRAnalysis::WriteCSV(const char *fileName) const
+{
+    FILE *fp = fopen(fileName, "w");
+
+    if(!fp)
+        return false;
+
+    fprintf(fp, "pid,offset,pcr,bits_per_second,segment_bits_per_second,accuracy_ns,jitter_ns\n");
+
+    for(size_t t = 0; t < m_tracks.size(); t++)
+    {
+        const PCRTrack &track = m_tracks[t];
+
+        for(size_t i = 0; i < track.Samples(); i++)
+        {
+            fprintf(fp, "%u,%llu,%llu,%.0f,%.0f,%.1f,%.1f\n", track.PID(),
+                    (unsigned long long) track.Offset(i), (unsigned long long) track.PCR(i),
+                    track.BitsPerSecond(i), track.SegmentBitsPerSecond(i), track.AccuracyNs(i), track.JitterNs(i));
+        }
+    }
+
+    return 0 == fclose(fp);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// TR 101 290 2.4: a PCR more than 500 ns from where the TS rate puts it
+#define PCR_ACCURACY_NS 500.0
+
+// A stretch of PCRs over which the TS rate is taken to be constant
+struct PCRSegment
+{
+    uint32_t    first;              // First sample
+    uint32_t    end;                // One past the last sample
+    double      bitsPerSecond;      // Least squares fit of TS bytes against PCR time
+};
+
+struct PCRSummary
+{
+    uint32_t    samples;
+    uint32_t    runs;               // Stretches without a discontinuity
+    double      minBitsPerSecond;   // Instantaneous, from one PCR to the next
+    double      maxBitsPerSecond;
+    double      meanBitsPerSecond;  // TS bytes over PCR time of every run
+    double      maxIntervalMs;
+    double      maxAccuracyNs;      // Largest distance of a PCR from its segment's rate
+    uint32_t    accuracyErrors;     // PCRs past PCR_ACCURACY_NS
+    double      minJitterNs;
+    double      maxJitterNs;
+    bool        bArrivalTimes;      // Jitter is against the arrival timestamps of 192 byte packets
+};
+
+/*
+    The PCRs of one PID and what they say about the TS rate.
+
+    Between two PCRs the TS rate is constant, so the instantaneous rate of
+    each sample is the TS bytes from the PCR before it over the time between
+    them.  The piecewise constant rate is a least squares line of PCR time
+    against TS bytes, fitted over windows of about a second; neighbouring
+    windows whose rates agree to PCR_RATE_TOLERANCE are merged into one
+    segment.  The accuracy of a PCR is its distance in time from its segment's
+    line.  With 192 byte packets the jitter is the PCR against the arrival
+    timestamp of its packet, less the line through both clocks that takes out
+    their drift.  Without arrival times it is the accuracy, the timing a
+    receiver fed at the constant rate would see.
+
+    A discontinuity_indicator, a PCR going back or jumping past 100 ms starts
+    a new run, and nothing is fitted across runs.
+*/
+class PCRTrack
+{
+public:
+
+    PCRTrack(uint16_t pid);
+
+    uint16_t PID() const { return m_pid; }
+
+    size_t Samples() const { return m_offsets.size(); }
+
+    // Byte offset in the file of the packet of sample i
+    uint64_t Offset(size_t i) const { return m_offsets[i]; }
+    uint64_t PCR(size_t i) const { return m_pcrs[i]; }
+
+    // Results of Analyze()
+    float BitsPerSecond(size_t i) const { return m_bitsPerSecond[i]; }     // 0 for the first of a run
+    float SegmentBitsPerSecond(size_t i) const { return m_segmentBitsPerSecond[i]; }
+    float AccuracyNs(size_t i) const { return m_accuracyNs[i]; }
+    float JitterNs(size_t i) const { return m_jitterNs.empty() ? m_accuracyNs[i] : m_jitterNs[i]; }
+
+    const std::vector<PCRSegment> &Segments() const { return m_segments; }
+    const PCRSummary &Summary() const { return m_summary; }
+
+    // First sample at or after offset
+    size_t FirstSampleAt(uint64_t offset) const;
+
+private:
+
+    friend class PCRAnalysis;
+
+    void Add(uint64_t offset, uint64_t pcr, bool bNewRun, bool bArrivalTimes, uint32_t arrivalTime);
+    void Analyze(unsigned int packetSize);
+    void AnalyzeRun(uint32_t first, uint32_t end, unsigned int packetSize);
+
+    uint16_t                m_pid;
+    uint64_t                m_lastPCR;          // As read, for unwrapping
+    uint32_t                m_lastArrival;
+    std::vector<uint64_t>   m_offsets;
+    std::vector<uint64_t>   m_pcrs;             // Unwrapped within a run
+    std::vector<uint64_t>   m_arrivals;         // Unwrapped 27 MHz arrival timestamps, none for 188 byte packets
+    std::vector<uint32_t>   m_runs;             // First sample of each run
+
+    std::vector<float>      m_bitsPerSecond;
+    std::vector<float>      m_segmentBitsPerSecond;
+    std::vector<float>      m_accuracyNs;
+    std::vector<float>      m_jitterNs;
+    std::vector<PCRSegment> m_segments;
+    PCRSummary              m_summary;
+
+    // Scratch of AnalyzeRun, bytes and ticks from the start of the run
+    std::vector<double>     m_x;
+    std::vector<double>     m_y;
+};
+
+/*
+    The PCR tracks of a TS, one per PID that carries a PCR, in the order the
+    PIDs were first seen.  Samples are added during a pass over the packet
+    headers, Analyze() then works out the rates, accuracy and jitter.
+*/
+class PCRAnalysis
+{
+public:
+
+    PCRAnalysis();
+
+    void Reset(unsigned int packetSize);
+
+    // bNewRun for the first PCR of a PID and after a discontinuity.  arrivalTime is the
+    // 30 bit arrival_time_stamp of a 192 byte packet.
+    void Add(uint16_t pid, uint64_t offset, uint64_t pcr, bool bNewRun, uint32_t arrivalTime);
+
+    void Analyze();
+
+    size_t Tracks() const { return m_tracks.size(); }
+    const PCRTrack &Track(size_t i) const { return m_tracks[i]; }
+
+    // Every sample of every track as comma separated values, false if fileName could not be written
+    bool WriteCSV(const char *fileName) const;
+
+private:
+
+    unsigned int            m_packetSize;
+    std::vector<int16_t>    m_trackOfPID;       // -1 for a PID without PCRs
+    std::vector<PCRTrack>   m_tracks;
+};
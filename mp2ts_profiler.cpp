@@ -0,0 +1,165 @@
+#include "mp2ts_profiler.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+
+// About 24 MB of events, a few minutes of playback with every stage timed
+#define MAX_TRACE_EVENTS (1024 * 1024)
+
+struct ProfileEvent
+{
+    uint64_t    start;
+    uint32_t    duration;   // ns, a single scope is well under 4 s
+    uint16_t    stage;
+    uint16_t    thread;
+};
+
+std::atomic<bool> g_bProfilerEnabled(false);
+
+static const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+static std::mutex g_eventsMutex;
+static std::vector<ProfileEvent> g_events;
+static uint64_t g_droppedEvents = 0;
+
+// Time spent in each stage during the current GUI frame
+static std::atomic<uint64_t> g_frameNanoseconds[eProfileNumStages];
+static uint64_t g_frameStart = 0;
+
+// The last slot holds the whole GUI frame
+static float g_history[eProfileNumStages + 1][PROFILER_HISTORY];
+static int g_historyOffset = 0;
+
+static std::atomic<uint16_t> g_nextThread(0);
+
+static const char *g_stageNames[eProfileNumStages] =
+{
+    "Read",
+    "FindData",
+    "av_read_frame",
+    "avcodec_send_packet",
+    "avcodec_receive_frame",
+    "sws_scale",
+    "Texture upload",
+    "ImGui",
+    "Present"
+};
+
+static uint16_t ThreadIndex()
+{
+    static thread_local uint16_t thread = g_nextThread.fetch_add(1);
+    return thread;
+}
+
+void ProfilerEnable(bool bEnable)
+{
+    if(bEnable && !ProfilerEnabled())
+    {
+        std::lock_guard<std::mutex> lock(g_eventsMutex);
+
+        if(g_events.capacity() < MAX_TRACE_EVENTS)
+            g_events.reserve(MAX_TRACE_EVENTS);
+
+        g_frameStart = ProfilerNow();
+    }
+
+    g_bProfilerEnabled.store(bEnable, std::memory_order_relaxed);
+}
+
+uint64_t ProfilerNow()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_epoch).count();
+}
+
+void ProfilerRecord(eProfileStage stage, uint64_t start, uint64_t end)
+{
+    uint64_t duration = end - start;
+
+    g_frameNanoseconds[stage].fetch_add(duration, std::memory_order_relaxed);
+
+    ProfileEvent event;
+    event.start = start;
+    event.duration = duration > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t) duration;
+    event.stage = (uint16_t) stage;
+    event.thread = ThreadIndex();
+
+    std::lock_guard<std::mutex> lock(g_eventsMutex);
+
+    if(g_events.size() < MAX_TRACE_EVENTS)
+        g_events.push_back(event);
+    else
+        g_droppedEvents++;
+}
+
+void ProfilerEndFrame()
+{
+    if(!ProfilerEnabled())
+        return;
+
+    uint64_t now = ProfilerNow();
+
+    for(int stage = 0; stage < eProfileNumStages; stage++)
+        g_history[stage][g_historyOffset] = (float) g_frameNanoseconds[stage].exchange(0, std::memory_order_relaxed) / 1e6f;
+
+    g_history[eProfileNumStages][g_historyOffset] = (float) (now - g_frameStart) / 1e6f;
+
+    g_frameStart = now;
+    g_historyOffset = (g_historyOffset + 1) % PROFILER_HISTORY;
+}
+
+const char *ProfileStageName(eProfileStage stage)
+{
+    return stage < eProfileNumStages ? g_stageNames[stage] : "Frame";
+}
+
+const float *ProfilerHistory(eProfileStage stage, int &offset)
+{
+    offset = g_historyOffset;
+    return g_history[stage];
+}
+
+uint64_t ProfilerEventCount()
+{
+    std::lock_guard<std::mutex> lock(g_eventsMutex);
+    return g_events.size();
+}
+
+uint64_t ProfilerDroppedEvents()
+{
+    std::lock_guard<std::mutex> lock(g_eventsMutex);
+    return g_droppedEvents;
+}
+
+bool ProfilerWriteChromeTrace(const char *fileName)
+{
+    FILE *fp = fopen(fileName, "wb");
+
+    if(!fp)
+    {
+        fprintf(stderr, "Error: Could not create %s\n", fileName);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_eventsMutex);
+
+    // Complete ("X") events, timestamps in microseconds
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for(size_t i = 0; i < g_events.size(); i++)
+    {
+        const ProfileEvent &event = g_events[i];
+
+        fprintf(fp, "{\"name\":\"%s\",\"cat\":\"mp2ts\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}%s\n",
+                g_stageNames[event.stage], (double) event.start / 1000.0, (double) event.duration / 1000.0,
+                event.thread, i + 1 < g_events.size() ? "," : "");
+    }
+
+    fprintf(fp, "]}\n");
+
+    bool bOK = 0 == ferror(fp);
+    fclose(fp);
+
+    return bOK;
+}
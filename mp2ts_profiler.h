@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+    Scoped timers on the stages of the frame pipeline.
+
+    PROFILE_SCOPE(eProfileFindData) times the rest of the enclosing block.
+    While the profiler is off that costs one relaxed atomic load and a branch,
+    building with MP2TS_NO_PROFILER removes the timers completely.
+
+    Every timed scope becomes a Chrome trace event, and its time is added to
+    the current GUI frame's total for that stage.  ProfilerEndFrame() closes
+    a GUI frame and pushes the totals into the history the Performance window plots.
+*/
+
+enum eProfileStage
+{
+    eProfileRead,           // InputSource reads of the transport stream
+    eProfileFindData,       // Cutting the ES payload out of TS packets
+    eProfileDemux,          // av_read_frame, includes its reads
+    eProfileSendPacket,     // avcodec_send_packet
+    eProfileReceiveFrame,   // avcodec_receive_frame
+    eProfileConvert,        // sws_scale to RGBA in WriteFrame
+    eProfileUpload,         // Texture upload and draw
+    eProfileImGui,          // Building and rendering the ImGui draw lists
+    eProfilePresent,        // glfwSwapBuffers
+    eProfileNumStages
+};
+
+// GUI frames kept for the Performance window graphs
+#define PROFILER_HISTORY 240
+
+extern std::atomic<bool> g_bProfilerEnabled;
+
+inline bool ProfilerEnabled()
+{
+    return g_bProfilerEnabled.load(std::memory_order_relaxed);
+}
+
+void ProfilerEnable(bool bEnable);
+
+// Nanoseconds since the profiler started
+uint64_t ProfilerNow();
+
+void ProfilerRecord(eProfileStage stage, uint64_t start, uint64_t end);
+
+// Closes a GUI frame
+void ProfilerEndFrame();
+
+const char *ProfileStageName(eProfileStage stage);
+
+// Milliseconds per GUI frame spent in stage, a ring of PROFILER_HISTORY values starting at offset.
+// eProfileNumStages gives the wall time of the whole GUI frame.
+const float *ProfilerHistory(eProfileStage stage, int &offset);
+
+// Trace events recorded so far, and how many were dropped because the buffer was full
+uint64_t ProfilerEventCount();
+uint64_t ProfilerDroppedEvents();
+
+// Writes every recorded event as a Chrome trace (chrome://tracing, Perfetto)
+bool ProfilerWriteChromeTrace(const char *fileName);
+
+class ProfileScope
+{
+public:
+
+    ProfileScope(eProfileStage stage)
+        : m_stage(stage)
+        , m_bActive(ProfilerEnabled())
+        , m_start(m_bActive ? ProfilerNow() : 0)
+    {
+    }
+
+    ~ProfileScope()
+    {
+        if(m_bActive)
+            ProfilerRecord(m_stage, m_start, ProfilerNow());
+    }
+
+private:
+    eProfileStage   m_stage;
+    bool            m_bActive;
+    uint64_t        m_start;
+};
+
+#ifdef MP2TS_NO_PROFILER
+    #define PROFILE_SCOPE(stage)
+#else
+    #define PROFILE_CONCAT_(a, b) a##b
+    #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+    #define PROFILE_SCOPE(stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(stage)
+#endif
@@ -0,0 +1,790 @@
+#include "mp2ts_programs.h"
+#include "mp2ts_xml.h"
+#include "mp2ts_demux.h"
+#include "mp2ts_memory.h"
+#include "mp2ts_mpeg2.h"
+#include "mp2ts_avc.h"
+
+// FFMPEG
+extern "C"
+{
+    #include <libavcodec/avcodec.h>
+    #include <libavutil/frame.h>
+}
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+// Buffers in the ring between the reader and the workers, and the packets in each
+#define PROGRAM_READ_BLOCKS 4
+#define PROGRAM_BLOCK_PACKETS 16384
+
+// How far into a video PES its picture type is looked for
+#define PROGRAM_TYPE_SCAN_BYTES (64 * 1024)
+
+// Largest picture buffered whole, to be decoded or have its headers parsed
+#define PROGRAM_MAX_DECODE_BYTES (8 * 1024 * 1024)
+
+// Every this many rows and columns of a decoded picture a luma sample is taken
+#define PROGRAM_LUMA_STEP 4
+
+// PCR steps above this are a discontinuity, not time
+#define PROGRAM_PCR_MAX_STEP (27000000ull / 10)
+
+#define PTS_WRAP (1ull << 33)
+
+enum
+{
+    ePictureI,
+    ePictureP,
+    ePictureB,
+    ePictureUnknown,
+};
+
+/*
+    The analysis of one program, only ever run on one worker.
+
+    A video PES is taken to be one picture.  MPEG-1/2, H.264 and HEVC pictures
+    are buffered whole and their headers parsed when the next PES starts, which
+    gives the type, and the quantiser_scale of every slice of MPEG-1/2.  The
+    type of an H.264 or HEVC picture is that of its most predicted slice, which
+    takes the SPS and PPS for HEVC.  MPEG-4 payload is only buffered until the
+    VOP header that gives the type is found.  An I frame that is to be decoded
+    is buffered whole and sent to the decoder when the next PES starts.
+*/
+class ProgramTask
+{
+public:
+
+    ProgramTask(const TransportProgram &program, const std::vector<ElementaryStream> &streams);
+    ~ProgramTask();
+
+    long VideoPID() const { return m_report.videoPID; }
+    long AudioPID() const { return m_report.audioPID; }
+    long PCRPID() const { return m_pcrPID; }
+
+    void Packet(const uint8_t *pPacket, unsigned int packetSize, const TSPacketHeader &header);
+
+    // After the last packet
+    void Finish();
+
+    const ProgramReport &Report() const { return m_report; }
+
+private:
+
+    ProgramTask(const ProgramTask &);
+    ProgramTask &operator=(const ProgramTask &);
+
+    void PCR(const TSPacketHeader &header);
+    void VideoPayload(const uint8_t *p, const uint8_t *pEnd, bool bStart);
+    void AudioPES(const uint8_t *p, const uint8_t *pEnd);
+
+    void FindPictureType();
+    void ParseHeaders();
+    void Picture(int type);
+    void EndPicture();
+    void Decode();
+
+    ProgramReport       m_report;
+    long                m_pcrPID;
+    int                 m_videoStreamType;
+    bool                m_bParseHeaders;    // MPEG-1/2, H.264 and HEVC
+    MPEG2HeaderParser   m_mpeg2;
+    AVCHeaderParser     m_avc;
+
+    // Time and packets between continuous PCRs
+    bool                m_bHasPCR;
+    uint64_t            m_lastPCR;
+    uint64_t            m_packetsAtLastPCR;
+    uint64_t            m_pcrTicks;
+    uint64_t            m_pcrPackets;
+
+    // The video PES being looked at
+    std::vector<uint8_t> m_es;
+    size_t              m_scanPos;
+    bool                m_bInPicture;
+    bool                m_bTypeKnown;
+    bool                m_bDecodeThis;
+    bool                m_bHasVideoPTS;
+    uint64_t            m_lastVideoPTS;
+
+    bool                m_bInGOP;
+    uint32_t            m_framesInGOP;
+    double              m_sumGOPLength;
+    double              m_sumAVOffsetMs;
+    double              m_sumQuantiserScale;
+    uint32_t            m_quantisedPictures;
+
+    uint32_t            m_iFrames;
+    double              m_sumLuma;
+    AVCodecContext      *m_pCodecContext;
+    AVFrame             *m_pFrame;
+};
+
+static AVCodecID CodecOfStreamType(int streamType)
+{
+    switch(streamType)
+    {
+    case eMPEG1_Video:              return AV_CODEC_ID_MPEG1VIDEO;
+    case eMPEG2_Video:              return AV_CODEC_ID_MPEG2VIDEO;
+    case eMPEG4_Video:              return AV_CODEC_ID_MPEG4;
+    case eH264_Video:               return AV_CODEC_ID_H264;
+    case eHEVC_Video:               return AV_CODEC_ID_HEVC;
+    default:                        return AV_CODEC_ID_NONE;
+    }
+}
+
+ProgramTask::ProgramTask(const TransportProgram &program, const std::vector<ElementaryStream> &streams)
+    : m_pcrPID(program.pcrPID)
+    , m_videoStreamType(eReserved)
+    , m_bParseHeaders(false)
+    , m_bHasPCR(false)
+    , m_lastPCR(0)
+    , m_packetsAtLastPCR(0)
+    , m_pcrTicks(0)
+    , m_pcrPackets(0)
+    , m_scanPos(0)
+    , m_bInPicture(false)
+    , m_bTypeKnown(false)
+    , m_bDecodeThis(false)
+    , m_bHasVideoPTS(false)
+    , m_lastVideoPTS(0)
+    , m_bInGOP(false)
+    , m_framesInGOP(0)
+    , m_sumGOPLength(0.0)
+    , m_sumAVOffsetMs(0.0)
+    , m_sumQuantiserScale(0.0)
+    , m_quantisedPictures(0)
+    , m_iFrames(0)
+    , m_sumLuma(0.0)
+    , m_pCodecContext(NULL)
+    , m_pFrame(NULL)
+{
+    memset(&m_report, 0, sizeof(m_report));
+    m_report.programNumber = program.programNumber;
+    m_report.videoPID = -1;
+    m_report.audioPID = -1;
+
+    for(size_t i = 0; i < program.streams.size(); i++)
+    {
+        const ElementaryStream &stream = streams[program.streams[i]];
+
+        if(eStreamKindVideo == stream.kind && m_report.videoPID < 0)
+        {
+            m_report.videoPID = stream.esd.pid;
+            m_videoStreamType = stream.esd.streamType;
+        }
+        else if(eStreamKindAudio == stream.kind && m_report.audioPID < 0)
+        {
+            m_report.audioPID = stream.esd.pid;
+        }
+    }
+
+    m_bParseHeaders = eMPEG1_Video == m_videoStreamType || eMPEG2_Video == m_videoStreamType ||
+                      eH264_Video == m_videoStreamType || eHEVC_Video == m_videoStreamType;
+    m_avc.Reset(eHEVC_Video == m_videoStreamType);
+
+    // One thread per decoder, the programs already keep the cores busy
+    const AVCodec *pCodec = avcodec_find_decoder(CodecOfStreamType(m_videoStreamType));
+
+    if(pCodec)
+    {
+        m_pCodecContext = avcodec_alloc_context3(pCodec);
+
+        if(m_pCodecContext)
+        {
+            m_pCodecContext->thread_count = 1;
+
+            if(avcodec_open2(m_pCodecContext, pCodec, NULL) < 0)
+                avcodec_free_context(&m_pCodecContext);
+        }
+
+        if(m_pCodecContext)
+            m_pFrame = av_frame_alloc();
+    }
+}
+
+ProgramTask::~ProgramTask()
+{
+    if(m_pFrame)
+        av_frame_free(&m_pFrame);
+
+    if(m_pCodecContext)
+        avcodec_free_context(&m_pCodecContext);
+}
+
+void ProgramTask::Packet(const uint8_t *pPacket, unsigned int packetSize, const TSPacketHeader &header)
+{
+    m_report.packets++;
+
+    if(header.bHasPCR && header.pid == m_pcrPID)
+        PCR(header);
+
+    if(header.transportScramblingControl || !(header.adaptationFieldControl & 1))
+        return;
+
+    // payloadOffset is from the start of the packet, with the timestamp of a 192 byte one
+    const uint8_t *p = pPacket + header.payloadOffset;
+    const uint8_t *pEnd = pPacket + packetSize;
+
+    if(p >= pEnd)
+        return;
+
+    if(header.pid == m_report.videoPID)
+        VideoPayload(p, pEnd, 0 != header.payloadUnitStartIndicator);
+    else if(header.pid == m_report.audioPID && header.payloadUnitStartIndicator)
+        AudioPES(p, pEnd);
+}
+
+void ProgramTask::PCR(const TSPacketHeader &header)
+{
+    uint64_t pcr = header.pcr;
+
+    if(m_bHasPCR && !header.discontinuityIndicator && pcr > m_lastPCR && pcr - m_lastPCR <= PROGRAM_PCR_MAX_STEP)
+    {
+        m_pcrTicks += pcr - m_lastPCR;
+        m_pcrPackets += m_report.packets - m_packetsAtLastPCR;
+    }
+
+    m_bHasPCR = true;
+    m_lastPCR = pcr;
+    m_packetsAtLastPCR = m_report.packets;
+}
+
+void ProgramTask::VideoPayload(const uint8_t *p, const uint8_t *pEnd, bool bStart)
+{
+    if(bStart)
+    {
+        EndPicture();
+
+        PESHeader pes;
+        int headerSize = ParsePESHeader(p, pEnd, pes);
+
+        if(headerSize < 0)
+            return;
+
+        if(pes.bHasPTS)
+        {
+            m_lastVideoPTS = pes.pts;
+            m_bHasVideoPTS = true;
+        }
+
+        p += headerSize;
+
+        m_bInPicture = true;
+        m_bTypeKnown = false;
+        m_bDecodeThis = false;
+        m_es.clear();
+        m_scanPos = 0;
+
+        if(AV_CODEC_ID_NONE == CodecOfStreamType(m_videoStreamType))
+        {
+            Picture(ePictureUnknown);
+            return;
+        }
+    }
+
+    if(!m_bInPicture || (m_bTypeKnown && !m_bDecodeThis))
+        return;
+
+    m_es.insert(m_es.end(), p, pEnd);
+
+    if(m_bParseHeaders || m_bDecodeThis)
+    {
+        // A PES too big to be a picture
+        if(m_es.size() > PROGRAM_MAX_DECODE_BYTES)
+        {
+            if(!m_bTypeKnown)
+                Picture(ePictureUnknown);
+
+            m_bDecodeThis = false;
+            m_es.clear();
+        }
+
+        return;
+    }
+
+    FindPictureType();
+
+    if(!m_bTypeKnown && m_es.size() > PROGRAM_TYPE_SCAN_BYTES)
+        Picture(ePictureUnknown);
+
+    if(m_bTypeKnown && !m_bDecodeThis)
+        m_es.clear();
+}
+
+void ProgramTask::FindPictureType()
+{
+    const uint8_t *p = m_es.data();
+    size_t size = m_es.size();
+
+    for(; m_scanPos + 6 <= size; m_scanPos++)
+    {
+        const uint8_t *q = p + m_scanPos;
+
+        if(q[2] > 1)
+        {
+            // Cannot be within a start code for two more bytes
+            m_scanPos += 2;
+            continue;
+        }
+
+        if(0 != q[0] || 0 != q[1] || 1 != q[2])
+            continue;
+
+        // vop_start_code, vop_coding_type, S(GMC) VOPs are counted with P
+        if(0xB6 == q[3])
+        {
+            int type = q[4] >> 6;
+            Picture(0 == type ? ePictureI : 2 == type ? ePictureB : ePictureP);
+            return;
+        }
+    }
+}
+
+void ProgramTask::Picture(int type)
+{
+    m_bTypeKnown = true;
+    m_report.frames++;
+    m_report.framesOfType[type]++;
+
+    if(ePictureI == type)
+    {
+        if(m_bInGOP)
+        {
+            if(0 == m_report.gops || m_framesInGOP < m_report.minGOPLength)
+                m_report.minGOPLength = m_framesInGOP;
+
+            if(m_framesInGOP > m_report.maxGOPLength)
+                m_report.maxGOPLength = m_framesInGOP;
+
+            m_sumGOPLength += m_framesInGOP;
+            m_report.gops++;
+        }
+
+        m_bInGOP = true;
+        m_framesInGOP = 0;
+
+        if(m_pCodecContext && 0 == m_iFrames++ % PROGRAM_DECODE_EVERY)
+            m_bDecodeThis = true;
+    }
+
+    m_framesInGOP++;
+}
+
+void ProgramTask::EndPicture()
+{
+    if(!m_bInPicture)
+        return;
+
+    if(m_bParseHeaders && !m_bTypeKnown)
+        ParseHeaders();
+
+    if(!m_bTypeKnown)
+        Picture(ePictureUnknown);
+
+    if(m_bDecodeThis)
+        Decode();
+
+    m_bInPicture = false;
+    m_bDecodeThis = false;
+    m_es.clear();
+}
+
+void ProgramTask::ParseHeaders()
+{
+    if(eH264_Video == m_videoStreamType || eHEVC_Video == m_videoStreamType)
+    {
+        AVCPicture picture;
+
+        if(m_avc.Parse(m_es.data(), m_es.size(), picture))
+            Picture('I' == picture.type ? ePictureI : 'P' == picture.type ? ePictureP : 'B' == picture.type ? ePictureB : ePictureUnknown);
+
+        return;
+    }
+
+    MPEG2Picture picture;
+
+    if(!m_mpeg2.Parse(m_es.data(), m_es.size(), picture))
+        return;
+
+    Picture('I' == picture.type ? ePictureI : 'P' == picture.type ? ePictureP : 'B' == picture.type ? ePictureB : ePictureUnknown);
+
+    if(picture.slices)
+    {
+        m_sumQuantiserScale += picture.meanQuantiserScale;
+        m_quantisedPictures++;
+    }
+}
+
+void ProgramTask::Decode()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    AVPacket packet;
+    av_init_packet(&packet);
+
+    if(av_new_packet(&packet, (int) m_es.size()) < 0)
+    {
+        m_report.decodeErrors++;
+        return;
+    }
+
+    memcpy(packet.data, m_es.data(), m_es.size());
+
+    bool bDecoded = false;
+    int ret = avcodec_send_packet(m_pCodecContext, &packet);
+    av_packet_unref(&packet);
+
+    if(ret >= 0)
+    {
+        // Drain, the picture is on its own
+        avcodec_send_packet(m_pCodecContext, NULL);
+
+        while(avcodec_receive_frame(m_pCodecContext, m_pFrame) >= 0)
+        {
+            if(!bDecoded && m_pFrame->data[0])
+            {
+                uint64_t sum = 0;
+                uint64_t samples = 0;
+
+                for(int y = 0; y < m_pFrame->height; y += PROGRAM_LUMA_STEP)
+                {
+                    const uint8_t *pRow = m_pFrame->data[0] + (ptrdiff_t) y * m_pFrame->linesize[0];
+
+                    for(int x = 0; x < m_pFrame->width; x += PROGRAM_LUMA_STEP)
+                        sum += pRow[x];
+
+                    samples += (m_pFrame->width + PROGRAM_LUMA_STEP - 1) / PROGRAM_LUMA_STEP;
+                }
+
+                double luma = samples ? (double) sum / (double) samples : 0.0;
+
+                if(0 == m_report.framesDecoded || luma < m_report.minLuma)
+                    m_report.minLuma = luma;
+
+                m_sumLuma += luma;
+                m_report.width = m_pFrame->width;
+                m_report.height = m_pFrame->height;
+                m_report.framesDecoded++;
+                bDecoded = true;
+            }
+
+            av_frame_unref(m_pFrame);
+        }
+    }
+
+    // Out of draining for the next one
+    avcodec_flush_buffers(m_pCodecContext);
+
+    if(!bDecoded)
+        m_report.decodeErrors++;
+
+    m_report.decodeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ProgramTask::AudioPES(const uint8_t *p, const uint8_t *pEnd)
+{
+    PESHeader pes;
+
+    if(ParsePESHeader(p, pEnd, pes) < 0 || !pes.bHasPTS || !m_bHasVideoPTS)
+        return;
+
+    // Signed distance across the 33 bit wrap
+    int64_t delta = (int64_t) ((pes.pts - m_lastVideoPTS) & (PTS_WRAP - 1));
+
+    if(delta >= (int64_t) (PTS_WRAP / 2))
+        delta -= (int64_t) PTS_WRAP;
+
+    double offsetMs = (double) delta / 90.0;
+
+    if(0 == m_report.avSamples || offsetMs < m_report.minAVOffsetMs)
+        m_report.minAVOffsetMs = offsetMs;
+
+    if(0 == m_report.avSamples || offsetMs > m_report.maxAVOffsetMs)
+        m_report.maxAVOffsetMs = offsetMs;
+
+    m_sumAVOffsetMs += offsetMs;
+    m_report.avSamples++;
+}
+
+void ProgramTask::Finish()
+{
+    EndPicture();
+
+    if(m_pcrTicks)
+        m_report.bitsPerSecond = (double) m_pcrPackets * 188.0 * 8.0 * 27000000.0 / (double) m_pcrTicks;
+
+    if(m_report.gops)
+        m_report.meanGOPLength = m_sumGOPLength / m_report.gops;
+
+    if(m_report.avSamples)
+        m_report.meanAVOffsetMs = m_sumAVOffsetMs / m_report.avSamples;
+
+    if(m_report.framesDecoded)
+        m_report.meanLuma = m_sumLuma / m_report.framesDecoded;
+
+    if(m_quantisedPictures)
+        m_report.meanQuantiserScale = m_sumQuantiserScale / m_quantisedPictures;
+
+    // Without a decoded frame the size is the sequence header's, or the SPS's
+    if(0 == m_report.framesDecoded && m_mpeg2.Sequence().bValid)
+    {
+        m_report.width = m_mpeg2.Sequence().width;
+        m_report.height = m_mpeg2.Sequence().height;
+    }
+    else if(0 == m_report.framesDecoded && m_avc.Sequence().bValid)
+    {
+        m_report.width = m_avc.Sequence().width;
+        m_report.height = m_avc.Sequence().height;
+    }
+}
+
+ProgramAnalyzer::ProgramAnalyzer()
+    : m_packetSize(188)
+    , m_numWorkers(0)
+    , m_seconds(0.0)
+    , m_blocksRead(0)
+    , m_bEndOfInput(false)
+    , m_bytesRead(0)
+    , m_bytesTotal(0)
+    , m_bStarted(false)
+    , m_bCancel(false)
+    , m_bDone(false)
+{
+}
+
+ProgramAnalyzer::~ProgramAnalyzer()
+{
+    Cancel();
+
+    if(m_thread.joinable())
+        m_thread.join();
+
+    for(size_t i = 0; i < m_tasks.size(); i++)
+        delete m_tasks[i];
+}
+
+bool ProgramAnalyzer::Start(const MpegTS_XML &mpts, eInputBackend backend, unsigned int numWorkers)
+{
+    if(m_bStarted)
+        return false;
+
+    InputSource *pInput = CreateInputSource(backend);
+    const std::string &fileName = mpts.m_mpegTSDescriptor.fileName;
+
+    if(!pInput || !pInput->Open(fileName))
+    {
+        fprintf(stderr, "Error: Could not open %s for the program analysis\n", fileName.c_str());
+        delete pInput;
+        return false;
+    }
+
+    m_bStarted = true;
+    m_bytesTotal = pInput->Size();
+    m_thread = std::thread(&ProgramAnalyzer::ThreadMain, this, &mpts, pInput, numWorkers);
+
+    return true;
+}
+
+void ProgramAnalyzer::ThreadMain(const MpegTS_XML *pMpts, InputSource *pInput, unsigned int numWorkers)
+{
+    Run(*pMpts, pInput, numWorkers);
+
+    pInput->Close();
+    delete pInput;
+}
+
+void ProgramAnalyzer::Cancel()
+{
+    m_bCancel.store(true, std::memory_order_relaxed);
+}
+
+bool ProgramAnalyzer::Run(const MpegTS_XML &mpts, InputSource *pInput, unsigned int numWorkers)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for(size_t i = 0; i < m_tasks.size(); i++)
+        delete m_tasks[i];
+
+    m_tasks.clear();
+    m_reports.clear();
+
+    m_packetSize = mpts.m_mpegTSDescriptor.packetSize ? mpts.m_mpegTSDescriptor.packetSize : 188;
+
+    const std::vector<TransportProgram> &programs = mpts.Programs();
+
+    for(size_t i = 0; i < programs.size(); i++)
+        m_tasks.push_back(new ProgramTask(programs[i], mpts.Streams()));
+
+    if(0 == numWorkers)
+        numWorkers = std::max(1u, std::thread::hardware_concurrency());
+
+    m_numWorkers = std::max<unsigned int>(1, std::min<unsigned int>(numWorkers, (unsigned int) m_tasks.size()));
+
+    // Round robin, a PID shared by two programs goes to the first
+    m_taskOfPID.assign(m_numWorkers, std::vector<int16_t>(MAX_PID, -1));
+
+    for(size_t i = 0; i < m_tasks.size(); i++)
+    {
+        std::vector<int16_t> &taskOfPID = m_taskOfPID[i % m_numWorkers];
+        long pids[3] = { m_tasks[i]->VideoPID(), m_tasks[i]->AudioPID(), m_tasks[i]->PCRPID() };
+
+        for(int k = 0; k < 3; k++)
+        {
+            if(pids[k] >= 0 && pids[k] < MAX_PID && taskOfPID[pids[k]] < 0)
+                taskOfPID[pids[k]] = (int16_t) i;
+        }
+    }
+
+    const uint8_t *pMapped = pInput->Data();
+    uint64_t fileSize = pInput->Size();
+    size_t blockBytes = (size_t) PROGRAM_BLOCK_PACKETS * m_packetSize;
+
+    m_blocks.assign(PROGRAM_READ_BLOCKS, Block());
+
+    for(size_t i = 0; i < m_blocks.size(); i++)
+    {
+        m_blocks[i].pData = NULL;
+        m_blocks[i].size = 0;
+        m_blocks[i].offset = 0;
+        m_blocks[i].sequence = 0;
+        m_blocks[i].pending = 0;
+
+        if(!pMapped)
+        {
+            MemoryScope memoryScope(eMemInputBuffers);
+            m_blocks[i].buffer.resize(blockBytes);
+        }
+    }
+
+    m_blocksRead = 0;
+    m_bEndOfInput = false;
+    m_bytesTotal = fileSize;
+    m_bytesRead.store(0, std::memory_order_relaxed);
+
+    std::vector<std::thread> workers;
+
+    for(unsigned int w = 0; w < m_numWorkers; w++)
+        workers.push_back(std::thread(&ProgramAnalyzer::WorkerMain, this, w));
+
+    bool bOK = true;
+    uint64_t offset = 0;
+
+    for(uint64_t sequence = 0; offset + m_packetSize <= fileSize && !m_bCancel.load(std::memory_order_relaxed); sequence++)
+    {
+        Block &block = m_blocks[sequence % PROGRAM_READ_BLOCKS];
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_blockFree.wait(lock, [&block] { return 0 == block.pending; });
+        }
+
+        size_t size = (size_t) std::min<uint64_t>(blockBytes, (fileSize - offset) / m_packetSize * m_packetSize);
+
+        if(pMapped)
+        {
+            block.pData = pMapped + offset;
+        }
+        else
+        {
+            if(!pInput->ReadAt(offset, block.buffer.data(), size))
+            {
+                fprintf(stderr, "Error: Could not read the TS at %llu for the program analysis\n", (unsigned long long) offset);
+                bOK = false;
+                break;
+            }
+
+            block.pData = block.buffer.data();
+        }
+
+        block.size = size;
+        block.offset = offset;
+        block.sequence = sequence;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            block.pending = m_numWorkers;
+            m_blocksRead = sequence + 1;
+        }
+
+        m_blockReady.notify_all();
+
+        offset += size;
+        m_bytesRead.store(offset, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bEndOfInput = true;
+    }
+
+    m_blockReady.notify_all();
+
+    for(size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+
+    for(size_t i = 0; i < m_tasks.size(); i++)
+    {
+        m_tasks[i]->Finish();
+        m_reports.push_back(m_tasks[i]->Report());
+    }
+
+    m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_bDone.store(true, std::memory_order_release);
+
+    return bOK;
+}
+
+void ProgramAnalyzer::WorkerMain(unsigned int worker)
+{
+    const std::vector<int16_t> &taskOfPID = m_taskOfPID[worker];
+    unsigned int syncOffset = 192 == m_packetSize ? 4 : 0;
+
+    for(uint64_t sequence = 0; ; sequence++)
+    {
+        Block *pBlock;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_blockReady.wait(lock, [this, sequence] { return m_blocksRead > sequence || m_bEndOfInput; });
+
+            if(m_blocksRead <= sequence)
+                break;
+
+            // The reader does not come back to this buffer until every worker is done with it
+            pBlock = &m_blocks[sequence % PROGRAM_READ_BLOCKS];
+        }
+
+        for(size_t pos = 0; pos + m_packetSize <= pBlock->size; pos += m_packetSize)
+        {
+            const uint8_t *pPacket = pBlock->pData + pos;
+            const uint8_t *pHeader = pPacket + syncOffset;
+
+            if(0x47 != pHeader[0])
+                continue;
+
+            int16_t task = taskOfPID[((pHeader[1] & 0x1F) << 8) | pHeader[2]];
+
+            if(task < 0)
+                continue;
+
+            TSPacketHeader header;
+
+            if(ParsePacketHeader(pPacket, m_packetSize, header))
+                m_tasks[task]->Packet(pPacket, m_packetSize, header);
+        }
+
+        bool bFree;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            bFree = 0 == --pBlock->pending;
+        }
+
+        if(bFree)
+            m_blockFree.notify_one();
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "mp2ts_input.h"
+
+class MpegTS_XML;
+class ProgramTask;
+
+// Every this many I frames of a program one is decoded
+#define PROGRAM_DECODE_EVERY 10
+
+// What one pass over the TS found out about one program
+struct ProgramReport
+{
+    uint16_t    programNumber;
+    long        videoPID;           // -1 if the program has no video
+    long        audioPID;           // -1 if the program has no audio
+    uint64_t    packets;            // Of the video, audio and PCR PIDs
+    double      bitsPerSecond;      // Those packets over the PCR time they span, 0 without two PCRs
+
+    // GOPs, from the picture headers of the video
+    uint32_t    frames;
+    uint32_t    framesOfType[4];    // I, P, B and pictures whose type was not found
+    uint32_t    gops;               // I frame to I frame
+    uint32_t    minGOPLength;
+    uint32_t    maxGOPLength;
+    double      meanGOPLength;
+
+    // A/V sync: PTS of each audio PES less the PTS of the last video PES before it, in ms.
+    // Muxers send video ahead of its audio, a drift or jump in this is an A/V sync problem.
+    uint32_t    avSamples;
+    double      minAVOffsetMs;
+    double      maxAVOffsetMs;
+    double      meanAVOffsetMs;
+
+    // MPEG-1/2: mean quantiser_scale of the slices, rises as a service is starved of bits
+    double      meanQuantiserScale;
+
+    // Decode sampling
+    uint32_t    framesDecoded;
+    uint32_t    decodeErrors;
+    double      decodeMs;           // Total
+    int         width;              // Of a decoded frame, else of the MPEG-1/2 sequence header
+    int         height;
+    double      meanLuma;           // Of the sampled frames, 0 to 255
+    double      minLuma;            // Darkest sampled frame, near 16 for black
+};
+
+/*
+    Analyzes every program of an MPTS in one pass over the TS, each program on
+    one of a pool of worker threads.
+
+    The calling thread reads the file once, in blocks that go round a ring of
+    PROGRAM_READ_BLOCKS buffers; with a backend that maps the file the blocks
+    point into the mapping and nothing is copied.  Every worker looks at every
+    block, but through its own PID table only handles the packets of the
+    programs it was given, so the programs are shared out over the cores and no
+    packet is handed between threads.  A buffer is read into again once every
+    worker is done with it.
+
+    For each program its worker finds the picture type of every video PES to
+    count GOPs, compares the PTS of each audio PES with that of the last video
+    PES, and decodes one in every PROGRAM_DECODE_EVERY I frames on a decoder
+    of its own.  Results can be read once IsDone().
+*/
+class ProgramAnalyzer
+{
+public:
+
+    ProgramAnalyzer();
+    ~ProgramAnalyzer();
+
+    // Analyzes the programs of mpts on the calling thread and numWorkers workers, 0 for one per core.
+    // False if the TS could not be read.
+    bool Run(const MpegTS_XML &mpts, InputSource *pInput, unsigned int numWorkers);
+
+    // Runs on a background thread, with its own InputSource of backend.  mpts must outlive the run.
+    bool Start(const MpegTS_XML &mpts, eInputBackend backend, unsigned int numWorkers);
+    void Cancel();
+
+    bool IsStarted() const { return m_bStarted; }
+    bool IsDone() const { return m_bDone.load(std::memory_order_acquire); }
+
+    uint64_t BytesRead() const { return m_bytesRead.load(std::memory_order_relaxed); }
+    uint64_t BytesTotal() const { return m_bytesTotal; }
+
+    unsigned int Workers() const { return m_numWorkers; }
+    double Seconds() const { return m_seconds; }
+
+    size_t Programs() const { return m_reports.size(); }
+    const ProgramReport &Report(size_t i) const { return m_reports[i]; }
+
+private:
+
+    ProgramAnalyzer(const ProgramAnalyzer &);
+    ProgramAnalyzer &operator=(const ProgramAnalyzer &);
+
+    struct Block
+    {
+        std::vector<uint8_t>    buffer;
+        const uint8_t           *pData;
+        size_t                  size;
+        uint64_t                offset;
+        uint64_t                sequence;
+        unsigned int            pending;    // Workers still looking at it
+    };
+
+    void WorkerMain(unsigned int worker);
+    void ThreadMain(const MpegTS_XML *pMpts, InputSource *pInput, unsigned int numWorkers);
+
+    unsigned int                m_packetSize;
+    unsigned int                m_numWorkers;
+    std::vector<ProgramTask*>   m_tasks;
+    std::vector<std::vector<int16_t> > m_taskOfPID;    // By worker, then PID, -1 for none
+    std::vector<ProgramReport>  m_reports;
+    double                      m_seconds;
+
+    std::vector<Block>          m_blocks;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_blockReady;
+    std::condition_variable     m_blockFree;
+    uint64_t                    m_blocksRead;       // Sequence numbers below this are in m_blocks
+    bool                        m_bEndOfInput;
+
+    std::atomic<uint64_t>       m_bytesRead;
+    uint64_t                    m_bytesTotal;
+    bool                        m_bStarted;
+    std::atomic<bool>           m_bCancel;
+    std::atomic<bool>           m_bDone;
+    std::thread                 m_thread;
+};
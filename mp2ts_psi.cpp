@@ -0,0 +1,483 @@
+#include "mp2ts_psi.h"
+#include "mp2ts_demux.h"
+
+#include <cstring>
+
+// Largest section, section_length is 12 bits
+#define PSI_MAX_SECTION 4096
+
+#define MAX_PID 8192
+
+// Table 2-2 and ETSI EN 300 468
+#define TABLE_PAT 0x00
+#define TABLE_PMT 0x02
+#define TABLE_SDT_ACTUAL 0x42
+#define TABLE_EIT_PF_ACTUAL 0x4E
+#define TABLE_EIT_SCHEDULE_ACTUAL_FIRST 0x50
+#define TABLE_EIT_SCHEDULE_ACTUAL_LAST 0x5F
+#define TABLE_EIT_FIRST 0x4E
+#define TABLE_EIT_LAST 0x6F
+
+#define DESCRIPTOR_SERVICE 0x48
+#define DESCRIPTOR_SHORT_EVENT 0x4D
+
+// Slice-by-8: t[k][i] is the CRC of byte i followed by k zero bytes
+struct CRCTables
+{
+    uint32_t t[8][256];
+
+    CRCTables()
+    {
+        for(int i = 0; i < 256; i++)
+        {
+            uint32_t crc = (uint32_t) i << 24;
+
+            for(int bit = 0; bit < 8; bit++)
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+
+            t[0][i] = crc;
+        }
+
+        for(int k = 1; k < 8; k++)
+            for(int i = 0; i < 256; i++)
+                t[k][i] = (t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> 24];
+    }
+};
+
+static const CRCTables g_crcTables;
+
+uint32_t SectionCRC32(const uint8_t *p, size_t size)
+{
+    const uint32_t (*t)[256] = g_crcTables.t;
+    uint32_t crc = 0xFFFFFFFF;
+
+    // The eight lookups of a step do not depend on each other
+    while(size >= 8)
+    {
+        uint32_t high = crc ^ ((uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3]);
+
+        crc = t[7][high >> 24] ^ t[6][(high >> 16) & 0xFF] ^ t[5][(high >> 8) & 0xFF] ^ t[4][high & 0xFF] ^
+              t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+
+        p += 8;
+        size -= 8;
+    }
+
+    while(size--)
+        crc = (crc << 8) ^ t[0][(crc >> 24) ^ *p++];
+
+    return crc;
+}
+
+// A DVB string without its character table selector, printable bytes only
+static std::string DVBText(const uint8_t *p, size_t size)
+{
+    if(size && 0x10 == p[0])
+    {
+        size_t skip = size < 3 ? size : 3;
+        p += skip;
+        size -= skip;
+    }
+    else if(size && p[0] < 0x20)
+    {
+        p++;
+        size--;
+    }
+
+    std::string text;
+
+    for(size_t i = 0; i < size; i++)
+        if(p[i] >= 0x20 && p[i] != 0x7F)
+            text += (char) p[i];
+
+    return text;
+}
+
+PSITables::PSITables()
+{
+    Reset();
+}
+
+void PSITables::Reset()
+{
+    m_roles.assign(MAX_PID, 0);
+    m_roles[PSI_PID_PAT] = PSI_ROLE_SECTIONS;
+    m_roles[PSI_PID_SDT] = PSI_ROLE_SECTIONS;
+    m_roles[PSI_PID_EIT] = PSI_ROLE_SECTIONS;
+
+    m_bufferOfPID.assign(MAX_PID, -1);
+    m_buffers.clear();
+
+    m_sectionStates.clear();
+    m_tableVersions.clear();
+
+    m_transportStreamId = -1;
+    m_programs.clear();
+    m_programIndex.clear();
+    m_services.clear();
+    m_serviceIndex.clear();
+    m_versionChanges.clear();
+
+    m_sections = 0;
+    m_sectionsParsed = 0;
+    m_crcErrors = 0;
+    m_versionChangeCount = 0;
+    m_lastFailedTableId = 0;
+}
+
+unsigned int PSITables::Packet(const TSPacketHeader &header, const uint8_t *pPayload, const uint8_t *pEnd, uint64_t offset)
+{
+    // Sections are never scrambled
+    if(header.transportScramblingControl || !(header.adaptationFieldControl & 1) || pPayload >= pEnd)
+        return 0;
+
+    uint16_t pid = header.pid;
+
+    if(m_bufferOfPID[pid] < 0)
+    {
+        SectionBuffer empty;
+        empty.lastCC = -1;
+
+        m_bufferOfPID[pid] = (int16_t) m_buffers.size();
+        m_buffers.push_back(empty);
+    }
+
+    SectionBuffer &buffer = m_buffers[m_bufferOfPID[pid]];
+
+    // A repeated packet adds nothing, a lost one leaves a hole in the section being read
+    int cc = header.continuityCounter;
+
+    if(buffer.lastCC >= 0 && !header.discontinuityIndicator)
+    {
+        if(cc == buffer.lastCC)
+            return 0;
+
+        if(cc != ((buffer.lastCC + 1) & 0x0F))
+            buffer.data.clear();
+    }
+
+    buffer.lastCC = cc;
+
+    unsigned int failures = 0;
+
+    if(header.payloadUnitStartIndicator)
+    {
+        // pointer_field, the bytes before the new section end the one being read
+        const uint8_t *pStart = pPayload + 1 + *pPayload;
+
+        if(pStart > pEnd)
+        {
+            buffer.data.clear();
+            return 0;
+        }
+
+        if(!buffer.data.empty())
+        {
+            buffer.data.insert(buffer.data.end(), pPayload + 1, pStart);
+            failures += Drain(pid, buffer, offset);
+            buffer.data.clear();
+        }
+
+        pPayload = pStart;
+    }
+    else if(buffer.data.empty())
+    {
+        // Not in a section, its start was lost
+        return 0;
+    }
+
+    buffer.data.insert(buffer.data.end(), pPayload, pEnd);
+
+    return failures + Drain(pid, buffer, offset);
+}
+
+unsigned int PSITables::Drain(uint16_t pid, SectionBuffer &buffer, uint64_t offset)
+{
+    std::vector<uint8_t> &data = buffer.data;
+    unsigned int failures = 0;
+    size_t pos = 0;
+
+    while(data.size() - pos >= 3)
+    {
+        // Stuffing fills the rest of the packet
+        if(0xFF == data[pos])
+        {
+            pos = data.size();
+            break;
+        }
+
+        size_t size = 3 + (((data[pos + 1] & 0x0F) << 8) | data[pos + 2]);
+
+        if(size > PSI_MAX_SECTION)
+        {
+            pos = data.size();
+            break;
+        }
+
+        if(data.size() - pos < size)
+            break;
+
+        if(!Section(pid, &data[pos], size, offset))
+            failures++;
+
+        pos += size;
+    }
+
+    data.erase(data.begin(), data.begin() + pos);
+
+    return failures;
+}
+
+bool PSITables::Section(uint16_t pid, const uint8_t *p, size_t size, uint64_t offset)
+{
+    m_sections++;
+
+    uint8_t tableId = p[0];
+
+    // Only the long form has a version and a CRC_32
+    if(!(p[1] & 0x80) || size < 12)
+        return true;
+
+    if(0 != SectionCRC32(p, size))
+    {
+        m_crcErrors++;
+        m_lastFailedTableId = tableId;
+        return false;
+    }
+
+    // current_next_indicator
+    if(!(p[5] & 0x01))
+        return true;
+
+    uint16_t extension = (p[3] << 8) | p[4];
+    uint8_t version = (p[5] >> 1) & 0x1F;
+    uint8_t sectionNumber = p[6];
+    uint32_t crc = (uint32_t) p[size - 4] << 24 | (uint32_t) p[size - 3] << 16 | (uint32_t) p[size - 2] << 8 | p[size - 1];
+
+    // An EIT of another TS can use the same service_id
+    uint16_t eitTransportStreamId = tableId >= TABLE_EIT_FIRST && tableId <= TABLE_EIT_LAST && size >= 14 ? (p[8] << 8) | p[9] : 0;
+
+    uint64_t tableKey = (uint64_t) pid << 48 | (uint64_t) tableId << 40 | (uint64_t) extension << 24 | (uint64_t) eitTransportStreamId << 8;
+
+    std::unordered_map<uint64_t, SectionState>::iterator known = m_sectionStates.find(tableKey | sectionNumber);
+
+    // A repeat of what was parsed already
+    if(known != m_sectionStates.end() && crc == known->second.crc && version == known->second.version)
+        return true;
+
+    std::unordered_map<uint64_t, uint8_t>::iterator table = m_tableVersions.find(tableKey);
+
+    if(table == m_tableVersions.end())
+    {
+        m_tableVersions[tableKey] = version;
+    }
+    else if(table->second != version)
+    {
+        m_versionChangeCount++;
+
+        if(m_versionChanges.size() < PSI_MAX_VERSION_CHANGES)
+        {
+            PSIVersionChange change = { offset, pid, tableId, extension, table->second, version };
+            m_versionChanges.push_back(change);
+        }
+
+        table->second = version;
+    }
+
+    SectionState state = { crc, version };
+    m_sectionStates[tableKey | sectionNumber] = state;
+    m_sectionsParsed++;
+
+    if(TABLE_PAT == tableId && PSI_PID_PAT == pid)
+    {
+        m_transportStreamId = extension;
+        ParsePAT(p, size);
+    }
+    else if(TABLE_PMT == tableId && (m_roles[pid] & PSI_ROLE_PMT))
+    {
+        ParsePMT(pid, p, size);
+    }
+    else if(TABLE_SDT_ACTUAL == tableId && PSI_PID_SDT == pid)
+    {
+        ParseSDT(p, size);
+    }
+    else if((TABLE_EIT_PF_ACTUAL == tableId || (tableId >= TABLE_EIT_SCHEDULE_ACTUAL_FIRST && tableId <= TABLE_EIT_SCHEDULE_ACTUAL_LAST)) && PSI_PID_EIT == pid)
+    {
+        ParseEIT(p, size);
+    }
+
+    return true;
+}
+
+PSIProgram &PSITables::Program(uint16_t programNumber)
+{
+    std::unordered_map<uint16_t, size_t>::iterator i = m_programIndex.find(programNumber);
+
+    if(i != m_programIndex.end())
+        return m_programs[i->second];
+
+    PSIProgram program;
+    program.programNumber = programNumber;
+    program.pmtPID = 0x1FFF;
+    program.pcrPID = 0x1FFF;
+    program.version = -1;
+
+    m_programIndex[programNumber] = m_programs.size();
+    m_programs.push_back(program);
+
+    return m_programs.back();
+}
+
+PSIService &PSITables::Service(uint16_t serviceId)
+{
+    std::unordered_map<uint16_t, size_t>::iterator i = m_serviceIndex.find(serviceId);
+
+    if(i != m_serviceIndex.end())
+        return m_services[i->second];
+
+    PSIService service;
+    service.serviceId = serviceId;
+    service.serviceType = 0;
+    service.runningStatus = 0;
+    service.eitSections = 0;
+
+    m_serviceIndex[serviceId] = m_services.size();
+    m_services.push_back(service);
+
+    return m_services.back();
+}
+
+void PSITables::ParsePAT(const uint8_t *p, size_t size)
+{
+    const uint8_t *pEnd = p + size - 4;
+
+    for(const uint8_t *q = p + 8; q + 4 <= pEnd; q += 4)
+    {
+        uint16_t programNumber = (q[0] << 8) | q[1];
+        uint16_t pid = ((q[2] & 0x1F) << 8) | q[3];
+
+        // Program 0 is the network PID
+        if(0 == programNumber)
+            continue;
+
+        Program(programNumber).pmtPID = pid;
+        m_roles[pid] |= PSI_ROLE_PMT | PSI_ROLE_SECTIONS;
+    }
+}
+
+void PSITables::ParsePMT(uint16_t pid, const uint8_t *p, size_t size)
+{
+    const uint8_t *pEnd = p + size - 4;
+
+    if(size < 16)
+        return;
+
+    PSIProgram &program = Program((p[3] << 8) | p[4]);
+    program.pmtPID = pid;
+    program.pcrPID = ((p[8] & 0x1F) << 8) | p[9];
+    program.version = (p[5] >> 1) & 0x1F;
+    program.streams.clear();
+
+    unsigned int programInfoLength = ((p[10] & 0x0F) << 8) | p[11];
+
+    // stream_type, elementary_PID, ES_info_length and the descriptors
+    for(const uint8_t *q = p + 12 + programInfoLength; q + 5 <= pEnd; )
+    {
+        PSIStream stream;
+        stream.streamType = q[0];
+        stream.pid = ((q[1] & 0x1F) << 8) | q[2];
+
+        program.streams.push_back(stream);
+        m_roles[stream.pid] |= PSI_ROLE_ES;
+
+        q += 5 + (((q[3] & 0x0F) << 8) | q[4]);
+    }
+}
+
+void PSITables::ParseSDT(const uint8_t *p, size_t size)
+{
+    const uint8_t *pEnd = p + size - 4;
+
+    // service_id, EIT flags, running_status and the descriptors
+    for(const uint8_t *q = p + 11; q + 5 <= pEnd; )
+    {
+        PSIService &service = Service((q[0] << 8) | q[1]);
+        service.runningStatus = q[3] >> 5;
+
+        const uint8_t *pDescriptor = q + 5;
+        const uint8_t *pDescriptorsEnd = pDescriptor + (((q[3] & 0x0F) << 8) | q[4]);
+
+        if(pDescriptorsEnd > pEnd)
+            pDescriptorsEnd = pEnd;
+
+        for(; pDescriptor + 2 <= pDescriptorsEnd; pDescriptor += 2 + pDescriptor[1])
+        {
+            const uint8_t *d = pDescriptor + 2;
+            const uint8_t *dEnd = d + pDescriptor[1];
+
+            if(DESCRIPTOR_SERVICE != pDescriptor[0] || dEnd > pDescriptorsEnd || dEnd - d < 3)
+                continue;
+
+            service.serviceType = d[0];
+
+            unsigned int providerLength = d[1];
+
+            if(d + 2 + providerLength + 1 > dEnd)
+                continue;
+
+            service.provider = DVBText(d + 2, providerLength);
+
+            const uint8_t *pName = d + 2 + providerLength;
+            unsigned int nameLength = pName[0];
+
+            if(pName + 1 + nameLength <= dEnd)
+                service.name = DVBText(pName + 1, nameLength);
+        }
+
+        q = pDescriptorsEnd;
+    }
+}
+
+void PSITables::ParseEIT(const uint8_t *p, size_t size)
+{
+    if(size < 18)
+        return;
+
+    PSIService &service = Service((p[3] << 8) | p[4]);
+    service.eitSections++;
+
+    // Section 0 of the present/following table is the present event, 1 the following
+    uint8_t sectionNumber = p[6];
+
+    if(TABLE_EIT_PF_ACTUAL != p[0] || sectionNumber > 1)
+        return;
+
+    std::string &eventName = 0 == sectionNumber ? service.presentEvent : service.followingEvent;
+    eventName.clear();
+
+    const uint8_t *pEnd = p + size - 4;
+    const uint8_t *q = p + 14;
+
+    // event_id, start_time, duration, running_status and the descriptors of the first event
+    if(q + 12 > pEnd)
+        return;
+
+    const uint8_t *pDescriptor = q + 12;
+    const uint8_t *pDescriptorsEnd = pDescriptor + (((q[10] & 0x0F) << 8) | q[11]);
+
+    if(pDescriptorsEnd > pEnd)
+        pDescriptorsEnd = pEnd;
+
+    for(; pDescriptor + 2 <= pDescriptorsEnd; pDescriptor += 2 + pDescriptor[1])
+    {
+        const uint8_t *d = pDescriptor + 2;
+        const uint8_t *dEnd = d + pDescriptor[1];
+
+        // ISO_639_language_code, then the event_name
+        if(DESCRIPTOR_SHORT_EVENT == pDescriptor[0] && dEnd <= pDescriptorsEnd && dEnd - d >= 4 && d + 4 + d[3] <= dEnd)
+        {
+            eventName = DVBText(d + 4, d[3]);
+            return;
+        }
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+struct TSPacketHeader;
+
+#define PSI_PID_PAT 0x0000
+#define PSI_PID_SDT 0x0011
+#define PSI_PID_EIT 0x0012
+
+// Version changes kept for display, the count goes on past it
+#define PSI_MAX_VERSION_CHANGES 10000
+
+// What the PAT and PMTs say a PID carries
+enum
+{
+    PSI_ROLE_SECTIONS = 1,      // PAT, SDT, EIT or a PMT, reassembled here
+    PSI_ROLE_PMT = 2,           // Listed in the PAT
+    PSI_ROLE_ES = 4,            // Listed in a PMT
+};
+
+// CRC_32 of ISO/IEC 13818-1 Annex A over size bytes.  0 over a whole section with its CRC_32.
+uint32_t SectionCRC32(const uint8_t *p, size_t size);
+
+struct PSIStream
+{
+    uint16_t    pid;
+    uint8_t     streamType;
+};
+
+struct PSIProgram
+{
+    uint16_t                programNumber;
+    uint16_t                pmtPID;
+    uint16_t                pcrPID;         // 0x1FFF until the PMT is seen
+    int                     version;        // Of the PMT, -1 until it is seen
+    std::vector<PSIStream>  streams;
+};
+
+struct PSIService
+{
+    uint16_t    serviceId;
+    uint8_t     serviceType;
+    uint8_t     runningStatus;
+    std::string provider;
+    std::string name;
+    uint32_t    eitSections;    // New or changed EIT sections of the service
+    std::string presentEvent;   // Names from the present/following EIT
+    std::string followingEvent;
+};
+
+struct PSIVersionChange
+{
+    uint64_t    offset;         // Byte offset of the packet that completed the section
+    uint16_t    pid;
+    uint8_t     tableId;
+    uint16_t    extension;      // table_id_extension: transport_stream_id, program_number or service_id
+    uint8_t     oldVersion;
+    uint8_t     newVersion;
+};
+
+/*
+    Reassembles the PAT, the PMTs, the SDT and the EIT from the TS packets of
+    their PIDs, checks each section's CRC_32 and tracks table versions.
+
+    The packets of a PID are appended to its buffer from the section start the
+    pointer_field gives, a section is taken off the front once section_length
+    bytes are in, and several sections in one packet are each taken.  A lost or
+    out of order packet drops what is buffered until the next section start.
+
+    Tables repeat many times a second, so a section is only parsed when it is
+    new or its CRC_32 changed since it was last seen under the same PID,
+    table_id, extension and section_number.  A repeat costs its CRC and one
+    hash lookup.  The CRC runs eight bytes at a time through eight tables.
+
+    Programs and services are kept once seen, a version change updates them.
+    Only sections with current_next_indicator set are used.
+*/
+class PSITables
+{
+public:
+
+    PSITables();
+
+    void Reset();
+
+    uint8_t Role(uint16_t pid) const { return m_roles[pid]; }
+
+    // Payload of a packet of a PID with PSI_ROLE_SECTIONS.  Returns the number of
+    // sections in it that failed their CRC_32, LastFailedTableId() is the table_id of the last.
+    unsigned int Packet(const TSPacketHeader &header, const uint8_t *pPayload, const uint8_t *pEnd, uint64_t offset);
+
+    uint8_t LastFailedTableId() const { return m_lastFailedTableId; }
+
+    int TransportStreamId() const { return m_transportStreamId; }   // -1 until the PAT is seen
+
+    const std::vector<PSIProgram> &Programs() const { return m_programs; }
+    const std::vector<PSIService> &Services() const { return m_services; }
+    const std::vector<PSIVersionChange> &VersionChanges() const { return m_versionChanges; }
+
+    uint64_t Sections() const { return m_sections; }                // Complete sections
+    uint64_t SectionsParsed() const { return m_sectionsParsed; }    // New or changed ones
+    uint64_t CRCErrors() const { return m_crcErrors; }
+    uint64_t VersionChangeCount() const { return m_versionChangeCount; }
+
+private:
+
+    struct SectionBuffer
+    {
+        std::vector<uint8_t>    data;
+        int                     lastCC;     // -1 before the first packet
+    };
+
+    struct SectionState
+    {
+        uint32_t    crc;
+        uint8_t     version;
+    };
+
+    // Takes the complete sections off the front of buffer, returns the CRC failures
+    unsigned int Drain(uint16_t pid, SectionBuffer &buffer, uint64_t offset);
+    bool Section(uint16_t pid, const uint8_t *p, size_t size, uint64_t offset);
+
+    void ParsePAT(const uint8_t *p, size_t size);
+    void ParsePMT(uint16_t pid, const uint8_t *p, size_t size);
+    void ParseSDT(const uint8_t *p, size_t size);
+    void ParseEIT(const uint8_t *p, size_t size);
+
+    PSIProgram &Program(uint16_t programNumber);
+    PSIService &Service(uint16_t serviceId);
+
+    std::vector<uint8_t>                        m_roles;            // By PID
+    std::vector<int16_t>                        m_bufferOfPID;      // -1 for none yet
+    std::vector<SectionBuffer>                  m_buffers;
+
+    std::unordered_map<uint64_t, SectionState>  m_sectionStates;    // By PID, table_id, extension, EIT transport_stream_id and section_number
+    std::unordered_map<uint64_t, uint8_t>       m_tableVersions;    // The same without section_number
+
+    int                                         m_transportStreamId;
+    std::vector<PSIProgram>                     m_programs;
+    std::unordered_map<uint16_t, size_t>        m_programIndex;
+    std::vector<PSIService>                     m_services;
+    std::unordered_map<uint16_t, size_t>        m_serviceIndex;
+    std::vector<PSIVersionChange>               m_versionChanges;
+
+    uint64_t                                    m_sections;
+    uint64_t                                    m_sectionsParsed;
+    uint64_t                                    m_crcErrors;
+    uint64_t                                    m_versionChangeCount;
+    uint8_t                                     m_lastFailedTableId;
+};
@@ -0,0 +1,95 @@
+#include "mp2ts_reorder.h"
+#include "mp2ts_memory.h"
+
+#define PTS_WRAP (1ull << 33)
+
+PresentationOrder::PresentationOrder()
+{
+    Clear();
+}
+
+void PresentationOrder::Clear()
+{
+    m_pending.clear();
+    m_decodeOfPresentation.clear();
+    m_presentationOfDecode.clear();
+
+    m_bStarted = false;
+    m_lastPTS = 0;
+    m_lastKey = 0;
+}
+
+void PresentationOrder::Add(uint32_t decodeIndex, uint64_t pts)
+{
+    MemoryScope memoryScope(eMemPresentationUnits);
+
+    // Signed distance from the AU before across the 33 bit wrap
+    int64_t step = (int64_t) ((pts - m_lastPTS) & (PTS_WRAP - 1));
+
+    if(step >= (int64_t) (PTS_WRAP / 2))
+        step -= (int64_t) PTS_WRAP;
+
+    if(m_bStarted && (step > (int64_t) REORDER_MAX_PTS_STEP || step < -(int64_t) REORDER_MAX_PTS_STEP))
+    {
+        // Nothing after a splice or a PTS reset is shown before what came ahead of it
+        while(!m_pending.empty())
+            Release();
+
+        step = 1;
+    }
+
+    m_lastKey = m_bStarted ? m_lastKey + step : 0;
+    m_lastPTS = pts;
+    m_bStarted = true;
+
+    if(decodeIndex >= m_presentationOfDecode.size())
+        m_presentationOfDecode.resize(decodeIndex + 1, UINT32_MAX);
+
+    Pending pending;
+    pending.key = m_lastKey;
+    pending.decodeIndex = decodeIndex;
+
+    m_pending.push_back(pending);
+
+    if(m_pending.size() > REORDER_MAX_DEPTH)
+        Release();
+}
+
+void PresentationOrder::Finish()
+{
+    MemoryScope memoryScope(eMemPresentationUnits);
+
+    while(!m_pending.empty())
+        Release();
+}
+
+uint32_t PresentationOrder::PresentationIndex(uint32_t decodeIndex) const
+{
+    if(decodeIndex >= m_presentationOfDecode.size() || UINT32_MAX == m_presentationOfDecode[decodeIndex])
+        return decodeIndex;
+
+    return m_presentationOfDecode[decodeIndex];
+}
+
+void PresentationOrder::Release()
+{
+    // No more than REORDER_MAX_DEPTH + 1 to look through
+    size_t lowest = 0;
+
+    for(size_t i = 1; i < m_pending.size(); i++)
+    {
+        const Pending &a = m_pending[i];
+        const Pending &b = m_pending[lowest];
+
+        if(a.key < b.key || (a.key == b.key && a.decodeIndex < b.decodeIndex))
+            lowest = i;
+    }
+
+    uint32_t decodeIndex = m_pending[lowest].decodeIndex;
+
+    m_presentationOfDecode[decodeIndex] = (uint32_t) m_decodeOfPresentation.size();
+    m_decodeOfPresentation.push_back(decodeIndex);
+
+    m_pending[lowest] = m_pending.back();
+    m_pending.pop_back();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Pictures one can be held back by before it is shown: max_num_reorder_frames of H.264 and
+// sps_max_num_reorder_pics of HEVC are at most 16, MPEG-2 needs 1
+#define REORDER_MAX_DEPTH 16
+
+// A PTS step between AUs in decode order bigger than this, either way, is a discontinuity
+#define REORDER_MAX_PTS_STEP (10ull * 90000)
+
+/*
+    The presentation order of the video AUs, worked out while they are indexed.
+
+    AUs go in in decode order with their PTS and wait in a buffer of up to
+    REORDER_MAX_DEPTH of them.  Once it is full the one with the lowest PTS is
+    the next to be shown, as a decoder bumps pictures out of its DPB, so the
+    order is right for B-pyramids and for H.264 and HEVC as well as for IBBP.
+    Equal PTS keep their decode order.  The PTS is unwrapped at 33 bits, and a
+    discontinuity shows everything buffered before the AU that jumps.
+
+    Both directions of the map are kept, 8 bytes an AU, so a seek or a step
+    of playback only looks the order up.
+*/
+class PresentationOrder
+{
+public:
+
+    PresentationOrder();
+
+    void Clear();
+
+    // The next AU in decode order, decodeIndex is its place in it
+    void Add(uint32_t decodeIndex, uint64_t pts);
+
+    // After the last AU, shows what is still buffered
+    void Finish();
+
+    // AUs with a place in presentation order
+    uint32_t size() const { return (uint32_t) m_decodeOfPresentation.size(); }
+
+    uint32_t DecodeIndex(uint32_t presentationIndex) const { return m_decodeOfPresentation[presentationIndex]; }
+
+    // The presentation index, or the decode index while the AU is still in the reorder buffer.
+    // Only a real presentation position once the AU has been released, or after Finish().
+    uint32_t PresentationIndex(uint32_t decodeIndex) const;
+
+private:
+
+    struct Pending
+    {
+        int64_t     key;            // Unwrapped PTS
+        uint32_t    decodeIndex;
+    };
+
+    // Shows the buffered AU with the lowest PTS
+    void Release();
+
+    std::vector<Pending>    m_pending;
+    std::vector<uint32_t>   m_decodeOfPresentation;
+    std::vector<uint32_t>   m_presentationOfDecode;     // UINT32_MAX while buffered
+
+    bool                    m_bStarted;
+    uint64_t                m_lastPTS;
+    int64_t                 m_lastKey;
+};
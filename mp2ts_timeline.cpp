@@ -0,0 +1,179 @@
+#include "mp2ts_timeline.h"
+#include "mp2ts_frame_table.h"
+#include "mp2ts_memory.h"
+
+// Levels smaller than this are not worth starting threads for
+#define PYRAMID_PARALLEL_MIN (64 * 1024)
+
+// Runs fn(begin, end) over [0, count) split across the cores
+template <typename Fn>
+static void ParallelFor(uint32_t count, Fn fn)
+{
+    unsigned int numThreads = std::thread::hardware_concurrency();
+
+    if(count < PYRAMID_PARALLEL_MIN || numThreads < 2)
+    {
+        fn(0, count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    uint32_t step = (count + numThreads - 1) / numThreads;
+
+    for(uint32_t begin = step; begin < count; begin += step)
+        threads.push_back(std::thread(fn, begin, count - begin < step ? count : begin + step));
+
+    // This thread does the first slice
+    fn(0, step);
+
+    for(size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+}
+
+FrameSizePyramid::FrameSizePyramid()
+    : m_frames(0)
+    , m_bStarted(false)
+    , m_bReady(false)
+{
+}
+
+FrameSizePyramid::~FrameSizePyramid()
+{
+    if(m_builder.joinable())
+        m_builder.join();
+}
+
+void FrameSizePyramid::Build(const FrameTable &table, uint8_t packetSize)
+{
+    if(m_bStarted)
+        return;
+
+    m_bStarted = true;
+    m_frames = table.Rows();
+    m_builder = std::thread(&FrameSizePyramid::BuildLevels, this, &table, (uint32_t) (packetSize ? packetSize : 188));
+}
+
+void FrameSizePyramid::BuildLevels(const FrameTable *pTable, uint32_t packetSize)
+{
+    MemoryScope memoryScope(eMemTimeline);
+
+    m_sizes.resize(m_frames);
+
+    ParallelFor(m_frames, [this, pTable, packetSize](uint32_t begin, uint32_t end)
+    {
+        for(uint32_t i = begin; i < end; i++)
+            m_sizes[i] = pTable->Row(i).numPackets * packetSize;
+    });
+
+    for(uint32_t count = m_frames; count > 1; )
+    {
+        count = (count + 1) / 2;
+
+        m_levels.push_back(std::vector<Node>(count));
+
+        std::vector<Node> &level = m_levels.back();
+
+        if(1 == m_levels.size())
+        {
+            uint32_t numSizes = m_frames;
+
+            ParallelFor(count, [this, &level, numSizes](uint32_t begin, uint32_t end)
+            {
+                for(uint32_t i = begin; i < end; i++)
+                {
+                    uint32_t a = m_sizes[2 * i];
+                    uint32_t b = 2 * i + 1 < numSizes ? m_sizes[2 * i + 1] : a;
+
+                    level[i].minBytes = a < b ? a : b;
+                    level[i].maxBytes = a > b ? a : b;
+                    level[i].sumBytes = (uint64_t) a + (2 * i + 1 < numSizes ? b : 0);
+                }
+            });
+        }
+        else
+        {
+            const std::vector<Node> &below = m_levels[m_levels.size() - 2];
+
+            ParallelFor(count, [&level, &below](uint32_t begin, uint32_t end)
+            {
+                for(uint32_t i = begin; i < end; i++)
+                {
+                    const Node &a = below[2 * i];
+
+                    level[i] = a;
+
+                    if(2 * i + 1 < below.size())
+                    {
+                        const Node &b = below[2 * i + 1];
+
+                        if(b.minBytes < level[i].minBytes)
+                            level[i].minBytes = b.minBytes;
+
+                        if(b.maxBytes > level[i].maxBytes)
+                            level[i].maxBytes = b.maxBytes;
+
+                        level[i].sumBytes += b.sumBytes;
+                    }
+                }
+            });
+        }
+    }
+
+    m_bReady.store(true, std::memory_order_release);
+}
+
+void FrameSizePyramid::Take(size_t level, uint32_t i, FrameSizeSpan &span) const
+{
+    uint32_t minBytes, maxBytes;
+    uint64_t sumBytes;
+
+    if(0 == level)
+    {
+        minBytes = maxBytes = m_sizes[i];
+        sumBytes = m_sizes[i];
+    }
+    else
+    {
+        const Node &node = m_levels[level - 1][i];
+        minBytes = node.minBytes;
+        maxBytes = node.maxBytes;
+        sumBytes = node.sumBytes;
+    }
+
+    if(minBytes < span.minBytes)
+        span.minBytes = minBytes;
+
+    if(maxBytes > span.maxBytes)
+        span.maxBytes = maxBytes;
+
+    span.sumBytes += sumBytes;
+}
+
+FrameSizeSpan FrameSizePyramid::Query(uint32_t first, uint32_t last) const
+{
+    FrameSizeSpan span = { 0, 0, 0, 0 };
+
+    if(last > m_frames)
+        last = m_frames;
+
+    if(first >= last)
+        return span;
+
+    span.minBytes = 0xFFFFFFFF;
+    span.count = last - first;
+
+    // Bottom up, taking the entries that stick out of the next level on either side
+    for(size_t level = 0; first < last; level++)
+    {
+        if(first & 1)
+            Take(level, first++, span);
+
+        if(last & 1)
+            Take(level, --last, span);
+
+        first >>= 1;
+        last >>= 1;
+    }
+
+    return span;
+}
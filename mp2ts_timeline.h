@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+class FrameTable;
+
+// Compressed sizes of a run of frames
+struct FrameSizeSpan
+{
+    uint32_t    minBytes;
+    uint32_t    maxBytes;
+    uint64_t    sumBytes;
+    uint32_t    count;
+};
+
+/*
+    Min, max and sum of the compressed frame sizes over every power of two run
+    of frames, for the timeline graph above the seek bar.
+
+    Level 0 is the size of each frame in decode order, packets times the packet
+    size.  Entry i of level k covers frames [i << k, (i + 1) << k), so it is made
+    from entries 2i and 2i + 1 of level k - 1.  Any run of frames is covered by
+    at most two entries per level, Query() is O(log frames) whatever the zoom,
+    and a graph costs O(pixels).  The levels together are about twice level 0.
+
+    Build() copies the sizes from a filled FrameTable and builds the levels on
+    a background thread, splitting each level over the cores.
+*/
+class FrameSizePyramid
+{
+public:
+
+    FrameSizePyramid();
+    ~FrameSizePyramid();
+
+    // table must be filled and must outlive the build
+    void Build(const FrameTable &table, uint8_t packetSize);
+
+    bool IsStarted() const { return m_bStarted; }
+    bool IsReady() const { return m_bReady.load(std::memory_order_acquire); }
+
+    uint32_t Frames() const { return m_frames; }
+
+    // Frames [first, last) of a ready pyramid
+    FrameSizeSpan Query(uint32_t first, uint32_t last) const;
+
+private:
+
+    struct Node
+    {
+        uint32_t    minBytes;
+        uint32_t    maxBytes;
+        uint64_t    sumBytes;
+    };
+
+    FrameSizePyramid(const FrameSizePyramid &);
+    FrameSizePyramid &operator=(const FrameSizePyramid &);
+
+    void BuildLevels(const FrameTable *pTable, uint32_t packetSize);
+
+    // Adds entry i of level to span
+    void Take(size_t level, uint32_t i, FrameSizeSpan &span) const;
+
+    uint32_t                        m_frames;
+    std::vector<uint32_t>           m_sizes;        // Level 0
+    std::vector<std::vector<Node> > m_levels;       // m_levels[k - 1] is level k
+    bool                            m_bStarted;
+    std::atomic<bool>               m_bReady;
+    std::thread                     m_builder;
+};
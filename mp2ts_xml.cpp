@@ -1,72 +1,289 @@
 #include "mp2ts_xml.h"
+#include "mp2ts_metrics.h"
+#include "mp2ts_memory.h"
+#include "mp2ts_input.h"
+#include "mp2ts_demux.h"
+#include "mp2ts_psi.h"
+#include "mp2ts_es_index.h"
 
+#include <algorithm>
+#include <cstring>
+
+// Presentation units kept ahead of the one displayed
 #define GOP_LENGTH 30
 
+// Packets read at a time while a TS is indexed
+#define TS_INDEX_BLOCK_PACKETS 16384
+
+// How far into a TS the PAT and every PMT it lists must have come
+#define TS_INDEX_PSI_BYTES (64ull * 1024 * 1024)
+
+// Packets in a row with a sync byte where the packet size puts it, to tell 188 from 192 byte packets
+#define TS_INDEX_SYNC_PACKETS 5
+
+static eStreamKind StreamKind(int streamType)
+{
+    switch(streamType)
+    {
+        case eMPEG1_Video:
+        case eMPEG2_Video:
+        case eMPEG4_Video:
+        case eH264_Video:
+        case eHEVC_Video:
+        case eDigiCipher_II_Video:
+        case eMSCODEC_Video:
+            return eStreamKindVideo;
+
+        case eMPEG1_Audio:
+        case eMPEG2_Audio:
+        case eMPEG2_AAC_Audio:
+        case eMPEG4_LATM_AAC_Audio:
+        case eA52_AC3_Audio:
+        case eHDMV_DTS_Audio:
+        case eA52b_AC3_Audio:
+        case eSDDS_Audio:
+            return eStreamKindAudio;
+    }
+
+    return eStreamKindOther;
+}
+
+// For a stream that came from a PMT rather than the XML
+static const char *StreamTypeName(int streamType)
+{
+    switch(streamType)
+    {
+        case eMPEG1_Video:              return "MPEG-1 Video";
+        case eMPEG2_Video:              return "MPEG-2 Video";
+        case eMPEG1_Audio:              return "MPEG-1 Audio";
+        case eMPEG2_Audio:              return "MPEG-2 Audio";
+        case eMPEG2_AAC_Audio:          return "MPEG-2 AAC Audio";
+        case eMPEG4_Video:              return "MPEG-4 Video";
+        case eMPEG4_LATM_AAC_Audio:     return "MPEG-4 LATM AAC Audio";
+        case eH264_Video:               return "H.264 Video";
+        case eHEVC_Video:               return "HEVC Video";
+        case eA52_AC3_Audio:            return "A52/AC-3 Audio";
+        case eEAC3_Audio:               return "E-AC-3 Audio";
+        case eISO13818_1_PES_private_data: return "PES private data";
+    }
+
+    return "";
+}
+
+// Text of the child element name as a number, missing if there is no such child
+static long ChildNumber(tinyxml2::XMLElement* element, const char *name, int base, long missing)
+{
+    tinyxml2::XMLElement* child = element->FirstChildElement(name);
+
+    if(!child || !child->GetText())
+        return missing;
+
+    return strtol(child->GetText(), NULL, base);
+}
+
 bool MpegTS_XML::ParsePMT(tinyxml2::XMLElement* root)
 {
-    bool bFoundPMT = false;
+    m_programs.clear();
+    m_streams.clear();
+    m_streamOfPID.assign(MAX_PID, -1);
 
-    tinyxml2::XMLElement* element = root->FirstChildElement("packet");
+    bool bFoundPAT = false;
+    size_t pmtsFound = 0;
+    std::vector<bool> bPMTFound;    // By program
 
-    while(!bFoundPMT && element)
+    for(tinyxml2::XMLElement* element = root->FirstChildElement("packet"); element; element = element->NextSiblingElement("packet"))
     {
-        tinyxml2::XMLElement* pmt = element->FirstChildElement("program_map_table");
+        tinyxml2::XMLElement* pat = element->FirstChildElement("program_association_table");
 
-        if(pmt)
+        if(pat && !bFoundPAT)
         {
-            tinyxml2::XMLElement* stream = pmt->FirstChildElement("stream");
-            while(stream)
+            // PMTs that came ahead of the PAT belong to the program the PAT gives their PID,
+            // the ones it does not list are dropped
+            std::vector<TransportProgram> early;
+            early.swap(m_programs);
+            bPMTFound.clear();
+            pmtsFound = 0;
+
+            for(tinyxml2::XMLElement* program = pat->FirstChildElement("program"); program; program = program->NextSiblingElement("program"))
             {
-                tinyxml2::XMLElement* type_number = stream->FirstChildElement("type_number");
-                int stream_type = strtol(type_number->GetText(), NULL, 16);
+                long programNumber = ChildNumber(program, "number", 10, 0);
+                long pmtPID = ChildNumber(program, "pid", 16, -1);
 
-                AccessUnit *pAU = nullptr;
+                // Program 0 is the network PID
+                if(programNumber <= 0 || programNumber > 0xFFFF || pmtPID < 0 || pmtPID >= MAX_PID)
+                    continue;
 
-                switch(stream_type)
-                {
-                    case eMPEG1_Video:
-                    case eMPEG2_Video:
-                    case eMPEG4_Video:
-                    case eH264_Video:
-                    case eDigiCipher_II_Video:
-                    case eMSCODEC_Video:
-                        pAU = &m_videoAU;
-                    break;
-
-                    case eMPEG1_Audio:
-                    case eMPEG2_Audio:
-                    case eMPEG2_AAC_Audio:
-                    case eMPEG4_LATM_AAC_Audio:
-                    case eA52_AC3_Audio:
-                    case eHDMV_DTS_Audio:
-                    case eA52b_AC3_Audio:
-                    case eSDDS_Audio:
-                        pAU = &m_audioAU;
-                    break;
-                }
+                TransportProgram transportProgram;
+                transportProgram.programNumber = (uint16_t) programNumber;
+                transportProgram.pmtPID = pmtPID;
+                transportProgram.pcrPID = -1;
 
-                if(pAU)
+                bool bEarly = false;
+
+                for(size_t e = 0; e < early.size() && !bEarly; e++)
                 {
-                    tinyxml2::XMLElement* pid = stream->FirstChildElement("pid");
-                    pAU->esd.pid = strtol(pid->GetText(), NULL, 16);
+                    if(early[e].pmtPID != pmtPID || early[e].programNumber)
+                        continue;
 
-                    tinyxml2::XMLElement* type = stream->FirstChildElement("type_number");
-                    pAU->esd.streamType = (eStreamType) strtol(type->GetText(), NULL, 16);
+                    transportProgram.pcrPID = early[e].pcrPID;
+                    transportProgram.streams = early[e].streams;
+                    early[e].programNumber = (uint16_t) programNumber;     // Taken
+                    bEarly = true;
 
-                    tinyxml2::XMLElement* typeName = stream->FirstChildElement("type_name");
-                    pAU->esd.name = typeName->GetText();
+                    for(size_t stream : transportProgram.streams)
+                    {
+                        if(0 == m_streams[stream].programNumber)
+                            m_streams[stream].programNumber = (uint16_t) programNumber;
+                    }
                 }
 
-                stream = stream->NextSiblingElement("stream");
+                m_programs.push_back(transportProgram);
+                bPMTFound.push_back(bEarly);
+                pmtsFound += bEarly ? 1 : 0;
             }
-                
-            bFoundPMT = true;
+
+            bFoundPAT = true;
+
+            if(!m_programs.empty() && pmtsFound == m_programs.size())
+                break;
+        }
+
+        tinyxml2::XMLElement* pmt = element->FirstChildElement("program_map_table");
+
+        if(!pmt)
+            continue;
+
+        long pmtPID = ChildNumber(element, "pid", 16, -1);
+
+        // Programs may share a PMT PID, the XML does not say which program a PMT is
+        // for, so they are taken in PAT order
+        size_t p = 0;
+
+        while(p < m_programs.size() && (m_programs[p].pmtPID != pmtPID || bPMTFound[p]))
+            p++;
+
+        if(p == m_programs.size())
+        {
+            // Without a PAT the tables have come round again once a PMT PID repeats
+            if(bFoundPAT)
+                continue;
+
+            bool bRepeat = false;
+
+            for(const TransportProgram &program : m_programs)
+                bRepeat = bRepeat || program.pmtPID == pmtPID;
+
+            if(bRepeat)
+                break;
+
+            TransportProgram transportProgram;
+            transportProgram.programNumber = 0;
+            transportProgram.pmtPID = pmtPID;
+
+            m_programs.push_back(transportProgram);
+            bPMTFound.push_back(false);
         }
 
-        element = element->NextSiblingElement("packet");
+        TransportProgram &program = m_programs[p];
+        program.pcrPID = ChildNumber(pmt, "pcr_pid", 16, -1);
+
+        for(tinyxml2::XMLElement* stream = pmt->FirstChildElement("stream"); stream; stream = stream->NextSiblingElement("stream"))
+        {
+            long pid = ChildNumber(stream, "pid", 16, -1);
+
+            if(pid < 0 || pid >= MAX_PID)
+                continue;
+
+            // A stream shared by several programs is indexed once
+            if(m_streamOfPID[pid] < 0)
+            {
+                int streamType = (int) ChildNumber(stream, "type_number", 16, eReserved);
+                tinyxml2::XMLElement* typeName = stream->FirstChildElement("type_name");
+
+                ElementaryStream elementaryStream;
+                elementaryStream.esd = ElementaryStreamDescriptor(typeName && typeName->GetText() ? typeName->GetText() : "", (eStreamType) streamType, pid);
+                elementaryStream.kind = StreamKind(streamType);
+                elementaryStream.programNumber = program.programNumber;
+                elementaryStream.pAccessUnits = nullptr;
+                elementaryStream.au.esd = elementaryStream.esd;
+
+                m_streamOfPID[pid] = (int16_t) m_streams.size();
+                m_streams.push_back(elementaryStream);
+            }
+
+            program.streams.push_back((size_t) m_streamOfPID[pid]);
+        }
+
+        bPMTFound[p] = true;
+
+        if(++pmtsFound == m_programs.size() && bFoundPAT)
+            break;
     }
 
-    return bFoundPMT;
+    AssignStreams();
+
+    return pmtsFound > 0;
+}
+
+void MpegTS_XML::AssignStreams()
+{
+    m_playedProgram = -1;
+
+    for(size_t p = 0; p < m_programs.size() && -1 == m_playedProgram; p++)
+    {
+        if(!m_programs[p].streams.empty() && (-1 == m_selectedProgram || m_programs[p].programNumber == m_selectedProgram))
+            m_playedProgram = (int) p;
+    }
+
+    for(ElementaryStream &stream : m_streams)
+        stream.pAccessUnits = nullptr;
+
+    // The first video and audio stream of the played program are the ones the player and timeline use
+    if(m_playedProgram >= 0)
+    {
+        for(size_t s : m_programs[m_playedProgram].streams)
+        {
+            ElementaryStream &stream = m_streams[s];
+
+            if(eStreamKindVideo == stream.kind && -1 == VideoPID())
+                stream.pAccessUnits = &m_videoAccessUnitsDecode;
+            else if(eStreamKindAudio == stream.kind && -1 == AudioPID())
+                stream.pAccessUnits = &m_audioAccessUnits;
+        }
+    }
+
+    m_otherAccessUnits.clear();
+
+    for(ElementaryStream &stream : m_streams)
+    {
+        if(!stream.pAccessUnits)
+        {
+            m_otherAccessUnits.emplace_back("stream AU index", eMemStreamUnits, "stream AU element store", eMemStreamUnits);
+            stream.pAccessUnits = &m_otherAccessUnits.back();
+        }
+    }
+}
+
+long MpegTS_XML::VideoPID() const
+{
+    for(const ElementaryStream &stream : m_streams)
+    {
+        if(stream.pAccessUnits == &m_videoAccessUnitsDecode)
+            return stream.esd.pid;
+    }
+
+    return -1;
+}
+
+long MpegTS_XML::AudioPID() const
+{
+    for(const ElementaryStream &stream : m_streams)
+    {
+        if(stream.pAccessUnits == &m_audioAccessUnits)
+            return stream.esd.pid;
+    }
+
+    return -1;
 }
 
 bool MpegTS_XML::ParseMpegTSDescriptor(tinyxml2::XMLElement* root)
@@ -75,7 +292,7 @@ bool MpegTS_XML::ParseMpegTSDescriptor(tinyxml2::XMLElement* root)
     m_mpegTSDescriptor.fileName = element->GetText();
 
     element = root->FirstChildElement("file_size");
-    m_mpegTSDescriptor.fileSize = std::atoi(element->GetText());
+    m_mpegTSDescriptor.fileSize = std::strtoll(element->GetText(), NULL, 10);
 
     element = root->FirstChildElement("packet_size");
     m_mpegTSDescriptor.packetSize = std::atoi(element->GetText());
@@ -122,104 +339,94 @@ static float ConvertStringToPTSSeconds(std::string input)
     return timeStamp;
 }
 
-bool MpegTS_XML::ParsePacketListTerse(tinyxml2::XMLElement* root)
+uint64_t MpegTS_XML::ParseTerseFrame(tinyxml2::XMLElement* element, AccessUnit &au)
 {
-    if(NULL == root)
-        return false;
+    uint64_t packetsParsed = 0;
 
-    tinyxml2::XMLElement* element = nullptr;
+    tinyxml2::XMLElement* pts = element->FirstChildElement("PTS");
+    if(pts)
+    {
+        au.pts = ConvertStringToPTS(pts->GetText());
+        au.pts_seconds = ConvertStringToPTSSeconds(pts->GetText());
+    }
 
-    element = root->FirstChildElement("frame");
+    // A frame without a DTS is decoded at its PTS.  Not keeping the last one also
+    // makes an AU the same whichever chunk a lazy load parses it in.
+    tinyxml2::XMLElement* dts = element->FirstChildElement("DTS");
+    if(dts)
+    {
+        au.dts = ConvertStringToPTS(dts->GetText());
+        au.dts_seconds = ConvertStringToPTSSeconds(dts->GetText());
+    }
+    else if(pts)
+    {
+        au.dts = au.pts;
+        au.dts_seconds = au.pts_seconds;
+    }
 
-    unsigned int videoFrameNumber = 0;
-    unsigned int audioFrameNumber = 0;
+    tinyxml2::XMLElement* type = element->FirstChildElement("type");
+    if(type)
+        //au.frameType = ConvertStringToFrameType(type->GetText());
+        au.frameType = type->GetText();
 
-    while(element)
+    // mpts_parser only describes MPEG-2, where decoding can start at any I frame
+    au.random_access = au.frameType == "I";
+
+    if(au.frameType == "I")
     {
-        const char *pid = element->Attribute("pid");
-        long thisPID = strtol(pid, NULL, 16);
+        tinyxml2::XMLElement* closed_gop = element->FirstChildElement("closed_gop");
+        if(closed_gop)
+            au.closed_gop = std::atoi(closed_gop->GetText());
+    }
 
-        AccessUnit *pAU = nullptr;
+    tinyxml2::XMLElement* slices = element->FirstChildElement("slices");
 
-        if(m_videoAU.esd.pid == thisPID)
-            pAU = &m_videoAU;
-        else if(m_audioAU.esd.pid == thisPID)
-            pAU = &m_audioAU;
+    if(slices)
+    {
+        tinyxml2::XMLElement* slice = slices->FirstChildElement("slice");
 
-        if(pAU)
+        while(slice)
         {
-            tinyxml2::XMLElement* dts = element->FirstChildElement("DTS");
-            if(dts)
-            {
-                pAU->dts = ConvertStringToPTS(dts->GetText());
-                pAU->dts_seconds = ConvertStringToPTSSeconds(dts->GetText());
-            }
-
-            tinyxml2::XMLElement* pts = element->FirstChildElement("PTS");
-            if(pts)
-            {
-                pAU->pts = ConvertStringToPTS(pts->GetText());
-                pAU->pts_seconds = ConvertStringToPTSSeconds(pts->GetText());
-            }
+            AccessUnitElement aue;
+            aue.startByteLocation = slice->Int64Attribute("byte");
+            aue.numPackets = slice->Int64Attribute("packets");
 
-            tinyxml2::XMLElement* type = element->FirstChildElement("type");
-            if(type)
-                //pAU->frameType = ConvertStringToFrameType(type->GetText());
-                pAU->frameType = type->GetText();
+            au.accessUnitElements.push_back(aue);
+            packetsParsed += aue.numPackets;
 
-            if(pAU->frameType == "I")
-            {
-                tinyxml2::XMLElement* closed_gop = element->FirstChildElement("closed_gop");
-                if(closed_gop)
-                    pAU->closed_gop = std::atoi(closed_gop->GetText());
-            }
+            slice = slice->NextSiblingElement("slice");
+        }
+    }
 
-            tinyxml2::XMLElement* slices = element->FirstChildElement("slices");
+    return packetsParsed;
+}
 
-            if(slices)
-            {
-                tinyxml2::XMLElement* slice = slices->FirstChildElement("slice");
+bool MpegTS_XML::ParsePacketListTerse(tinyxml2::XMLElement* root)
+{
+    if(NULL == root)
+        return false;
 
-                while(slice)
-                {
-                    AccessUnitElement aue;
-                    aue.startByteLocation = slice->Int64Attribute("byte");
-                    aue.numPackets = slice->Int64Attribute("packets");
+    tinyxml2::XMLElement* element = nullptr;
 
-                    pAU->accessUnitElements.push_back(aue);
+    element = root->FirstChildElement("frame");
 
-                    slice = slice->NextSiblingElement("slice");
-                }
-            }
+    uint64_t packetsParsed = 0;
 
-            if(pAU == &m_videoAU)
-            {
-                m_videoAU.frameNumber = videoFrameNumber++;
-                m_videoAccessUnitsDecode.push_back(m_videoAU);
-            }
-            else if(pAU == &m_audioAU)
-            {
-                m_videoAU.frameNumber = audioFrameNumber++;
-                m_audioAccessUnits.push_back(m_audioAU);
-            }
+    while(element)
+    {
+        const char *pid = element->Attribute("pid");
+        ElementaryStream *pStream = pid ? StreamOfPID(strtol(pid, NULL, 16)) : nullptr;
 
-            pAU->accessUnitElements.clear();
+        if(pStream)
+        {
+            packetsParsed += ParseTerseFrame(element, pStream->au);
+            AddAccessUnit(*pStream);
         }
 
         element = element->NextSiblingElement("frame");
     }
 
-    if(m_videoAU.accessUnitElements.size())
-    {
-        m_videoAccessUnitsDecode.push_back(m_videoAU);
-        m_videoAU.accessUnitElements.clear();
-    }
-        
-    if(m_audioAU.accessUnitElements.size())
-    {
-        m_audioAccessUnits.push_back(m_audioAU);
-        m_audioAU.accessUnitElements.clear();
-    }
+    MetricsAdd(eMetricPacketsParsed, packetsParsed);
 
     return true;
 }
@@ -231,6 +438,18 @@ bool MpegTS_XML::ParsePacketList(tinyxml2::XMLElement* root)
 
     bool ret = false;
 
+    m_videoAccessUnitsDecode.Clear();
+    m_videoPresentationOrder.Clear();
+    m_videoAccessUnitsDecode.SetPacketSize(m_mpegTSDescriptor.packetSize);
+    m_audioAccessUnits.Clear();
+    m_audioAccessUnits.SetPacketSize(m_mpegTSDescriptor.packetSize);
+
+    for(AccessUnitIndex &accessUnits : m_otherAccessUnits)
+    {
+        accessUnits.Clear();
+        accessUnits.SetPacketSize(m_mpegTSDescriptor.packetSize);
+    }
+
     if(m_mpegTSDescriptor.terse)
         ret = ParsePacketListTerse(root);
     else
@@ -241,87 +460,80 @@ bool MpegTS_XML::ParsePacketList(tinyxml2::XMLElement* root)
 
         long lastPID = -1;
 
-        unsigned int videoFrameNumber = 0;
-        unsigned int audioFrameNumber = 0;
+        uint64_t packetsParsed = 0;
 
         while(element)
         {
+            packetsParsed++;
+
             tinyxml2::XMLElement* pid = element->FirstChildElement("pid");
             long thisPID = strtol(pid->GetText(), NULL, 16);
 
-            AccessUnit *pAU = nullptr;
-
-            if(m_videoAU.esd.pid == thisPID)
-                pAU = &m_videoAU;
-            else if(m_audioAU.esd.pid == thisPID)
-                pAU = &m_audioAU;
+            ElementaryStream *pStream = StreamOfPID(thisPID);
 
-            if(pAU)
+            if(pStream)
             {
+                AccessUnit &au = pStream->au;
+
                 tinyxml2::XMLElement* pusi = element->FirstChildElement("payload_unit_start_indicator");
 
                 bool bNewAUSet = false;
 
                 if(1 == strtol(pusi->GetText(), NULL, 16))
                 {
-                    if(pAU->accessUnitElements.size())
-                    {
-                        if(pAU == &m_videoAU)
-                        {
-                            m_videoAU.frameNumber = videoFrameNumber++;
-                            m_videoAccessUnitsDecode.push_back(m_videoAU);
-                        }
-                        else if(pAU == &m_audioAU)
-                        {
-                            m_videoAU.frameNumber = audioFrameNumber++;
-                            m_audioAccessUnits.push_back(m_audioAU);
-                        }
-                    }
+                    if(au.accessUnitElements.size())
+                        AddAccessUnit(*pStream);
 
-                    pAU->accessUnitElements.clear();
+                    au.accessUnitElements.clear();
                     bNewAUSet = true;
                 }
 
                 if(-1 != lastPID && thisPID != lastPID)
                     bNewAUSet = true;
 
-                if(bNewAUSet)
+                // A stream that starts part way through a PES has no element to add to yet
+                if(bNewAUSet || au.accessUnitElements.empty())
                 {
                     const tinyxml2::XMLAttribute *attribute = element->FirstAttribute();
 
                     AccessUnitElement aue;
-                    aue.startByteLocation = attribute->IntValue();
+                    aue.startByteLocation = attribute->Int64Value();
                     aue.numPackets = 1;
 
-                    pAU->accessUnitElements.push_back(aue);
+                    au.accessUnitElements.push_back(aue);
                 }
                 else
                 {
-                    AccessUnitElement &aue = pAU->accessUnitElements.back();
+                    AccessUnitElement &aue = au.accessUnitElements.back();
                     aue.numPackets++;
                 }
-
-                lastPID = thisPID;
             }
 
+            // Any other PID in between ends the run of packets, not just the other AV stream
+            lastPID = thisPID;
+
             element = element->NextSiblingElement("packet");
         }
 
-        if(m_videoAU.accessUnitElements.size())
-        {
-            m_videoAccessUnitsDecode.push_back(m_videoAU);
-            m_videoAU.accessUnitElements.clear();
-        }
-        
-        if(m_audioAU.accessUnitElements.size())
+        for(ElementaryStream &stream : m_streams)
         {
-            m_audioAccessUnits.push_back(m_audioAU);
-            m_audioAU.accessUnitElements.clear();
+            if(stream.au.accessUnitElements.size())
+                AddAccessUnit(stream);
         }
 
+        MetricsAdd(eMetricPacketsParsed, packetsParsed);
+
         ret = true;
     }
 
+    uint64_t accessUnitsIndexed = 0;
+
+    for(const ElementaryStream &stream : m_streams)
+        accessUnitsIndexed += stream.pAccessUnits->size();
+
+    MetricsAdd(eMetricAccessUnitsIndexed, accessUnitsIndexed);
+
+    m_videoPresentationOrder.Finish();
     BuildPresentationUnits(0);
 
 /*
@@ -356,105 +568,503 @@ bool MpegTS_XML::ParsePacketList(tinyxml2::XMLElement* root)
     return ret;
 }
 
-inline void MpegTS_XML::AddPresentationUnit(AccessUnit au, uint32_t frameNumber)
+bool MpegTS_XML::OpenLazy(const char *fileName)
 {
-    au.frameNumber = frameNumber;
-    m_videoAccessUnitsPresentation.push_back(au);
+    MemoryScope memoryScope(eMemXmlDom);
+
+    if(!m_lazyText.Open(fileName))
+        return false;
+
+    // Everything ahead of the first <frame> is the descriptor and the PSI packets,
+    // closed with </file> it parses on its own
+    uint64_t headerEnd = m_lazyText.FindFirstFrame();
+    std::vector<char> header;
+
+    if(headerEnd == m_lazyText.Size() || !m_lazyText.Read(0, (size_t) headerEnd, header))
+    {
+        m_lazyText.Close();
+        return false;
+    }
+
+    static const char fileEndTag[] = "</file>";
+
+    header.resize((size_t) headerEnd);
+    header.insert(header.end(), fileEndTag, fileEndTag + sizeof(fileEndTag) - 1);
+
+    tinyxml2::XMLDocument doc;
+    tinyxml2::XMLElement* root = nullptr;
+
+    if(tinyxml2::XML_SUCCESS == doc.Parse(header.data(), header.size()))
+        root = doc.FirstChildElement("file");
+
+    if(!root || !ParseMpegTSDescriptor(root) || !m_mpegTSDescriptor.terse || !ParsePMT(root))
+    {
+        m_lazyText.Close();
+        return false;
+    }
+
+    m_lazyFrames.assign(m_streams.size(), std::vector<uint64_t>());
+    m_lazyFrameSizes.assign(m_streams.size(), std::vector<uint32_t>());
+
+    int16_t videoStream = -1;
+
+    for(size_t s = 0; s < m_streams.size(); s++)
+    {
+        if(m_streams[s].pAccessUnits == &m_videoAccessUnitsDecode)
+            videoStream = (int16_t) s;
+    }
+
+    m_videoPresentationOrder.Clear();
+
+    if(!m_lazyText.ScanFrames(headerEnd, m_streamOfPID, m_lazyFrames, m_lazyFrameSizes, videoStream, m_videoPresentationOrder))
+    {
+        fprintf(stderr, "Error: Could not read %s\n", fileName);
+        m_lazyText.Close();
+        return false;
+    }
+
+    m_lazyTextEnd = m_lazyText.FindLastFrameEnd();
+    m_lazyChunksLoaded = 0;
+    m_lazyChunksFailed = 0;
+    m_lazyChunkFailed.assign(m_streams.size(), std::vector<bool>());
+
+    for(size_t s = 0; s < m_streams.size(); s++)
+    {
+        // The last frame of the file runs to the end of the text, not just to its </frame>
+        if(!m_lazyFrames[s].empty() && m_lazyFrames[s].back() + m_lazyFrameSizes[s].back() > m_lazyTextEnd)
+            m_lazyFrameSizes[s].back() = (uint32_t) (m_lazyTextEnd > m_lazyFrames[s].back() ? m_lazyTextEnd - m_lazyFrames[s].back() : 0);
+
+        m_lazyChunkFailed[s].assign((m_lazyFrames[s].size() + LAZY_CHUNK_FRAMES - 1) / LAZY_CHUNK_FRAMES, false);
+        m_streams[s].pAccessUnits->Reserve((uint32_t) m_lazyFrames[s].size(), this);
+        m_streams[s].pAccessUnits->SetPacketSize(m_mpegTSDescriptor.packetSize);
+    }
+
+    m_videoPresentationOrder.Finish();
+    BuildPresentationUnits(0);
+
+    return true;
 }
 
-// Frame reordering: decode order to presentation order.
-// Call this after a seek
-unsigned int MpegTS_XML::BuildPresentationUnits(unsigned int startFrameNumber)
+// 188 or 192 from where the sync bytes are at the start of the file, 0 if it is not a TS
+static unsigned int DetectPacketSize(InputSource *pInput)
 {
-    unsigned int retCount = startFrameNumber;
-    bool bRetCountSet = false;
+    static const unsigned int packetSizes[2] = { 188, 192 };
 
-    if(m_videoAccessUnitsDecode.size())
+    std::vector<uint8_t> scratch;
+
+    for(unsigned int packetSize : packetSizes)
     {
-        m_previousReferenceFrame = nullptr;
+        size_t size = (size_t) packetSize * TS_INDEX_SYNC_PACKETS;
 
-        m_videoAccessUnitsPresentation.clear();
+        if(pInput->Size() < size)
+            continue;
+
+        const uint8_t *p = pInput->Fetch(0, size, scratch);
+        unsigned int syncOffset = 192 == packetSize ? 4 : 0;
+        unsigned int i = 0;
+
+        while(p && i < TS_INDEX_SYNC_PACKETS && 0x47 == p[i * packetSize + syncOffset])
+            i++;
+
+        if(TS_INDEX_SYNC_PACKETS == i)
+            return packetSize;
+    }
 
-        bool closedGOP = m_videoAccessUnitsDecode[startFrameNumber].closed_gop;
+    return 0;
+}
+
+// Calls func(pPacket, header, offset) for every packet with a sync byte, in file order,
+// until it returns false.  False if the file could not be read.
+template <typename Func>
+static bool ForEachPacket(InputSource *pInput, unsigned int packetSize, Func func)
+{
+    std::vector<uint8_t> scratch;
+    uint64_t fileSize = pInput->Size();
+    size_t blockBytes = (size_t) TS_INDEX_BLOCK_PACKETS * packetSize;
+
+    for(uint64_t offset = 0; offset + packetSize <= fileSize; offset += blockBytes)
+    {
+        size_t size = (size_t) std::min<uint64_t>(blockBytes, (fileSize - offset) / packetSize * packetSize);
+        const uint8_t *pBlock;
 
-        unsigned int addFrameCount = startFrameNumber;
-        unsigned int i = startFrameNumber;
-        unsigned int endFrameNumber = startFrameNumber+GOP_LENGTH;
-        for(; i<endFrameNumber && i < m_videoAccessUnitsDecode.size(); i++)
         {
-            if(m_videoAccessUnitsDecode[i].frameType == "I" ||
-               m_videoAccessUnitsDecode[i].frameType == "P")
-            {
-                if(m_previousReferenceFrame)
-                {
-                    if(!bRetCountSet)
-                    {
-                        retCount = addFrameCount;
-                        bRetCountSet = true;
-                    }
+            MemoryScope memoryScope(eMemInputBuffers);
+            pBlock = pInput->Fetch(offset, size, scratch);
+        }
 
-                    AddPresentationUnit(*m_previousReferenceFrame, addFrameCount++);
-                    
-                    // Always set closedGOP to true once second reference frame is found
-                    closedGOP = true;
-                }
+        if(!pBlock)
+        {
+            fprintf(stderr, "Error: Could not read the TS at %llu to index it\n", (unsigned long long) offset);
+            return false;
+        }
+
+        for(size_t pos = 0; pos < size; pos += packetSize)
+        {
+            TSPacketHeader header;
+
+            if(ParsePacketHeader(pBlock + pos, packetSize, header) && !func(pBlock + pos, header, offset + pos))
+                return true;
+        }
+    }
 
-                m_previousReferenceFrame = &(m_videoAccessUnitsDecode[i]);
+    return true;
+}
+
+void MpegTS_XML::SetPrograms(const std::vector<PSIProgram> &programs)
+{
+    m_programs.clear();
+    m_streams.clear();
+    m_streamOfPID.assign(MAX_PID, -1);
+
+    for(const PSIProgram &psiProgram : programs)
+    {
+        // Listed in the PAT but its PMT never came
+        if(psiProgram.version < 0)
+            continue;
+
+        TransportProgram program;
+        program.programNumber = psiProgram.programNumber;
+        program.pmtPID = psiProgram.pmtPID;
+        program.pcrPID = psiProgram.pcrPID;
+
+        for(const PSIStream &psiStream : psiProgram.streams)
+        {
+            // A stream shared by several programs is indexed once
+            if(m_streamOfPID[psiStream.pid] < 0)
+            {
+                ElementaryStream elementaryStream;
+                elementaryStream.esd = ElementaryStreamDescriptor(StreamTypeName(psiStream.streamType), (eStreamType) psiStream.streamType, psiStream.pid);
+                elementaryStream.kind = StreamKind(psiStream.streamType);
+                elementaryStream.programNumber = program.programNumber;
+                elementaryStream.pAccessUnits = nullptr;
+                elementaryStream.au.esd = elementaryStream.esd;
+
+                m_streamOfPID[psiStream.pid] = (int16_t) m_streams.size();
+                m_streams.push_back(elementaryStream);
             }
-            else
+
+            program.streams.push_back((size_t) m_streamOfPID[psiStream.pid]);
+        }
+
+        m_programs.push_back(program);
+    }
+
+    AssignStreams();
+}
+
+bool MpegTS_XML::OpenTransportStream(const char *fileName, InputSource *pInput)
+{
+    unsigned int packetSize = DetectPacketSize(pInput);
+
+    if(!packetSize)
+        return false;
+
+    // The PAT, then the PMT of every program in it
+    PSITables psi;
+
+    ForEachPacket(pInput, packetSize, [&psi, packetSize](const uint8_t *pPacket, const TSPacketHeader &header, uint64_t offset)
+    {
+        if((psi.Role(header.pid) & PSI_ROLE_SECTIONS) && !header.transportErrorIndicator && header.payloadOffset < (int) packetSize)
+            psi.Packet(header, pPacket + header.payloadOffset, pPacket + packetSize, offset);
+
+        bool bComplete = psi.TransportStreamId() >= 0;
+
+        for(const PSIProgram &program : psi.Programs())
+            bComplete = bComplete && program.version >= 0;
+
+        return !bComplete && offset < TS_INDEX_PSI_BYTES;
+    });
+
+    SetPrograms(psi.Programs());
+
+    if(m_programs.empty())
+    {
+        fprintf(stderr, "Error: No PMT in the first %llu MB of %s\n", TS_INDEX_PSI_BYTES >> 20, fileName);
+        return false;
+    }
+
+    m_mpegTSDescriptor.fileName = fileName;
+    m_mpegTSDescriptor.fileSize = (int64_t) pInput->Size();
+    m_mpegTSDescriptor.packetSize = (uint8_t) packetSize;
+    m_mpegTSDescriptor.terse = true;
+
+    m_videoAccessUnitsDecode.Clear();
+    m_videoPresentationOrder.Clear();
+    m_videoAccessUnitsDecode.SetPacketSize(packetSize);
+    m_audioAccessUnits.Clear();
+    m_audioAccessUnits.SetPacketSize(packetSize);
+
+    for(AccessUnitIndex &accessUnits : m_otherAccessUnits)
+    {
+        accessUnits.Clear();
+        accessUnits.SetPacketSize(packetSize);
+    }
+
+    std::deque<ESIndexer> indexers;
+
+    for(const ElementaryStream &stream : m_streams)
+        indexers.emplace_back(stream.esd, eStreamKindVideo == stream.kind);
+
+    long lastPID = -1;
+    uint64_t packetsParsed = 0;
+
+    bool bOK = ForEachPacket(pInput, packetSize, [&](const uint8_t *pPacket, const TSPacketHeader &header, uint64_t offset)
+    {
+        packetsParsed++;
+
+        int16_t s = m_streamOfPID[header.pid];
+
+        // Any other PID in between ends the run of packets, as in the XML
+        if(s >= 0 && !header.transportErrorIndicator && indexers[s].Packet(pPacket, packetSize, header, offset, lastPID != header.pid, m_streams[s].au))
+            AddAccessUnit(m_streams[s]);
+
+        // A corrupt packet is skipped, so it ends the run too: elements are read back as contiguous packets
+        lastPID = header.transportErrorIndicator ? -1 : header.pid;
+
+        return true;
+    });
+
+    uint64_t accessUnitsIndexed = 0;
+
+    for(size_t s = 0; s < m_streams.size(); s++)
+    {
+        if(indexers[s].Finish(m_streams[s].au))
+            AddAccessUnit(m_streams[s]);
+
+        accessUnitsIndexed += m_streams[s].pAccessUnits->size();
+    }
+
+    MetricsAdd(eMetricPacketsParsed, packetsParsed);
+    MetricsAdd(eMetricAccessUnitsIndexed, accessUnitsIndexed);
+
+    m_videoPresentationOrder.Finish();
+    BuildPresentationUnits(0);
+
+    return bOK;
+}
+
+bool MpegTS_XML::LoadAccessUnits(AccessUnitIndex &accessUnits, uint32_t index)
+{
+    size_t s = 0;
+
+    while(s < m_streams.size() && m_streams[s].pAccessUnits != &accessUnits)
+        s++;
+
+    if(s == m_streams.size())
+        return false;
+
+    const std::vector<uint64_t> &frames = m_lazyFrames[s];
+    const std::vector<uint32_t> &sizes = m_lazyFrameSizes[s];
+    const ElementaryStreamDescriptor &esd = m_streams[s].esd;
+
+    uint32_t first = index & ~(LAZY_CHUNK_FRAMES - 1);
+    uint32_t last = first + LAZY_CHUNK_FRAMES;
+
+    if(last > frames.size())
+        last = (uint32_t) frames.size();
+
+    if(first >= last)
+        return false;
+
+    // Every AU of a failed chunk would try it again otherwise, and report it again
+    std::vector<bool>::reference bFailed = m_lazyChunkFailed[s][first / LAZY_CHUNK_FRAMES];
+
+    if(bFailed)
+        return false;
+
+    uint64_t begin = frames[first];
+
+    tinyxml2::XMLDocument doc;
+
+    {
+        MemoryScope memoryScope(eMemXmlDom);
+
+        // Only the frames of this stream are read and parsed.  The frames of other streams
+        // between them are read over when that is less than LAZY_READ_GAP bytes, so a
+        // stream of an MPTS costs about what the only stream of a file does.
+        bool bRead = true;
+
+        m_lazyChunkFrames.clear();
+
+        for(uint32_t i = first; bRead && i < last; )
+        {
+            uint64_t runBegin = frames[i];
+            uint64_t runEnd = frames[i] + sizes[i];
+            uint32_t j = i + 1;
+
+            while(j < last && frames[j] - runEnd < LAZY_READ_GAP)
             {
-                if(closedGOP)
-                {
-                    if(!bRetCountSet)
-                    {
-                        retCount = addFrameCount;
-                        bRetCountSet = true;
-                    }
+                runEnd = frames[j] + sizes[j];
+                j++;
+            }
 
-                    AddPresentationUnit(m_videoAccessUnitsDecode[i], addFrameCount++);
-                }
-                else
-                {
-                    // We are skipping B frames since Open GOP.
-                    // Increment frame count
-                    // Increment endFrameNumber so we get a full GOP length of frames added
-                    addFrameCount++;
-                    endFrameNumber++;
-                }
+            bRead = runEnd > runBegin && m_lazyText.Read(runBegin, (size_t) (runEnd - runBegin), m_lazyChunkText);
+
+            for(; bRead && i < j; i++)
+            {
+                const char *pFrame = m_lazyChunkText.data() + (frames[i] - runBegin);
+                m_lazyChunkFrames.insert(m_lazyChunkFrames.end(), pFrame, pFrame + sizes[i]);
             }
         }
 
-        if(m_previousReferenceFrame)
-            AddPresentationUnit(*m_previousReferenceFrame, addFrameCount++);
+        if(!bRead || tinyxml2::XML_SUCCESS != doc.Parse(m_lazyChunkFrames.data(), m_lazyChunkFrames.size()))
+        {
+            fprintf(stderr, "Error: Could not parse the frames at offset %llu of the XML\n", (unsigned long long) begin);
+            bFailed = true;
+            m_lazyChunksFailed++;
+            return false;
+        }
+    }
+
+    AccessUnit au(esd.name, esd.streamType, esd.pid);
+    uint64_t packetsParsed = 0;
+    uint32_t i = first;
 
-        m_startFrameNumber = startFrameNumber;
+    accessUnits.SetWritePosition(first);
+
+    for(tinyxml2::XMLElement* element = doc.FirstChildElement("frame"); element && i < last; element = element->NextSiblingElement("frame"))
+    {
+        const char *pid = element->Attribute("pid");
+
+        if(!pid || strtol(pid, NULL, 16) != esd.pid)
+            continue;
+
+        packetsParsed += ParseTerseFrame(element, au);
+
+        au.frameNumber = i++;
+        accessUnits.Add(au);
+        au.accessUnitElements.clear();
     }
 
-    return retCount;
+    // The AUs found stay loaded, the rest of the chunk is not looked for again
+    if(i != last)
+    {
+        fprintf(stderr, "Error: Expected %u frames at offset %llu of the XML, found %u.  Did it change since it was opened?\n",
+                last - first, (unsigned long long) begin, i - first);
+        bFailed = true;
+        m_lazyChunksFailed++;
+    }
+
+    m_lazyChunksLoaded++;
+
+    MetricsAdd(eMetricXmlChunksLoaded);
+    MetricsAdd(eMetricPacketsParsed, packetsParsed);
+    MetricsAdd(eMetricAccessUnitsIndexed, i - first);
+
+    return i > index;
 }
 
-bool MpegTS_XML::UpdatePresentationUnits(unsigned int frameDisplaying)
+uint32_t MpegTS_XML::LazyChunks() const
 {
-    bool bRet = false;
+    if(!m_lazyText.Size())
+        return 0;
 
-    // Frame reordering: decode order to presentation order.
-    // Build a presentation order list too.
+    uint32_t chunks = 0;
 
-    unsigned int index = frameDisplaying + m_videoAccessUnitsPresentation.size()-1;
+    for(const std::vector<uint64_t> &frames : m_lazyFrames)
+        chunks += (uint32_t) ((frames.size() + LAZY_CHUNK_FRAMES - 1) / LAZY_CHUNK_FRAMES);
 
-    if(index < m_videoAccessUnitsDecode.size())
-    {
-        bRet = true;
-        int i = 0;
-        for(; i<m_videoAccessUnitsPresentation.size()-1; i++)
-            m_videoAccessUnitsPresentation[i] = m_videoAccessUnitsPresentation[i+1];
+    return chunks;
+}
+
+// Appends the AU of stream in decode order, its elements go to the paged element store
+void MpegTS_XML::AddAccessUnit(ElementaryStream &stream)
+{
+    AccessUnit &au = stream.au;
+
+    au.frameNumber = stream.pAccessUnits->size();
+    au.decodeFrameNumber = stream.pAccessUnits->Add(au);
+
+    if(stream.pAccessUnits == &m_videoAccessUnitsDecode)
+        m_videoPresentationOrder.Add(au.decodeFrameNumber, au.pts);
+
+    au.accessUnitElements.clear();
+}
+
+size_t MpegTS_XML::GetVideoAccessUnitElements(const AccessUnit &au, std::vector<AccessUnitElement> &elements) const
+{
+    return m_videoAccessUnitsDecode.GetElements(au.decodeFrameNumber, elements);
+}
 
-        m_videoAccessUnitsPresentation[i] = m_videoAccessUnitsDecode[index];
+uint64_t MpegTS_XML::VideoFirstByteLocation(const AccessUnit &au) const
+{
+    return m_videoAccessUnitsDecode.FirstByteLocation(au.decodeFrameNumber);
+}
+
+uint64_t MpegTS_XML::VideoNumPackets(const AccessUnit &au) const
+{
+    return m_videoAccessUnitsDecode.NumPackets(au.decodeFrameNumber);
+}
+
+unsigned int MpegTS_XML::VideoKeyFrameFromBytePos(uint64_t &bytePos) const
+{
+    // If searching for beginning of file, just return 0
+    if(0 == bytePos)
+        return 0;
+
+    // Look for bytePos in the list of AUs, then the next random access point from there
+    for(unsigned int i = m_videoAccessUnitsDecode.LowerBound(bytePos); i < m_videoAccessUnitsDecode.size(); i++)
+    {
+        if(m_videoAccessUnitsDecode.RandomAccess(i) && m_videoAccessUnitsDecode.FirstByteLocation(i, bytePos))
+            return m_videoAccessUnitsDecode.FrameNumber(i);
     }
-    else
+
+    // Didn't find one? Return the frame number of the last AU
+    return m_videoAccessUnitsDecode.FrameNumber(m_videoAccessUnitsDecode.size() - 1);
+}
+
+inline void MpegTS_XML::AddPresentationUnit(AccessUnit au, uint32_t frameNumber)
+{
+    au.frameNumber = frameNumber;
+    m_videoAccessUnitsPresentation.push_back(au);
+}
+
+// Call this after a seek.  The order itself was worked out while indexing.
+unsigned int MpegTS_XML::BuildPresentationUnits(unsigned int startFrameNumber)
+{
+    MemoryScope memoryScope(eMemPresentationUnits);
+
+    unsigned int retCount = startFrameNumber;
+
+    if(startFrameNumber < m_videoAccessUnitsDecode.size())
     {
-        m_videoAccessUnitsPresentation.pop_front();
+        m_videoAccessUnitsPresentation.clear();
+
+        uint32_t presentation = m_videoPresentationOrder.PresentationIndex(startFrameNumber);
+
+        // Pictures shown ahead of the one decoded first only decode in a closed GOP
+        if(m_videoAccessUnitsDecode[startFrameNumber].closed_gop)
+        {
+            while(presentation > 0 && m_videoPresentationOrder.DecodeIndex(presentation - 1) > startFrameNumber)
+                presentation--;
+        }
+
+        retCount = presentation;
+
+        for(uint32_t p = presentation; p < presentation + GOP_LENGTH && p < m_videoPresentationOrder.size(); p++)
+            AddPresentationUnit(m_videoAccessUnitsDecode[m_videoPresentationOrder.DecodeIndex(p)], p);
+
+        m_startFrameNumber = startFrameNumber;
     }
 
-    return bRet;
+    return retCount;
+}
+
+bool MpegTS_XML::UpdatePresentationUnits(unsigned int frameDisplaying)
+{
+    MemoryScope memoryScope(eMemPresentationUnits);
+
+    if(m_videoAccessUnitsPresentation.empty())
+        return false;
+
+    unsigned int index = frameDisplaying + (unsigned int) m_videoAccessUnitsPresentation.size() - 1;
+
+    m_videoAccessUnitsPresentation.pop_front();
+
+    if(index >= m_videoPresentationOrder.size())
+        return false;
+
+    AddPresentationUnit(m_videoAccessUnitsDecode[m_videoPresentationOrder.DecodeIndex(index)], index);
+
+    return true;
 }
\ No newline at end of file
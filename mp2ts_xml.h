@@ -7,7 +7,21 @@
 // Tinyxml
 #include "tinyxml2.h"
 
-struct AVFrame;
+#include "mp2ts_au_store.h"
+#include "mp2ts_xml_text.h"
+#include "mp2ts_reorder.h"
+
+class InputSource;
+struct PSIProgram;
+
+// AUs parsed at a time by a lazy load, a multiple of AccessUnitElementStore::BLOCK_SIZE
+#define LAZY_CHUNK_FRAMES 256
+
+// A lazy load reads over the text of other streams' frames when the gap is smaller than this
+#define LAZY_READ_GAP 4096
+
+// Entries of the PID dispatch table
+#define MAX_PID 8192
 
 /*
 Taken from: http://www.sno.phy.queensu.ca/~phil/exiftool/TagNames/M2TS.html
@@ -59,6 +73,7 @@ enum eStreamType
     eISO14496_1_SL_packetized                   = 0x13,
     eISO13818_6_Synchronized_Download_Protocol  = 0x14,
     eH264_Video                                 = 0x1b,
+    eHEVC_Video                                 = 0x24,
     eDigiCipher_II_Video                        = 0x80,
     eA52_AC3_Audio                              = 0x81,
     eHDMV_DTS_Audio                             = 0x82,
@@ -126,34 +141,73 @@ struct AccessUnit
 {
     ElementaryStreamDescriptor esd;
 
+    // Only filled while an AU is being built.
+    // Once added, the elements live in the AccessUnitIndex of the stream, indexed by decodeFrameNumber.
     std::vector<AccessUnitElement> accessUnitElements;
     
     AccessUnit()
         : frameNumber(0)
+        , decodeFrameNumber(0)
         , frameType("")
+        , dts(0)
+        , dts_seconds(0.f)
         , pts(0)
         , pts_seconds(0.f)
         , closed_gop(0)
+        , random_access(0)
     {
     }
 
     AccessUnit(std::string name, eStreamType type, long pid)
         : esd(name, type, pid)
         , frameNumber(0)
+        , decodeFrameNumber(0)
         , frameType("")
+        , dts(0)
+        , dts_seconds(0.f)
         , pts(0)
         , pts_seconds(0.f)
         , closed_gop(0)
+        , random_access(0)
     {
     }
 
     unsigned int frameNumber;
+    unsigned int decodeFrameNumber;
     std::string frameType;
     uint64_t dts;
     float dts_seconds;
     uint64_t pts;
     float pts_seconds;
     uint8_t closed_gop;
+    uint8_t random_access;      // Decoding can start here, every I frame of the XML
+};
+
+enum eStreamKind
+{
+    eStreamKindVideo,
+    eStreamKindAudio,
+    eStreamKindOther
+};
+
+// An elementary stream from a PMT and the AU index its frames go to
+struct ElementaryStream
+{
+    ElementaryStreamDescriptor  esd;
+    eStreamKind                 kind;
+    uint16_t                    programNumber;
+    AccessUnitIndex             *pAccessUnits;
+
+    // Only used while the packets or frames of the stream are parsed
+    AccessUnit                  au;
+};
+
+struct TransportProgram
+{
+    uint16_t            programNumber;      // 0 if the PMT came without a PAT
+    long                pmtPID;
+    long                pcrPID;
+    std::vector<size_t> streams;            // Into MpegTS_XML::Streams()
 };
 
 struct MpegTSDescriptor
@@ -171,49 +225,135 @@ struct MpegTSDescriptor
     {}
 };
 
-class MpegTS_XML
+class MpegTS_XML : public AccessUnitLoader
 {
 public:
 
     MpegTS_XML()
-    : m_bParsedMpegTSDescriptor(false)
-    , m_bParsedPMT(false)
+    : m_videoAccessUnitsDecode("video AU index", eMemDecodeUnits, "video AU element store", eMemElementStore)
+    , m_audioAccessUnits("audio AU index", eMemAudioUnits, "audio AU element store", eMemAudioUnits)
     , m_videoStreamIndex(-1)
     , m_audioStreamIndex(-1)
-    , m_previousReferenceFrame(nullptr)
-    , m_decodeFrameNumber(0)
+    , m_bParsedMpegTSDescriptor(false)
+    , m_bParsedPMT(false)
+    , m_selectedProgram(-1)
+    , m_playedProgram(-1)
+    , m_streamOfPID(MAX_PID, -1)
     , m_startFrameNumber(0)
+    , m_lazyTextEnd(0)
+    , m_lazyChunksLoaded(0)
+    , m_lazyChunksFailed(0)
     {
     }
 
+    // Program whose first video and audio stream go to m_videoAccessUnitsDecode and
+    // m_audioAccessUnits, -1 for the first in the PAT.  Set before the PMTs are parsed.
+    void SelectProgram(int programNumber) { m_selectedProgram = programNumber; }
+
+    // Every program of the PAT with the streams of its PMT, parsed until each program has
+    // its PMT.  Every stream gets an AU index and a slot in the PID dispatch table.
     bool ParsePMT(tinyxml2::XMLElement* root);
     bool ParseMpegTSDescriptor(tinyxml2::XMLElement* root);
     bool ParsePacketList(tinyxml2::XMLElement* root);
     bool ParsePacketListTerse(tinyxml2::XMLElement* root);
 
+    // Lazy alternative to the three above, for terse files.  Only the header is parsed,
+    // a raw scan finds where every <frame> starts and the AUs are parsed LAZY_CHUNK_FRAMES
+    // at a time the first time they are used.  Returns false if the file has no PMT
+    // ahead of its first frame or is not terse, parse it in full then.
+    bool OpenLazy(const char *fileName);
+
+    // Builds the same index straight from a transport stream, for when there is no XML.
+    // The PAT and PMTs are read from its start, then every PES of every stream is an AU
+    // whose type and random access point come from the video headers, see ESIndexer.
+    // Returns false if pInput, opened on fileName, is not a TS or has no PMT.
+    bool OpenTransportStream(const char *fileName, InputSource *pInput);
+
+    // AccessUnitLoader, the chunk of a lazily opened index that index is in.  A chunk that
+    // could not be read or parsed is reported once and not tried again, its AUs stay unloaded.
+    bool LoadAccessUnits(AccessUnitIndex &accessUnits, uint32_t index);
+
+    // Chunks parsed so far, that failed and in total, all 0 unless opened lazily
+    uint32_t LazyChunksLoaded() const { return m_lazyChunksLoaded; }
+    uint32_t LazyChunksFailed() const { return m_lazyChunksFailed; }
+    uint32_t LazyChunks() const;
+
+    // m_videoAccessUnitsPresentation from the AU decoding starts at, the decode order frame
+    // number startFrameNumber, after a seek.  Returns the presentation order frame number of
+    // that AU, or of the first leading picture ahead of it in a closed GOP.
     unsigned int BuildPresentationUnits(unsigned int startFrameNumber);
+
+    // Moves m_videoAccessUnitsPresentation on to the presentation order frame number frameDisplaying
     bool UpdatePresentationUnits(unsigned int frameDisplaying);
 
-    AVFrame* GetNextVideoFrameInternal(MpegTS_XML& mpts, uint64_t &bytePos, int seekFrame = -1);
+    // Elements of a video AU, looked up by its decode order frame number
+    size_t GetVideoAccessUnitElements(const AccessUnit &au, std::vector<AccessUnitElement> &elements) const;
+    uint64_t VideoFirstByteLocation(const AccessUnit &au) const;
+    uint64_t VideoNumPackets(const AccessUnit &au) const;
+
+    // Decode order frame number of the first random access point at or after bytePos, bytePos is moved to its
+    // first byte.  Both packet sources start decoding at one, an I frame of MPEG-2 or an IDR, CRA or recovery point.
+    unsigned int VideoKeyFrameFromBytePos(uint64_t &bytePos) const;
+
+    const std::vector<TransportProgram> &Programs() const { return m_programs; }
+    const std::vector<ElementaryStream> &Streams() const { return m_streams; }
+
+    // Index into Programs() of the program that is played, -1 if there is none
+    int PlayedProgram() const { return m_playedProgram; }
+
+    // PIDs of the streams of m_videoAccessUnitsDecode and m_audioAccessUnits, -1 for none
+    long VideoPID() const;
+    long AudioPID() const;
 
 public:
     MpegTSDescriptor            m_mpegTSDescriptor;
-    std::vector<AccessUnit>     m_videoAccessUnitsDecode;
+    AccessUnitIndex             m_videoAccessUnitsDecode;
     std::deque<AccessUnit>      m_videoAccessUnitsPresentation;
-    std::vector<AccessUnit>     m_audioAccessUnits;
+    AccessUnitIndex             m_audioAccessUnits;
     int                         m_videoStreamIndex;
     int                         m_audioStreamIndex;
 
 private:
     bool                        m_bParsedMpegTSDescriptor = false;
     bool                        m_bParsedPMT = false;
-    AccessUnit                  m_videoAU;
-    AccessUnit                  m_audioAU;
-    AccessUnit                  *m_previousReferenceFrame;
-    int                         m_decodeFrameNumber;
+    int                         m_selectedProgram;
+    int                         m_playedProgram;
+    std::vector<TransportProgram> m_programs;
+    std::vector<ElementaryStream> m_streams;
+    std::vector<int16_t>        m_streamOfPID;          // Index into m_streams by PID, -1 for none
+    std::deque<AccessUnitIndex> m_otherAccessUnits;     // Of the streams that are not played
+    PresentationOrder           m_videoPresentationOrder;
     uint32_t                    m_startFrameNumber;
 
-    //std::vector<ElementaryStream> gElementaryStreams;
+    // Lazy loading: the text, where each <frame> of each stream starts, its size and where the last one ends
+    XmlTextSource               m_lazyText;
+    std::vector<std::vector<uint64_t> > m_lazyFrames;   // By stream
+    std::vector<std::vector<uint32_t> > m_lazyFrameSizes;
+    uint64_t                    m_lazyTextEnd;
+    uint32_t                    m_lazyChunksLoaded;
+    uint32_t                    m_lazyChunksFailed;
+    std::vector<std::vector<bool> > m_lazyChunkFailed;  // By stream and chunk
+    std::vector<char>           m_lazyChunkText;
+    std::vector<char>           m_lazyChunkFrames;      // The frames of one stream out of m_lazyChunkText
+
+    // Fills in au from one terse <frame>, returns the number of packets its slices cover
+    static uint64_t ParseTerseFrame(tinyxml2::XMLElement* element, AccessUnit &au);
+
+    // The stream of the frames or packets of pid, NULL if no PMT lists it
+    ElementaryStream *StreamOfPID(long pid)
+    {
+        int16_t stream = pid >= 0 && pid < MAX_PID ? m_streamOfPID[pid] : -1;
+        return stream >= 0 ? &m_streams[stream] : nullptr;
+    }
+
+    // Picks the played program and gives every stream its AU index
+    void AssignStreams();
+
+    // m_programs and m_streams from the PAT and PMTs read out of a TS
+    void SetPrograms(const std::vector<PSIProgram> &programs);
 
     inline void AddPresentationUnit(AccessUnit au, uint32_t frameNumber);
+
+    // Appends the AU being built in stream in decode order and clears it
+    void AddAccessUnit(ElementaryStream &stream);
 };
@@ -0,0 +1,330 @@
+#include "mp2ts_xml_text.h"
+#include "mp2ts_gzip.h"
+#include "mp2ts_memory.h"
+#include "mp2ts_reorder.h"
+
+#include <cstring>
+
+// Text looked at per read while scanning
+#define XML_SCAN_WINDOW (4 * 1024 * 1024)
+
+// How far past its tag the <PTS> of a frame is looked for, it comes ahead of the slices
+#define XML_PTS_SEARCH_BYTES 256
+
+static const char g_frameTag[] = "<frame";
+static const size_t g_frameTagLength = sizeof(g_frameTag) - 1;
+
+static const char g_frameEndTag[] = "</frame>";
+static const size_t g_frameEndTagLength = sizeof(g_frameEndTag) - 1;
+
+static const char g_ptsTag[] = "<PTS>";
+static const size_t g_ptsTagLength = sizeof(g_ptsTag) - 1;
+
+static bool SeekFile(FILE *fp, uint64_t offset)
+{
+#ifdef _WIN32
+    return 0 == _fseeki64(fp, (int64_t) offset, SEEK_SET);
+#else
+    return 0 == fseeko(fp, (off_t) offset, SEEK_SET);
+#endif
+}
+
+static const char *FindToken(const char *p, const char *end, const char *token, size_t length)
+{
+    while(end - p >= (ptrdiff_t) length)
+    {
+        p = (const char *) memchr(p, token[0], (end - p) - length + 1);
+
+        if(!p)
+            return NULL;
+
+        if(0 == memcmp(p, token, length))
+            return p;
+
+        p++;
+    }
+
+    return NULL;
+}
+
+// First "<frame" that is the whole element name, not the start of a longer one
+static const char *FindFrameTag(const char *p, const char *end)
+{
+    while((p = FindToken(p, end, g_frameTag, g_frameTagLength)))
+    {
+        const char *pAfter = p + g_frameTagLength;
+
+        if(pAfter < end && (' ' == *pAfter || '>' == *pAfter || '\t' == *pAfter || '\r' == *pAfter || '\n' == *pAfter))
+            return p;
+
+        p = pAfter;
+    }
+
+    return NULL;
+}
+
+// Value of the pid attribute between the tag name and its '>', as strtol(pid, NULL, 16) would read it
+static long ParsePID(const char *p, const char *end)
+{
+    p = FindToken(p, end, "pid=\"", 5);
+
+    if(!p)
+        return -1;
+
+    p += 5;
+
+    if(end - p > 2 && '0' == p[0] && ('x' == p[1] || 'X' == p[1]))
+        p += 2;
+
+    long pid = 0;
+
+    for(; p < end; p++)
+    {
+        char c = *p;
+
+        if(c >= '0' && c <= '9')
+            pid = (pid << 4) | (c - '0');
+        else if(c >= 'a' && c <= 'f')
+            pid = (pid << 4) | (c - 'a' + 10);
+        else if(c >= 'A' && c <= 'F')
+            pid = (pid << 4) | (c - 'A' + 10);
+        else
+            break;
+    }
+
+    return pid;
+}
+
+XmlTextSource::XmlTextSource()
+    : m_fp(NULL)
+    , m_pText(NULL)
+    , m_size(0)
+{
+}
+
+XmlTextSource::~XmlTextSource()
+{
+    Close();
+}
+
+bool XmlTextSource::Open(const char *fileName)
+{
+    Close();
+
+    if(IsGzipFile(fileName))
+    {
+        size_t size = 0;
+        m_pText = InflateXMLFile(fileName, size);
+        m_size = size;
+
+        return NULL != m_pText;
+    }
+
+    m_fp = fopen(fileName, "rb");
+
+    if(!m_fp)
+        return false;
+
+#ifdef _WIN32
+    _fseeki64(m_fp, 0, SEEK_END);
+    m_size = (uint64_t) _ftelli64(m_fp);
+#else
+    fseeko(m_fp, 0, SEEK_END);
+    m_size = (uint64_t) ftello(m_fp);
+#endif
+
+    return true;
+}
+
+void XmlTextSource::Close()
+{
+    if(m_fp)
+        fclose(m_fp);
+
+    if(m_pText)
+        FreeXMLText(m_pText, (size_t) m_size);
+
+    m_fp = NULL;
+    m_pText = NULL;
+    m_size = 0;
+}
+
+bool XmlTextSource::Read(uint64_t offset, size_t n, std::vector<char> &text)
+{
+    if(offset > m_size || n > m_size - offset)
+        return false;
+
+    text.resize(n + 1);
+    text[n] = 0;
+
+    if(m_pText)
+    {
+        memcpy(text.data(), m_pText + offset, n);
+        return true;
+    }
+
+    return m_fp && SeekFile(m_fp, offset) && n == fread(text.data(), 1, n, m_fp);
+}
+
+uint64_t XmlTextSource::FindFirstFrame()
+{
+    std::vector<char> window;
+
+    for(uint64_t offset = 0; offset < m_size; )
+    {
+        size_t n = (size_t) (m_size - offset < XML_SCAN_WINDOW ? m_size - offset : XML_SCAN_WINDOW);
+
+        if(!Read(offset, n, window))
+            break;
+
+        const char *pTag = FindFrameTag(window.data(), window.data() + n);
+
+        if(pTag)
+            return offset + (pTag - window.data());
+
+        // Keep enough of the end that a tag split across two windows is found in the next
+        if(offset + n >= m_size || n <= g_frameTagLength)
+            break;
+
+        offset += n - g_frameTagLength;
+    }
+
+    return m_size;
+}
+
+uint64_t XmlTextSource::FindLastFrameEnd()
+{
+    std::vector<char> window;
+
+    for(uint64_t end = m_size; end > 0; )
+    {
+        size_t n = (size_t) (end < XML_SCAN_WINDOW ? end : XML_SCAN_WINDOW);
+        uint64_t offset = end - n;
+
+        if(!Read(offset, n, window))
+            break;
+
+        for(size_t i = n; i >= g_frameEndTagLength; i--)
+        {
+            if(0 == memcmp(window.data() + i - g_frameEndTagLength, g_frameEndTag, g_frameEndTagLength))
+                return offset + i;
+        }
+
+        if(0 == offset || n <= g_frameEndTagLength)
+            break;
+
+        end = offset + g_frameEndTagLength - 1;
+    }
+
+    return 0;
+}
+
+// The <PTS> of the frame whose tag ends at p, as ConvertStringToPTS reads it.  1 if found,
+// 0 if the frame has none, -1 if the text ends before that is known.
+static int ParseFramePTS(const char *p, const char *end, uint64_t &pts)
+{
+    const char *pLimit = end - p > XML_PTS_SEARCH_BYTES ? p + XML_PTS_SEARCH_BYTES : end;
+    const char *pPTS = FindToken(p, pLimit, g_ptsTag, g_ptsTagLength);
+
+    if(FindToken(p, pPTS ? pPTS : pLimit, g_frameEndTag, g_frameEndTagLength))
+        return 0;
+
+    if(!pPTS)
+        return pLimit == end ? -1 : 0;
+
+    uint64_t value = 0;
+
+    for(p = pPTS + g_ptsTagLength; p < end && *p >= '0' && *p <= '9'; p++)
+        value = value * 10 + (uint64_t) (*p - '0');
+
+    if(p == end)
+        return -1;
+
+    pts = value;
+
+    return 1;
+}
+
+bool XmlTextSource::ScanFrames(uint64_t offset, const std::vector<int16_t> &streamOfPID,
+                               std::vector<std::vector<uint64_t> > &frames, std::vector<std::vector<uint32_t> > &sizes,
+                               int16_t orderStream, PresentationOrder &order)
+{
+    MemoryScope memoryScope(eMemXmlDom);
+
+    std::vector<char> window;
+
+    // The last frame kept, its size is known once the next tag is found
+    int16_t lastStream = -1;
+    uint64_t pts = 0;
+
+    while(offset < m_size)
+    {
+        size_t n = (size_t) (m_size - offset < XML_SCAN_WINDOW ? m_size - offset : XML_SCAN_WINDOW);
+        bool bLastWindow = offset + n >= m_size;
+
+        if(!Read(offset, n, window))
+            return false;
+
+        const char *pStart = window.data();
+        const char *pEnd = pStart + n;
+        const char *p = pStart;
+
+        // Where the next window starts
+        uint64_t next = bLastWindow ? m_size : offset + n - g_frameTagLength;
+
+        while(const char *pTag = FindFrameTag(p, pEnd))
+        {
+            const char *pClose = (const char *) memchr(pTag, '>', pEnd - pTag);
+
+            if(!pClose)
+            {
+                // The tag continues in the next window, unless it is the whole window
+                if(!bLastWindow && pTag > pStart)
+                    next = offset + (pTag - pStart);
+
+                break;
+            }
+
+            // -1 without a pid attribute
+            long pid = ParsePID(pTag + g_frameTagLength, pClose);
+            int16_t stream = pid >= 0 && pid < (long) streamOfPID.size() ? streamOfPID[pid] : -1;
+
+            uint64_t tagOffset = offset + (pTag - pStart);
+
+            // Like a tag that is cut off, a frame cut off before its PTS is scanned again from the next window
+            if(stream >= 0 && stream == orderStream && ParseFramePTS(pClose + 1, pEnd, pts) < 0 && !bLastWindow)
+            {
+                if(pTag > pStart)
+                    next = tagOffset;
+
+                break;
+            }
+
+            if(lastStream >= 0)
+                sizes[lastStream].back() = (uint32_t) (tagOffset - frames[lastStream].back());
+
+            if(stream >= 0)
+            {
+                if(stream == orderStream)
+                    order.Add((uint32_t) frames[stream].size(), pts);
+
+                frames[stream].push_back(tagOffset);
+                sizes[stream].push_back(0);
+            }
+
+            lastStream = stream;
+            p = pClose + 1;
+        }
+
+        // Tags already handled are not looked at again
+        if(!bLastWindow && offset + (p - pStart) > next)
+            next = offset + (p - pStart);
+
+        offset = next;
+    }
+
+    if(lastStream >= 0)
+        sizes[lastStream].back() = (uint32_t) (m_size - frames[lastStream].back());
+
+    return true;
+}
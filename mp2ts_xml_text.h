@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+class PresentationOrder;
+
+/*
+    Random access to the raw text of an mpts_parser XML file, for lazy loading.
+
+    A plain .xml stays on disk and each range is read when it is asked for.
+    A .xml.gz cannot be read at an offset, it is inflated once and the text
+    is held in memory.
+
+    ScanFrames() is the first pass of a lazy load: it finds every <frame> element
+    without building a DOM or converting any text but the pid attribute, and the
+    PTS of the frames of the video stream for their presentation order.
+*/
+class XmlTextSource
+{
+public:
+
+    XmlTextSource();
+    ~XmlTextSource();
+
+    bool Open(const char *fileName);
+    void Close();
+
+    uint64_t Size() const { return m_size; }
+
+    // n bytes at offset into text, NUL terminated
+    bool Read(uint64_t offset, size_t n, std::vector<char> &text);
+
+    // Offset of the first <frame> element, Size() if there is none
+    uint64_t FindFirstFrame();
+
+    // Offset just past the last </frame>, 0 if there is none
+    uint64_t FindLastFrameEnd();
+
+    // Appends the offset of every <frame> from offset on to frames[streamOfPID[pid]],
+    // where pid is its pid attribute, and to sizes the bytes up to the next <frame> or
+    // the end of the text.  Frames of a PID with a negative entry are skipped.  The frames of
+    // orderStream go to order with their PTS, a frame without one gets the PTS of the one before.
+    bool ScanFrames(uint64_t offset, const std::vector<int16_t> &streamOfPID,
+                    std::vector<std::vector<uint64_t> > &frames, std::vector<std::vector<uint32_t> > &sizes,
+                    int16_t orderStream, PresentationOrder &order);
+
+private:
+
+    XmlTextSource(const XmlTextSource &);
+    XmlTextSource &operator=(const XmlTextSource &);
+
+    FILE        *m_fp;
+    char        *m_pText;       // Inflated .xml.gz, NULL for a plain file
+    uint64_t    m_size;
+};